@@ -0,0 +1,94 @@
+#include "allocator.h"
+#include <malloc.h>
+#include <string.h>
+#include <assert.h>
+
+//-----------------------------------------------------------------------//
+//                        ALLOCATOR: FUNCTIONS                           //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: allocatorInit *****
+ * Description: Initializes an allocator holding no memory.
+ *
+ * @param allocator - The allocator to initialize.
+ * @param allocate - Allocation hook. NULL for malloc.
+ * @param deallocate - Deallocation hook. NULL for free.
+ * @param context - Passed as is to the hooks.
+ */
+void allocatorInit(Allocator allocator, allocateMemory allocate,
+                   deallocateMemory deallocate, void* context){
+    assert(allocator);
+    allocator->allocate = allocate;
+    allocator->deallocate = deallocate;
+    allocator->context = context;
+    allocator->bytes = 0;
+}
+
+/**
+ ***** Function: allocatorAllocate *****
+ * Description: Allocates a block of memory.
+ *
+ * @param allocator - The allocator. If NULL malloc is used.
+ * @param size - Size of the block in bytes.
+ *
+ * @return
+ * The block in case of success.
+ * NULL in case of memory fail.
+ */
+void* allocatorAllocate(Allocator allocator, size_t size){
+    if(!allocator){
+        return malloc(size);
+    }
+    void* memory = allocator->allocate ?
+                   allocator->allocate(size, allocator->context) :
+                   malloc(size);
+    if(memory){
+        allocator->bytes += size;
+    }
+    return memory;
+}
+
+/**
+ ***** Function: allocatorAllocateZeroed *****
+ * Description: Allocates a block of memory filled with zeros.
+ *
+ * @param allocator - The allocator. If NULL malloc is used.
+ * @param size - Size of the block in bytes.
+ *
+ * @return
+ * The block in case of success.
+ * NULL in case of memory fail.
+ */
+void* allocatorAllocateZeroed(Allocator allocator, size_t size){
+    void* memory = allocatorAllocate(allocator, size);
+    if(memory){
+        memset(memory, 0, size);
+    }
+    return memory;
+}
+
+/**
+ ***** Function: allocatorFree *****
+ * Description: Frees a block given by allocatorAllocate.
+ *
+ * @param allocator - The allocator the block came from.
+ * @param memory - The block. If NULL nothing will be done.
+ * @param size - The size the block was allocated with.
+ */
+void allocatorFree(Allocator allocator, void* memory, size_t size){
+    if(!memory){
+        return;
+    }
+    if(!allocator){
+        free(memory);
+        return;
+    }
+    assert(allocator->bytes >= size);
+    allocator->bytes -= size;
+    if(allocator->deallocate){
+        allocator->deallocate(memory, size, allocator->context);
+    } else {
+        free(memory);
+    }
+}
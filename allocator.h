@@ -0,0 +1,89 @@
+
+#ifndef MTM_EX3_ALLOCATOR_H
+#define MTM_EX3_ALLOCATOR_H
+
+#include <stddef.h>
+
+/**
+* Allocator
+*
+* A pair of allocation hooks and the number of bytes currently held through
+* them. Containers take an Allocator at creation and route all of their
+* internal allocations through it, so a user can place them in an arena or
+* a per-tenant budget and can tell how much memory they hold. The
+* deallocation hook is told the size of the block, so the hooks don't need
+* to keep headers of their own.
+*
+* A NULL Allocator, or NULL hooks, stand for malloc and free.
+*/
+
+//-----------------------------------------------------------------------//
+//                         ALLOCATOR: TYPEDEFS                           //
+//-----------------------------------------------------------------------//
+
+/** Type of function allocating 'size' bytes. Returns NULL on failure */
+typedef void*(*allocateMemory)(size_t size, void* context);
+
+/** Type of function freeing a block of 'size' bytes given by the above */
+typedef void(*deallocateMemory)(void* memory, size_t size, void* context);
+
+typedef struct allocator_t{
+    allocateMemory allocate;
+    deallocateMemory deallocate;
+    void* context; // Passed as is to the hooks.
+    size_t bytes; // Bytes currently allocated through the allocator.
+} *Allocator;
+
+//-----------------------------------------------------------------------//
+//                        ALLOCATOR: FUNCTIONS                           //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: allocatorInit *****
+ * Description: Initializes an allocator holding no memory.
+ *
+ * @param allocator - The allocator to initialize.
+ * @param allocate - Allocation hook. NULL for malloc.
+ * @param deallocate - Deallocation hook. NULL for free.
+ * @param context - Passed as is to the hooks.
+ */
+void allocatorInit(Allocator allocator, allocateMemory allocate,
+                   deallocateMemory deallocate, void* context);
+
+/**
+ ***** Function: allocatorAllocate *****
+ * Description: Allocates a block of memory.
+ *
+ * @param allocator - The allocator. If NULL malloc is used.
+ * @param size - Size of the block in bytes.
+ *
+ * @return
+ * The block in case of success.
+ * NULL in case of memory fail.
+ */
+void* allocatorAllocate(Allocator allocator, size_t size);
+
+/**
+ ***** Function: allocatorAllocateZeroed *****
+ * Description: Allocates a block of memory filled with zeros.
+ *
+ * @param allocator - The allocator. If NULL malloc is used.
+ * @param size - Size of the block in bytes.
+ *
+ * @return
+ * The block in case of success.
+ * NULL in case of memory fail.
+ */
+void* allocatorAllocateZeroed(Allocator allocator, size_t size);
+
+/**
+ ***** Function: allocatorFree *****
+ * Description: Frees a block given by allocatorAllocate.
+ *
+ * @param allocator - The allocator the block came from.
+ * @param memory - The block. If NULL nothing will be done.
+ * @param size - The size the block was allocated with.
+ */
+void allocatorFree(Allocator allocator, void* memory, size_t size);
+
+#endif //MTM_EX3_ALLOCATOR_H
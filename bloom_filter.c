@@ -0,0 +1,278 @@
+#include "bloom_filter.h"
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------//
+//                        BLOOM FILTER: DEFINES                          //
+//-----------------------------------------------------------------------//
+
+#define BLOOM_BLOCK_BYTES 64
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BYTES / sizeof(uint64_t))
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_BYTES * 8)
+#define BLOOM_BITS_PER_ELEMENT 10
+#define BLOOM_PROBES 7
+#define BLOOM_PROBE_BITS 9 // log2(BLOOM_BLOCK_BITS)
+#define BLOOM_MINIMAL_CAPACITY 64
+/* Probe positions are taken from a second mix, independent of the bits
+ * which picked the block. */
+#define BLOOM_PROBES_SEED 0x9e3779b97f4a7c15ULL
+
+//-----------------------------------------------------------------------//
+//                        BLOOM FILTER: STRUCT                           //
+//-----------------------------------------------------------------------//
+
+struct bloom_filter_t{
+    uint64_t* blocks;
+    void* memory; // The allocated block, 'blocks' is aligned inside it.
+    Allocator allocator;
+    size_t blocks_number;
+    int capacity;
+};
+
+//-----------------------------------------------------------------------//
+//               BLOOM FILTER: STATIC FUNCTIONS DECLARATIONS             //
+//-----------------------------------------------------------------------//
+
+static uint64_t bloomMix(uint64_t hash);
+static uint64_t* bloomGetBlock(BloomFilter filter, uint64_t mixed);
+static int bloomPopCount(uint64_t word);
+static size_t bloomGetAllocationSize(BloomFilter filter);
+
+//-----------------------------------------------------------------------//
+//                       BLOOM FILTER: FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: bloomFilterCreate *****
+ * Description: Creates an empty filter sized for a given number of
+ * elements (about 1% false positives at that size).
+ *
+ * @param capacity - Number of elements the filter is sized for.
+ * @param allocator - Allocator for the filter. May be NULL.
+ *
+ * @return
+ * A new filter in case of success.
+ * NULL in case of memory fail.
+ */
+BloomFilter bloomFilterCreate(int capacity, Allocator allocator){
+    BloomFilter filter = allocatorAllocate(allocator, sizeof(*filter));
+    if(!filter){
+        return NULL;
+    }
+    if(capacity<BLOOM_MINIMAL_CAPACITY){
+        capacity = BLOOM_MINIMAL_CAPACITY;
+    }
+    size_t bits = (size_t)capacity * BLOOM_BITS_PER_ELEMENT;
+    filter->blocks_number = (bits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+    filter->capacity = capacity;
+    filter->allocator = allocator;
+    /* Blocks are aligned to cache lines. The allocator only promises the
+     * usual alignment, so a block's worth of slack is taken. */
+    filter->memory = allocatorAllocate(allocator, bloomGetAllocationSize(
+            filter));
+    if(!filter->memory){
+        allocatorFree(allocator, filter, sizeof(*filter));
+        return NULL;
+    }
+    uintptr_t address = (uintptr_t)filter->memory;
+    address = (address + BLOOM_BLOCK_BYTES - 1) &
+              ~(uintptr_t)(BLOOM_BLOCK_BYTES - 1);
+    filter->blocks = (uint64_t*)address;
+    bloomFilterClear(filter);
+    return filter;
+}
+
+/**
+ ***** Function: bloomFilterDestroy *****
+ * Description: Frees the filter.
+ *
+ * @param filter - The filter to destroy. If NULL nothing will be done.
+ */
+void bloomFilterDestroy(BloomFilter filter){
+    if(!filter){
+        return;
+    }
+    allocatorFree(filter->allocator, filter->memory,
+                  bloomGetAllocationSize(filter));
+    allocatorFree(filter->allocator, filter, sizeof(*filter));
+}
+
+/**
+ ***** Function: bloomFilterAdd *****
+ * Description: Adds a hash value to the filter.
+ *
+ * @param filter - The filter.
+ * @param hash - The hash value to add.
+ */
+void bloomFilterAdd(BloomFilter filter, BloomHash hash){
+    assert(filter);
+    uint64_t mixed = bloomMix(hash);
+    uint64_t* block = bloomGetBlock(filter,mixed);
+    uint64_t probes = bloomMix(mixed + BLOOM_PROBES_SEED);
+    for(int i=0;i<BLOOM_PROBES;i++){
+        unsigned bit = (unsigned)(probes >> (i*BLOOM_PROBE_BITS)) &
+                       (BLOOM_BLOCK_BITS - 1);
+        block[bit/64] |= (uint64_t)1 << (bit%64);
+    }
+}
+
+/**
+ ***** Function: bloomFilterMayContain *****
+ * Description: Checks whether a hash value may have been added.
+ *
+ * @param filter - The filter.
+ * @param hash - The hash value to look for.
+ *
+ * @return
+ * false if the hash value was definitely not added.
+ * true if it may have been added.
+ */
+bool bloomFilterMayContain(BloomFilter filter, BloomHash hash){
+    assert(filter);
+    uint64_t mixed = bloomMix(hash);
+    const uint64_t* block = bloomGetBlock(filter,mixed);
+    uint64_t probes = bloomMix(mixed + BLOOM_PROBES_SEED);
+    for(int i=0;i<BLOOM_PROBES;i++){
+        unsigned bit = (unsigned)(probes >> (i*BLOOM_PROBE_BITS)) &
+                       (BLOOM_BLOCK_BITS - 1);
+        if(!(block[bit/64] & ((uint64_t)1 << (bit%64)))){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ ***** Function: bloomFilterClear *****
+ * Description: Removes all the hash values from the filter.
+ *
+ * @param filter - The filter.
+ */
+void bloomFilterClear(BloomFilter filter){
+    assert(filter);
+    memset(filter->blocks,0,filter->blocks_number*BLOOM_BLOCK_BYTES);
+}
+
+/**
+ ***** Function: bloomFilterGetCapacity *****
+ * Description: Returns the number of elements the filter is sized for.
+ *
+ * @param filter - The filter.
+ *
+ * @return
+ * The capacity of the filter.
+ */
+int bloomFilterGetCapacity(BloomFilter filter){
+    assert(filter);
+    return filter->capacity;
+}
+
+/**
+ ***** Function: bloomFilterGetFalsePositiveRate *****
+ * Description: Estimates the probability of a false positive answer from
+ * the amount of bits set in every block.
+ *
+ * @param filter - The filter.
+ *
+ * @return
+ * The estimated false positive rate, between 0 and 1.
+ */
+double bloomFilterGetFalsePositiveRate(BloomFilter filter){
+    assert(filter);
+    double sum = 0;
+    for(size_t i=0;i<filter->blocks_number;i++){
+        int bits_set = 0;
+        for(size_t word=0;word<BLOOM_BLOCK_WORDS;word++){
+            bits_set += bloomPopCount(
+                    filter->blocks[i*BLOOM_BLOCK_WORDS+word]);
+        }
+        /* A query on this block passes if all its probes hit set bits. */
+        double fill = (double)bits_set / BLOOM_BLOCK_BITS;
+        double block_rate = 1;
+        for(int probe=0;probe<BLOOM_PROBES;probe++){
+            block_rate *= fill;
+        }
+        sum += block_rate;
+    }
+    return sum / (double)filter->blocks_number;
+}
+
+/**
+ ***** Function: bloomFilterGetMemoryUsage *****
+ * Description: Returns the number of bytes held by the filter.
+ *
+ * @param filter - The filter.
+ *
+ * @return
+ * The size of the filter in bytes.
+ */
+size_t bloomFilterGetMemoryUsage(BloomFilter filter){
+    assert(filter);
+    return sizeof(*filter) + filter->blocks_number*BLOOM_BLOCK_BYTES;
+}
+
+//-----------------------------------------------------------------------//
+//                    BLOOM FILTER: STATIC FUNCTIONS                     //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Static function: bloomMix *****
+ * Description: Spreads the bits of a user hash value, so weak hashes (such
+ * as the identity of small integers) still use the whole filter.
+ *
+ * @param hash - The user hash value.
+ *
+ * @return
+ * The mixed hash value.
+ */
+static uint64_t bloomMix(uint64_t hash){
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ ***** Static function: bloomGetBlock *****
+ * Description: Returns the block a mixed hash value belongs to, picked by
+ * its high bits.
+ *
+ * @param filter - The filter.
+ * @param mixed - The mixed hash value.
+ *
+ * @return
+ * Pointer to the first word of the block.
+ */
+static uint64_t* bloomGetBlock(BloomFilter filter, uint64_t mixed){
+    size_t block = (size_t)(((mixed >> 32) * filter->blocks_number) >> 32);
+    return filter->blocks + block*BLOOM_BLOCK_WORDS;
+}
+
+/**
+ ***** Static function: bloomPopCount *****
+ * Description: Counts the set bits of a word.
+ *
+ * @param word - The word.
+ *
+ * @return
+ * The number of set bits.
+ */
+static int bloomPopCount(uint64_t word){
+    return __builtin_popcountll(word);
+}
+
+/**
+ ***** Static function: bloomGetAllocationSize *****
+ * Description: Returns the size of the memory holding the filter's blocks,
+ * including the slack taken for aligning them.
+ *
+ * @param filter - The filter.
+ * @return
+ * The size in bytes.
+ */
+static size_t bloomGetAllocationSize(BloomFilter filter){
+    return (filter->blocks_number + 1) * BLOOM_BLOCK_BYTES;
+}
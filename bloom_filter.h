@@ -0,0 +1,120 @@
+
+#ifndef MTM_EX3_BLOOM_FILTER_H
+#define MTM_EX3_BLOOM_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "allocator.h"
+
+/**
+* Blocked Bloom Filter
+*
+* A probabilistic set of hash values. bloomFilterMayContain never answers
+* false for a hash which was added, but may answer true for a hash which
+* wasn't. All the bits tested for a single hash live in one 64 byte block,
+* so a query touches a single cache line.
+*
+* Elements can't be removed; a filter with many stale elements should be
+* cleared and refilled.
+*/
+
+//-----------------------------------------------------------------------//
+//                        BLOOM FILTER: TYPEDEFS                         //
+//-----------------------------------------------------------------------//
+
+typedef struct bloom_filter_t *BloomFilter;
+
+/** Type of hash values stored in the filter */
+typedef unsigned long BloomHash;
+
+//-----------------------------------------------------------------------//
+//                       BLOOM FILTER: FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: bloomFilterCreate *****
+ * Description: Creates an empty filter sized for a given number of
+ * elements (about 1% false positives at that size).
+ *
+ * @param capacity - Number of elements the filter is sized for.
+ * @param allocator - Allocator for the filter. May be NULL.
+ *
+ * @return
+ * A new filter in case of success.
+ * NULL in case of memory fail.
+ */
+BloomFilter bloomFilterCreate(int capacity, Allocator allocator);
+
+/**
+ ***** Function: bloomFilterDestroy *****
+ * Description: Frees the filter.
+ *
+ * @param filter - The filter to destroy. If NULL nothing will be done.
+ */
+void bloomFilterDestroy(BloomFilter filter);
+
+/**
+ ***** Function: bloomFilterAdd *****
+ * Description: Adds a hash value to the filter.
+ *
+ * @param filter - The filter.
+ * @param hash - The hash value to add.
+ */
+void bloomFilterAdd(BloomFilter filter, BloomHash hash);
+
+/**
+ ***** Function: bloomFilterMayContain *****
+ * Description: Checks whether a hash value may have been added.
+ *
+ * @param filter - The filter.
+ * @param hash - The hash value to look for.
+ *
+ * @return
+ * false if the hash value was definitely not added.
+ * true if it may have been added.
+ */
+bool bloomFilterMayContain(BloomFilter filter, BloomHash hash);
+
+/**
+ ***** Function: bloomFilterClear *****
+ * Description: Removes all the hash values from the filter.
+ *
+ * @param filter - The filter.
+ */
+void bloomFilterClear(BloomFilter filter);
+
+/**
+ ***** Function: bloomFilterGetCapacity *****
+ * Description: Returns the number of elements the filter is sized for.
+ *
+ * @param filter - The filter.
+ *
+ * @return
+ * The capacity of the filter.
+ */
+int bloomFilterGetCapacity(BloomFilter filter);
+
+/**
+ ***** Function: bloomFilterGetFalsePositiveRate *****
+ * Description: Estimates the probability of a false positive answer from
+ * the amount of bits set in every block.
+ *
+ * @param filter - The filter.
+ *
+ * @return
+ * The estimated false positive rate, between 0 and 1.
+ */
+double bloomFilterGetFalsePositiveRate(BloomFilter filter);
+
+/**
+ ***** Function: bloomFilterGetMemoryUsage *****
+ * Description: Returns the number of bytes held by the filter.
+ *
+ * @param filter - The filter.
+ *
+ * @return
+ * The size of the filter in bytes.
+ */
+size_t bloomFilterGetMemoryUsage(BloomFilter filter);
+
+#endif //MTM_EX3_BLOOM_FILTER_H
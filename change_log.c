@@ -0,0 +1,171 @@
+#include "change_log.h"
+#include <string.h>
+#include <assert.h>
+
+//-----------------------------------------------------------------------//
+//                          CHANGE LOG: DEFINES                          //
+//-----------------------------------------------------------------------//
+
+#define CHANGE_LOG_CACHE_LINE 64
+
+//-----------------------------------------------------------------------//
+//                          CHANGE LOG: STRUCTS                          //
+//-----------------------------------------------------------------------//
+
+/** The positions only grow; an event's slot is its position masked. Every
+ * side's fields sit on cache lines of their own, so the producer and the
+ * consumer don't slow each other down. */
+struct change_log_t{
+    char* events;
+    size_t event_size;
+    unsigned long mask; // Capacity minus one.
+    Allocator allocator;
+    char shared_padding[CHANGE_LOG_CACHE_LINE];
+    /* Producer side. */
+    unsigned long tail; // Next position to write. Read by the consumer.
+    unsigned long cached_head; // Last head seen by the producer.
+    char producer_padding[CHANGE_LOG_CACHE_LINE - 2*sizeof(unsigned long)];
+    /* Consumer side. */
+    unsigned long head; // Next position to read. Read by the producer.
+    unsigned long cached_tail; // Last tail seen by the consumer.
+    char consumer_padding[CHANGE_LOG_CACHE_LINE - 2*sizeof(unsigned long)];
+};
+
+//-----------------------------------------------------------------------//
+//                         CHANGE LOG: FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: changeLogCreate *****
+ * Description: Creates a new empty log.
+ *
+ * @param capacity - Minimal number of events the log can hold. Rounded up
+ * to a power of two.
+ * @param event_size - Size of an event in bytes.
+ * @param allocator - Allocator for the log. May be NULL.
+ *
+ * @return
+ * A new log in case of success.
+ * NULL if capacity or event_size isn't positive or in case of memory fail.
+ */
+ChangeLog changeLogCreate(int capacity, size_t event_size,
+                          Allocator allocator){
+    if(capacity <= 0 || event_size == 0){
+        return NULL;
+    }
+    unsigned long slots = 1;
+    while(slots < (unsigned long)capacity){
+        slots <<= 1;
+    }
+    ChangeLog log = allocatorAllocate(allocator, sizeof(*log));
+    if(!log){
+        return NULL;
+    }
+    log->events = allocatorAllocate(allocator, slots*event_size);
+    if(!log->events){
+        allocatorFree(allocator, log, sizeof(*log));
+        return NULL;
+    }
+    log->event_size = event_size;
+    log->mask = slots-1;
+    log->allocator = allocator;
+    log->tail = 0;
+    log->cached_head = 0;
+    log->head = 0;
+    log->cached_tail = 0;
+    return log;
+}
+
+/**
+ ***** Function: changeLogDestroy *****
+ * Description: Frees the log. Events still in it are dropped as is.
+ * Neither side may use the log anymore.
+ *
+ * @param log - The log to destroy. If NULL nothing will be done.
+ */
+void changeLogDestroy(ChangeLog log){
+    if(!log){
+        return;
+    }
+    allocatorFree(log->allocator, log->events,
+                  (log->mask+1)*log->event_size);
+    allocatorFree(log->allocator, log, sizeof(*log));
+}
+
+/**
+ ***** Function: changeLogPush *****
+ * Description: Appends a copy of an event to the log. Producer side only.
+ *
+ * @param log - The log.
+ * @param event - The event, event_size bytes long.
+ *
+ * @return
+ * true if the event was appended, false if the log is full.
+ */
+bool changeLogPush(ChangeLog log, const void* event){
+    assert(log && event);
+    unsigned long tail = log->tail;
+    if(tail - log->cached_head > log->mask){
+        /* Looks full: checking how far the consumer got. */
+        log->cached_head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+        if(tail - log->cached_head > log->mask){
+            return false;
+        }
+    }
+    memcpy(log->events + (tail & log->mask)*log->event_size, event,
+           log->event_size);
+    /* Publishes the event's bytes along with the position. */
+    __atomic_store_n(&log->tail, tail+1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ ***** Function: changeLogDrain *****
+ * Description: Moves the oldest events of the log into an array, in the
+ * order they were pushed. Consumer side only.
+ *
+ * @param log - The log.
+ * @param events - Array of at least 'max' events.
+ * @param max - Maximal number of events to take.
+ *
+ * @return
+ * The number of events taken.
+ */
+int changeLogDrain(ChangeLog log, void* events, int max){
+    assert(log && (events || max <= 0));
+    unsigned long head = log->head;
+    if(log->cached_tail - head < (unsigned long)(max > 0 ? max : 0)){
+        /* Not enough known events: checking how far the producer got. */
+        log->cached_tail = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+    }
+    unsigned long available = log->cached_tail - head;
+    int taken = max <= 0 ? 0 :
+                available < (unsigned long)max ? (int)available : max;
+    for(int i=0; i<taken; i++){
+        memcpy((char*)events + i*log->event_size,
+               log->events + ((head+i) & log->mask)*log->event_size,
+               log->event_size);
+    }
+    if(taken > 0){
+        /* The slots may be reused only once they were copied out. */
+        __atomic_store_n(&log->head, head+taken, __ATOMIC_RELEASE);
+    }
+    return taken;
+}
+
+/**
+ ***** Function: changeLogGetSize *****
+ * Description: Returns the number of events in the log. The result may be
+ * outdated by the time it's used if the other side is running.
+ *
+ * @param log - The log.
+ *
+ * @return
+ * The number of events in the log.
+ */
+int changeLogGetSize(ChangeLog log){
+    assert(log);
+    unsigned long head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+    unsigned long tail = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+    return (int)(tail - head);
+}
@@ -0,0 +1,93 @@
+
+#ifndef MTM_EX3_CHANGE_LOG_H
+#define MTM_EX3_CHANGE_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "allocator.h"
+
+/**
+* Change Log
+*
+* A bounded ring buffer of fixed size events passed from a single producer
+* thread to a single consumer thread without locks. The producer never
+* waits: pushing into a full log fails instead. The consumer takes events
+* out in batches, and both sides keep a private copy of the other side's
+* position, so the shared positions are only touched once per batch when
+* the log is neither full nor empty.
+*/
+
+//-----------------------------------------------------------------------//
+//                         CHANGE LOG: TYPEDEFS                          //
+//-----------------------------------------------------------------------//
+
+typedef struct change_log_t *ChangeLog;
+
+//-----------------------------------------------------------------------//
+//                        CHANGE LOG: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: changeLogCreate *****
+ * Description: Creates a new empty log.
+ *
+ * @param capacity - Minimal number of events the log can hold. Rounded up
+ * to a power of two.
+ * @param event_size - Size of an event in bytes.
+ * @param allocator - Allocator for the log. May be NULL.
+ *
+ * @return
+ * A new log in case of success.
+ * NULL if capacity or event_size isn't positive or in case of memory fail.
+ */
+ChangeLog changeLogCreate(int capacity, size_t event_size,
+                          Allocator allocator);
+
+/**
+ ***** Function: changeLogDestroy *****
+ * Description: Frees the log. Events still in it are dropped as is.
+ * Neither side may use the log anymore.
+ *
+ * @param log - The log to destroy. If NULL nothing will be done.
+ */
+void changeLogDestroy(ChangeLog log);
+
+/**
+ ***** Function: changeLogPush *****
+ * Description: Appends a copy of an event to the log. Producer side only.
+ *
+ * @param log - The log.
+ * @param event - The event, event_size bytes long.
+ *
+ * @return
+ * true if the event was appended, false if the log is full.
+ */
+bool changeLogPush(ChangeLog log, const void* event);
+
+/**
+ ***** Function: changeLogDrain *****
+ * Description: Moves the oldest events of the log into an array, in the
+ * order they were pushed. Consumer side only.
+ *
+ * @param log - The log.
+ * @param events - Array of at least 'max' events.
+ * @param max - Maximal number of events to take.
+ *
+ * @return
+ * The number of events taken.
+ */
+int changeLogDrain(ChangeLog log, void* events, int max);
+
+/**
+ ***** Function: changeLogGetSize *****
+ * Description: Returns the number of events in the log. The result may be
+ * outdated by the time it's used if the other side is running.
+ *
+ * @param log - The log.
+ *
+ * @return
+ * The number of events in the log.
+ */
+int changeLogGetSize(ChangeLog log);
+
+#endif //MTM_EX3_CHANGE_LOG_H
@@ -0,0 +1,1046 @@
+#define _POSIX_C_SOURCE 200112L
+#include "disk_tier.h"
+#include "bloom_filter.h"
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+
+//-----------------------------------------------------------------------//
+//                          DISK TIER: DEFINES                           //
+//-----------------------------------------------------------------------//
+
+#define DISK_TIER_MAGIC "MAPRUN01"
+#define DISK_TIER_MAGIC_LENGTH 8
+/* The magic is followed by the number of entries, in 8 bytes. */
+#define DISK_TIER_COUNT_BYTES 8
+#define DISK_TIER_HEADER_SIZE (DISK_TIER_MAGIC_LENGTH + DISK_TIER_COUNT_BYTES)
+/* Room for the file name of a run, after the directory. */
+#define DISK_TIER_NAME_LENGTH 80
+
+/* Every entry starts with one of these bytes; the file ends with the last
+ * one. */
+#define DISK_TIER_TOMBSTONE 0
+#define DISK_TIER_PUT 1
+#define DISK_TIER_END 2
+
+//-----------------------------------------------------------------------//
+//                          DISK TIER: STRUCTS                           //
+//-----------------------------------------------------------------------//
+
+typedef struct disk_run_t{
+    char* path;
+    FILE* file; // Used by lookups.
+    long count; // Number of entries.
+    BloomFilter bloom;
+    /* Key and offset of every DISK_TIER_INDEX_INTERVAL-th entry. */
+    void** index_keys;
+    long* index_offsets;
+    long index_size;
+} *DiskRun;
+
+/** A position in a single run, with its entry read. */
+typedef struct run_reader_t{
+    FILE* file;
+    void* key; // NULL past the last entry.
+    void* data; // NULL for a tombstone.
+} RunReader;
+
+struct tier_cursor_t{
+    DiskTier tier;
+    RunReader* readers; // One per run, oldest first.
+    int readers_capacity; // Number of runs when the cursor was created.
+    int readers_number; // Readers which were initialized.
+    int current; // Reader holding the current entry, -1 past the end.
+};
+
+/** Entries handed to a compaction's run: those of a cursor, but the
+ * tombstones. */
+typedef struct tier_merge_t{
+    TierCursor cursor;
+    bool started;
+    bool failed;
+} TierMerge;
+
+struct disk_tier_t{
+    char* directory;
+    TierFormat format;
+    Allocator allocator;
+    DiskRun* runs; // Oldest first.
+    int runs_number;
+    int runs_capacity;
+    unsigned long next_run; // Number in the name of the next run file.
+    /* The background compaction, merging the oldest compaction_runs
+     * runs. Only compaction_done is written by the compaction thread
+     * after it started, once it wrote compaction_failed. */
+    bool compacting;
+    pthread_t compactor;
+    TierCursor compaction_cursor;
+    char* compaction_path;
+    int compaction_runs;
+    bool compaction_failed;
+    int compaction_done;
+};
+
+//-----------------------------------------------------------------------//
+//              DISK TIER: STATIC FUNCTIONS DECLARATIONS                 //
+//-----------------------------------------------------------------------//
+
+static char* diskTierNewPath(DiskTier tier);
+
+static void diskTierFreePath(DiskTier tier, char* path);
+
+static bool diskTierWriteCount(FILE* file, long count);
+
+static bool diskTierReadCount(FILE* file, long* count);
+
+static bool diskTierWriteRun(DiskTier tier, const char* path,
+                             nextTierEntry next, void* context,
+                             long* count);
+
+static int diskTierReadEntry(DiskTier tier, FILE* file, void** key,
+                             void** data);
+
+static void diskTierFreeEntry(DiskTier tier, void* key, void* data);
+
+static DiskRun diskTierOpenRun(DiskTier tier, char* path);
+
+static void diskTierDestroyRun(DiskTier tier, DiskRun run);
+
+static DiskTierLookup diskTierFindInRun(DiskTier tier, DiskRun run,
+                                        void* key, void** data);
+
+static bool diskTierAddRun(DiskTier tier, DiskRun run);
+
+static void diskTierStartCompaction(DiskTier tier);
+
+static void* diskTierCompact(void* tier);
+
+static bool diskTierNextMerged(void* merge, void** key, void** data);
+
+static bool diskTierFinishCompaction(DiskTier tier, bool wait);
+
+static bool diskTierReaderNext(DiskTier tier, RunReader* reader);
+
+static void tierCursorSelect(TierCursor cursor);
+
+//-----------------------------------------------------------------------//
+//                         DISK TIER: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: diskTierCreate *****
+ * Description: Creates a new tier without runs.
+ *
+ * @param directory - Existing directory the run files are created in.
+ * @param format - Functions of the elements (copied).
+ * @param allocator - Allocator for the tier. May be NULL.
+ *
+ * @return
+ * A new tier in case of success.
+ * NULL if an argument is NULL or in case of memory fail.
+ */
+DiskTier diskTierCreate(const char* directory, const TierFormat* format,
+                        Allocator allocator){
+    if(!directory || !format || !format->writeKey || !format->readKey ||
+       !format->freeKey || !format->writeData || !format->readData ||
+       !format->freeData || !format->compareKeys || !format->hashKey){
+        return NULL;
+    }
+    DiskTier tier = allocatorAllocate(allocator, sizeof(*tier));
+    if(!tier){
+        return NULL;
+    }
+    tier->directory = allocatorAllocate(allocator, strlen(directory)+1);
+    if(!tier->directory){
+        allocatorFree(allocator, tier, sizeof(*tier));
+        return NULL;
+    }
+    strcpy(tier->directory, directory);
+    tier->format = *format;
+    tier->allocator = allocator;
+    tier->runs = NULL;
+    tier->runs_number = 0;
+    tier->runs_capacity = 0;
+    tier->next_run = 0;
+    tier->compacting = false;
+    tier->compaction_cursor = NULL;
+    tier->compaction_path = NULL;
+    tier->compaction_runs = 0;
+    tier->compaction_failed = false;
+    tier->compaction_done = 0;
+    return tier;
+}
+
+/**
+ ***** Function: diskTierCreateLike *****
+ * Description: Creates a new tier without runs, in the directory and with
+ * the format of another tier. Its run files don't collide with those of the
+ * other tier.
+ *
+ * @param tier - The tier to take the directory and the format of.
+ * @param allocator - Allocator for the new tier. May be NULL.
+ *
+ * @return
+ * A new tier in case of success.
+ * NULL if a NULL tier was sent or in case of memory fail.
+ */
+DiskTier diskTierCreateLike(DiskTier tier, Allocator allocator){
+    if(!tier){
+        return NULL;
+    }
+    return diskTierCreate(tier->directory, &tier->format, allocator);
+}
+
+/**
+ ***** Function: diskTierDestroy *****
+ * Description: Waits for a running compaction, then deletes all the run
+ * files and frees the tier.
+ *
+ * @param tier - The tier. If NULL nothing will be done.
+ */
+void diskTierDestroy(DiskTier tier){
+    if(!tier){
+        return;
+    }
+    diskTierClear(tier);
+    allocatorFree(tier->allocator, tier->runs,
+                  sizeof(*tier->runs)*tier->runs_capacity);
+    allocatorFree(tier->allocator, tier->directory,
+                  strlen(tier->directory)+1);
+    allocatorFree(tier->allocator, tier, sizeof(*tier));
+}
+
+/**
+ ***** Function: diskTierClear *****
+ * Description: Waits for a running compaction, then deletes all the runs.
+ *
+ * @param tier - The tier.
+ */
+void diskTierClear(DiskTier tier){
+    assert(tier);
+    diskTierFinishCompaction(tier, true);
+    for(int i=0; i<tier->runs_number; i++){
+        remove(tier->runs[i]->path);
+        diskTierDestroyRun(tier, tier->runs[i]);
+    }
+    tier->runs_number = 0;
+}
+
+/**
+ ***** Function: diskTierFlush *****
+ * Description: Writes a stream of sorted entries as the newest run, and
+ * starts a background compaction if there are enough runs.
+ *
+ * @param tier - The tier.
+ * @param next - Hands out the entries.
+ * @param context - Passed as is to next.
+ *
+ * @return
+ * true in case of success (also if there were no entries).
+ * false if writing or reading back the run failed. The tier is unchanged.
+ */
+bool diskTierFlush(DiskTier tier, nextTierEntry next, void* context){
+    assert(tier && next);
+    diskTierFinishCompaction(tier, false);
+    char* path = diskTierNewPath(tier);
+    if(!path){
+        return false;
+    }
+    long count = 0;
+    if(!diskTierWriteRun(tier, path, next, context, &count)){
+        diskTierFreePath(tier, path);
+        return false;
+    }
+    if(count == 0){
+        remove(path);
+        diskTierFreePath(tier, path);
+        return true;
+    }
+    DiskRun run = diskTierOpenRun(tier, path);
+    if(!run){
+        remove(path);
+        diskTierFreePath(tier, path);
+        return false;
+    }
+    if(!diskTierAddRun(tier, run)){
+        remove(run->path);
+        diskTierDestroyRun(tier, run);
+        return false;
+    }
+    diskTierStartCompaction(tier);
+    return true;
+}
+
+/**
+ ***** Function: diskTierFind *****
+ * Description: Looks a key up in the runs, newest first.
+ *
+ * @param tier - The tier.
+ * @param key - The key.
+ * @param data - Will hold the key's data if found, which belongs to the
+ * caller. May be NULL if the data isn't needed.
+ *
+ * @return
+ * DISK_TIER_FOUND - The key's newest entry has data.
+ * DISK_TIER_REMOVED - The key's newest entry is a tombstone.
+ * DISK_TIER_MISSING - No run holds the key.
+ * DISK_TIER_IO_ERROR - Reading a run failed.
+ */
+DiskTierLookup diskTierFind(DiskTier tier, void* key, void** data){
+    assert(tier && key);
+    for(int i=tier->runs_number-1; i>=0; i--){
+        DiskTierLookup result = diskTierFindInRun(tier, tier->runs[i], key,
+                                                  data);
+        if(result != DISK_TIER_MISSING){
+            return result;
+        }
+    }
+    return DISK_TIER_MISSING;
+}
+
+/**
+ ***** Function: diskTierWait *****
+ * Description: Waits for a running compaction and puts its result in
+ * place of the runs it merged, then compacts the runs flushed meanwhile
+ * if there are enough of them. Unless a compaction can't be started, there
+ * are fewer than DISK_TIER_COMPACT_RUNS runs afterwards.
+ *
+ * @param tier - The tier.
+ *
+ * @return
+ * false if a compaction failed (the runs are kept as they were).
+ * true otherwise.
+ */
+bool diskTierWait(DiskTier tier){
+    assert(tier);
+    bool merged = diskTierFinishCompaction(tier, true);
+    while(merged && tier->runs_number >= DISK_TIER_COMPACT_RUNS){
+        diskTierStartCompaction(tier);
+        if(!tier->compacting){
+            break;
+        }
+        merged = diskTierFinishCompaction(tier, true);
+    }
+    return merged;
+}
+
+/**
+ ***** Function: diskTierGetRunsNumber *****
+ * Description: Returns the number of runs of the tier. A finished
+ * compaction is put in place first.
+ *
+ * @param tier - The tier.
+ *
+ * @return
+ * The number of runs.
+ */
+int diskTierGetRunsNumber(DiskTier tier){
+    assert(tier);
+    diskTierFinishCompaction(tier, false);
+    return tier->runs_number;
+}
+
+/**
+ ***** Function: tierCursorCreate *****
+ * Description: Creates a cursor on the first entry of the merged runs: the
+ * entries of all the runs in key order, a single one per key (the newest),
+ * tombstones included. The cursor is invalidated by every other function
+ * of the tier but diskTierFind.
+ *
+ * @param tier - The tier.
+ *
+ * @return
+ * A new cursor in case of success.
+ * NULL in case of memory or read fail.
+ */
+TierCursor tierCursorCreate(DiskTier tier){
+    assert(tier);
+    TierCursor cursor = allocatorAllocate(tier->allocator, sizeof(*cursor));
+    if(!cursor){
+        return NULL;
+    }
+    cursor->tier = tier;
+    cursor->readers_capacity = tier->runs_number;
+    cursor->readers_number = 0;
+    cursor->current = -1;
+    cursor->readers = tier->runs_number ?
+                      allocatorAllocate(tier->allocator,
+                              sizeof(RunReader)*tier->runs_number) : NULL;
+    if(tier->runs_number && !cursor->readers){
+        tierCursorDestroy(cursor);
+        return NULL;
+    }
+    for(int i=0; i<tier->runs_number; i++){
+        /* A file of its own, so the cursor may move on another thread. */
+        RunReader* reader = &cursor->readers[i];
+        reader->key = NULL;
+        reader->data = NULL;
+        reader->file = fopen(tier->runs[i]->path, "rb");
+        cursor->readers_number++;
+        if(!reader->file ||
+           fseek(reader->file, DISK_TIER_HEADER_SIZE, SEEK_SET) != 0 ||
+           !diskTierReaderNext(tier, reader)){
+            tierCursorDestroy(cursor);
+            return NULL;
+        }
+    }
+    tierCursorSelect(cursor);
+    return cursor;
+}
+
+/**
+ ***** Function: tierCursorGetKey *****
+ * Description: Returns the key of the cursor's entry. It belongs to the
+ * cursor and is valid until the cursor moves.
+ *
+ * @param cursor - The cursor.
+ *
+ * @return
+ * The key, NULL if the cursor is past the last entry.
+ */
+void* tierCursorGetKey(TierCursor cursor){
+    assert(cursor);
+    return cursor->current < 0 ? NULL :
+           cursor->readers[cursor->current].key;
+}
+
+/**
+ ***** Function: tierCursorGetData *****
+ * Description: Returns the data of the cursor's entry. It belongs to the
+ * cursor and is valid until the cursor moves.
+ *
+ * @param cursor - The cursor.
+ *
+ * @return
+ * The data, NULL for a tombstone or if the cursor is past the last entry.
+ */
+void* tierCursorGetData(TierCursor cursor){
+    assert(cursor);
+    return cursor->current < 0 ? NULL :
+           cursor->readers[cursor->current].data;
+}
+
+/**
+ ***** Function: tierCursorNext *****
+ * Description: Moves the cursor to the next entry.
+ *
+ * @param cursor - The cursor.
+ *
+ * @return
+ * false if reading a run failed; the cursor is then past the last entry.
+ * true otherwise.
+ */
+bool tierCursorNext(TierCursor cursor){
+    assert(cursor);
+    if(cursor->current < 0){
+        return true;
+    }
+    DiskTier tier = cursor->tier;
+    RunReader* current = &cursor->readers[cursor->current];
+    bool succeeded = true;
+    /* Older entries of the same key are hidden: they're skipped too. The
+     * current reader moves last, since its key is the one compared. */
+    for(int i=0; i<cursor->readers_number; i++){
+        RunReader* reader = &cursor->readers[i];
+        if(reader != current && reader->key &&
+           tier->format.compareKeys(reader->key, current->key) == 0){
+            succeeded = diskTierReaderNext(tier, reader) && succeeded;
+        }
+    }
+    succeeded = diskTierReaderNext(tier, current) && succeeded;
+    if(!succeeded){
+        cursor->current = -1;
+        return false;
+    }
+    tierCursorSelect(cursor);
+    return true;
+}
+
+/**
+ ***** Function: tierCursorDestroy *****
+ * Description: Frees a cursor.
+ *
+ * @param cursor - The cursor. If NULL nothing will be done.
+ */
+void tierCursorDestroy(TierCursor cursor){
+    if(!cursor){
+        return;
+    }
+    DiskTier tier = cursor->tier;
+    for(int i=0; i<cursor->readers_number; i++){
+        diskTierFreeEntry(tier, cursor->readers[i].key,
+                          cursor->readers[i].data);
+        if(cursor->readers[i].file){
+            fclose(cursor->readers[i].file);
+        }
+    }
+    if(cursor->readers){
+        allocatorFree(tier->allocator, cursor->readers,
+                      sizeof(RunReader)*cursor->readers_capacity);
+    }
+    allocatorFree(tier->allocator, cursor, sizeof(*cursor));
+}
+
+//-----------------------------------------------------------------------//
+//                     DISK TIER: STATIC FUNCTIONS                       //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: diskTierNewPath *****
+ * Description: Makes up the path of a new run file, unique among the runs
+ * of all the tiers of all the processes sharing the directory.
+ *
+ * @param tier - The tier.
+ *
+ * @return
+ * The path, NULL in case of memory fail.
+ */
+static char* diskTierNewPath(DiskTier tier){
+    size_t size = strlen(tier->directory)+DISK_TIER_NAME_LENGTH;
+    char* path = allocatorAllocate(tier->allocator, size);
+    if(!path){
+        return NULL;
+    }
+    snprintf(path, size, "%s/map-%ld-%lx-%lu.run", tier->directory,
+             (long)getpid(), (unsigned long)(uintptr_t)tier,
+             tier->next_run++);
+    /* Freed by the length of its string. */
+    char* exact = allocatorAllocate(tier->allocator, strlen(path)+1);
+    if(exact){
+        strcpy(exact, path);
+    }
+    allocatorFree(tier->allocator, path, size);
+    return exact;
+}
+
+/**
+ ***** Function: diskTierFreePath *****
+ * Description: Frees a path made by diskTierNewPath.
+ *
+ * @param tier - The tier.
+ * @param path - The path.
+ */
+static void diskTierFreePath(DiskTier tier, char* path){
+    allocatorFree(tier->allocator, path, strlen(path)+1);
+}
+
+/**
+ ***** Function: diskTierWriteCount *****
+ * Description: Writes the number of entries of a run, least significant
+ * byte first.
+ *
+ * @param file - The file, at the position of the count.
+ * @param count - The count.
+ *
+ * @return
+ * true in case of success, false otherwise.
+ */
+static bool diskTierWriteCount(FILE* file, long count){
+    unsigned long long value = (unsigned long long)count;
+    for(int i=0; i<DISK_TIER_COUNT_BYTES; i++){
+        if(fputc((int)(value & 0xFF), file) == EOF){
+            return false;
+        }
+        value >>= 8;
+    }
+    return true;
+}
+
+/**
+ ***** Function: diskTierReadCount *****
+ * Description: Reads a count written by diskTierWriteCount.
+ *
+ * @param file - The file, at the position of the count.
+ * @param count - Will hold the count.
+ *
+ * @return
+ * true in case of success, false otherwise.
+ */
+static bool diskTierReadCount(FILE* file, long* count){
+    unsigned long long value = 0;
+    for(int i=0; i<DISK_TIER_COUNT_BYTES; i++){
+        int byte = fgetc(file);
+        if(byte == EOF){
+            return false;
+        }
+        value |= (unsigned long long)byte << (8*i);
+    }
+    *count = (long)value;
+    return *count >= 0;
+}
+
+/**
+ ***** Function: diskTierWriteRun *****
+ * Description: Writes a run file from a stream of sorted entries. Only
+ * touches the file, so it may run on another thread.
+ *
+ * @param tier - The tier.
+ * @param path - Path of the file, which is replaced if it exists.
+ * @param next - Hands out the entries.
+ * @param context - Passed as is to next.
+ * @param count - Will hold the number of entries written.
+ *
+ * @return
+ * true in case of success.
+ * false if writing failed. The file is removed.
+ */
+static bool diskTierWriteRun(DiskTier tier, const char* path,
+                             nextTierEntry next, void* context,
+                             long* count){
+    FILE* file = fopen(path, "wb");
+    if(!file){
+        return false;
+    }
+    bool written = fwrite(DISK_TIER_MAGIC, 1, DISK_TIER_MAGIC_LENGTH, file) ==
+                   DISK_TIER_MAGIC_LENGTH && diskTierWriteCount(file, 0);
+    *count = 0;
+    void* key = NULL;
+    void* data = NULL;
+    while(written && next(context, &key, &data)){
+        written = fputc(data ? DISK_TIER_PUT : DISK_TIER_TOMBSTONE,
+                        file) != EOF &&
+                  tier->format.writeKey(key, file) &&
+                  (!data || tier->format.writeData(data, file));
+        (*count)++;
+    }
+    /* The count is only known now. */
+    written = written && fputc(DISK_TIER_END, file) != EOF &&
+              fseek(file, DISK_TIER_MAGIC_LENGTH, SEEK_SET) == 0 &&
+              diskTierWriteCount(file, *count);
+    written = fclose(file) == 0 && written;
+    if(!written){
+        remove(path);
+    }
+    return written;
+}
+
+/**
+ ***** Function: diskTierReadEntry *****
+ * Description: Reads the entry at the position of a run file.
+ *
+ * @param tier - The tier.
+ * @param file - The file.
+ * @param key - Will hold the entry's key, which belongs to the caller.
+ * @param data - Will hold the entry's data (NULL for a tombstone), which
+ * belongs to the caller.
+ *
+ * @return
+ * DISK_TIER_PUT or DISK_TIER_TOMBSTONE - An entry was read.
+ * DISK_TIER_END - The file ended; nothing was read.
+ * -1 - Reading failed.
+ */
+static int diskTierReadEntry(DiskTier tier, FILE* file, void** key,
+                             void** data){
+    *key = NULL;
+    *data = NULL;
+    int kind = fgetc(file);
+    if(kind == DISK_TIER_END){
+        return DISK_TIER_END;
+    }
+    if(kind != DISK_TIER_PUT && kind != DISK_TIER_TOMBSTONE){
+        return -1;
+    }
+    *key = tier->format.readKey(file);
+    if(!*key){
+        return -1;
+    }
+    if(kind == DISK_TIER_PUT){
+        *data = tier->format.readData(file);
+        if(!*data){
+            tier->format.freeKey(*key);
+            *key = NULL;
+            return -1;
+        }
+    }
+    return kind;
+}
+
+/**
+ ***** Function: diskTierFreeEntry *****
+ * Description: Frees the elements of an entry read from a run.
+ *
+ * @param tier - The tier.
+ * @param key - The key. May be NULL.
+ * @param data - The data. May be NULL.
+ */
+static void diskTierFreeEntry(DiskTier tier, void* key, void* data){
+    if(key){
+        tier->format.freeKey(key);
+    }
+    if(data){
+        tier->format.freeData(data);
+    }
+}
+
+/**
+ ***** Function: diskTierOpenRun *****
+ * Description: Opens a run file written by diskTierWriteRun, and builds
+ * its Bloom filter and sparse index in a single pass over it.
+ *
+ * @param tier - The tier.
+ * @param path - Path of the file, owned by the run on success.
+ *
+ * @return
+ * The run in case of success.
+ * NULL in case of memory or read fail.
+ */
+static DiskRun diskTierOpenRun(DiskTier tier, char* path){
+    DiskRun run = allocatorAllocate(tier->allocator, sizeof(*run));
+    if(!run){
+        return NULL;
+    }
+    run->path = path;
+    run->bloom = NULL;
+    run->index_keys = NULL;
+    run->index_offsets = NULL;
+    run->index_size = 0;
+    run->count = 0;
+    run->file = fopen(path, "rb");
+    char magic[DISK_TIER_MAGIC_LENGTH];
+    if(!run->file ||
+       fread(magic, 1, DISK_TIER_MAGIC_LENGTH, run->file) !=
+       DISK_TIER_MAGIC_LENGTH ||
+       memcmp(magic, DISK_TIER_MAGIC, DISK_TIER_MAGIC_LENGTH) != 0 ||
+       !diskTierReadCount(run->file, &run->count)){
+        run->path = NULL;
+        diskTierDestroyRun(tier, run);
+        return NULL;
+    }
+    long index_size = (run->count + DISK_TIER_INDEX_INTERVAL - 1) /
+                      DISK_TIER_INDEX_INTERVAL;
+    run->bloom = bloomFilterCreate(run->count > 0 ? (int)run->count : 1,
+                                   tier->allocator);
+    run->index_keys = allocatorAllocate(tier->allocator,
+            sizeof(*run->index_keys)*(index_size ? index_size : 1));
+    run->index_offsets = allocatorAllocate(tier->allocator,
+            sizeof(*run->index_offsets)*(index_size ? index_size : 1));
+    bool succeeded = run->bloom && run->index_keys && run->index_offsets;
+    for(long i=0; succeeded && i<run->count; i++){
+        long offset = ftell(run->file);
+        void* key = NULL;
+        void* data = NULL;
+        int kind = diskTierReadEntry(tier, run->file, &key, &data);
+        if(kind != DISK_TIER_PUT && kind != DISK_TIER_TOMBSTONE){
+            succeeded = false;
+            break;
+        }
+        bloomFilterAdd(run->bloom, tier->format.hashKey(key));
+        if(i % DISK_TIER_INDEX_INTERVAL == 0){
+            run->index_keys[run->index_size] = key;
+            run->index_offsets[run->index_size++] = offset;
+            key = NULL;
+        }
+        diskTierFreeEntry(tier, key, data);
+    }
+    if(!succeeded || fgetc(run->file) != DISK_TIER_END){
+        run->path = NULL;
+        diskTierDestroyRun(tier, run);
+        return NULL;
+    }
+    return run;
+}
+
+/**
+ ***** Function: diskTierDestroyRun *****
+ * Description: Frees a run. Its file is left alone.
+ *
+ * @param tier - The tier.
+ * @param run - The run.
+ */
+static void diskTierDestroyRun(DiskTier tier, DiskRun run){
+    if(run->file){
+        fclose(run->file);
+    }
+    for(long i=0; i<run->index_size; i++){
+        tier->format.freeKey(run->index_keys[i]);
+    }
+    long index_size = (run->count + DISK_TIER_INDEX_INTERVAL - 1) /
+                      DISK_TIER_INDEX_INTERVAL;
+    if(run->index_keys){
+        allocatorFree(tier->allocator, run->index_keys,
+                sizeof(*run->index_keys)*(index_size ? index_size : 1));
+    }
+    if(run->index_offsets){
+        allocatorFree(tier->allocator, run->index_offsets,
+                sizeof(*run->index_offsets)*(index_size ? index_size : 1));
+    }
+    bloomFilterDestroy(run->bloom);
+    if(run->path){
+        diskTierFreePath(tier, run->path);
+    }
+    allocatorFree(tier->allocator, run, sizeof(*run));
+}
+
+/**
+ ***** Function: diskTierFindInRun *****
+ * Description: Looks a key up in a single run: the Bloom filter first, then
+ * the stretch of the file the sparse index points to.
+ *
+ * @param tier - The tier.
+ * @param run - The run.
+ * @param key - The key.
+ * @param data - Will hold the key's data if found. May be NULL.
+ *
+ * @return
+ * Same as diskTierFind.
+ */
+static DiskTierLookup diskTierFindInRun(DiskTier tier, DiskRun run,
+                                        void* key, void** data){
+    if(!bloomFilterMayContain(run->bloom, tier->format.hashKey(key))){
+        return DISK_TIER_MISSING;
+    }
+    /* The last index key which isn't greater than the key. */
+    long low = 0;
+    long high = run->index_size;
+    while(low < high){
+        long middle = (low+high)/2;
+        if(tier->format.compareKeys(run->index_keys[middle], key) <= 0){
+            low = middle+1;
+        } else {
+            high = middle;
+        }
+    }
+    if(low == 0){
+        return DISK_TIER_MISSING;
+    }
+    long block = low-1;
+    if(fseek(run->file, run->index_offsets[block], SEEK_SET) != 0){
+        return DISK_TIER_IO_ERROR;
+    }
+    long entries = run->count - block*DISK_TIER_INDEX_INTERVAL;
+    if(entries > DISK_TIER_INDEX_INTERVAL){
+        entries = DISK_TIER_INDEX_INTERVAL;
+    }
+    for(long i=0; i<entries; i++){
+        void* entry_key = NULL;
+        void* entry_data = NULL;
+        int kind = diskTierReadEntry(tier, run->file, &entry_key,
+                                     &entry_data);
+        if(kind != DISK_TIER_PUT && kind != DISK_TIER_TOMBSTONE){
+            return DISK_TIER_IO_ERROR;
+        }
+        int difference = tier->format.compareKeys(entry_key, key);
+        tier->format.freeKey(entry_key);
+        if(difference == 0){
+            if(data && entry_data){
+                *data = entry_data;
+            } else if(entry_data){
+                tier->format.freeData(entry_data);
+            }
+            return kind == DISK_TIER_PUT ? DISK_TIER_FOUND :
+                   DISK_TIER_REMOVED;
+        }
+        diskTierFreeEntry(tier, NULL, entry_data);
+        if(difference > 0){
+            break;
+        }
+    }
+    return DISK_TIER_MISSING;
+}
+
+/**
+ ***** Function: diskTierAddRun *****
+ * Description: Adds a run as the newest one.
+ *
+ * @param tier - The tier.
+ * @param run - The run.
+ *
+ * @return
+ * true in case of success, false in case of memory fail.
+ */
+static bool diskTierAddRun(DiskTier tier, DiskRun run){
+    if(tier->runs_number == tier->runs_capacity){
+        int capacity = tier->runs_capacity ? 2*tier->runs_capacity :
+                       DISK_TIER_COMPACT_RUNS;
+        DiskRun* runs = allocatorAllocate(tier->allocator,
+                                          sizeof(*runs)*capacity);
+        if(!runs){
+            return false;
+        }
+        if(tier->runs){
+            memcpy(runs, tier->runs, sizeof(*runs)*tier->runs_number);
+            allocatorFree(tier->allocator, tier->runs,
+                          sizeof(*runs)*tier->runs_capacity);
+        }
+        tier->runs = runs;
+        tier->runs_capacity = capacity;
+    }
+    tier->runs[tier->runs_number++] = run;
+    return true;
+}
+
+/**
+ ***** Function: diskTierStartCompaction *****
+ * Description: Starts merging all the runs on a background thread, if
+ * there are enough of them and no compaction is running. Does nothing if
+ * it can't be started.
+ *
+ * @param tier - The tier.
+ */
+static void diskTierStartCompaction(DiskTier tier){
+    if(tier->compacting || tier->runs_number < DISK_TIER_COMPACT_RUNS){
+        return;
+    }
+    /* Everything the thread needs is allocated here, on the owner's
+     * thread. */
+    tier->compaction_path = diskTierNewPath(tier);
+    tier->compaction_cursor = tier->compaction_path ?
+                              tierCursorCreate(tier) : NULL;
+    tier->compaction_runs = tier->runs_number;
+    tier->compaction_failed = false;
+    tier->compaction_done = 0;
+    if(!tier->compaction_cursor ||
+       pthread_create(&tier->compactor, NULL, diskTierCompact, tier) != 0){
+        tierCursorDestroy(tier->compaction_cursor);
+        tier->compaction_cursor = NULL;
+        if(tier->compaction_path){
+            diskTierFreePath(tier, tier->compaction_path);
+            tier->compaction_path = NULL;
+        }
+        return;
+    }
+    tier->compacting = true;
+}
+
+/**
+ ***** Function: diskTierCompact *****
+ * Description: Body of the compaction thread: writes the merged runs into
+ * a new run file. Tombstones are dropped, since the oldest run is merged.
+ *
+ * @param tier - The tier.
+ *
+ * @return
+ * NULL.
+ */
+static void* diskTierCompact(void* tier){
+    DiskTier compacted = tier;
+    TierMerge merge = {compacted->compaction_cursor, false, false};
+    long count = 0;
+    bool written = diskTierWriteRun(compacted, compacted->compaction_path,
+                                    diskTierNextMerged, &merge, &count);
+    if(written && merge.failed){
+        remove(compacted->compaction_path);
+    }
+    compacted->compaction_failed = !written || merge.failed;
+    __atomic_store_n(&compacted->compaction_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ ***** Function: diskTierNextMerged *****
+ * Description: nextTierEntry of a compaction: the entries of the merged
+ * runs which have data.
+ *
+ * @param merge - The TierMerge.
+ * @param key - Will hold the key of the next entry.
+ * @param data - Will hold the data of the next entry.
+ *
+ * @return
+ * true if there is a next entry, false otherwise.
+ */
+static bool diskTierNextMerged(void* merge, void** key, void** data){
+    TierMerge* state = merge;
+    do {
+        if(state->started && !tierCursorNext(state->cursor)){
+            state->failed = true;
+            return false;
+        }
+        state->started = true;
+        *key = tierCursorGetKey(state->cursor);
+        *data = tierCursorGetData(state->cursor);
+    } while(*key && !*data);
+    return *key != NULL;
+}
+
+/**
+ ***** Function: diskTierFinishCompaction *****
+ * Description: Puts the result of a finished compaction in place of the
+ * runs it merged.
+ *
+ * @param tier - The tier.
+ * @param wait - Whether to wait for a running compaction. Otherwise a
+ * running compaction is left alone.
+ *
+ * @return
+ * false if a finished compaction failed, true otherwise.
+ */
+static bool diskTierFinishCompaction(DiskTier tier, bool wait){
+    if(!tier->compacting ||
+       (!wait && !__atomic_load_n(&tier->compaction_done,
+                                  __ATOMIC_ACQUIRE))){
+        return true;
+    }
+    pthread_join(tier->compactor, NULL);
+    tier->compacting = false;
+    tierCursorDestroy(tier->compaction_cursor);
+    tier->compaction_cursor = NULL;
+    char* path = tier->compaction_path;
+    tier->compaction_path = NULL;
+    DiskRun run = tier->compaction_failed ? NULL :
+                  diskTierOpenRun(tier, path);
+    if(!run){
+        if(!tier->compaction_failed){
+            remove(path);
+        }
+        diskTierFreePath(tier, path);
+        return false;
+    }
+    int merged = tier->compaction_runs;
+    for(int i=0; i<merged; i++){
+        remove(tier->runs[i]->path);
+        diskTierDestroyRun(tier, tier->runs[i]);
+    }
+    /* Everything may have been removed. */
+    int kept = run->count ? 1 : 0;
+    if(!kept){
+        remove(run->path);
+        diskTierDestroyRun(tier, run);
+    }
+    memmove(tier->runs + kept, tier->runs + merged,
+            sizeof(*tier->runs)*(tier->runs_number - merged));
+    if(kept){
+        tier->runs[0] = run;
+    }
+    tier->runs_number -= merged - kept;
+    return true;
+}
+
+/**
+ ***** Function: diskTierReaderNext *****
+ * Description: Moves a reader to the next entry of its run, freeing the
+ * current one.
+ *
+ * @param tier - The tier.
+ * @param reader - The reader.
+ *
+ * @return
+ * false if reading failed; the reader is then past the last entry.
+ * true otherwise.
+ */
+static bool diskTierReaderNext(DiskTier tier, RunReader* reader){
+    diskTierFreeEntry(tier, reader->key, reader->data);
+    int kind = diskTierReadEntry(tier, reader->file, &reader->key,
+                                 &reader->data);
+    return kind != -1;
+}
+
+/**
+ ***** Function: tierCursorSelect *****
+ * Description: Points a cursor at the reader with the smallest key, the
+ * newest one among equal keys.
+ *
+ * @param cursor - The cursor.
+ */
+static void tierCursorSelect(TierCursor cursor){
+    cursor->current = -1;
+    for(int i=cursor->readers_number-1; i>=0; i--){
+        void* key = cursor->readers[i].key;
+        if(key && (cursor->current < 0 ||
+                   cursor->tier->format.compareKeys(key,
+                           cursor->readers[cursor->current].key) < 0)){
+            cursor->current = i;
+        }
+    }
+}
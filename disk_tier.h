@@ -0,0 +1,261 @@
+
+#ifndef MTM_EX3_DISK_TIER_H
+#define MTM_EX3_DISK_TIER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "allocator.h"
+
+/**
+* Disk Tier
+*
+* The on-disk part of a log structured merge tree: a stack of immutable
+* runs, each a file of entries sorted by key. A run is written at once from
+* a sorted stream of entries (a flushed memtable) and is never modified;
+* an entry of a newer run hides the entries of older runs with the same
+* key, and an entry without data (a tombstone) marks its key as removed.
+*
+* Every run keeps a Bloom filter of its keys and a sparse index (the key of
+* every DISK_TIER_INDEX_INTERVAL-th entry and its offset), so a lookup
+* reads at most one short stretch of every run which may hold the key.
+* Once there are DISK_TIER_COMPACT_RUNS runs, a background thread merges
+* all of them into a single run, dropping hidden entries and tombstones;
+* the result replaces them on a later call of the owning thread. The
+* element functions are thus also called from the background thread.
+*
+* The tier itself is not thread safe: it belongs to a single thread.
+*/
+
+//-----------------------------------------------------------------------//
+//                         DISK TIER: DEFINES                            //
+//-----------------------------------------------------------------------//
+
+/* Entries of a run between two keys of its sparse index. */
+#define DISK_TIER_INDEX_INTERVAL 16
+/* Number of runs which starts a background compaction. */
+#define DISK_TIER_COMPACT_RUNS 4
+
+//-----------------------------------------------------------------------//
+//                         DISK TIER: TYPEDEFS                           //
+//-----------------------------------------------------------------------//
+
+typedef struct disk_tier_t *DiskTier;
+
+/** Merged iteration over the entries of all the runs of a tier */
+typedef struct tier_cursor_t *TierCursor;
+
+/** Type of function writing an element to a file. Returns false on
+ * failure */
+typedef bool(*writeTierElement)(void* element, FILE* file);
+
+/** Type of function reading an element written by the above. Returns a new
+ * element, NULL on failure */
+typedef void*(*readTierElement)(FILE* file);
+
+/** Type of function freeing an element returned by a readTierElement */
+typedef void(*freeTierElement)(void* element);
+
+/** Type of function comparing two keys, like strcmp */
+typedef int(*compareTierKeys)(void* first, void* second);
+
+/** Type of function hashing a key. Equal keys must have equal hashes */
+typedef unsigned long(*hashTierKey)(void* key);
+
+/**
+* Type of function handing out the entries of a flush, in increasing key
+* order. Sets the key and the data (NULL for a tombstone) of the next entry
+* and returns true, or returns false once there are no entries left. The
+* first argument is a user context.
+*/
+typedef bool(*nextTierEntry)(void* context, void** key, void** data);
+
+/** How the keys and the data of a tier are stored and ordered */
+typedef struct tier_format_t {
+    writeTierElement writeKey;
+    readTierElement readKey;
+    freeTierElement freeKey;
+    writeTierElement writeData;
+    readTierElement readData;
+    freeTierElement freeData;
+    compareTierKeys compareKeys;
+    hashTierKey hashKey;
+} TierFormat;
+
+/** Results of a lookup in the tier */
+typedef enum DiskTierLookup_t {
+    DISK_TIER_FOUND,
+    DISK_TIER_REMOVED, // The newest entry of the key is a tombstone.
+    DISK_TIER_MISSING,
+    DISK_TIER_IO_ERROR
+} DiskTierLookup;
+
+//-----------------------------------------------------------------------//
+//                        DISK TIER: FUNCTIONS                           //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: diskTierCreate *****
+ * Description: Creates a new tier without runs.
+ *
+ * @param directory - Existing directory the run files are created in.
+ * @param format - Functions of the elements (copied).
+ * @param allocator - Allocator for the tier. May be NULL.
+ *
+ * @return
+ * A new tier in case of success.
+ * NULL if an argument is NULL or in case of memory fail.
+ */
+DiskTier diskTierCreate(const char* directory, const TierFormat* format,
+                        Allocator allocator);
+
+/**
+ ***** Function: diskTierCreateLike *****
+ * Description: Creates a new tier without runs, in the directory and with
+ * the format of another tier. Its run files don't collide with those of the
+ * other tier.
+ *
+ * @param tier - The tier to take the directory and the format of.
+ * @param allocator - Allocator for the new tier. May be NULL.
+ *
+ * @return
+ * A new tier in case of success.
+ * NULL if a NULL tier was sent or in case of memory fail.
+ */
+DiskTier diskTierCreateLike(DiskTier tier, Allocator allocator);
+
+/**
+ ***** Function: diskTierDestroy *****
+ * Description: Waits for a running compaction, then deletes all the run
+ * files and frees the tier.
+ *
+ * @param tier - The tier. If NULL nothing will be done.
+ */
+void diskTierDestroy(DiskTier tier);
+
+/**
+ ***** Function: diskTierClear *****
+ * Description: Waits for a running compaction, then deletes all the runs.
+ *
+ * @param tier - The tier.
+ */
+void diskTierClear(DiskTier tier);
+
+/**
+ ***** Function: diskTierFlush *****
+ * Description: Writes a stream of sorted entries as the newest run, and
+ * starts a background compaction if there are enough runs.
+ *
+ * @param tier - The tier.
+ * @param next - Hands out the entries.
+ * @param context - Passed as is to next.
+ *
+ * @return
+ * true in case of success (also if there were no entries).
+ * false if writing or reading back the run failed. The tier is unchanged.
+ */
+bool diskTierFlush(DiskTier tier, nextTierEntry next, void* context);
+
+/**
+ ***** Function: diskTierFind *****
+ * Description: Looks a key up in the runs, newest first.
+ *
+ * @param tier - The tier.
+ * @param key - The key.
+ * @param data - Will hold the key's data if found, which belongs to the
+ * caller. May be NULL if the data isn't needed.
+ *
+ * @return
+ * DISK_TIER_FOUND - The key's newest entry has data.
+ * DISK_TIER_REMOVED - The key's newest entry is a tombstone.
+ * DISK_TIER_MISSING - No run holds the key.
+ * DISK_TIER_IO_ERROR - Reading a run failed.
+ */
+DiskTierLookup diskTierFind(DiskTier tier, void* key, void** data);
+
+/**
+ ***** Function: diskTierWait *****
+ * Description: Waits for a running compaction and puts its result in
+ * place of the runs it merged, then compacts the runs flushed meanwhile
+ * if there are enough of them. Unless a compaction can't be started, there
+ * are fewer than DISK_TIER_COMPACT_RUNS runs afterwards.
+ *
+ * @param tier - The tier.
+ *
+ * @return
+ * false if a compaction failed (the runs are kept as they were).
+ * true otherwise.
+ */
+bool diskTierWait(DiskTier tier);
+
+/**
+ ***** Function: diskTierGetRunsNumber *****
+ * Description: Returns the number of runs of the tier. A finished
+ * compaction is put in place first.
+ *
+ * @param tier - The tier.
+ *
+ * @return
+ * The number of runs.
+ */
+int diskTierGetRunsNumber(DiskTier tier);
+
+/**
+ ***** Function: tierCursorCreate *****
+ * Description: Creates a cursor on the first entry of the merged runs: the
+ * entries of all the runs in key order, a single one per key (the newest),
+ * tombstones included. The cursor is invalidated by every other function
+ * of the tier but diskTierFind.
+ *
+ * @param tier - The tier.
+ *
+ * @return
+ * A new cursor in case of success.
+ * NULL in case of memory or read fail.
+ */
+TierCursor tierCursorCreate(DiskTier tier);
+
+/**
+ ***** Function: tierCursorGetKey *****
+ * Description: Returns the key of the cursor's entry. It belongs to the
+ * cursor and is valid until the cursor moves.
+ *
+ * @param cursor - The cursor.
+ *
+ * @return
+ * The key, NULL if the cursor is past the last entry.
+ */
+void* tierCursorGetKey(TierCursor cursor);
+
+/**
+ ***** Function: tierCursorGetData *****
+ * Description: Returns the data of the cursor's entry. It belongs to the
+ * cursor and is valid until the cursor moves.
+ *
+ * @param cursor - The cursor.
+ *
+ * @return
+ * The data, NULL for a tombstone or if the cursor is past the last entry.
+ */
+void* tierCursorGetData(TierCursor cursor);
+
+/**
+ ***** Function: tierCursorNext *****
+ * Description: Moves the cursor to the next entry.
+ *
+ * @param cursor - The cursor.
+ *
+ * @return
+ * false if reading a run failed; the cursor is then past the last entry.
+ * true otherwise.
+ */
+bool tierCursorNext(TierCursor cursor);
+
+/**
+ ***** Function: tierCursorDestroy *****
+ * Description: Frees a cursor.
+ *
+ * @param cursor - The cursor. If NULL nothing will be done.
+ */
+void tierCursorDestroy(TierCursor cursor);
+
+#endif //MTM_EX3_DISK_TIER_H
@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200112L
+#include "epoch.h"
+#include <malloc.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+//-----------------------------------------------------------------------//
+//                            EPOCH: DEFINES                             //
+//-----------------------------------------------------------------------//
+
+#define EPOCH_CACHE_LINE 64
+/* A reader's state: the epoch it saw, shifted, and whether it's reading. */
+#define EPOCH_READING 1UL
+
+//-----------------------------------------------------------------------//
+//                            EPOCH: STRUCTS                             //
+//-----------------------------------------------------------------------//
+
+/** Readers sit on cache lines of their own, so they don't slow each other
+ * down. */
+struct epoch_reader_t{
+    unsigned long state; // Accessed atomically.
+    EpochDomain domain;
+    EpochReader next;
+    EpochReader previous;
+    char padding[EPOCH_CACHE_LINE - sizeof(unsigned long) -
+                 sizeof(EpochDomain) - 2*sizeof(EpochReader)];
+};
+
+struct epoch_domain_t{
+    unsigned long epoch; // Written by the writer, read atomically.
+    pthread_mutex_t lock; // Guards the list of readers.
+    EpochReader readers;
+    Allocator allocator;
+};
+
+//-----------------------------------------------------------------------//
+//                           EPOCH: FUNCTIONS                            //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: epochDomainCreate *****
+ * Description: Creates a new domain without readers, at epoch 0.
+ *
+ * @param allocator - Allocator for the domain. May be NULL. Readers are
+ * registered from their own threads, so they are allocated with malloc.
+ *
+ * @return
+ * A new domain in case of success.
+ * NULL in case of memory fail.
+ */
+EpochDomain epochDomainCreate(Allocator allocator){
+    EpochDomain domain = allocatorAllocate(allocator, sizeof(*domain));
+    if(!domain){
+        return NULL;
+    }
+    if(pthread_mutex_init(&domain->lock, NULL) != 0){
+        allocatorFree(allocator, domain, sizeof(*domain));
+        return NULL;
+    }
+    domain->epoch = 0;
+    domain->readers = NULL;
+    domain->allocator = allocator;
+    return domain;
+}
+
+/**
+ ***** Function: epochDomainDestroy *****
+ * Description: Frees the domain. All its readers must be unregistered.
+ *
+ * @param domain - The domain to destroy. If NULL nothing will be done.
+ */
+void epochDomainDestroy(EpochDomain domain){
+    if(!domain){
+        return;
+    }
+    assert(!domain->readers);
+    pthread_mutex_destroy(&domain->lock);
+    allocatorFree(domain->allocator, domain, sizeof(*domain));
+}
+
+/**
+ ***** Function: epochReaderRegister *****
+ * Description: Registers a new reader of the domain. May be called from
+ * any thread.
+ *
+ * @param domain - The domain.
+ *
+ * @return
+ * A new reader, outside of a read section, in case of success.
+ * NULL in case of memory fail.
+ */
+EpochReader epochReaderRegister(EpochDomain domain){
+    assert(domain);
+    void* memory = NULL;
+    if(posix_memalign(&memory, EPOCH_CACHE_LINE,
+                      sizeof(struct epoch_reader_t))){
+        return NULL;
+    }
+    EpochReader reader = memory;
+    reader->state = 0;
+    reader->domain = domain;
+    reader->previous = NULL;
+    pthread_mutex_lock(&domain->lock);
+    reader->next = domain->readers;
+    if(domain->readers){
+        domain->readers->previous = reader;
+    }
+    domain->readers = reader;
+    pthread_mutex_unlock(&domain->lock);
+    return reader;
+}
+
+/**
+ ***** Function: epochReaderUnregister *****
+ * Description: Unregisters a reader and frees it. The reader must be
+ * outside of a read section.
+ *
+ * @param reader - The reader. If NULL nothing will be done.
+ */
+void epochReaderUnregister(EpochReader reader){
+    if(!reader){
+        return;
+    }
+    assert(!(reader->state & EPOCH_READING));
+    EpochDomain domain = reader->domain;
+    pthread_mutex_lock(&domain->lock);
+    if(reader->previous){
+        reader->previous->next = reader->next;
+    } else {
+        domain->readers = reader->next;
+    }
+    if(reader->next){
+        reader->next->previous = reader->previous;
+    }
+    pthread_mutex_unlock(&domain->lock);
+    free(reader);
+}
+
+/**
+ ***** Function: epochReaderEnter *****
+ * Description: Starts a read section: memory reachable from now on is not
+ * freed before epochReaderExit. Sections don't nest.
+ *
+ * @param reader - The reader, used by a single thread at a time.
+ */
+void epochReaderEnter(EpochReader reader){
+    assert(reader && !(reader->state & EPOCH_READING));
+    unsigned long epoch = __atomic_load_n(&reader->domain->epoch,
+                                          __ATOMIC_RELAXED);
+    __atomic_store_n(&reader->state, (epoch << 1) | EPOCH_READING,
+                     __ATOMIC_RELAXED);
+    /* The state must be visible to the writer before any shared pointer is
+     * read. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ ***** Function: epochReaderExit *****
+ * Description: Ends a read section.
+ *
+ * @param reader - The reader.
+ */
+void epochReaderExit(EpochReader reader){
+    assert(reader && (reader->state & EPOCH_READING));
+    __atomic_store_n(&reader->state, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ ***** Function: epochGetCurrent *****
+ * Description: Returns the domain's current epoch. Only for the writer.
+ *
+ * @param domain - The domain.
+ *
+ * @return
+ * The current epoch.
+ */
+unsigned long epochGetCurrent(EpochDomain domain){
+    assert(domain);
+    return domain->epoch;
+}
+
+/**
+ ***** Function: epochTryAdvance *****
+ * Description: Moves the domain to the next epoch if every reader inside a
+ * read section saw the current one. Only for the writer.
+ *
+ * @param domain - The domain.
+ *
+ * @return
+ * true if the epoch advanced, false if a reader is behind.
+ */
+bool epochTryAdvance(EpochDomain domain){
+    assert(domain);
+    /* Unlinking done before this call must be visible to readers before
+     * their states are checked. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    unsigned long epoch = domain->epoch;
+    bool behind = false;
+    pthread_mutex_lock(&domain->lock);
+    for(EpochReader reader = domain->readers; reader && !behind;
+        reader = reader->next){
+        unsigned long state = __atomic_load_n(&reader->state,
+                                              __ATOMIC_ACQUIRE);
+        behind = (state & EPOCH_READING) && (state >> 1) != epoch;
+    }
+    pthread_mutex_unlock(&domain->lock);
+    if(behind){
+        return false;
+    }
+    __atomic_store_n(&domain->epoch, epoch + 1, __ATOMIC_RELEASE);
+    return true;
+}
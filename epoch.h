@@ -0,0 +1,118 @@
+
+#ifndef MTM_EX3_EPOCH_H
+#define MTM_EX3_EPOCH_H
+
+#include <stdbool.h>
+#include "allocator.h"
+
+/**
+* Epoch Based Reclamation
+*
+* Tells a single writer when memory it unlinked from a shared structure can
+* no longer be reached by concurrent readers. The domain has a global epoch;
+* a reader publishes the epoch it saw when it enters a read section, and
+* the writer may only advance the epoch once every reader inside a section
+* saw the current one. Memory unlinked during epoch e is therefore safe to
+* free once the epoch reached e+2.
+*
+* Entering and leaving a read section only write the reader's own cache
+* line and never wait, so readers scale with their number. Registering and
+* unregistering readers take a lock.
+*/
+
+//-----------------------------------------------------------------------//
+//                            EPOCH: TYPEDEFS                            //
+//-----------------------------------------------------------------------//
+
+typedef struct epoch_domain_t *EpochDomain;
+
+typedef struct epoch_reader_t *EpochReader;
+
+//-----------------------------------------------------------------------//
+//                           EPOCH: FUNCTIONS                            //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: epochDomainCreate *****
+ * Description: Creates a new domain without readers, at epoch 0.
+ *
+ * @param allocator - Allocator for the domain. May be NULL. Readers are
+ * registered from their own threads, so they are allocated with malloc.
+ *
+ * @return
+ * A new domain in case of success.
+ * NULL in case of memory fail.
+ */
+EpochDomain epochDomainCreate(Allocator allocator);
+
+/**
+ ***** Function: epochDomainDestroy *****
+ * Description: Frees the domain. All its readers must be unregistered.
+ *
+ * @param domain - The domain to destroy. If NULL nothing will be done.
+ */
+void epochDomainDestroy(EpochDomain domain);
+
+/**
+ ***** Function: epochReaderRegister *****
+ * Description: Registers a new reader of the domain. May be called from
+ * any thread.
+ *
+ * @param domain - The domain.
+ *
+ * @return
+ * A new reader, outside of a read section, in case of success.
+ * NULL in case of memory fail.
+ */
+EpochReader epochReaderRegister(EpochDomain domain);
+
+/**
+ ***** Function: epochReaderUnregister *****
+ * Description: Unregisters a reader and frees it. The reader must be
+ * outside of a read section.
+ *
+ * @param reader - The reader. If NULL nothing will be done.
+ */
+void epochReaderUnregister(EpochReader reader);
+
+/**
+ ***** Function: epochReaderEnter *****
+ * Description: Starts a read section: memory reachable from now on is not
+ * freed before epochReaderExit. Sections don't nest.
+ *
+ * @param reader - The reader, used by a single thread at a time.
+ */
+void epochReaderEnter(EpochReader reader);
+
+/**
+ ***** Function: epochReaderExit *****
+ * Description: Ends a read section.
+ *
+ * @param reader - The reader.
+ */
+void epochReaderExit(EpochReader reader);
+
+/**
+ ***** Function: epochGetCurrent *****
+ * Description: Returns the domain's current epoch. Only for the writer.
+ *
+ * @param domain - The domain.
+ *
+ * @return
+ * The current epoch.
+ */
+unsigned long epochGetCurrent(EpochDomain domain);
+
+/**
+ ***** Function: epochTryAdvance *****
+ * Description: Moves the domain to the next epoch if every reader inside a
+ * read section saw the current one. Only for the writer.
+ *
+ * @param domain - The domain.
+ *
+ * @return
+ * true if the epoch advanced, false if a reader is behind.
+ */
+bool epochTryAdvance(EpochDomain domain);
+
+#endif //MTM_EX3_EPOCH_H
@@ -0,0 +1,343 @@
+#include "hash_index.h"
+#include <assert.h>
+
+//-----------------------------------------------------------------------//
+//                         HASH INDEX: DEFINES                           //
+//-----------------------------------------------------------------------//
+
+#define HASH_INDEX_INITIAL_CAPACITY 16
+
+//-----------------------------------------------------------------------//
+//                          HASH INDEX: STRUCTS                          //
+//-----------------------------------------------------------------------//
+
+typedef struct hash_index_slot_t{
+    unsigned int hash;
+    void* value; // NULL for an empty slot.
+} HashIndexSlot;
+
+struct hash_index_t{
+    HashIndexSlot* slots;
+    unsigned int mask; // Number of slots minus one, 0 without a table.
+    int size;
+    Allocator allocator;
+};
+
+//-----------------------------------------------------------------------//
+//               HASH INDEX: STATIC FUNCTIONS DECLARATIONS               //
+//-----------------------------------------------------------------------//
+
+static unsigned int hashIndexHome(HashIndex index, unsigned int hash);
+static unsigned int hashIndexCapacity(HashIndex index);
+static unsigned int hashIndexFindSlot(HashIndex index, unsigned int hash,
+                                      void* value);
+static HashIndexResult hashIndexGrow(HashIndex index);
+
+//-----------------------------------------------------------------------//
+//                        HASH INDEX: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: hashIndexCreate *****
+ * Description: Creates a new empty index. The table is allocated by the
+ * first insertion.
+ *
+ * @param allocator - Allocator for the index and its table. May be NULL.
+ *
+ * @return
+ * A new index in case of success.
+ * NULL in case of memory fail.
+ */
+HashIndex hashIndexCreate(Allocator allocator){
+    HashIndex index = allocatorAllocate(allocator, sizeof(*index));
+    if(!index){
+        return NULL;
+    }
+    index->slots = NULL;
+    index->mask = 0;
+    index->size = 0;
+    index->allocator = allocator;
+    return index;
+}
+
+/**
+ ***** Function: hashIndexDestroy *****
+ * Description: Frees the index. The values are not freed.
+ *
+ * @param index - The index to destroy. If NULL nothing will be done.
+ */
+void hashIndexDestroy(HashIndex index){
+    if(!index){
+        return;
+    }
+    hashIndexClear(index);
+    allocatorFree(index->allocator, index, sizeof(*index));
+}
+
+/**
+ ***** Function: hashIndexClear *****
+ * Description: Removes all the values from the index and frees its table.
+ * The values are not freed.
+ *
+ * @param index - The index to clear.
+ */
+void hashIndexClear(HashIndex index){
+    assert(index);
+    allocatorFree(index->allocator, index->slots,
+                  sizeof(*index->slots)*hashIndexCapacity(index));
+    index->slots = NULL;
+    index->mask = 0;
+    index->size = 0;
+}
+
+/**
+ ***** Function: hashIndexInsert *****
+ * Description: Adds a value under a hash.
+ *
+ * @param index - The index to insert to.
+ * @param hash - Hash of the value's key.
+ * @param value - The value to insert.
+ *
+ * @return
+ * HASH_INDEX_NULL_ARGUMENT if a NULL was sent.
+ * HASH_INDEX_OUT_OF_MEMORY in case of memory fail. The index is unchanged.
+ * HASH_INDEX_SUCCESS otherwise.
+ */
+HashIndexResult hashIndexInsert(HashIndex index, unsigned int hash,
+                                void* value){
+    if(!index || !value){
+        return HASH_INDEX_NULL_ARGUMENT;
+    }
+    if((unsigned int)(index->size+1)*4 > hashIndexCapacity(index)*3 &&
+       hashIndexGrow(index) != HASH_INDEX_SUCCESS){
+        return HASH_INDEX_OUT_OF_MEMORY;
+    }
+    unsigned int slot = hashIndexHome(index, hash);
+    while(index->slots[slot].value){
+        slot = (slot+1) & index->mask;
+    }
+    index->slots[slot].hash = hash;
+    index->slots[slot].value = value;
+    index->size++;
+    return HASH_INDEX_SUCCESS;
+}
+
+/**
+ ***** Function: hashIndexFind *****
+ * Description: Finds a value stored under a hash.
+ *
+ * @param index - The index to search in.
+ * @param hash - Hash of the key looked for.
+ * @param match - Called with the values stored under the hash and
+ * 'context', until it returns true.
+ * @param context - Passed as is to 'match'.
+ *
+ * @return
+ * The first value which matched.
+ * NULL if there is none.
+ */
+void* hashIndexFind(HashIndex index, unsigned int hash, hashIndexMatch match,
+                    void* context){
+    if(!index || !match || !index->slots){
+        return NULL;
+    }
+    for(unsigned int slot = hashIndexHome(index, hash);
+        index->slots[slot].value; slot = (slot+1) & index->mask){
+        if(index->slots[slot].hash == hash &&
+           match(index->slots[slot].value, context)){
+            return index->slots[slot].value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ ***** Function: hashIndexRemove *****
+ * Description: Removes a value from the index. The values after it in its
+ * run are shifted back into the hole, so no tombstones are left.
+ *
+ * @param index - The index to remove from.
+ * @param hash - The hash the value was inserted with.
+ * @param value - The value to remove.
+ *
+ * @return
+ * true if the value was removed, false if it wasn't in the index.
+ */
+bool hashIndexRemove(HashIndex index, unsigned int hash, void* value){
+    if(!index || !value){
+        return false;
+    }
+    unsigned int hole = hashIndexFindSlot(index, hash, value);
+    if(hole > index->mask){
+        return false;
+    }
+    for(unsigned int slot = (hole+1) & index->mask;
+        index->slots[slot].value; slot = (slot+1) & index->mask){
+        unsigned int home = hashIndexHome(index, index->slots[slot].hash);
+        /* A value may only move back as far as its home slot. */
+        if(((slot-home) & index->mask) >= ((slot-hole) & index->mask)){
+            index->slots[hole] = index->slots[slot];
+            hole = slot;
+        }
+    }
+    index->slots[hole].value = NULL;
+    index->size--;
+    return true;
+}
+
+/**
+ ***** Function: hashIndexReplace *****
+ * Description: Puts a value in the place of another one with the same
+ * hash, without allocating.
+ *
+ * @param index - The index.
+ * @param hash - The hash the value was inserted with.
+ * @param value - The value to replace.
+ * @param replacement - The value to put instead.
+ *
+ * @return
+ * true if the value was replaced, false if it wasn't in the index.
+ */
+bool hashIndexReplace(HashIndex index, unsigned int hash, void* value,
+                      void* replacement){
+    if(!index || !value || !replacement){
+        return false;
+    }
+    unsigned int slot = hashIndexFindSlot(index, hash, value);
+    if(slot > index->mask){
+        return false;
+    }
+    index->slots[slot].value = replacement;
+    return true;
+}
+
+/**
+ ***** Function: hashIndexMoveValues *****
+ * Description: Replaces every value by its new address, after the values
+ * were moved in memory. The hashes stay as they are.
+ *
+ * @param index - The index.
+ * @param move - Returns the new address of a value.
+ */
+void hashIndexMoveValues(HashIndex index, hashIndexMove move){
+    assert(index && move);
+    for(unsigned int slot = 0; slot < hashIndexCapacity(index); slot++){
+        if(index->slots[slot].value){
+            index->slots[slot].value = move(index->slots[slot].value);
+        }
+    }
+}
+
+/**
+ ***** Function: hashIndexGetSize *****
+ * Description: Returns the number of values in the index.
+ *
+ * @param index - The index.
+ *
+ * @return
+ * The number of values.
+ */
+int hashIndexGetSize(HashIndex index){
+    assert(index);
+    return index->size;
+}
+
+//-----------------------------------------------------------------------//
+//                      HASH INDEX: STATIC FUNCTIONS                     //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: hashIndexHome *****
+ * Description: Returns the slot where probing for a hash starts. The hash
+ * is mixed first, since the given hashes may differ in their high bits
+ * only.
+ *
+ * @param index - The index. Must have a table.
+ * @param hash - The hash.
+ *
+ * @return
+ * The home slot of the hash.
+ */
+static unsigned int hashIndexHome(HashIndex index, unsigned int hash){
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bU;
+    hash ^= hash >> 16;
+    return hash & index->mask;
+}
+
+/**
+ ***** Function: hashIndexCapacity *****
+ * Description: Returns the number of slots of the index's table.
+ *
+ * @param index - The index.
+ *
+ * @return
+ * The number of slots, 0 without a table.
+ */
+static unsigned int hashIndexCapacity(HashIndex index){
+    return index->slots ? index->mask+1 : 0;
+}
+
+/**
+ ***** Function: hashIndexFindSlot *****
+ * Description: Finds the slot holding a value.
+ *
+ * @param index - The index.
+ * @param hash - The hash the value was inserted with.
+ * @param value - The value.
+ *
+ * @return
+ * The value's slot, or a number greater than the index's mask if the
+ * value isn't in the index.
+ */
+static unsigned int hashIndexFindSlot(HashIndex index, unsigned int hash,
+                                      void* value){
+    if(!index->slots){
+        return 1;
+    }
+    for(unsigned int slot = hashIndexHome(index, hash);
+        index->slots[slot].value; slot = (slot+1) & index->mask){
+        if(index->slots[slot].value == value){
+            return slot;
+        }
+    }
+    return index->mask+1;
+}
+
+/**
+ ***** Function: hashIndexGrow *****
+ * Description: Moves the values into a table twice as large (or into a
+ * first table).
+ *
+ * @param index - The index.
+ *
+ * @return
+ * HASH_INDEX_OUT_OF_MEMORY in case of memory fail. The index is unchanged.
+ * HASH_INDEX_SUCCESS otherwise.
+ */
+static HashIndexResult hashIndexGrow(HashIndex index){
+    unsigned int capacity = hashIndexCapacity(index);
+    unsigned int new_capacity = capacity ? capacity*2 :
+                                HASH_INDEX_INITIAL_CAPACITY;
+    HashIndexSlot* slots = allocatorAllocateZeroed(index->allocator,
+                                                   sizeof(*slots)*
+                                                   new_capacity);
+    if(!slots){
+        return HASH_INDEX_OUT_OF_MEMORY;
+    }
+    HashIndexSlot* old_slots = index->slots;
+    index->slots = slots;
+    index->mask = new_capacity-1;
+    for(unsigned int slot = 0; slot < capacity; slot++){
+        if(!old_slots[slot].value){
+            continue;
+        }
+        unsigned int new_slot = hashIndexHome(index, old_slots[slot].hash);
+        while(slots[new_slot].value){
+            new_slot = (new_slot+1) & index->mask;
+        }
+        slots[new_slot] = old_slots[slot];
+    }
+    allocatorFree(index->allocator, old_slots, sizeof(*old_slots)*capacity);
+    return HASH_INDEX_SUCCESS;
+}
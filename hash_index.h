@@ -0,0 +1,158 @@
+#ifndef MTM_EX3_HASH_INDEX_H
+#define MTM_EX3_HASH_INDEX_H
+
+#include <stdbool.h>
+#include "allocator.h"
+
+/**
+* Hash Index
+*
+* An unordered index of values by a hash of their keys: an open addressing
+* table with linear probing. Every slot keeps the hash of its value, so
+* probing never touches the values themselves, and a lookup only asks
+* about the values which hash is equal to the one looked for. The table
+* doubles once three quarters of its slots are used; a miss ends at the
+* first empty slot, so it costs about as much as a hit.
+*
+* The index doesn't know the keys: the caller hashes them, and must give
+* the same hash again to remove or replace a value. Several values may
+* share a hash.
+*/
+
+//-----------------------------------------------------------------------//
+//                         HASH INDEX: TYPEDEFS                          //
+//-----------------------------------------------------------------------//
+
+typedef struct hash_index_t *HashIndex;
+
+/** Type of function telling whether a value is the one looked for */
+typedef bool(*hashIndexMatch)(void* value, void* context);
+
+/** Type of function returning the new address of a moved value */
+typedef void*(*hashIndexMove)(void* value);
+
+/** Type used for returning error codes from hash index functions */
+typedef enum HashIndexResult_t {
+    HASH_INDEX_SUCCESS,
+    HASH_INDEX_NULL_ARGUMENT,
+    HASH_INDEX_OUT_OF_MEMORY
+} HashIndexResult;
+
+//-----------------------------------------------------------------------//
+//                        HASH INDEX: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: hashIndexCreate *****
+ * Description: Creates a new empty index. The table is allocated by the
+ * first insertion.
+ *
+ * @param allocator - Allocator for the index and its table. May be NULL.
+ *
+ * @return
+ * A new index in case of success.
+ * NULL in case of memory fail.
+ */
+HashIndex hashIndexCreate(Allocator allocator);
+
+/**
+ ***** Function: hashIndexDestroy *****
+ * Description: Frees the index. The values are not freed.
+ *
+ * @param index - The index to destroy. If NULL nothing will be done.
+ */
+void hashIndexDestroy(HashIndex index);
+
+/**
+ ***** Function: hashIndexClear *****
+ * Description: Removes all the values from the index and frees its table.
+ * The values are not freed.
+ *
+ * @param index - The index to clear.
+ */
+void hashIndexClear(HashIndex index);
+
+/**
+ ***** Function: hashIndexInsert *****
+ * Description: Adds a value under a hash.
+ *
+ * @param index - The index to insert to.
+ * @param hash - Hash of the value's key.
+ * @param value - The value to insert.
+ *
+ * @return
+ * HASH_INDEX_NULL_ARGUMENT if a NULL was sent.
+ * HASH_INDEX_OUT_OF_MEMORY in case of memory fail. The index is unchanged.
+ * HASH_INDEX_SUCCESS otherwise.
+ */
+HashIndexResult hashIndexInsert(HashIndex index, unsigned int hash,
+                                void* value);
+
+/**
+ ***** Function: hashIndexFind *****
+ * Description: Finds a value stored under a hash.
+ *
+ * @param index - The index to search in.
+ * @param hash - Hash of the key looked for.
+ * @param match - Called with the values stored under the hash and
+ * 'context', until it returns true.
+ * @param context - Passed as is to 'match'.
+ *
+ * @return
+ * The first value which matched.
+ * NULL if there is none.
+ */
+void* hashIndexFind(HashIndex index, unsigned int hash, hashIndexMatch match,
+                    void* context);
+
+/**
+ ***** Function: hashIndexRemove *****
+ * Description: Removes a value from the index.
+ *
+ * @param index - The index to remove from.
+ * @param hash - The hash the value was inserted with.
+ * @param value - The value to remove.
+ *
+ * @return
+ * true if the value was removed, false if it wasn't in the index.
+ */
+bool hashIndexRemove(HashIndex index, unsigned int hash, void* value);
+
+/**
+ ***** Function: hashIndexReplace *****
+ * Description: Puts a value in the place of another one with the same
+ * hash, without allocating.
+ *
+ * @param index - The index.
+ * @param hash - The hash the value was inserted with.
+ * @param value - The value to replace.
+ * @param replacement - The value to put instead.
+ *
+ * @return
+ * true if the value was replaced, false if it wasn't in the index.
+ */
+bool hashIndexReplace(HashIndex index, unsigned int hash, void* value,
+                      void* replacement);
+
+/**
+ ***** Function: hashIndexMoveValues *****
+ * Description: Replaces every value by its new address, after the values
+ * were moved in memory. The hashes stay as they are.
+ *
+ * @param index - The index.
+ * @param move - Returns the new address of a value.
+ */
+void hashIndexMoveValues(HashIndex index, hashIndexMove move);
+
+/**
+ ***** Function: hashIndexGetSize *****
+ * Description: Returns the number of values in the index.
+ *
+ * @param index - The index.
+ *
+ * @return
+ * The number of values.
+ */
+int hashIndexGetSize(HashIndex index);
+
+#endif //MTM_EX3_HASH_INDEX_H
@@ -0,0 +1,384 @@
+#include "key_blocks.h"
+#include <string.h>
+#include <assert.h>
+
+//-----------------------------------------------------------------------//
+//                         KEY BLOCKS: DEFINES                           //
+//-----------------------------------------------------------------------//
+
+/* Lengths are stored as varints: 7 bits per byte, the high bit set on all
+ * the bytes but the last. */
+#define KEY_BLOCKS_VARINT_BITS 7
+#define KEY_BLOCKS_VARINT_MORE 0x80
+
+//-----------------------------------------------------------------------//
+//                         KEY BLOCKS: STRUCT                            //
+//-----------------------------------------------------------------------//
+
+/** Every entry is the length of the prefix shared with the previous key,
+ * the length of the rest of the key and the rest of the key's bytes. */
+struct key_blocks_t{
+    unsigned char* bytes; // The entries, one after another.
+    size_t size;
+    size_t* restarts; // Offset of the first entry of every block.
+    int restarts_number;
+    int count;
+    size_t max_length;
+    Allocator allocator;
+};
+
+//-----------------------------------------------------------------------//
+//              KEY BLOCKS: STATIC FUNCTIONS DECLARATIONS                //
+//-----------------------------------------------------------------------//
+
+static size_t keyBlocksSharedPrefix(void* const* keys, int index);
+
+static size_t keyBlocksVarintSize(size_t value);
+
+static size_t keyBlocksPutVarint(unsigned char* bytes, size_t value);
+
+static size_t keyBlocksGetVarint(const unsigned char* bytes, size_t* value);
+
+static size_t keyBlocksDecode(KeyBlocks blocks, size_t offset, char* key);
+
+static int keyBlocksCompareRestart(KeyBlocks blocks, int block,
+                                   const unsigned char* key, size_t length);
+
+//-----------------------------------------------------------------------//
+//                        KEY BLOCKS: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: keyBlocksCreate *****
+ * Description: Front codes a sorted array of keys.
+ *
+ * @param keys - The keys: C strings in increasing strcmp order, without
+ * duplicates. Not kept.
+ * @param count - Number of keys. Must be positive.
+ * @param allocator - Allocator for the blocks. May be NULL.
+ *
+ * @return
+ * The blocks in case of success.
+ * NULL in case of memory fail.
+ */
+KeyBlocks keyBlocksCreate(void* const* keys, int count, Allocator allocator){
+    assert(keys && count > 0);
+    KeyBlocks blocks = allocatorAllocate(allocator, sizeof(*blocks));
+    if(!blocks){
+        return NULL;
+    }
+    blocks->count = count;
+    blocks->restarts_number = (count + KEY_BLOCKS_RESTART_INTERVAL - 1) /
+                              KEY_BLOCKS_RESTART_INTERVAL;
+    blocks->max_length = 0;
+    blocks->allocator = allocator;
+    /* The entries are sized first, so they take a single exact block. */
+    size_t size = 0;
+    for(int i=0; i<count; i++){
+        size_t length = strlen(keys[i]);
+        size_t shared = keyBlocksSharedPrefix(keys, i);
+        size += keyBlocksVarintSize(shared) +
+                keyBlocksVarintSize(length - shared) + length - shared;
+        if(length > blocks->max_length){
+            blocks->max_length = length;
+        }
+    }
+    blocks->size = size;
+    blocks->bytes = allocatorAllocate(allocator, size);
+    blocks->restarts = allocatorAllocate(allocator,
+            sizeof(*blocks->restarts)*blocks->restarts_number);
+    if(!blocks->bytes || !blocks->restarts){
+        keyBlocksDestroy(blocks);
+        return NULL;
+    }
+    size_t offset = 0;
+    for(int i=0; i<count; i++){
+        if(i % KEY_BLOCKS_RESTART_INTERVAL == 0){
+            blocks->restarts[i / KEY_BLOCKS_RESTART_INTERVAL] = offset;
+        }
+        const char* key = keys[i];
+        size_t length = strlen(key);
+        size_t shared = keyBlocksSharedPrefix(keys, i);
+        offset += keyBlocksPutVarint(blocks->bytes + offset, shared);
+        offset += keyBlocksPutVarint(blocks->bytes + offset, length - shared);
+        memcpy(blocks->bytes + offset, key + shared, length - shared);
+        offset += length - shared;
+    }
+    assert(offset == size);
+    return blocks;
+}
+
+/**
+ ***** Function: keyBlocksDestroy *****
+ * Description: Frees the blocks.
+ *
+ * @param blocks - The blocks. If NULL nothing will be done.
+ */
+void keyBlocksDestroy(KeyBlocks blocks){
+    if(!blocks){
+        return;
+    }
+    Allocator allocator = blocks->allocator;
+    allocatorFree(allocator, blocks->bytes, blocks->size);
+    allocatorFree(allocator, blocks->restarts,
+                  sizeof(*blocks->restarts)*blocks->restarts_number);
+    allocatorFree(allocator, blocks, sizeof(*blocks));
+}
+
+/**
+ ***** Function: keyBlocksGetMaxLength *****
+ * Description: Returns the length of the longest key, so a buffer of one
+ * more byte can hold any key.
+ *
+ * @param blocks - The blocks.
+ *
+ * @return
+ * The length of the longest key.
+ */
+size_t keyBlocksGetMaxLength(KeyBlocks blocks){
+    assert(blocks);
+    return blocks->max_length;
+}
+
+/**
+ ***** Function: keyBlocksGet *****
+ * Description: Decodes a key. Decoding the keys in increasing order with
+ * the same buffer and cursor costs O(1) per key (plus the key's length);
+ * any other key is decoded from its restart point.
+ *
+ * @param blocks - The blocks.
+ * @param index - Index of the key.
+ * @param key - Will hold the key. Must hold at least
+ * keyBlocksGetMaxLength()+1 bytes, and the key last decoded with cursor.
+ * @param cursor - Will hold the position of the decoded key.
+ */
+void keyBlocksGet(KeyBlocks blocks, int index, char* key,
+                  KeyBlocksCursor* cursor){
+    assert(blocks && key && cursor && index >= 0 && index < blocks->count);
+    int block = index / KEY_BLOCKS_RESTART_INTERVAL;
+    int current = block * KEY_BLOCKS_RESTART_INTERVAL;
+    size_t offset = blocks->restarts[block];
+    if(cursor->index >= current && cursor->index < index){
+        /* The buffer holds an earlier key of the same block. */
+        current = cursor->index + 1;
+        offset = cursor->offset;
+    }
+    for(; current <= index; current++){
+        offset = keyBlocksDecode(blocks, offset, key);
+    }
+    cursor->index = index;
+    cursor->offset = offset;
+}
+
+/**
+ ***** Function: keyBlocksFind *****
+ * Description: Finds the first key which is not smaller than a given key.
+ * The comparisons run on the encoded keys, nothing is decoded.
+ *
+ * @param blocks - The blocks.
+ * @param key - The key to look for.
+ * @param found - Will hold whether the key is in the blocks.
+ *
+ * @return
+ * The index of the first key which is not smaller than the given key (the
+ * number of keys if there is none).
+ */
+int keyBlocksFind(KeyBlocks blocks, const char* key, bool* found){
+    assert(blocks && key && found);
+    *found = false;
+    const unsigned char* target = (const unsigned char*)key;
+    size_t length = strlen(key);
+    /* The last block which first key isn't greater than the key, or the
+     * first block. */
+    int low = 0;
+    int high = blocks->restarts_number;
+    while(high - low > 1){
+        int middle = low + (high - low)/2;
+        if(keyBlocksCompareRestart(blocks, middle, target, length) <= 0){
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    int index = low * KEY_BLOCKS_RESTART_INTERVAL;
+    int end = blocks->count - index < KEY_BLOCKS_RESTART_INTERVAL ?
+              blocks->count : index + KEY_BLOCKS_RESTART_INTERVAL;
+    size_t offset = blocks->restarts[low];
+    /* Length of the prefix the previous key shares with the key. Every key
+     * passed so far is smaller than the key. */
+    size_t matched = 0;
+    for(; index < end; index++){
+        size_t shared = 0;
+        size_t suffix_length = 0;
+        offset += keyBlocksGetVarint(blocks->bytes + offset, &shared);
+        offset += keyBlocksGetVarint(blocks->bytes + offset, &suffix_length);
+        const unsigned char* suffix = blocks->bytes + offset;
+        offset += suffix_length;
+        if(shared < matched){
+            /* It parts from the previous key where that one still matched
+             * the key, with a greater byte. */
+            return index;
+        }
+        if(shared > matched){
+            /* It parts from the key where the previous key did. */
+            continue;
+        }
+        size_t common = 0;
+        while(common < suffix_length && matched + common < length &&
+              suffix[common] == target[matched + common]){
+            common++;
+        }
+        if(common == suffix_length){
+            if(matched + common == length){
+                *found = true;
+                return index;
+            }
+            /* A prefix of the key. */
+            matched += common;
+            continue;
+        }
+        if(matched + common == length ||
+           suffix[common] > target[matched + common]){
+            return index;
+        }
+        matched += common;
+    }
+    return index;
+}
+
+//-----------------------------------------------------------------------//
+//                     KEY BLOCKS: STATIC FUNCTIONS                      //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: keyBlocksSharedPrefix *****
+ * Description: Returns the length of the prefix a key is stored without.
+ *
+ * @param keys - The keys.
+ * @param index - Index of the key.
+ *
+ * @return
+ * 0 for a restart point, otherwise the length of the prefix the key shares
+ * with the previous key.
+ */
+static size_t keyBlocksSharedPrefix(void* const* keys, int index){
+    if(index % KEY_BLOCKS_RESTART_INTERVAL == 0){
+        return 0;
+    }
+    const char* previous = keys[index-1];
+    const char* key = keys[index];
+    size_t shared = 0;
+    while(previous[shared] && previous[shared] == key[shared]){
+        shared++;
+    }
+    return shared;
+}
+
+/**
+ ***** Function: keyBlocksVarintSize *****
+ * Description: Returns the number of bytes of a value's varint.
+ *
+ * @param value - The value.
+ *
+ * @return
+ * The number of bytes.
+ */
+static size_t keyBlocksVarintSize(size_t value){
+    size_t size = 1;
+    while(value >>= KEY_BLOCKS_VARINT_BITS){
+        size++;
+    }
+    return size;
+}
+
+/**
+ ***** Function: keyBlocksPutVarint *****
+ * Description: Writes a value as a varint.
+ *
+ * @param bytes - Where to write.
+ * @param value - The value.
+ *
+ * @return
+ * The number of bytes written.
+ */
+static size_t keyBlocksPutVarint(unsigned char* bytes, size_t value){
+    size_t size = 0;
+    while(value >= KEY_BLOCKS_VARINT_MORE){
+        bytes[size++] = (unsigned char)(value | KEY_BLOCKS_VARINT_MORE);
+        value >>= KEY_BLOCKS_VARINT_BITS;
+    }
+    bytes[size++] = (unsigned char)value;
+    return size;
+}
+
+/**
+ ***** Function: keyBlocksGetVarint *****
+ * Description: Reads a varint.
+ *
+ * @param bytes - Where to read.
+ * @param value - Will hold the value.
+ *
+ * @return
+ * The number of bytes read.
+ */
+static size_t keyBlocksGetVarint(const unsigned char* bytes, size_t* value){
+    size_t size = 0;
+    int shift = 0;
+    *value = 0;
+    do {
+        *value |= (size_t)(bytes[size] & ~KEY_BLOCKS_VARINT_MORE) << shift;
+        shift += KEY_BLOCKS_VARINT_BITS;
+    } while(bytes[size++] & KEY_BLOCKS_VARINT_MORE);
+    return size;
+}
+
+/**
+ ***** Function: keyBlocksDecode *****
+ * Description: Decodes an entry into a buffer holding the previous key.
+ *
+ * @param blocks - The blocks.
+ * @param offset - Offset of the entry.
+ * @param key - The buffer.
+ *
+ * @return
+ * The offset of the next entry.
+ */
+static size_t keyBlocksDecode(KeyBlocks blocks, size_t offset, char* key){
+    size_t shared = 0;
+    size_t suffix_length = 0;
+    offset += keyBlocksGetVarint(blocks->bytes + offset, &shared);
+    offset += keyBlocksGetVarint(blocks->bytes + offset, &suffix_length);
+    memcpy(key + shared, blocks->bytes + offset, suffix_length);
+    key[shared + suffix_length] = '\0';
+    return offset + suffix_length;
+}
+
+/**
+ ***** Function: keyBlocksCompareRestart *****
+ * Description: Compares the first key of a block with a given key, like
+ * strcmp.
+ *
+ * @param blocks - The blocks.
+ * @param block - Index of the block.
+ * @param key - The key.
+ * @param length - The key's length.
+ *
+ * @return
+ * A negative value if the block's key is smaller, 0 if the keys are equal,
+ * a positive value otherwise.
+ */
+static int keyBlocksCompareRestart(KeyBlocks blocks, int block,
+                                   const unsigned char* key, size_t length){
+    size_t offset = blocks->restarts[block];
+    size_t shared = 0;
+    size_t stored_length = 0;
+    offset += keyBlocksGetVarint(blocks->bytes + offset, &shared);
+    offset += keyBlocksGetVarint(blocks->bytes + offset, &stored_length);
+    assert(shared == 0);
+    size_t shorter = stored_length < length ? stored_length : length;
+    int order = memcmp(blocks->bytes + offset, key, shorter);
+    if(order != 0){
+        return order;
+    }
+    return stored_length < length ? -1 : stored_length > length;
+}
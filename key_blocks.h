@@ -0,0 +1,117 @@
+
+#ifndef MTM_EX3_KEY_BLOCKS_H
+#define MTM_EX3_KEY_BLOCKS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "allocator.h"
+
+/**
+* Key Blocks
+*
+* An immutable sorted sequence of C strings, front coded: every key is
+* stored as the length of the prefix it shares with the previous key and
+* the rest of its bytes. Every KEY_BLOCKS_RESTART_INTERVAL-th key (a
+* restart point) is stored whole and starts a block, so a lookup binary
+* searches the restart points and then decodes a single block. Keys sharing
+* long prefixes (paths, URLs) take a fraction of the memory of separate
+* copies.
+*
+* Keys are decoded into buffers of the caller, so any number of threads may
+* read the same blocks at once.
+*/
+
+//-----------------------------------------------------------------------//
+//                         KEY BLOCKS: DEFINES                           //
+//-----------------------------------------------------------------------//
+
+/* Number of keys of a block: the first one is stored whole. */
+#define KEY_BLOCKS_RESTART_INTERVAL 16
+
+//-----------------------------------------------------------------------//
+//                         KEY BLOCKS: TYPEDEFS                          //
+//-----------------------------------------------------------------------//
+
+typedef struct key_blocks_t *KeyBlocks;
+
+/**
+* The key last decoded into a buffer, which lets the next keys of its block
+* be decoded from it. Initialize with KEY_BLOCKS_CURSOR_INITIALIZER.
+*/
+typedef struct KeyBlocksCursor_t {
+    int index;
+    size_t offset; // Offset of the entry following the decoded key.
+} KeyBlocksCursor;
+
+#define KEY_BLOCKS_CURSOR_INITIALIZER {-1, 0}
+
+//-----------------------------------------------------------------------//
+//                        KEY BLOCKS: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: keyBlocksCreate *****
+ * Description: Front codes a sorted array of keys.
+ *
+ * @param keys - The keys: C strings in increasing strcmp order, without
+ * duplicates. Not kept.
+ * @param count - Number of keys. Must be positive.
+ * @param allocator - Allocator for the blocks. May be NULL.
+ *
+ * @return
+ * The blocks in case of success.
+ * NULL in case of memory fail.
+ */
+KeyBlocks keyBlocksCreate(void* const* keys, int count, Allocator allocator);
+
+/**
+ ***** Function: keyBlocksDestroy *****
+ * Description: Frees the blocks.
+ *
+ * @param blocks - The blocks. If NULL nothing will be done.
+ */
+void keyBlocksDestroy(KeyBlocks blocks);
+
+/**
+ ***** Function: keyBlocksGetMaxLength *****
+ * Description: Returns the length of the longest key, so a buffer of one
+ * more byte can hold any key.
+ *
+ * @param blocks - The blocks.
+ *
+ * @return
+ * The length of the longest key.
+ */
+size_t keyBlocksGetMaxLength(KeyBlocks blocks);
+
+/**
+ ***** Function: keyBlocksGet *****
+ * Description: Decodes a key. Decoding the keys in increasing order with
+ * the same buffer and cursor costs O(1) per key (plus the key's length);
+ * any other key is decoded from its restart point.
+ *
+ * @param blocks - The blocks.
+ * @param index - Index of the key.
+ * @param key - Will hold the key. Must hold at least
+ * keyBlocksGetMaxLength()+1 bytes, and the key last decoded with cursor.
+ * @param cursor - Will hold the position of the decoded key.
+ */
+void keyBlocksGet(KeyBlocks blocks, int index, char* key,
+                  KeyBlocksCursor* cursor);
+
+/**
+ ***** Function: keyBlocksFind *****
+ * Description: Finds the first key which is not smaller than a given key.
+ * The comparisons run on the encoded keys, nothing is decoded.
+ *
+ * @param blocks - The blocks.
+ * @param key - The key to look for.
+ * @param found - Will hold whether the key is in the blocks.
+ *
+ * @return
+ * The index of the first key which is not smaller than the given key (the
+ * number of keys if there is none).
+ */
+int keyBlocksFind(KeyBlocks blocks, const char* key, bool* found);
+
+#endif //MTM_EX3_KEY_BLOCKS_H
@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 199309L
+#include "latency_histogram.h"
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+//-----------------------------------------------------------------------//
+//                      LATENCY HISTOGRAM: DEFINES                       //
+//-----------------------------------------------------------------------//
+
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BITS)
+#define LATENCY_NANOSECONDS_PER_SECOND 1000000000ULL
+
+//-----------------------------------------------------------------------//
+//              LATENCY HISTOGRAM: STATIC FUNCTIONS DECLARATIONS         //
+//-----------------------------------------------------------------------//
+
+static int latencyBucketOf(unsigned long long value);
+
+//-----------------------------------------------------------------------//
+//                     LATENCY HISTOGRAM: FUNCTIONS                      //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: latencyHistogramReset *****
+ * Description: Empties a histogram.
+ *
+ * @param histogram - The histogram.
+ */
+void latencyHistogramReset(LatencyHistogram* histogram){
+    assert(histogram);
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+/**
+ ***** Function: latencyHistogramRecord *****
+ * Description: Counts a value in the histogram.
+ *
+ * @param histogram - The histogram.
+ * @param value - The value.
+ */
+void latencyHistogramRecord(LatencyHistogram* histogram,
+                            unsigned long long value){
+    assert(histogram);
+    if(!histogram->count || value < histogram->min){
+        histogram->min = value;
+    }
+    if(value > histogram->max){
+        histogram->max = value;
+    }
+    histogram->count++;
+    histogram->total += value;
+    histogram->buckets[latencyBucketOf(value)]++;
+}
+
+/**
+ ***** Function: latencyHistogramPercentile *****
+ * Description: Returns an upper bound of the value below which a given
+ * percentage of the recorded values fall. The bound is the end of the
+ * bucket holding the percentile, but never more than the largest value.
+ *
+ * @param histogram - The histogram.
+ * @param percentile - Percentage between 0 and 100.
+ *
+ * @return
+ * 0 if the histogram is empty.
+ * The percentile otherwise.
+ */
+unsigned long long latencyHistogramPercentile(const LatencyHistogram*
+                                              histogram, double percentile){
+    assert(histogram);
+    if(!histogram->count){
+        return 0;
+    }
+    /* Rank of the percentile among the values, starting from 1. */
+    double wanted = percentile/100.0*(double)histogram->count;
+    unsigned long long rank = (unsigned long long)wanted;
+    if((double)rank < wanted){
+        rank++;
+    }
+    if(rank < 1){
+        rank = 1;
+    }
+    unsigned long long seen = 0;
+    for(int bucket=0; bucket<LATENCY_HISTOGRAM_BUCKETS; bucket++){
+        seen += histogram->buckets[bucket];
+        if(seen >= rank){
+            if(bucket+1 == LATENCY_HISTOGRAM_BUCKETS){
+                return histogram->max;
+            }
+            unsigned long long last =
+                    latencyHistogramBucketStart(bucket+1) - 1;
+            return last < histogram->max ? last : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/**
+ ***** Function: latencyHistogramBucketStart *****
+ * Description: Returns the smallest value counted in a bucket.
+ *
+ * @param bucket - Index of the bucket.
+ *
+ * @return
+ * The smallest value of the bucket.
+ */
+unsigned long long latencyHistogramBucketStart(int bucket){
+    assert(bucket >= 0 && bucket < LATENCY_HISTOGRAM_BUCKETS);
+    if(bucket < LATENCY_SUB_BUCKETS){
+        /* Small values have exact buckets. */
+        return (unsigned long long)bucket;
+    }
+    int shift = (bucket >> LATENCY_HISTOGRAM_SUB_BITS) - 1;
+    unsigned long long mantissa = (unsigned long long)
+            ((bucket & (LATENCY_SUB_BUCKETS-1)) + LATENCY_SUB_BUCKETS);
+    return mantissa << shift;
+}
+
+/**
+ ***** Function: latencyNow *****
+ * Description: Returns a monotonic time stamp in nanoseconds, for measuring
+ * latencies.
+ *
+ * @return
+ * The current time in nanoseconds.
+ */
+unsigned long long latencyNow(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec*LATENCY_NANOSECONDS_PER_SECOND +
+           (unsigned long long)now.tv_nsec;
+}
+
+//-----------------------------------------------------------------------//
+//                 LATENCY HISTOGRAM: STATIC FUNCTIONS                   //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: latencyBucketOf *****
+ * Description: Finds the bucket counting a value: its power of two, and the
+ * LATENCY_HISTOGRAM_SUB_BITS bits below its highest one.
+ *
+ * @param value - The value.
+ *
+ * @return
+ * Index of the value's bucket.
+ */
+static int latencyBucketOf(unsigned long long value){
+    if(value < LATENCY_SUB_BUCKETS){
+        return (int)value;
+    }
+    int shift = 63 - __builtin_clzll(value) - LATENCY_HISTOGRAM_SUB_BITS;
+    return ((shift+1) << LATENCY_HISTOGRAM_SUB_BITS) +
+           (int)((value >> shift) - LATENCY_SUB_BUCKETS);
+}
@@ -0,0 +1,95 @@
+
+#ifndef MTM_EX3_LATENCY_HISTOGRAM_H
+#define MTM_EX3_LATENCY_HISTOGRAM_H
+
+/**
+* Latency Histogram
+*
+* Counts values (latencies in nanoseconds) in logarithmic buckets: every
+* power of two is split into 2^LATENCY_HISTOGRAM_SUB_BITS equal buckets, so
+* a value is known to within 1/8 of itself whatever its magnitude, from
+* nanoseconds to centuries, in a fixed amount of memory. Recording a value
+* costs a few instructions and never allocates.
+*/
+
+//-----------------------------------------------------------------------//
+//                      LATENCY HISTOGRAM: DEFINES                       //
+//-----------------------------------------------------------------------//
+
+/* Every power of two is split into 2^LATENCY_HISTOGRAM_SUB_BITS buckets. */
+#define LATENCY_HISTOGRAM_SUB_BITS 3
+#define LATENCY_HISTOGRAM_BUCKETS \
+    ((64 - LATENCY_HISTOGRAM_SUB_BITS + 1) << LATENCY_HISTOGRAM_SUB_BITS)
+
+//-----------------------------------------------------------------------//
+//                      LATENCY HISTOGRAM: TYPEDEFS                      //
+//-----------------------------------------------------------------------//
+
+typedef struct latency_histogram_t {
+    unsigned long long count; // Number of recorded values.
+    unsigned long long total; // Sum of the recorded values.
+    unsigned long long min; // Smallest recorded value, if count>0.
+    unsigned long long max; // Largest recorded value, if count>0.
+    unsigned long long buckets[LATENCY_HISTOGRAM_BUCKETS];
+} LatencyHistogram;
+
+//-----------------------------------------------------------------------//
+//                     LATENCY HISTOGRAM: FUNCTIONS                      //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: latencyHistogramReset *****
+ * Description: Empties a histogram.
+ *
+ * @param histogram - The histogram.
+ */
+void latencyHistogramReset(LatencyHistogram* histogram);
+
+/**
+ ***** Function: latencyHistogramRecord *****
+ * Description: Counts a value in the histogram.
+ *
+ * @param histogram - The histogram.
+ * @param value - The value.
+ */
+void latencyHistogramRecord(LatencyHistogram* histogram,
+                            unsigned long long value);
+
+/**
+ ***** Function: latencyHistogramPercentile *****
+ * Description: Returns an upper bound of the value below which a given
+ * percentage of the recorded values fall. The bound is the end of the
+ * bucket holding the percentile, but never more than the largest value.
+ *
+ * @param histogram - The histogram.
+ * @param percentile - Percentage between 0 and 100.
+ *
+ * @return
+ * 0 if the histogram is empty.
+ * The percentile otherwise.
+ */
+unsigned long long latencyHistogramPercentile(const LatencyHistogram*
+                                              histogram, double percentile);
+
+/**
+ ***** Function: latencyHistogramBucketStart *****
+ * Description: Returns the smallest value counted in a bucket.
+ *
+ * @param bucket - Index of the bucket.
+ *
+ * @return
+ * The smallest value of the bucket.
+ */
+unsigned long long latencyHistogramBucketStart(int bucket);
+
+/**
+ ***** Function: latencyNow *****
+ * Description: Returns a monotonic time stamp in nanoseconds, for measuring
+ * latencies.
+ *
+ * @return
+ * The current time in nanoseconds.
+ */
+unsigned long long latencyNow(void);
+
+#endif //MTM_EX3_LATENCY_HISTOGRAM_H
@@ -5,7 +5,10 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "map_mtm.h"
+#include "map_trace.h"
+#include "set_mtm.h"
 #include "test_utilities.h"
 
 
@@ -25,6 +28,173 @@ static int compareInt(MapKeyElement a, MapKeyElement b) {
     return *(int *) a - *(int *) b;
 }
 
+static unsigned long hashInt(MapKeyElement e) {
+    return (unsigned long) *(int *) e;
+}
+
+static int compare_calls = 0;
+
+static int compareIntCounted(MapKeyElement a, MapKeyElement b) {
+    compare_calls++;
+    return compareInt(a, b);
+}
+
+
+static bool isIntAbove(MapKeyElement key, MapDataElement data, void *context) {
+    return *(int *) key > *(int *) context;
+}
+
+static void sumIntData(void *accumulator, MapKeyElement key, MapDataElement data, void *context) {
+    *(long *) accumulator += *(int *) data;
+}
+
+static void sumLongs(void *result, void *accumulator, void *context) {
+    *(long *) result += *(long *) accumulator;
+}
+
+static void incrementIntData(MapKeyElement key, MapDataElement data, void *context) {
+    *(int *) data += 1;
+}
+
+static void addToInt(MapDataElement data, void *context) {
+    *(int *) data += *(int *) context;
+}
+
+static void countEntries(MapKeyElement key, MapDataElement data, void *context) {
+    *(int *) context += 1;
+}
+
+static size_t sizeInt(MapKeyElement e) {
+    return sizeof(int);
+}
+
+static int data_copies = 0;
+static int live_data = 0;
+
+static MapDataElement copyIntCounted(MapDataElement e) {
+    data_copies++;
+    live_data++;
+    return copyInt(e);
+}
+
+static void freeIntCounted(MapDataElement e) {
+    live_data--;
+    freeInt(e);
+}
+
+/* Marks an entry of an array of expected values (indexed by key) as seen,
+ * if the entry's data is the expected value. */
+static void markExpectedValue(MapKeyElement key, MapDataElement data, void *context) {
+    int *expected = context;
+    if (expected[*(int *) key] == *(int *) data) {
+        expected[*(int *) key] = -2;
+    }
+}
+
+static bool fail_copies_of_777 = false;
+
+static MapDataElement copyIntFailingOn777(MapDataElement e) {
+    return fail_copies_of_777 && *(int *) e == 777 ? NULL : copyInt(e);
+}
+
+static bool equalInts(MapDataElement a, MapDataElement b) {
+    return *(int *) a == *(int *) b;
+}
+
+static bool writeInt(void *e, FILE *file) {
+    return fwrite(e, sizeof(int), 1, file) == 1;
+}
+
+static void *readInt(FILE *file) {
+    int value;
+    if (fread(&value, sizeof(int), 1, file) != 1) return NULL;
+    return copyInt(&value);
+}
+
+typedef struct {
+    size_t used;
+    size_t budget;
+} MemoryBudget;
+
+typedef struct {
+    Map map;
+    int stop;
+    int errors;
+} ConcurrentReadState;
+
+static void checkSortedEntry(MapKeyElement key, MapDataElement data, void *context) {
+    int *last = context;
+    if (*(int *) key <= *last || *(int *) data != *(int *) key) {
+        *last = 1 << 30; // Makes the check fail.
+        return;
+    }
+    *last = *(int *) key;
+}
+
+typedef struct {
+    Map source;
+    Map mirror;
+    unsigned long long applied; // Changes applied to the mirror.
+    int stop;
+    int gaps;
+} MirrorState;
+
+static void *mirrorChanges(void *context) {
+    MirrorState *state = context;
+    MapChange changes[64];
+    for (;;) {
+        int stop = __atomic_load_n(&state->stop, __ATOMIC_ACQUIRE);
+        int taken = mapDrainChanges(state->source, changes, 64);
+        for (int i = 0; i < taken; i++) {
+            state->gaps += changes[i].sequence != state->applied;
+            if (changes[i].type == MAP_CHANGE_PUT) {
+                mapPut(state->mirror, changes[i].key, changes[i].data);
+            } else if (changes[i].type == MAP_CHANGE_REMOVE) {
+                mapRemove(state->mirror, changes[i].key);
+            } else {
+                mapClear(state->mirror);
+            }
+            __atomic_store_n(&state->applied, changes[i].sequence + 1, __ATOMIC_RELEASE);
+        }
+        mapFreeChanges(state->source, changes, taken);
+        if (stop && taken == 0) {
+            return NULL;
+        }
+    }
+}
+
+static void *concurrentReader(void *context) {
+    ConcurrentReadState *state = context;
+    MapReader reader = mapReaderCreate(state->map);
+    int errors = reader == NULL;
+    for (int round = 0; reader && !__atomic_load_n(&state->stop, __ATOMIC_ACQUIRE); round++) {
+        mapReadBegin(reader);
+        int key = round % 200;
+        int *data = mapReaderGet(reader, &key);
+        errors += data != NULL && *data != key;
+        if (round % 50 == 0) {
+            int last = -1;
+            mapReaderForEach(reader, checkSortedEntry, &last);
+            errors += last == 1 << 30;
+        }
+        mapReadEnd(reader);
+    }
+    mapReaderDestroy(reader);
+    __atomic_fetch_add(&state->errors, errors, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void *allocateFromBudget(size_t size, void *context) {
+    MemoryBudget *budget = context;
+    if (budget->used + size > budget->budget) return NULL;
+    budget->used += size;
+    return malloc(size);
+}
+
+static void freeToBudget(void *memory, size_t size, void *context) {
+    ((MemoryBudget *) context)->used -= size;
+    free(memory);
+}
 
 //The tests block
 static int createDestroyTest(int *tests_passed) {
@@ -212,6 +382,14 @@ static int mapClearTest(int *tests_passed) {
     test( mapClear(NULL) != MAP_NULL_ARGUMENT ,__LINE__, &test_number, "mapClear doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
     test( mapClear(map) != MAP_SUCCESS , __LINE__, &test_number, "mapClear doesn't return MAP_SUCCESS after clear", tests_passed);
     test( mapContains(map, &a[0]) == true, __LINE__, &test_number, "mapClear doesn't remove elements from the map", tests_passed);
+    test( mapGetSize(map) != 0, __LINE__, &test_number, "mapClear doesn't reset the size of the map", tests_passed);
+    for (int i = 0; i < 6; i++) {
+        mapPut(map, &a[i], &a[i]);
+    }
+    test( mapClearStep(NULL, 1) != -1, __LINE__, &test_number, "mapClearStep doesn't return -1 on NULL map input", tests_passed);
+    test( mapClearStep(map, 4) != 2, __LINE__, &test_number, "mapClearStep doesn't remove exactly budget elements", tests_passed);
+    test( mapContains(map, &a[0]) || !mapContains(map, &a[5]), __LINE__, &test_number, "mapClearStep doesn't remove the smallest keys first", tests_passed);
+    test( mapClearStep(map, 4) != 0, __LINE__, &test_number, "mapClearStep doesn't empty the map", tests_passed);
     _print_test_success(test_number);
     *tests_passed += 1;
     mapDestroy(map);
@@ -241,6 +419,1312 @@ static int mapGetTest(int *tests_passed) {
     return test_number;
 }
 
+static int mapLRUTest(int *tests_passed) {
+    _print_mode_name("Testing mapCreateLRU function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    int a[6] = {0, 1, 2, 3, 4, 5};
+    test( mapCreateLRU(0, copyInt, copyInt, freeInt, freeInt, compareInt) != NULL, __LINE__, &test_number, "mapCreateLRU doesn't return NULL on non positive capacity", tests_passed);
+    Map map = mapCreateLRU(2, copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( map == NULL, __LINE__, &test_number, "mapCreateLRU returns NULL on valid input", tests_passed);
+    mapPut(map, &a[0], &a[1]);
+    mapPut(map, &a[2], &a[3]);
+    mapGet(map, &a[0]);                                 // a[2] is now the least recently used key.
+    mapPut(map, &a[4], &a[5]);
+    test( mapGetSize(map) != 2, __LINE__, &test_number, "mapPut doesn't keep the map within its capacity", tests_passed);
+    test( mapContains(map, &a[2]), __LINE__, &test_number, "mapPut doesn't evict the least recently used key", tests_passed);
+    test( !mapContains(map, &a[0]), __LINE__, &test_number, "mapPut evicts a recently used key", tests_passed);
+    mapGet(map, &a[2]);
+    long hits = 0, misses = 0, evictions = 0;
+    test( mapGetCacheStatistics(NULL, &hits, &misses, &evictions) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapGetCacheStatistics doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
+    mapGetCacheStatistics(map, &hits, &misses, &evictions);
+    test( hits != 1 || misses != 1 || evictions != 1, __LINE__, &test_number, "mapGetCacheStatistics doesn't count hits, misses and evictions", tests_passed);
+    mapDestroy(map);
+    map = mapCreateLRU(40, copyInt, copyInt, freeInt, freeInt, compareInt);
+    Map unbounded = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    int keys[40];
+    size_t growth[2][2];
+    for(int i = 0; i < 40; i++){
+        keys[i] = i;
+        mapPut(map, &keys[i], &keys[i]);
+        mapPut(unbounded, &keys[i], &keys[i]);
+        if(i == 19 || i == 39){
+            mapGetMemoryUsage(map, NULL, NULL, &growth[0][i / 20], NULL);
+            mapGetMemoryUsage(unbounded, NULL, NULL, &growth[1][i / 20], NULL);
+        }
+    }
+    test( (growth[0][1] - growth[0][0]) - (growth[1][1] - growth[1][0]) != 20 * 2 * sizeof(void*), __LINE__, &test_number, "Only the nodes of a bounded map should have recency links", tests_passed);
+    mapCompact(map, NULL);
+    mapGet(map, &keys[0]);
+    int new_key = 40;
+    mapPut(map, &new_key, &new_key);                    // Evicts keys[1].
+    test( mapGetSize(map) != 40 || mapContains(map, &keys[1]) || !mapContains(map, &keys[0]), __LINE__, &test_number, "mapCompact breaks the recency list", tests_passed);
+    mapDestroy(unbounded);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapTTLTest(int *tests_passed) {
+    _print_mode_name("Testing mapPutWithTTL function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    int a[6] = {0, 1, 2, 3, 4, 5};
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapPutWithTTL(NULL, &a[0], &a[1], 1000) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapPutWithTTL doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
+    test( mapPutWithTTL(map, &a[0], &a[1], 100000) != MAP_SUCCESS, __LINE__, &test_number, "mapPutWithTTL doesn't return MAP_SUCCESS on valid input", tests_passed);
+    test( !mapContains(map, &a[0]), __LINE__, &test_number, "mapPutWithTTL entry isn't found before it expires", tests_passed);
+    mapPutWithTTL(map, &a[2], &a[3], 0);
+    mapPut(map, &a[4], &a[5]);
+    test( mapGet(map, &a[2]) != NULL, __LINE__, &test_number, "mapGet returns an expired entry", tests_passed);
+    int count = 0;
+    MAP_FOREACH(int*, i, map) {
+        count++;
+    }
+    test( count != 2, __LINE__, &test_number, "Iteration doesn't skip expired entries", tests_passed);
+    mapReclaimExpired(map, 16);
+    test( mapGetSize(map) != 2, __LINE__, &test_number, "mapReclaimExpired doesn't free expired entries", tests_passed);
+    mapPutWithTTL(map, &a[4], &a[5], 0);
+    mapPut(map, &a[4], &a[1]);
+    test( !mapContains(map, &a[4]), __LINE__, &test_number, "mapPut doesn't make an entry permanent", tests_passed);
+    mapDestroy(map);
+    map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    MapHint hint = MAP_HINT_INITIALIZER;
+    int keys[21];
+    for (int i = 0; i < 20; i++) {
+        keys[i] = 2 * i;
+        mapPutHint(map, &hint, &keys[i], &keys[i]);
+    }
+    keys[20] = 1;
+    test( mapPutWithTTL(map, &keys[20], &keys[20], 100000) != MAP_SUCCESS, __LINE__, &test_number, "mapPutWithTTL fails on a map of permanent nodes", tests_passed);
+    int previous = -1;
+    count = 0;
+    MAP_FOREACH(int*, key, map) {
+        count += *key > previous && *(int*)mapGet(map, key) == *key;
+        previous = *key;
+    }
+    test( count != 21, __LINE__, &test_number, "The first TTL entry loses the order of the map", tests_passed);
+    test( mapPutHint(map, &hint, &a[3], &a[3]) != MAP_SUCCESS || mapGetSize(map) != 22, __LINE__, &test_number, "mapPutHint follows a hint to a moved node", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapBloomFilterTest(int *tests_passed) {
+    _print_mode_name("Testing mapSetBloomFilter function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    int a[6] = {0, 1, 2, 3, 4, 5};
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    mapPut(map, &a[0], &a[1]);
+    test( mapSetBloomFilter(NULL, hashInt) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapSetBloomFilter doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
+    test( mapSetBloomFilter(map, hashInt) != MAP_SUCCESS, __LINE__, &test_number, "mapSetBloomFilter doesn't return MAP_SUCCESS on valid input", tests_passed);
+    mapPut(map, &a[2], &a[3]);
+    test( !mapContains(map, &a[0]) || !mapContains(map, &a[2]), __LINE__, &test_number, "mapContains misses a key when a Bloom filter is set", tests_passed);
+    test( mapContains(map, &a[4]), __LINE__, &test_number, "mapContains finds an absent key when a Bloom filter is set", tests_passed);
+    for (int i = 0; i < 1000; i++) {
+        mapPut(map, &i, &i);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        mapRemove(map, &i);
+    }
+    bool found_all = true;
+    for (int i = 1; i < 1000; i += 2) {
+        found_all = found_all && mapContains(map, &i);
+    }
+    test( !found_all, __LINE__, &test_number, "mapContains misses a key after the Bloom filter was rebuilt", tests_passed);
+    double rate = 1;
+    size_t bytes = 0;
+    mapGetBloomFilterStatistics(map, &rate, &bytes);
+    test( rate >= 0.5 || bytes == 0, __LINE__, &test_number, "mapGetBloomFilterStatistics doesn't report the filter", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapRemoveIfTest(int *tests_passed) {
+    _print_mode_name("Testing mapRemoveIf function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    int a[6] = {0, 1, 2, 3, 4, 5};
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    for (int i = 0; i < 6; i++) {
+        mapPut(map, &a[i], &a[i]);
+    }
+    test( mapRemoveIf(NULL, isIntAbove, &a[2]) != -1, __LINE__, &test_number, "mapRemoveIf doesn't return -1 on NULL map input", tests_passed);
+    test( mapRemoveIf(map, NULL, &a[2]) != -1, __LINE__, &test_number, "mapRemoveIf doesn't return -1 on NULL predicate input", tests_passed);
+    test( mapRemoveIf(map, isIntAbove, &a[2]) != 3, __LINE__, &test_number, "mapRemoveIf doesn't return the number of removed entries", tests_passed);
+    test( mapGetSize(map) != 3 || mapContains(map, &a[3]) || !mapContains(map, &a[2]), __LINE__, &test_number, "mapRemoveIf doesn't remove exactly the matching entries", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapParallelTest(int *tests_passed) {
+    _print_mode_name("Testing mapParallelForEach/mapParallelReduce functions");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    for (int i = 0; i < 1000; i++) {
+        mapPut(map, &i, &i);
+    }
+    long sum = 0;
+    test( mapParallelReduce(NULL, sumIntData, sumLongs, &sum, sizeof(sum), NULL, 4) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapParallelReduce doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
+    test( mapParallelReduce(map, sumIntData, sumLongs, &sum, sizeof(sum), NULL, 4) != MAP_SUCCESS, __LINE__, &test_number, "mapParallelReduce doesn't return MAP_SUCCESS on valid input", tests_passed);
+    test( sum != 999 * 1000 / 2, __LINE__, &test_number, "mapParallelReduce doesn't fold every entry exactly once", tests_passed);
+    test( mapParallelForEach(map, NULL, NULL, 4) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapParallelForEach doesn't return MAP_NULL_ARGUMENT on NULL function input", tests_passed);
+    mapParallelForEach(map, incrementIntData, NULL, 1000000);         // Bounded by the processors.
+    sum = 0;
+    mapParallelReduce(map, sumIntData, sumLongs, &sum, sizeof(sum), NULL, 7);
+    test( sum != 999 * 1000 / 2 + 1000, __LINE__, &test_number, "mapParallelForEach doesn't visit every entry exactly once", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapComputeTest(int *tests_passed) {
+    _print_mode_name("Testing mapCompute function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    int a[6] = {0, 1, 2, 3, 4, 5};
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapCompute(NULL, &a[0], addToInt, &a[1], NULL) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapCompute doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
+    test( mapCompute(map, &a[0], addToInt, &a[1], NULL) != MAP_ITEM_DOES_NOT_EXIST, __LINE__, &test_number, "mapCompute doesn't return MAP_ITEM_DOES_NOT_EXIST on missing key without default", tests_passed);
+    test( mapCompute(map, &a[2], addToInt, &a[1], &a[0]) != MAP_SUCCESS, __LINE__, &test_number, "mapCompute doesn't return MAP_SUCCESS when inserting a default", tests_passed);
+    mapCompute(map, &a[2], addToInt, &a[4], &a[0]);
+    test( mapGet(map, &a[2]) == NULL || *(int *) mapGet(map, &a[2]) != 5, __LINE__, &test_number, "mapCompute doesn't modify the data in place", tests_passed);
+    mapCompute(map, &a[0], addToInt, &a[1], &a[3]);
+    mapCompute(map, &a[4], addToInt, &a[1], &a[3]);
+    bool ordered = true;
+    int k = 0;
+    MAP_FOREACH(int*, i, map) {
+        if((a[k] != *i)) {
+            ordered = false;
+            break;
+        }
+        k+=2;
+    }
+    test( !ordered || mapGetSize(map) != 3, __LINE__, &test_number, "mapCompute doesn't insert defaults in order", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapPutHintTest(int *tests_passed) {
+    _print_mode_name("Testing mapPutHint function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    int a[6] = {0, 1, 2, 3, 4, 5};
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    MapHint hint = MAP_HINT_INITIALIZER;
+    test( mapPutHint(NULL, &hint, &a[0], &a[1]) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapPutHint doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
+    for (int i = 0; i < 1000; i += 2) {
+        mapPutHint(map, &hint, &i, &i);
+    }
+    for (int i = 999; i > 0; i -= 2) {
+        mapPutHint(map, &hint, &i, &i);
+    }
+    test( mapPutHint(map, &hint, &a[4], &a[1]) != MAP_SUCCESS, __LINE__, &test_number, "mapPutHint doesn't return MAP_SUCCESS on existing key", tests_passed);
+    mapRemove(map, &a[4]);
+    mapPutHint(map, &hint, &a[4], &a[4]);                 // The hint is outdated here.
+    bool ordered = true;
+    int k = 0;
+    MAP_FOREACH(int*, i, map) {
+        if(k++ != *i) {
+            ordered = false;
+            break;
+        }
+    }
+    test( !ordered || mapGetSize(map) != 1000, __LINE__, &test_number, "mapPutHint doesn't order the keys correctly", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapStringKeyedTest(int *tests_passed) {
+    _print_mode_name("Testing string keyed maps and mapPrefixScan");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    int a[3] = {0, 1, 2};
+    Map map = mapCreateStringKeyed(copyInt, freeInt);
+    Map int_map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapCreateStringKeyed(NULL, freeInt) != NULL, __LINE__, &test_number, "mapCreateStringKeyed doesn't return NULL on NULL input", tests_passed);
+    mapPut(map, "/usr/bin/ls", &a[0]);
+    mapPut(map, "/usr/bin/cat", &a[1]);
+    mapPut(map, "/usr/lib", &a[2]);
+    mapPut(map, "/usr", &a[2]);
+    mapPut(map, "", &a[0]);
+    char key[32];
+    for (int i = 0; i < 500; i++) {
+        sprintf(key, "/var/log/%d", i * 7919 % 500);
+        mapPut(map, key, &i);
+    }
+    test( mapGetSize(map) != 505 || *(int *) mapGet(map, "/usr/bin/cat") != 1, __LINE__, &test_number, "mapGet doesn't find string keys", tests_passed);
+    test( mapContains(map, "/usr/bin") || mapGet(map, "/usr/bin/cat/") != NULL, __LINE__, &test_number, "mapContains finds a missing string key", tests_passed);
+    bool ordered = true;
+    char* previous = NULL;
+    MAP_FOREACH(char*, k, map) {
+        if(previous && strcmp(previous, k) >= 0) {
+            ordered = false;
+        }
+        previous = k;
+    }
+    test( !ordered, __LINE__, &test_number, "string keys aren't ordered like strcmp", tests_passed);
+    int count = 0;
+    test( mapPrefixScan(map, "/usr/bin/", countEntries, &count) != 2 || count != 2, __LINE__, &test_number, "mapPrefixScan doesn't visit the matching keys", tests_passed);
+    test( mapPrefixScan(map, "/var/log/4", countEntries, &count) != 111, __LINE__, &test_number, "mapPrefixScan doesn't visit the matching keys", tests_passed);
+    test( mapPrefixScan(map, "/usr/bin/lsx", countEntries, &count) != 0, __LINE__, &test_number, "mapPrefixScan visits keys without the prefix", tests_passed);
+    test( mapPrefixScan(map, "", countEntries, &count) != 505, __LINE__, &test_number, "mapPrefixScan doesn't visit every key on an empty prefix", tests_passed);
+    test( mapPrefixScan(int_map, "", countEntries, &count) != -1, __LINE__, &test_number, "mapPrefixScan doesn't return -1 on a map which isn't string keyed", tests_passed);
+    mapRemove(map, "/usr/bin/ls");
+    mapRemove(map, "/var/log/250");
+    test( mapContains(map, "/usr/bin/ls") || mapPrefixScan(map, "/usr", countEntries, &count) != 3, __LINE__, &test_number, "mapRemove doesn't remove string keys", tests_passed);
+    Map copy = mapCopy(map);
+    test( mapPrefixScan(copy, "/var/log/25", countEntries, &count) != 10 || !mapContains(copy, "/usr/lib"), __LINE__, &test_number, "mapCopy doesn't copy a string keyed map", tests_passed);
+    mapClear(copy);
+    mapPut(copy, "/a", &a[0]);
+    test( mapPrefixScan(copy, "/", countEntries, &count) != 1, __LINE__, &test_number, "mapClear doesn't clear a string keyed map", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(copy);
+    mapDestroy(int_map);
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapKeyFingerprintTest(int *tests_passed) {
+    _print_mode_name("Testing mapSetKeyFingerprint function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareIntCounted);
+    test( mapSetKeyFingerprint(NULL, hashInt) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapSetKeyFingerprint doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
+    for (int i = 0; i < 500; i++) {
+        mapPut(map, &i, &i);
+    }
+    test( mapSetKeyFingerprint(map, hashInt) != MAP_SUCCESS, __LINE__, &test_number, "mapSetKeyFingerprint doesn't return MAP_SUCCESS", tests_passed);
+    for (int i = 500; i < 1000; i++) {
+        mapPut(map, &i, &i);
+    }
+    compare_calls = 0;
+    bool found = true;
+    for (int i = 0; i < 1000; i += 10) {
+        found = found && mapGet(map, &i) && *(int *) mapGet(map, &i) == i;
+    }
+    test( !found || compare_calls != 200, __LINE__, &test_number, "mapGet doesn't compare only keys with a matching fingerprint", tests_passed);
+    int missing = 1000;
+    compare_calls = 0;
+    test( mapContains(map, &missing) || compare_calls != 0, __LINE__, &test_number, "mapContains compares keys with a different fingerprint", tests_passed);
+    int removed = 123, last = 999, first = 0;
+    test( mapRemove(map, &removed) != MAP_SUCCESS || mapGet(map, &removed) != NULL, __LINE__, &test_number, "mapRemove doesn't remove a fingerprinted key", tests_passed);
+    Map copy = mapCopy(map);
+    compare_calls = 0;
+    test( copy == NULL || !mapContains(copy, &last) || compare_calls != 1, __LINE__, &test_number, "mapCopy doesn't keep the fingerprints", tests_passed);
+    int middle = 500;
+    compare_calls = 0;
+    test( mapCompact(map, NULL) != MAP_SUCCESS || !mapContains(map, &last) || mapRemove(map, &middle) != MAP_SUCCESS ||
+          mapContains(map, &middle) || compare_calls != 2, __LINE__, &test_number, "The fingerprints don't follow mapCompact", tests_passed);
+    mapSetKeyFingerprint(map, NULL);
+    test( !mapContains(map, &first), __LINE__, &test_number, "mapContains fails without fingerprints", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(copy);
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapSmallMapTest(int *tests_passed) {
+    _print_mode_name("Testing small maps growing into big ones");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    for (int i = 15; i >= 0; i--) {
+        mapPut(map, &i, &i);
+    }
+    int a[3] = {3, 16, 100};
+    int count = 0;
+    test( mapGetSize(map) != 16 || *(int *) mapGet(map, &a[0]) != 3 || mapGet(map, &a[1]) != NULL, __LINE__, &test_number, "mapGet fails on a small map", tests_passed);
+    test( mapRemoveIf(map, isIntAbove, &a[0]) != 12 || mapRemove(map, &a[0]) != MAP_SUCCESS, __LINE__, &test_number, "mapRemoveIf fails on a small map", tests_passed);
+    mapCompute(map, &a[2], addToInt, &a[2], &a[0]);
+    test( *(int *) mapGet(map, &a[2]) != 103, __LINE__, &test_number, "mapCompute fails on a small map", tests_passed);
+    mapParallelForEach(map, countEntries, &count, 4);
+    test( count != 4, __LINE__, &test_number, "mapParallelForEach fails on a small map", tests_passed);
+    mapGetFirst(map);
+    int *second = mapGetNext(map);
+    mapSetKeyFingerprint(map, hashInt);                   // Needs nodes, the iterator stays.
+    int *third = mapGetNext(map);
+    test( *second != 1 || *third != 2, __LINE__, &test_number, "the iterator moves when a small map grows", tests_passed);
+    mapClear(map);
+    mapSetKeyFingerprint(map, NULL);
+    for (int i = 0; i < 40; i++) {
+        mapPut(map, &i, &i);
+    }
+    int k = 0;
+    bool ordered = true;
+    MAP_FOREACH(int*, i, map) {
+        ordered = ordered && *i == k++;
+    }
+    test( !ordered || k != 40 || *(int *) mapGet(map, &a[1]) != 16, __LINE__, &test_number, "a small map doesn't keep its entries when it grows", tests_passed);
+    Map copy = mapCopy(map);
+    mapClearStep(map, 35);
+    Map small_copy = mapCopy(map);
+    test( mapGetSize(copy) != 40 || mapGetSize(small_copy) != 5 || *(int *) mapGetFirst(small_copy) != 35, __LINE__, &test_number, "mapCopy fails on small maps", tests_passed);
+    int sizes[] = {0, 1, 8, 16};
+    bool lean = true;
+    for (int i = 0; i < 4; i++) {
+        Map sized = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+        for (int j = 0; j < sizes[i]; j++) {
+            mapPut(sized, &j, &j);
+        }
+        size_t structure = 0;
+        mapGetMemoryUsage(sized, NULL, NULL, &structure, NULL);
+        lean = lean && structure <= 64 + 24 * (size_t) sizes[i];    // The list head and nodes the map started with.
+        mapDestroy(sized);
+    }
+    test( !lean, __LINE__, &test_number, "small maps take more memory than the original list", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(small_copy);
+    mapDestroy(copy);
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapFreezeTest(int *tests_passed) {
+    _print_mode_name("Testing mapFreeze and mapThaw functions");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapFreeze(NULL) != MAP_NULL_ARGUMENT || mapThaw(NULL) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapFreeze doesn't return MAP_NULL_ARGUMENT on NULL map input", tests_passed);
+    for (int i = 0; i < 100; i++) {
+        mapPut(map, &i, &i);
+    }
+    int a[4] = {-1, 42, 100, 150};
+    mapPutWithTTL(map, &a[0], &a[0], 0);                  // Expired before freezing.
+    mapPutWithTTL(map, &a[3], &a[3], 100000);
+    test( mapFreeze(map) != MAP_SUCCESS || mapGetSize(map) != 101, __LINE__, &test_number, "mapFreeze fails", tests_passed);
+    bool found = true;
+    for (int i = 0; i < 100; i++) {
+        found = found && mapContains(map, &i) && *(int *) mapGet(map, &i) == i;
+    }
+    test( !found || mapGet(map, &a[2]) != NULL || mapContains(map, &a[0]) || *(int *) mapGet(map, &a[3]) != 150, __LINE__, &test_number, "mapGet fails on a frozen map", tests_passed);
+    test( mapPut(map, &a[2], &a[2]) != MAP_FROZEN || mapRemove(map, &a[1]) != MAP_FROZEN || mapClear(map) != MAP_FROZEN, __LINE__, &test_number, "a frozen map can be modified", tests_passed);
+    test( mapRemoveIf(map, isIntAbove, &a[1]) != -1 || mapCompute(map, &a[1], addToInt, &a[1], NULL) != MAP_FROZEN, __LINE__, &test_number, "a frozen map can be modified", tests_passed);
+    int k = 0;
+    bool ordered = true;
+    MAP_FOREACH(int*, i, map) {
+        ordered = ordered && *i == (k < 100 ? k : 150);
+        k++;
+    }
+    test( !ordered || k != 101, __LINE__, &test_number, "MAP_FOREACH doesn't iterate a frozen map in order", tests_passed);
+    long sum = 0;
+    mapParallelReduce(map, sumIntData, sumLongs, &sum, sizeof(sum), NULL, 3);
+    test( sum != 4950 + 150, __LINE__, &test_number, "mapParallelReduce fails on a frozen map", tests_passed);
+    Map copy = mapCopy(map);
+    test( copy == NULL || mapPut(copy, &a[2], &a[2]) != MAP_SUCCESS || mapGetSize(copy) != 102, __LINE__, &test_number, "mapCopy of a frozen map isn't modifiable", tests_passed);
+    test( mapThaw(map) != MAP_SUCCESS || mapPut(map, &a[2], &a[2]) != MAP_SUCCESS || mapGetSize(map) != 102, __LINE__, &test_number, "mapThaw doesn't make the map modifiable", tests_passed);
+    test( *(int *) mapGet(map, &a[1]) != 42 || !mapContains(map, &a[3]), __LINE__, &test_number, "mapThaw doesn't keep the entries", tests_passed);
+    mapDestroy(copy);
+    copy = mapCreateStringKeyed(copyInt, freeInt);
+    mapPut(copy, "/b/1", &a[1]);
+    mapPut(copy, "/a/2", &a[2]);
+    mapPut(copy, "/b/3", &a[3]);
+    mapFreeze(copy);
+    int count = 0;
+    test( mapPrefixScan(copy, "/b/", countEntries, &count) != 2, __LINE__, &test_number, "mapPrefixScan fails on a frozen map", tests_passed);
+    Map small = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    mapPut(small, &a[1], &a[1]);
+    mapFreeze(small);
+    test( mapThaw(small) != MAP_SUCCESS || mapPut(small, &a[2], &a[2]) != MAP_SUCCESS || *(int *) mapGetFirst(small) != 42, __LINE__, &test_number, "mapThaw fails on a small map", tests_passed);
+    mapDestroy(small);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(copy);
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapAllocatorTest(int *tests_passed) {
+    _print_mode_name("Testing mapCreateWithAllocator and mapGetMemoryUsage functions");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    MemoryBudget budget = {0, 1 << 20};
+    Map map = mapCreateWithAllocator(copyInt, copyInt, freeInt, freeInt, compareInt, allocateFromBudget, NULL, &budget);
+    test( map != NULL || mapGetMemoryUsage(NULL, NULL, NULL, NULL, NULL) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapCreateWithAllocator accepts a single hook", tests_passed);
+    map = mapCreateWithAllocator(copyInt, copyInt, freeInt, freeInt, compareInt, allocateFromBudget, freeToBudget, &budget);
+    for (int i = 0; i < 100; i++) {
+        mapPut(map, &i, &i);
+    }
+    int a[2] = {100, 101};
+    mapPutWithTTL(map, &a[0], &a[0], 100000);
+    mapSetBloomFilter(map, hashInt);
+    size_t structure = 0, elements = 0;
+    mapGetMemoryUsage(map, sizeInt, sizeInt, &structure, &elements);
+    test( budget.used == 0 || structure != budget.used || elements != 101 * 2 * sizeof(int), __LINE__, &test_number, "mapGetMemoryUsage doesn't match the allocator", tests_passed);
+    budget.budget = budget.used;
+    test( mapPut(map, &a[1], &a[1]) != MAP_OUT_OF_MEMORY || mapGetSize(map) != 101 || mapPut(map, &a[0], &a[1]) != MAP_SUCCESS, __LINE__, &test_number, "mapPut exceeds the allocator's budget", tests_passed);
+    budget.budget = 1 << 20;
+    mapGetMemoryUsage(map, NULL, NULL, &structure, NULL);
+    Map copy = mapCopy(map);
+    size_t copy_structure = 0;
+    mapGetMemoryUsage(copy, NULL, NULL, &copy_structure, NULL);
+    test( copy == NULL || budget.used != structure + copy_structure, __LINE__, &test_number, "mapCopy doesn't use the allocator", tests_passed);
+    mapFreeze(copy);
+    mapDestroy(copy);
+    test( budget.used != structure, __LINE__, &test_number, "mapDestroy doesn't give the memory back", tests_passed);
+    mapDestroy(map);
+    test( budget.used != 0, __LINE__, &test_number, "mapDestroy doesn't give the memory back", tests_passed);
+    Map strings = mapCreateStringKeyed(copyInt, freeInt);
+    mapPut(strings, "abc", &a[0]);
+    mapPut(strings, "de", &a[1]);
+    mapGetMemoryUsage(strings, NULL, sizeInt, NULL, &elements);
+    test( elements != 4 + 3 + 2 * sizeof(int), __LINE__, &test_number, "mapGetMemoryUsage doesn't measure string keys", tests_passed);
+    mapDestroy(strings);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
+static int mapTraceTest(int *tests_passed) {
+    _print_mode_name("Testing mapTraceStart and mapTraceStop functions");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    const char *path = "map_trace_test.bin";
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapTraceStart(map, path, NULL) != MAP_NULL_ARGUMENT || mapTraceStart(map, "/no/such/dir/trace", hashInt) != MAP_IO_ERROR, __LINE__, &test_number, "mapTraceStart doesn't fail on bad arguments", tests_passed);
+    test( mapTraceStart(map, path, hashInt) != MAP_SUCCESS, __LINE__, &test_number, "mapTraceStart fails", tests_passed);
+    int a[3] = {5, 1000000, -7};
+    for (int i = 0; i < 3; i++) {
+        mapPut(map, &a[i], &a[i]);
+    }
+    mapGet(map, &a[1]);
+    mapContains(map, &a[0]);
+    int one = 1, b = 8;
+    mapCompute(map, &b, addToInt, &one, &b);                    // Adds b like a put.
+    mapCompute(map, &a[0], addToInt, &one, NULL);               // Keeps the keys like a get.
+    MAP_FOREACH(int*, i, map) {
+    }
+    mapRemove(map, &a[2]);
+    mapClear(map);
+    test( mapTraceStop(map) != MAP_SUCCESS, __LINE__, &test_number, "mapTraceStop fails", tests_passed);
+    mapGet(map, &a[0]); // Not traced anymore.
+    TraceOperation expected[] = {TRACE_PUT, TRACE_PUT, TRACE_PUT, TRACE_GET, TRACE_CONTAINS, TRACE_PUT, TRACE_GET, TRACE_GET_FIRST,
+                                 TRACE_GET_NEXT, TRACE_GET_NEXT, TRACE_GET_NEXT, TRACE_GET_NEXT, TRACE_REMOVE, TRACE_CLEAR};
+    unsigned long long keys[] = {5, 1000000, (unsigned long long) (unsigned long) -7, 1000000, 5, 8, 5, 0, 0, 0, 0, 0,
+                                 (unsigned long long) (unsigned long) -7, 0};
+    TraceReader reader = traceReaderCreate(path);
+    TraceOperation operation;
+    unsigned long long key = 0, time = 0, last_time = 0;
+    bool matches = reader != NULL;
+    for (int i = 0; matches && i < 14; i++) {
+        matches = traceReaderNext(reader, &operation, &key, &time) == TRACE_READ_SUCCESS && operation == expected[i] &&
+                  key == keys[i] && time >= last_time;
+        last_time = time;
+    }
+    test( !matches || traceReaderNext(reader, &operation, &key, &time) != TRACE_READ_END, __LINE__, &test_number, "The trace doesn't hold the map's operations", tests_passed);
+    traceReaderDestroy(reader);
+    remove(path);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapConcurrentReadsTest(int *tests_passed) {
+    _print_mode_name("Testing mapEnableConcurrentReads and the reader functions");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapReaderCreate(map) != NULL || mapEnableConcurrentReads(NULL) != MAP_NULL_ARGUMENT, __LINE__, &test_number, "mapReaderCreate works without concurrent reads", tests_passed);
+    Map lru = mapCreateLRU(4, copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapEnableConcurrentReads(lru) != MAP_UNSUPPORTED_MODE, __LINE__, &test_number, "mapEnableConcurrentReads accepts a bounded map", tests_passed);
+    mapDestroy(lru);
+    for (int i = 0; i < 200; i += 2) {
+        mapPut(map, &i, &i);
+    }
+    test( mapEnableConcurrentReads(map) != MAP_SUCCESS || mapPutWithTTL(map, &test_number, &test_number, 10) != MAP_UNSUPPORTED_MODE ||
+          mapSetBloomFilter(map, hashInt) != MAP_UNSUPPORTED_MODE || mapFreeze(map) != MAP_UNSUPPORTED_MODE, __LINE__, &test_number, "mapEnableConcurrentReads fails", tests_passed);
+    ConcurrentReadState state = {map, 0, 0};
+    pthread_t readers[3];
+    for (int i = 0; i < 3; i++) {
+        pthread_create(&readers[i], NULL, concurrentReader, &state);
+    }
+    int zero = 0;
+    for (int round = 0; round < 300; round++) {
+        for (int i = round % 2; i < 200; i += 2) {
+            mapPut(map, &i, &i);                            // Inserts or replaces.
+        }
+        for (int i = (round + 1) % 2; i < 200; i += 4) {
+            mapRemove(map, &i);
+        }
+        mapCompute(map, &zero, addToInt, &zero, &zero);      // Copy on write.
+        if (round % 100 == 99) {
+            mapClear(map);
+        }
+    }
+    __atomic_store_n(&state.stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < 3; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    test( state.errors != 0, __LINE__, &test_number, "Readers saw an inconsistent map", tests_passed);
+    MapReader reader = mapReaderCreate(map);
+    int key = 1;
+    mapPut(map, &key, &key);
+    mapReadBegin(reader);
+    int *data = mapReaderGet(reader, &key);
+    int other = 7;
+    mapPut(map, &key, &other);                                  // The reader still holds the old data.
+    test( data == NULL || *data != 1 || !mapReaderContains(reader, &key) || *(int *) mapReaderGet(reader, &key) != 7, __LINE__, &test_number, "mapReaderGet fails", tests_passed);
+    mapReadEnd(reader);
+    mapReaderDestroy(reader);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapChangesTest(int *tests_passed) {
+    _print_mode_name("Testing mapSubscribeChanges and mapDrainChanges functions");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    MapChange changes[8];
+    test( mapDrainChanges(map, changes, 8) != -1 || mapSubscribeChanges(map, 0) != MAP_OUT_OF_MEMORY, __LINE__, &test_number, "Draining without a subscription doesn't fail", tests_passed);
+    test( mapSubscribeChanges(map, 4) != MAP_SUCCESS, __LINE__, &test_number, "mapSubscribeChanges fails", tests_passed);
+    int keys[] = {3, 1, 3};
+    int data[] = {30, 10, 31};
+    for (int i = 0; i < 3; i++) {
+        mapPut(map, &keys[i], &data[i]);
+    }
+    mapRemove(map, &keys[1]);
+    mapRemove(map, &keys[1]);                                   // Missing, not logged.
+    int taken = mapDrainChanges(map, changes, 8);
+    bool matches = taken == 4;
+    MapChangeType types[] = {MAP_CHANGE_PUT, MAP_CHANGE_PUT, MAP_CHANGE_PUT, MAP_CHANGE_REMOVE};
+    int changed_keys[] = {3, 1, 3, 1};
+    for (int i = 0; matches && i < 4; i++) {
+        matches = changes[i].type == types[i] && changes[i].sequence == (unsigned long long) i &&
+                  *(int *) changes[i].key == changed_keys[i] && (i == 3 ? changes[i].data == NULL : *(int *) changes[i].data == data[i]);
+    }
+    mapFreeChanges(map, changes, taken);
+    test( !matches, __LINE__, &test_number, "mapDrainChanges returns wrong changes", tests_passed);
+    for (int i = 0; i < 6; i++) {
+        mapPut(map, &i, &i);                                    // Two don't fit.
+    }
+    taken = mapDrainChanges(map, changes, 8);
+    mapFreeChanges(map, changes, taken);
+    mapClear(map);
+    int after = mapDrainChanges(map, changes, 8);
+    test( taken != 4 || after != 1 || changes[0].type != MAP_CHANGE_CLEAR || changes[0].sequence != 10 || changes[0].key != NULL,
+          __LINE__, &test_number, "Lost changes don't leave a gap", tests_passed);
+    mapFreeChanges(map, changes, after);
+    mapPutWithTTL(map, &keys[1], &data[1], 0);                  // Expired before freezing.
+    mapFreeze(map);
+    taken = mapDrainChanges(map, changes, 8);
+    test( taken != 2 || changes[1].type != MAP_CHANGE_REMOVE || *(int *) changes[1].key != keys[1],
+          __LINE__, &test_number, "mapFreeze doesn't log the removal of expired entries", tests_passed);
+    mapFreeChanges(map, changes, taken);
+    mapThaw(map);
+    mapPut(map, &keys[0], &data[0]);                            // Left for mapDestroy to free.
+    mapDestroy(map);
+
+    map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    mapSubscribeChanges(map, 256);
+    MirrorState state = {map, mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt), 0, 0, 0};
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, mirrorChanges, &state);
+    int one = 1;
+    for (int round = 0; round < 2000; round++) {
+        int key = (round * 37) % 500;
+        if (round % 7 == 3) {
+            mapRemove(map, &key);
+        } else if (round % 5 == 0) {
+            mapCompute(map, &key, addToInt, &one, &key);
+        } else {
+            mapPut(map, &key, &round);
+        }
+        if (round == 1000) {
+            mapClear(map);
+        }
+        /* Never letting the buffer fill up, so no change is lost. */
+        while (mapGetPendingChanges(map) > 128) {
+        }
+    }
+    __atomic_store_n(&state.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(consumer, NULL);
+    matches = mapGetSize(map) == mapGetSize(state.mirror) && state.gaps == 0;
+    MAP_FOREACH(int*, key, map) {
+        int *mirrored = mapGet(state.mirror, key);
+        matches = matches && mirrored && *mirrored == *(int *) mapGet(map, key);
+    }
+    test( !matches, __LINE__, &test_number, "The mirror differs from the map", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(state.mirror);
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapLatencyHistogramTest(int *tests_passed) {
+    _print_mode_name("Testing latency histograms");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    LatencyHistogram histogram;
+    latencyHistogramReset(&histogram);
+    for (unsigned long long value = 1; value <= 1000; value++) {
+        latencyHistogramRecord(&histogram, value);
+    }
+    latencyHistogramRecord(&histogram, 1000000000ULL);
+    unsigned long long p50 = latencyHistogramPercentile(&histogram, 50);
+    unsigned long long p99 = latencyHistogramPercentile(&histogram, 99);
+    test( histogram.count != 1001 || histogram.min != 1 || histogram.max != 1000000000ULL || p50 < 501 || p50 > 501 + 501 / 8 ||
+          p99 < 991 || p99 > 991 + 991 / 8 || latencyHistogramPercentile(&histogram, 100) != 1000000000ULL,
+          __LINE__, &test_number, "latencyHistogramPercentile is off by more than a bucket", tests_passed);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+#ifdef MAP_LATENCY_HISTOGRAMS
+    test( mapSetLatencyHistograms(map, true) != MAP_SUCCESS, __LINE__, &test_number, "mapSetLatencyHistograms fails", tests_passed);
+    for (int i = 0; i < 100; i++) {
+        mapPut(map, &i, &i);
+        mapGet(map, &i);
+    }
+    int missing = 100;
+    int one = 1;
+    mapCompute(map, &missing, addToInt, &one, &missing);
+    mapRemove(map, &missing);
+    MAP_FOREACH(int*, key, map) {
+    }
+    Map copy = mapCopy(map);
+    mapClear(map);
+    int counts[MAP_OPERATIONS_NUMBER] = {101, 100, 1, 1, 1, 101};
+    bool matches = true;
+    for (int operation = 0; operation < MAP_OPERATIONS_NUMBER; operation++) {
+        matches = matches && mapGetLatencyHistogram(map, operation, &histogram) == MAP_SUCCESS &&
+                  histogram.count == (unsigned long long) counts[operation];
+    }
+    test( !matches || mapGetLatencyHistogram(copy, MAP_OPERATION_PUT, &histogram) != MAP_SUCCESS || histogram.count != 0,
+          __LINE__, &test_number, "mapGetLatencyHistogram returns wrong counts", tests_passed);
+    mapResetLatencyHistograms(map);
+    mapGetLatencyHistogram(map, MAP_OPERATION_GET, &histogram);
+    test( histogram.count != 0 || mapGetLatencyHistogram(map, MAP_OPERATIONS_NUMBER, &histogram) != MAP_ITEM_DOES_NOT_EXIST,
+          __LINE__, &test_number, "mapResetLatencyHistograms fails", tests_passed);
+    mapDestroy(copy);
+#else
+    test( mapSetLatencyHistograms(map, true) != MAP_UNSUPPORTED_MODE ||
+          mapGetLatencyHistogram(map, MAP_OPERATION_PUT, &histogram) != MAP_UNSUPPORTED_MODE,
+          __LINE__, &test_number, "Latency histograms work without MAP_LATENCY_HISTOGRAMS", tests_passed);
+#endif
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapCompactTest(int *tests_passed) {
+    _print_mode_name("Testing mapCompact function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    int relocated = -1;
+    test( mapCompact(NULL, &relocated) != MAP_NULL_ARGUMENT || mapCompact(map, &relocated) != MAP_SUCCESS || relocated != 0,
+          __LINE__, &test_number, "mapCompact fails on an empty map", tests_passed);
+    for (int i = 0; i < 1000; i++) {
+        int key = (i * 7919) % 1000;                            // Scattered insertion order.
+        mapPut(map, &key, &key);
+    }
+    for (int i = 0; i < 1000; i += 3) {
+        mapRemove(map, &i);
+    }
+    mapGetFirst(map);
+    mapGetNext(map);                                            // The iterator is kept by the compaction.
+    test( mapCompact(map, &relocated) != MAP_SUCCESS || relocated != mapGetSize(map) || *(int *) mapGetNext(map) != 4,
+          __LINE__, &test_number, "mapCompact fails", tests_passed);
+    int expected = 1;
+    bool matches = true;
+    MAP_FOREACH(int*, key, map) {
+        matches = matches && *key == expected && *(int *) mapGet(map, key) == expected;
+        expected += expected % 3 == 2 ? 2 : 1;
+    }
+    test( !matches || expected != 1000, __LINE__, &test_number, "mapCompact breaks the order", tests_passed);
+    for (int i = 0; i < 1000; i += 2) {
+        mapRemove(map, &i);                                     // Removing compacted nodes.
+    }
+    int key = 2000;
+    mapPut(map, &key, &key);
+    test( mapCompact(map, &relocated) != MAP_SUCCESS || relocated != mapGetSize(map) || !mapContains(map, &key),
+          __LINE__, &test_number, "mapCompact fails on a compacted map", tests_passed);
+    Map copy = mapCopy(map);
+    test( mapGetSize(copy) != mapGetSize(map), __LINE__, &test_number, "mapCopy fails on a compacted map", tests_passed);
+    mapDestroy(copy);
+    mapClear(map);
+
+    Map lru = mapCreateLRU(3, copyInt, copyInt, freeInt, freeInt, compareInt);
+    for (int i = 0; i < 3; i++) {
+        mapPut(lru, &i, &i);
+    }
+    int zero = 0;
+    mapGet(lru, &zero);                                         // 1 is now the least recently used.
+    mapCompact(lru, NULL);
+    key = 3;
+    mapPut(lru, &key, &key);
+    int one = 1;
+    test( mapContains(lru, &one) || !mapContains(lru, &zero), __LINE__, &test_number, "mapCompact breaks the recency order", tests_passed);
+    mapDestroy(lru);
+
+    Map strings = mapCreateStringKeyed(copyInt, freeInt);
+    char *words[] = {"delta", "alpha", "charlie", "bravo"};
+    for (int i = 0; i < 4; i++) {
+        mapPut(strings, words[i], &i);
+        mapPutWithTTL(map, &i, &i, i < 2 ? 0 : 100000);         // Two of them expire at once.
+    }
+    mapCompact(map, NULL);
+    mapCompact(strings, NULL);
+    mapReclaimExpired(map, 10);
+    key = 3;
+    test( mapGetSize(map) != 2 || !mapContains(map, &key) || *(int *) mapGet(strings, "charlie") != 2 ||
+          strcmp(mapGetFirst(strings), "alpha") != 0, __LINE__, &test_number, "mapCompact breaks TTLs or string keys", tests_passed);
+    mapDestroy(strings);
+    mapDestroy(map);
+    map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    mapEnableConcurrentReads(map);
+    test( mapCompact(map, NULL) != MAP_UNSUPPORTED_MODE, __LINE__, &test_number, "mapCompact works with concurrent reads", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    mapDestroy(map);
+    return test_number;
+}
+
+static int mapValueInterningTest(int *tests_passed) {
+    _print_mode_name("Testing mapSetValueInterning function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyIntCounted, copyInt, freeIntCounted, freeInt, compareInt);
+    test( mapSetValueInterning(NULL, hashInt, equalInts) != MAP_NULL_ARGUMENT ||
+          mapSetValueInterning(map, hashInt, NULL) != MAP_NULL_ARGUMENT ||
+          mapSetValueInterning(map, hashInt, equalInts) != MAP_SUCCESS,
+          __LINE__, &test_number, "mapSetValueInterning fails", tests_passed);
+    data_copies = 0;
+    for (int i = 0; i < 10; i++) {
+        int value = i % 2;
+        mapPut(map, &i, &value);                                // Small map.
+    }
+    test( data_copies != 2 || mapGet(map, &(int) {0}) != mapGet(map, &(int) {2}),
+          __LINE__, &test_number, "mapPut copies interned values", tests_passed);
+    for (int i = 10; i < 100; i++) {
+        int value = i % 2;
+        mapPut(map, &i, &value);                                // Promoted to nodes.
+    }
+    Map copy = mapCopy(map);
+    test( data_copies != 2 || live_data != 2 || mapGetSize(copy) != 100 || mapGet(copy, &(int) {98}) != mapGet(map, &(int) {0}),
+          __LINE__, &test_number, "mapCopy copies interned values", tests_passed);
+    int ten = 10;
+    mapCompute(map, &(int) {4}, addToInt, &ten, NULL);          // Computed on a private copy.
+    mapCompute(copy, &(int) {6}, addToInt, &ten, NULL);         // Interned as the same value.
+    test( *(int *) mapGet(map, &(int) {4}) != 10 || *(int *) mapGet(map, &(int) {6}) != 0 ||
+          *(int *) mapGet(copy, &(int) {4}) != 0 || mapGet(copy, &(int) {6}) != mapGet(map, &(int) {4}) || live_data != 3,
+          __LINE__, &test_number, "mapCompute modifies a shared value", tests_passed);
+    test( mapSetValueInterning(map, NULL, NULL) != MAP_UNSUPPORTED_MODE,
+          __LINE__, &test_number, "mapSetValueInterning works on a map with entries", tests_passed);
+    mapDestroy(map);
+    int one = 1;
+    mapPut(copy, &(int) {0}, &one);
+    mapRemove(copy, &(int) {6});
+    test( live_data != 2 || *(int *) mapGet(copy, &(int) {0}) != 1,
+          __LINE__, &test_number, "interned values aren't released", tests_passed);
+    mapFreeze(copy);
+    mapThaw(copy);
+    mapEnableConcurrentReads(copy);
+    mapCompute(copy, &(int) {1}, addToInt, &ten, NULL);
+    test( *(int *) mapGet(copy, &(int) {1}) != 11 || *(int *) mapGet(copy, &(int) {3}) != 1,
+          __LINE__, &test_number, "mapCompute modifies a shared value with concurrent reads", tests_passed);
+    mapDestroy(copy);
+    test( live_data != 0, __LINE__, &test_number, "interned values leak", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
+static int mapDiskTierTest(int *tests_passed) {
+    _print_mode_name("Testing mapSetDiskTier, mapFlush and mapGetDiskRuns functions");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapSetDiskTier(NULL, ".", 32, hashInt, writeInt, readInt, writeInt, readInt) != MAP_NULL_ARGUMENT ||
+          mapSetDiskTier(map, ".", 0, hashInt, writeInt, readInt, writeInt, readInt) != MAP_UNSUPPORTED_MODE ||
+          mapFlush(map) != MAP_UNSUPPORTED_MODE || mapGetDiskRuns(map) != 0 ||
+          mapSetDiskTier(map, ".", 32, hashInt, writeInt, readInt, writeInt, readInt) != MAP_SUCCESS,
+          __LINE__, &test_number, "mapSetDiskTier fails", tests_passed);
+    for (int i = 299; i >= 0; i--) {
+        int data = 2 * i;
+        mapPut(map, &i, &data);                                 // Flushed every 32 puts.
+    }
+    mapPut(map, &(int) {5}, &(int) {7});                        // Overwrites a key on disk.
+    test( mapGetSize(map) != 300 || mapGetDiskRuns(map) < 1 || *(int *) mapGet(map, &(int) {299}) != 598 ||
+          *(int *) mapGet(map, &(int) {5}) != 7 || *(int *) mapGet(map, &(int) {0}) != 0 ||
+          mapContains(map, &(int) {300}) || !mapContains(map, &(int) {150}),
+          __LINE__, &test_number, "mapGet doesn't find the entries on disk", tests_passed);
+    for (int i = 0; i < 300; i += 3) {
+        mapRemove(map, &i);
+    }
+    test( mapRemove(map, &(int) {3}) != MAP_ITEM_DOES_NOT_EXIST || mapGetSize(map) != 200 ||
+          mapContains(map, &(int) {297}) || mapGet(map, &(int) {0}) != NULL || *(int *) mapGet(map, &(int) {4}) != 8,
+          __LINE__, &test_number, "mapRemove doesn't remove the entries on disk", tests_passed);
+    mapPut(map, &(int) {3}, &(int) {1});                        // Put back over its tombstone.
+    int count = 0, last = -1;
+    bool sorted = true;
+    MAP_FOREACH(int*, key, map) {
+        sorted = sorted && *key > last && (*key % 3 != 0 || *key == 3);
+        last = *key;
+        count++;
+    }
+    test( count != 201 || !sorted, __LINE__, &test_number, "Iteration doesn't merge the memtable and the runs", tests_passed);
+    test( mapFlush(map) != MAP_SUCCESS || mapGetDiskRuns(map) < 1 || mapGetDiskRuns(map) > 3 ||
+          mapGetSize(map) != 201 || *(int *) mapGet(map, &(int) {3}) != 1 || mapContains(map, &(int) {6}),
+          __LINE__, &test_number, "mapFlush loses entries", tests_passed);
+    int *first = mapGet(map, &(int) {4});                       // Both are read from the runs.
+    int *second = mapGet(map, &(int) {8});
+    test( !first || !second || *first != 8 || *second != 16 || mapGet(map, &(int) {4}) != first,
+          __LINE__, &test_number, "Data read from disk doesn't stay valid until the map changes", tests_passed);
+    Map copy = mapCopy(map);
+    Map parallel_copy = mapCopyParallel(map, 4);
+    bool copies_match = copy && parallel_copy && mapGetSize(copy) == 201 && mapGetSize(parallel_copy) == 201;
+    for (int i = 0; copies_match && i < 300; i++) {
+        int *data = mapGet(map, &i), *copy_data = mapGet(copy, &i), *parallel_data = mapGet(parallel_copy, &i);
+        copies_match = data ? copy_data && parallel_data && *copy_data == *data && *parallel_data == *data :
+                       !copy_data && !parallel_data;
+    }
+    test( !copies_match, __LINE__, &test_number, "mapCopy of a disk tiered map differs from it", tests_passed);
+    test( mapPut(copy, &(int) {4}, &(int) {0}) != MAP_SUCCESS || mapRemove(copy, &(int) {8}) != MAP_SUCCESS ||
+          mapFlush(copy) != MAP_SUCCESS || *(int *) mapGet(map, &(int) {4}) != 8 || !mapContains(map, &(int) {8}) ||
+          *(int *) mapGet(copy, &(int) {4}) != 0 || mapContains(copy, &(int) {8}) || mapGetSize(map) != 201,
+          __LINE__, &test_number, "A copy of a disk tiered map shares its runs", tests_passed);
+    mapDestroy(copy);
+    mapDestroy(parallel_copy);
+    int threshold = 250;                                        // 33 keys above it in the runs, one more put now.
+    test( mapPut(map, &(int) {270}, &(int) {1}) != MAP_SUCCESS || mapRemoveIf(map, isIntAbove, &threshold) != 34 ||
+          mapGetSize(map) != 168 || mapContains(map, &(int) {251}) || mapContains(map, &(int) {270}) ||
+          *(int *) mapGet(map, &(int) {250}) != 500,
+          __LINE__, &test_number, "mapRemoveIf fails on a disk tiered map", tests_passed);
+    test( mapClearStep(map, 10) != 158 || mapContains(map, &(int) {13}) || *(int *) mapGetFirst(map) != 14 ||
+          mapClearStep(map, 0) != 158 || mapGetSize(map) != 158,
+          __LINE__, &test_number, "mapClearStep fails on a disk tiered map", tests_passed);
+    test( mapFreeze(map) != MAP_UNSUPPORTED_MODE ||
+          mapPutWithTTL(map, &(int) {1}, &(int) {1}, 10) != MAP_UNSUPPORTED_MODE,
+          __LINE__, &test_number, "Unsupported functions work on a disk tiered map", tests_passed);
+    mapClear(map);
+    test( mapGetSize(map) != 0 || mapGetDiskRuns(map) != 0 || mapGet(map, &(int) {4}) != NULL || mapGetFirst(map) != NULL,
+          __LINE__, &test_number, "mapClear doesn't delete the runs", tests_passed);
+    mapDestroy(map);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
+static int mapKeyCompressionTest(int *tests_passed) {
+    _print_mode_name("Testing mapSetKeyCompression function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreateStringKeyed(copyInt, freeInt);
+    Map plain = mapCreateStringKeyed(copyInt, freeInt);
+    Map int_map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapSetKeyCompression(NULL, true) != MAP_NULL_ARGUMENT || mapSetKeyCompression(int_map, true) != MAP_UNSUPPORTED_MODE ||
+          mapSetKeyCompression(map, true) != MAP_SUCCESS,
+          __LINE__, &test_number, "mapSetKeyCompression fails", tests_passed);
+    char key[64];
+    for (int i = 0; i < 1000; i++) {
+        sprintf(key, "https://example.com/shop/category-%d/item-%04d", i % 10, i);
+        mapPut(map, key, &i);
+        mapPut(plain, key, &i);
+    }
+    mapFreeze(map);
+    mapFreeze(plain);
+    size_t structure = 0, elements = 0, plain_structure = 0, plain_elements = 0;
+    mapGetMemoryUsage(map, NULL, sizeInt, &structure, &elements);
+    mapGetMemoryUsage(plain, NULL, sizeInt, &plain_structure, &plain_elements);
+    test( (structure + elements) * 2 > plain_structure + plain_elements || mapSetKeyCompression(map, false) != MAP_FROZEN,
+          __LINE__, &test_number, "Frozen keys aren't compressed", tests_passed);
+    test( *(int *) mapGet(map, "https://example.com/shop/category-7/item-0357") != 357 ||
+          *(int *) mapGet(map, "https://example.com/shop/category-0/item-0000") != 0 ||
+          *(int *) mapGet(map, "https://example.com/shop/category-9/item-0999") != 999 ||
+          mapContains(map, "https://example.com/shop/category-7/item-035") ||
+          mapContains(map, "https://example.com/shop/category-7/item-03570") ||
+          mapContains(map, "https://example.com/shop/") || mapContains(map, "") || mapContains(map, "zzz"),
+          __LINE__, &test_number, "mapGet doesn't find compressed keys", tests_passed);
+    int count = 0;
+    bool matches = true;
+    char* previous_plain = mapGetFirst(plain);
+    MAP_FOREACH(char*, k, map) {
+        matches = matches && previous_plain && strcmp(k, previous_plain) == 0 && *(int *) mapGet(map, k) == *(int *) mapGet(plain, k);
+        previous_plain = mapGetNext(plain);
+        count++;
+    }
+    test( count != 1000 || !matches, __LINE__, &test_number, "Iteration doesn't decode the compressed keys in order", tests_passed);
+    count = 0;
+    test( mapPrefixScan(map, "https://example.com/shop/category-3/", countEntries, &count) != 100 ||
+          mapPrefixScan(map, "https://example.com/shop/category-3/item-09", countEntries, &count) != 10 ||
+          mapPrefixScan(map, "https://example.com/shop/category-3/item-1", countEntries, &count) != 0,
+          __LINE__, &test_number, "mapPrefixScan doesn't visit the compressed keys", tests_passed);
+    int total = 0;
+    test( mapParallelForEach(map, countEntries, &total, 4) != MAP_SUCCESS || total != 1000,
+          __LINE__, &test_number, "mapParallelForEach doesn't visit the compressed keys", tests_passed);
+    Map copy = mapCopy(map);
+    test( mapThaw(map) != MAP_SUCCESS || mapGetSize(map) != 1000 || mapGetSize(copy) != 1000 ||
+          *(int *) mapGet(map, "https://example.com/shop/category-4/item-0124") != 124 ||
+          *(int *) mapGet(copy, "https://example.com/shop/category-4/item-0124") != 124,
+          __LINE__, &test_number, "Compressed keys are lost by mapThaw or mapCopy", tests_passed);
+    mapPut(map, "https://example.com/", &count);
+    test( mapPrefixScan(map, "https://example.com/", countEntries, &count) != 1001,
+          __LINE__, &test_number, "A thawed map isn't modifiable", tests_passed);
+    mapDestroy(map);
+    mapDestroy(plain);
+    mapDestroy(copy);
+    mapDestroy(int_map);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
+static int mapCopyParallelTest(int *tests_passed) {
+    _print_mode_name("Testing mapCopyParallel function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    for (int i = 0; i < 10000; i++) {
+        mapPut(map, &i, &(int) {i * 2});
+    }
+    for (int i = 10000; i < 10010; i++) {
+        mapPutWithTTL(map, &i, &i, 0);
+    }
+    mapPutWithTTL(map, &(int) {10010}, &(int) {1}, 100000);
+    test( mapCopyParallel(NULL, 4) != NULL, __LINE__, &test_number, "mapCopyParallel doesn't return NULL on NULL map input", tests_passed);
+    Map copy = mapCopyParallel(map, 4);
+    bool matches = copy != NULL;
+    int count = 0, previous = -1;
+    MAP_FOREACH(int*, key, copy) {
+        matches = matches && *key > previous && (*key == 10010 || *(int *) mapGet(copy, key) == *key * 2);
+        previous = *key;
+        count++;
+    }
+    test( !matches || count != 10001 || mapGetSize(copy) != 10001, __LINE__, &test_number, "mapCopyParallel doesn't copy the live entries in order", tests_passed);
+    test( !mapContains(copy, &(int) {10010}) || mapContains(copy, &(int) {10005}),
+          __LINE__, &test_number, "mapCopyParallel doesn't keep the expiry times", tests_passed);
+    mapPut(copy, &(int) {-5}, &(int) {-10});
+    mapRemove(copy, &(int) {5000});
+    test( mapContains(map, &(int) {-5}) || !mapContains(map, &(int) {5000}) || mapGetSize(copy) != 10001,
+          __LINE__, &test_number, "The parallel copy isn't independent of the original", tests_passed);
+    mapDestroy(copy);
+    Map failing = mapCreate(copyIntFailingOn777, copyInt, freeInt, freeInt, compareInt);
+    for (int i = 0; i < 2000; i++) {
+        mapPut(failing, &i, &i);
+    }
+    fail_copies_of_777 = true;
+    test( mapCopyParallel(failing, 4) != NULL || mapGetSize(failing) != 2000,
+          __LINE__, &test_number, "mapCopyParallel doesn't fail when a copy fails", tests_passed);
+    fail_copies_of_777 = false;
+    mapDestroy(failing);
+    mapFreeze(map);
+    copy = mapCopyParallel(map, 3);
+    test( copy == NULL || mapGetSize(copy) != 10001 || *(int *) mapGet(copy, &(int) {9999}) != 19998,
+          __LINE__, &test_number, "mapCopyParallel doesn't copy a frozen map", tests_passed);
+    mapDestroy(copy);
+    Map strings = mapCreateStringKeyed(copyInt, freeInt);
+    mapSetKeyCompression(strings, true);
+    char key[32];
+    for (int i = 0; i < 500; i++) {
+        sprintf(key, "/var/log/app-%04d", i);
+        mapPut(strings, key, &i);
+    }
+    mapFreeze(strings);
+    copy = mapCopyParallel(strings, 4);
+    test( copy == NULL || mapGetSize(copy) != 500 || *(int *) mapGet(copy, "/var/log/app-0321") != 321 ||
+          strcmp(mapGetFirst(copy), "/var/log/app-0000") != 0,
+          __LINE__, &test_number, "mapCopyParallel doesn't decode compressed keys", tests_passed);
+    mapDestroy(copy);
+    mapDestroy(strings);
+    mapDestroy(map);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
+static int mapBuildFromUnsortedTest(int *tests_passed) {
+    _print_mode_name("Testing mapBuildFromUnsorted function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    enum { PAIRS = 100000 };
+    int *numbers = malloc(sizeof(int) * PAIRS * 2);
+    MapKeyElement *keys = malloc(sizeof(MapKeyElement) * PAIRS);
+    MapDataElement *values = malloc(sizeof(MapDataElement) * PAIRS);
+    unsigned long random = 12345;
+    for (int i = 0; i < PAIRS; i++) {
+        random = random * 6364136223846793005UL + 1442695040888963407UL;
+        numbers[2 * i] = (int) (random >> 33) % (PAIRS / 2);
+        numbers[2 * i + 1] = i;
+        keys[i] = &numbers[2 * i];
+        values[i] = &numbers[2 * i + 1];
+    }
+    /* The value each key should end with, -1 for missing keys. */
+    int *last = malloc(sizeof(int) * (PAIRS / 2));
+    int distinct = 0;
+    for (int i = 0; i < PAIRS / 2; i++) {
+        last[i] = -1;
+    }
+    for (int i = 0; i < PAIRS; i++) {
+        distinct += last[numbers[2 * i]] == -1;
+        last[numbers[2 * i]] = i;
+    }
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapBuildFromUnsorted(NULL, keys, values, PAIRS, 4) != MAP_NULL_ARGUMENT ||
+          mapBuildFromUnsorted(map, NULL, values, PAIRS, 4) != MAP_NULL_ARGUMENT ||
+          mapBuildFromUnsorted(map, keys, values, 0, 4) != MAP_SUCCESS || mapGetSize(map) != 0,
+          __LINE__, &test_number, "mapBuildFromUnsorted doesn't check its arguments", tests_passed);
+    test( mapBuildFromUnsorted(map, keys, values, PAIRS, 4) != MAP_SUCCESS || mapGetSize(map) != distinct,
+          __LINE__, &test_number, "mapBuildFromUnsorted doesn't put every key once", tests_passed);
+    bool matches = true;
+    int previous = -1;
+    MAP_FOREACH(int*, key, map) {
+        matches = matches && *key > previous;
+        previous = *key;
+    }
+    mapParallelForEach(map, markExpectedValue, last, 1);
+    for (int i = 0; i < PAIRS / 2; i++) {
+        matches = matches && last[i] < 0;
+    }
+    test( !matches, __LINE__, &test_number, "mapBuildFromUnsorted doesn't keep the last value of a key in order", tests_passed);
+    int more_keys[] = {PAIRS, -1, 7, PAIRS};
+    int more_values[] = {1, 2, 3, 4};
+    MapKeyElement few_keys[] = {&more_keys[0], &more_keys[1], &more_keys[2], &more_keys[3]};
+    MapDataElement few_values[] = {&more_values[0], &more_values[1], &more_values[2], &more_values[3]};
+    int size = mapGetSize(map);
+    test( mapBuildFromUnsorted(map, few_keys, few_values, 4, 16) != MAP_SUCCESS || mapGetSize(map) != size + 2 ||
+          *(int *) mapGet(map, &more_keys[0]) != 4 || *(int *) mapGet(map, &more_keys[2]) != 3 ||
+          *(int *) mapGetFirst(map) != -1,
+          __LINE__, &test_number, "mapBuildFromUnsorted doesn't merge into a non empty map", tests_passed);
+    Map small = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapBuildFromUnsorted(small, few_keys, few_values, 4, 1) != MAP_SUCCESS || mapGetSize(small) != 3 ||
+          *(int *) mapGet(small, &more_keys[3]) != 4,
+          __LINE__, &test_number, "mapBuildFromUnsorted doesn't build a small map", tests_passed);
+    mapFreeze(small);
+    test( mapBuildFromUnsorted(small, few_keys, few_values, 4, 1) != MAP_FROZEN,
+          __LINE__, &test_number, "mapBuildFromUnsorted doesn't return MAP_FROZEN", tests_passed);
+    mapDestroy(small);
+    mapDestroy(map);
+    free(last);
+    free(values);
+    free(keys);
+    free(numbers);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
+static int mapPopTest(int *tests_passed) {
+    _print_mode_name("Testing mapGetLast, mapGetPrev, mapPopFirst and mapPopLast functions");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map map = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    MapKeyElement key = NULL;
+    MapDataElement data = NULL;
+    test( mapGetLast(NULL) != NULL || mapGetLast(map) != NULL || mapGetPrev(map) != NULL ||
+          mapPopFirst(NULL, &key, &data) != MAP_NULL_ARGUMENT || mapPopLast(map, &key, &data) != MAP_ITEM_DOES_NOT_EXIST,
+          __LINE__, &test_number, "Empty or NULL maps aren't handled", tests_passed);
+    for (int i = 0; i < 6; i++) {
+        mapPut(map, &i, &(int) {i * 10});
+    }
+    int expected = 5;
+    MAP_FOREACH_REVERSE(int*, k, map) {
+        test( *k != expected, __LINE__, &test_number, "Reverse iteration of a small map is out of order", tests_passed);
+        expected--;
+    }
+    test( expected != -1 || *(int *) mapGetLast(map) != 5 || *(int *) mapGetPrev(map) != 4 ||
+          *(int *) mapGetNext(map) != 5 || mapGetNext(map) != NULL,
+          __LINE__, &test_number, "mapGetPrev and mapGetNext don't mix", tests_passed);
+    test( mapPopFirst(map, &key, &data) != MAP_SUCCESS || *(int *) key != 0 || *(int *) data != 0 ||
+          mapGetSize(map) != 5 || mapContains(map, &(int) {0}),
+          __LINE__, &test_number, "mapPopFirst doesn't hand over the first entry of a small map", tests_passed);
+    freeInt(key);
+    freeInt(data);
+    test( mapPopLast(map, NULL, &data) != MAP_SUCCESS || *(int *) data != 50 || *(int *) mapGetLast(map) != 4,
+          __LINE__, &test_number, "mapPopLast doesn't remove the last entry of a small map", tests_passed);
+    freeInt(data);
+    for (int i = 100; i > 5; i--) {
+        mapPut(map, &i, &(int) {i * 10});
+    }
+    mapPutWithTTL(map, &(int) {200}, &(int) {1}, 0);
+    mapPutWithTTL(map, &(int) {-1}, &(int) {1}, 0);
+    expected = 100;
+    int count = 0;
+    MAP_FOREACH_REVERSE(int*, k, map) {
+        count += *k == expected;
+        expected = *k == 6 ? 4 : *k - 1;
+    }
+    test( count != 99 || expected != 0, __LINE__, &test_number, "Reverse iteration skips entries or visits expired ones", tests_passed);
+    int popped = 0;
+    bool ordered = true;
+    while (mapPopLast(map, &key, NULL) == MAP_SUCCESS) {
+        ordered = ordered && *(int *) key == 100 - popped - (popped >= 95 ? 1 : 0);
+        freeInt(key);
+        popped++;
+        if (popped == 50) {
+            ordered = ordered && mapPopFirst(map, NULL, NULL) == MAP_SUCCESS && *(int *) mapGetFirst(map) == 2;
+        }
+    }
+    test( !ordered || popped != 98 || mapGetSize(map) != 0, __LINE__, &test_number, "mapPopLast doesn't pop in order", tests_passed);
+    Map shared = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    mapSetValueInterning(shared, hashInt, equalInts);
+    mapEnableConcurrentReads(shared);
+    for (int i = 0; i < 20; i++) {
+        mapPut(shared, &i, &(int) {7});
+    }
+    test( mapPopFirst(shared, &key, &data) != MAP_SUCCESS || *(int *) key != 0 || *(int *) data != 7 ||
+          mapGet(shared, &(int) {1}) == data || *(int *) mapGet(shared, &(int) {1}) != 7,
+          __LINE__, &test_number, "mapPopFirst hands over shared elements", tests_passed);
+    freeInt(key);
+    freeInt(data);
+    mapDestroy(shared);
+    for (int i = 0; i < 40; i++) {
+        mapPut(map, &i, &i);
+    }
+    mapFreeze(map);
+    test( *(int *) mapGetLast(map) != 39 || *(int *) mapGetPrev(map) != 38 ||
+          mapPopFirst(map, NULL, NULL) != MAP_FROZEN,
+          __LINE__, &test_number, "A frozen map isn't iterated backwards", tests_passed);
+    mapDestroy(map);
+    Map strings = mapCreateStringKeyed(copyInt, freeInt);
+    mapSetKeyCompression(strings, true);
+    char name[16];
+    for (int i = 0; i < 100; i++) {
+        sprintf(name, "key-%03d", i);
+        mapPut(strings, name, &i);
+    }
+    mapFreeze(strings);
+    count = 0;
+    expected = 99;
+    MAP_FOREACH_REVERSE(char*, k, strings) {
+        sprintf(name, "key-%03d", expected--);
+        count += strcmp(k, name) == 0;
+    }
+    test( count != 100, __LINE__, &test_number, "Compressed keys aren't decoded backwards", tests_passed);
+    mapDestroy(strings);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
+static int mapKeyOnlyTest(int *tests_passed) {
+    _print_mode_name("Testing mapCreateKeyOnly function");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Map keys = mapCreateKeyOnly(copyInt, freeInt, compareInt);
+    Map full = mapCreate(copyInt, copyInt, freeInt, freeInt, compareInt);
+    test( mapCreateKeyOnly(NULL, freeInt, compareInt) != NULL, __LINE__, &test_number, "NULL arguments aren't handled", tests_passed);
+    for (int i = 63; i >= 0; i--) {
+        mapPut(keys, &i, &i);
+        mapPut(full, &i, &i);
+        if (i == 48) {
+            Map small = mapCopy(keys);
+            test( mapGetSize(small) != 16 || !mapGet(small, &i) || mapGet(small, &(int) {1}) ||
+                  *(int *) mapGetFirst(small) != 48, __LINE__, &test_number, "A small key-only map is broken", tests_passed);
+            mapDestroy(small);
+        }
+    }
+    size_t key_only_bytes = 0, full_bytes = 0;
+    mapGetMemoryUsage(keys, NULL, NULL, &key_only_bytes, NULL);
+    mapGetMemoryUsage(full, NULL, NULL, &full_bytes, NULL);
+    test( key_only_bytes + 64 * sizeof(void *) > full_bytes, __LINE__, &test_number, "Key-only entries keep a data pointer", tests_passed);
+    int k = 0;
+    bool ordered = true;
+    MAP_FOREACH(int*, i, keys) {
+        ordered = ordered && *i == k++;
+    }
+    test( !ordered || k != 64 || !mapContains(keys, &(int) {63}) || !mapGet(keys, &(int) {7}) || mapGet(keys, &(int) {64}),
+          __LINE__, &test_number, "A key-only map loses its keys", tests_passed);
+    test( mapCompute(keys, &(int) {7}, addToInt, &k, NULL) != MAP_UNSUPPORTED_MODE ||
+          mapSetValueInterning(keys, hashInt, equalInts) != MAP_UNSUPPORTED_MODE,
+          __LINE__, &test_number, "Data features are allowed on a key-only map", tests_passed);
+    mapPutWithTTL(keys, &(int) {100}, &k, 1000);
+    mapFreeze(keys);
+    Map frozen_copy = mapCopy(keys);
+    mapThaw(keys);
+    mapRemove(keys, &(int) {7});
+    test( mapGetSize(frozen_copy) != 65 || mapGetSize(keys) != 64 || mapContains(keys, &(int) {7}) ||
+          !mapContains(frozen_copy, &(int) {100}), __LINE__, &test_number, "A key-only map can't be frozen, copied or thawed", tests_passed);
+    mapDestroy(frozen_copy);
+    mapDestroy(full);
+    mapDestroy(keys);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
+static int setTest(int *tests_passed) {
+    _print_mode_name("Testing the Set type");
+    int test_number = 1;
+    _print_test_number(test_number, __LINE__);
+    Set evens = setCreate(copyIntCounted, freeIntCounted, compareInt);
+    Set thirds = setCreate(copyInt, freeInt, compareInt);
+    test( setCreate(NULL, freeInt, compareInt) != NULL || setGetSize(NULL) != -1 || setAdd(evens, NULL) != SET_NULL_ARGUMENT ||
+          setRemove(NULL, &(int) {1}) != SET_NULL_ARGUMENT || setContains(NULL, &(int) {1}) || setUnion(evens, NULL) != NULL,
+          __LINE__, &test_number, "NULL arguments aren't handled", tests_passed);
+    int copies = data_copies;
+    for (int i = 300; i >= 0; i -= 2) {
+        setAdd(evens, &i);
+    }
+    for (int i = 0; i <= 300; i += 3) {
+        setAdd(thirds, &i);
+    }
+    test( data_copies - copies != 151 || setGetSize(evens) != 151 || setAdd(evens, &(int) {4}) != SET_ITEM_ALREADY_EXISTS ||
+          setGetSize(evens) != 151 || data_copies - copies != 151,
+          __LINE__, &test_number, "setAdd doesn't copy every element once", tests_passed);
+    test( !setContains(evens, &(int) {120}) || setContains(evens, &(int) {121}) ||
+          setRemove(evens, &(int) {120}) != SET_SUCCESS || setRemove(evens, &(int) {120}) != SET_ITEM_DOES_NOT_EXIST ||
+          setContains(evens, &(int) {120}) || setGetSize(evens) != 150,
+          __LINE__, &test_number, "setContains or setRemove fail", tests_passed);
+    int previous = -1;
+    bool ordered = true;
+    SET_FOREACH(int*, element, evens) {
+        ordered = ordered && *element > previous && *element % 2 == 0;
+        previous = *element;
+    }
+    test( !ordered || previous != 300, __LINE__, &test_number, "Set iteration is out of order", tests_passed);
+    Set both = setIntersection(evens, thirds);
+    Set either = setUnion(evens, thirds);
+    int count = 0;
+    previous = -1;
+    SET_FOREACH(int*, element, both) {
+        ordered = ordered && *element > previous && *element % 6 == 0 && *element != 120;
+        previous = *element;
+        count++;
+    }
+    test( !ordered || count != 50, __LINE__, &test_number, "setIntersection is wrong", tests_passed);
+    count = 0;
+    SET_FOREACH(int*, element, either) {
+        count += (*element % 2 == 0 && *element != 120) || *element % 3 == 0;
+    }
+    test( count != 201 || setGetSize(either) != 201 || !setContains(either, &(int) {120}) || !setContains(either, &(int) {3}),
+          __LINE__, &test_number, "setUnion is wrong", tests_passed);
+    Set same = setUnion(thirds, thirds);
+    Set copy = setCopy(evens);
+    setClear(evens);
+    test( setGetSize(same) != 101 || setGetSize(copy) != 150 || setGetSize(evens) != 0 || setGetFirst(evens) != NULL,
+          __LINE__, &test_number, "setCopy or setClear fail", tests_passed);
+    setDestroy(same);
+    setDestroy(copy);
+    setDestroy(both);
+    setDestroy(either);
+    setDestroy(thirds);
+    setDestroy(evens);
+    test( live_data != 0, __LINE__, &test_number, "Set elements leak", tests_passed);
+    _print_test_success(test_number);
+    *tests_passed += 1;
+    return test_number;
+}
+
 int main() {
     printf("\nWelcome to the homework 3 map_module tests, written by Vova Parakhin.\n\n---Passing those tests won't "
            "guarantee you a good grade---\nBut they might get you close to one "
@@ -259,6 +1743,31 @@ int main() {
     tests_number += mapRemoveTest(&tests_passed);
     tests_number += mapClearTest(&tests_passed);
     tests_number += mapGetTest(&tests_passed);
+    tests_number += mapLRUTest(&tests_passed);
+    tests_number += mapTTLTest(&tests_passed);
+    tests_number += mapBloomFilterTest(&tests_passed);
+    tests_number += mapRemoveIfTest(&tests_passed);
+    tests_number += mapParallelTest(&tests_passed);
+    tests_number += mapComputeTest(&tests_passed);
+    tests_number += mapPutHintTest(&tests_passed);
+    tests_number += mapStringKeyedTest(&tests_passed);
+    tests_number += mapKeyFingerprintTest(&tests_passed);
+    tests_number += mapSmallMapTest(&tests_passed);
+    tests_number += mapFreezeTest(&tests_passed);
+    tests_number += mapAllocatorTest(&tests_passed);
+    tests_number += mapTraceTest(&tests_passed);
+    tests_number += mapConcurrentReadsTest(&tests_passed);
+    tests_number += mapChangesTest(&tests_passed);
+    tests_number += mapLatencyHistogramTest(&tests_passed);
+    tests_number += mapCompactTest(&tests_passed);
+    tests_number += mapValueInterningTest(&tests_passed);
+    tests_number += mapDiskTierTest(&tests_passed);
+    tests_number += mapKeyCompressionTest(&tests_passed);
+    tests_number += mapCopyParallelTest(&tests_passed);
+    tests_number += mapBuildFromUnsortedTest(&tests_passed);
+    tests_number += mapPopTest(&tests_passed);
+    tests_number += mapKeyOnlyTest(&tests_passed);
+    tests_number += setTest(&tests_passed);
     print_grade(tests_number, tests_passed);
     return 0;
 }
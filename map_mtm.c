@@ -1,41 +1,410 @@
+#define _POSIX_C_SOURCE 199309L
 #include "map_mtm.h"
 #include "node.h"
+#include "timing_wheel.h"
+#include "bloom_filter.h"
+#include "worker_pool.h"
+#include "radix_tree.h"
+#include "hash_index.h"
+#include "allocator.h"
+#include "map_trace.h"
+#include "epoch.h"
+#include "change_log.h"
+#include "latency_histogram.h"
+#include "value_pool.h"
+#include "disk_tier.h"
+#include "key_blocks.h"
 #include <malloc.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
 
 //-----------------------------------------------------------------------//
 //                            MAP: DEFINES                               //
 //-----------------------------------------------------------------------//
 
 #define ILLEGAL_VALUE -1
+/* Maximal number of expired entries reclaimed by a single map operation. */
+#define MAP_TTL_SWEEP_BUDGET 16
+/* The Bloom filter is sized for this many times the map's size. */
+#define MAP_BLOOM_GROWTH_FACTOR 2
+/* Number of entries a small map holds before it switches to nodes. Its
+ * block of entries doubles as it grows, up to this many. */
+#define MAP_SMALL_CAPACITY 16
+/* Expiry of the entries of a frozen map which have no TTL. */
+#define MAP_NO_EXPIRY ((WheelTick)-1)
+/* Number of changes freed at a time when a subscription ends. */
+#define MAP_CHANGES_BATCH 32
+/* Nodes retired in epoch e are freed when the epoch reaches e+2, so lists
+ * of three epochs are enough. */
+#define MAP_RETIRED_LISTS 3
+/* Sides a disk tiered map's iterator moves past on its next step. */
+#define MAP_DISK_ADVANCE_NODES 1
+#define MAP_DISK_ADVANCE_RUNS 2
+#ifdef MAP_LATENCY_HISTOGRAMS
+/* Times a public operation into the map's histograms, if it records them.
+ * Without MAP_LATENCY_HISTOGRAMS nothing is timed at all. */
+#define MAP_LATENCY_START(map) \
+    unsigned long long latency_start = mapLatencyStart(map)
+#define MAP_LATENCY_STOP(map, operation) \
+    mapLatencyStop(map, operation, latency_start)
+#else
+#define MAP_LATENCY_START(map)
+#define MAP_LATENCY_STOP(map, operation)
+#endif
 
 //-----------------------------------------------------------------------//
 //                 MAP: STATIC FUNCTIONS DECLARATIONS                    //
 //-----------------------------------------------------------------------//
 
 static Node mapGetNodeByKey(Map map,MapKeyElement key);
-static Node mapGetPreviousNode(Map map, Node node);
+static Node mapFindByFingerprint(Map map, MapKeyElement key);
+static unsigned int mapKeyFingerprint(Map map, MapKeyElement key);
+static bool mapNodeHasKey(void* node, void* search);
+static Node mapFindLowerBound(Map map, MapKeyElement key,
+                              Node* previous_node);
+static Node mapFindLowerBoundFrom(Map map, Node start, MapKeyElement key,
+                                  Node* previous_node);
+static MapResult mapPutNode(Map map, MapKeyElement keyElement,
+                            MapDataElement dataElement, Node hint,
+                            Node* put_node);
 static MapResult mapAddNewData(Map map, MapKeyElement keyElement,
+                               MapDataElement dataElement,
+                               Node previous_node, Node next_node,
+                               Node* added_node);
+static void mapUnlinkNode(Map map, Node node);
+static void mapDeleteNode(Map map, Node node);
+static void mapLruPushFront(Map map, Node node);
+static void mapLruUnlink(Map map, Node node);
+static void mapTouchNode(Map map, Node node);
+static void mapEvictLeastRecent(Map map);
+static MapResult mapModifyData(Map map, Node* node, MapDataElement new_data);
+static WheelTick mapTimeNow(void);
+static WheelTimer mapGetNodeTimer(Map map, Node node);
+static bool mapIsExpired(Map map, Node node);
+static Node mapSkipExpired(Map map, Node node);
+static Node mapSkipExpiredBackward(Map map, Node node);
+static MapResult mapSetNodeExpiry(Map map, Node node, WheelTick expiry);
+static void mapClearNodeExpiry(Map map, Node node);
+static int mapSweepExpired(Map map, int budget);
+static void mapExpireNode(void* node, void* map);
+static bool mapBloomMayContain(Map map, MapKeyElement key);
+static MapResult mapBloomRebuild(Map map);
+static Node* mapSplitRanges(Map map, int ranges);
+static void mapForEachRange(int range, void* job);
+static void mapReduceRange(int range, void* job);
+static void mapSortRun(int run, void* job);
+static void mapMergeRunPair(int pair, void* job);
+static void mapMergeIndices(MapKeyElement* keys,
+                            compareMapKeyElements compare, const int* source,
+                            int start, int middle, int end, int* target);
+static MapKeyElement mapCopyString(MapKeyElement key);
+static void mapFreeString(MapKeyElement key);
+static int mapCompareStrings(MapKeyElement first, MapKeyElement second);
+static const char* mapGetNodeString(void* node);
+static bool mapCanBeSmall(Map map);
+static MapResult mapPromote(Map map);
+static int mapSmallFind(Map map, MapKeyElement key, bool* found);
+static MapResult mapSmallInsert(Map map, int index, MapKeyElement key,
+                                MapDataElement data);
+static MapResult mapSmallPut(Map map, MapKeyElement key, MapDataElement data);
+static void mapSmallRemove(Map map, int index);
+static void mapSmallDetach(Map map, int index);
+static void* mapAdoptElement(void* element);
+static int mapFrozenFind(Map map, MapKeyElement key, bool* found);
+static bool mapFrozenIsLive(Map map, int index);
+static int mapFrozenSkipExpired(Map map, int index);
+static int mapFrozenSkipExpiredBackward(Map map, int index);
+static void mapFrozenFree(Map map);
+static void mapForEachFrozenRange(int range, void* job);
+static void mapReduceFrozenRange(int range, void* job);
+static void mapKeepElement(void* element);
+static void* mapAllocate(Map map, size_t size);
+static void mapDeallocate(Map map, void* memory, size_t size);
+static bool mapHasExtension(Map map);
+static bool mapHasFeatures(Map map);
+static Allocator mapAllocator(Map map);
+static bool mapExtendWith(Map map, Allocator allocator);
+static bool mapExtend(Map map);
+static bool mapExtendFeatures(Map map);
+static bool mapDropData(Map map);
+static MapResult mapMakeBounded(Map map, int capacity);
+static void mapResetIterator(Map map);
+static void mapCountLookup(Map map, bool hit);
+static bool mapHasData(Map map);
+static MapDataElement mapNodeData(Map map, Node node);
+static MapKeyElement* mapSmallKeys(Map map);
+static MapDataElement* mapSmallData(Map map);
+static MapDataElement mapSmallGetData(Map map, int index);
+static size_t mapSmallEntrySize(Map map);
+static size_t mapSmallBlockSize(Map map);
+static bool mapSmallResize(Map map, int capacity);
+static void mapFrozenFreeArrays(Map map);
+static bool mapFrozenCompressKeys(Map map);
+static MapKeyElement mapFrozenKey(Map map, int index, char* buffer,
+                                  KeyBlocksCursor* cursor);
+static void mapTrace(Map map, TraceOperation operation, MapKeyElement key);
+static void mapSetFirstNode(Map map, Node node);
+static MapResult mapReplaceNode(Map map, Node* replaced, MapDataElement data,
+                                mapComputeFunction compute, void* context);
+static void mapRetireNode(Map map, Node node);
+static void mapFreeRetired(Map map, int list);
+static void mapPublishChange(Map map, MapChangeType type, MapKeyElement key,
+                             MapDataElement data);
+static void mapNodeDestroy(Map map, Node node,
+                           freeMapDataElements freeDataElement,
+                           freeMapKeyElements freeKeyElement);
+static void* mapCompactForward(void* node);
+static MapDataElement mapCopyData(Map map, MapDataElement data);
+static void mapFreeData(Map map, MapDataElement data);
+static MapDataElement mapComputeData(Map map, MapDataElement data,
+                                     mapComputeFunction compute,
+                                     void* context);
+static void mapDropNodes(Map map);
+static MapResult mapMoveNodes(Map map, NodeLayout layout);
+static DiskTierLookup mapDiskFind(Map map, MapKeyElement key,
+                                  MapDataElement* data);
+static MapDataElement mapDiskGet(Map map, MapKeyElement key);
+static MapResult mapDiskPut(Map map, MapKeyElement key, MapDataElement data);
+static MapResult mapDiskRemove(Map map, MapKeyElement key);
+static MapResult mapDiskFlush(Map map);
+static void mapDiskFlushIfFull(Map map);
+static bool mapDiskNextEntry(void* flush, void** key, void** data);
+static MapKeyElement mapDiskFirst(Map map);
+static MapKeyElement mapDiskStep(Map map);
+static void mapDiskEndIteration(Map map);
+static MapResult mapAttachDisk(Map map, DiskTier tier, int threshold);
+static Map mapDiskCopy(Map map);
+static int mapDiskRemoveIf(Map map, mapEntryPredicate predicate,
+                           void* context, int budget);
+static Map mapCopyUntimed(Map map);
+static Map mapCopyParallelUntimed(Map map, int threads);
+static Map mapCreateEmptyCopy(Map map);
+static void mapCopyRange(int range, void* job);
+static MapResult mapStitchCopies(Map new_map, Map map, MapKeyElement* keys,
+                                 MapDataElement* data);
+static bool mapContainsUntimed(Map map, MapKeyElement element);
+static MapResult mapPutUntimed(Map map, MapKeyElement keyElement,
                                MapDataElement dataElement);
-static MapResult mapModifyData(Map map, MapKeyElement keyElement,
-                               MapDataElement new_data);
+static MapResult mapPutHintUntimed(Map map, MapHint* hint,
+                                   MapKeyElement keyElement,
+                                   MapDataElement dataElement);
+static MapResult mapPutWithTTLUntimed(Map map, MapKeyElement keyElement,
+                                      MapDataElement dataElement, long ttl);
+static MapResult mapComputeUntimed(Map map, MapKeyElement keyElement,
+                                   mapComputeFunction compute, void* context,
+                                   MapDataElement defaultData);
+static MapDataElement mapGetUntimed(Map map, MapKeyElement keyElement);
+static MapResult mapRemoveUntimed(Map map, MapKeyElement keyElement);
+static MapKeyElement mapGetFirstUntimed(Map map);
+static MapKeyElement mapGetNextUntimed(Map map);
+static MapKeyElement mapGetLastUntimed(Map map);
+static MapKeyElement mapGetPrevUntimed(Map map);
+static MapResult mapPopEntry(Map map, bool last, MapKeyElement* keyElement,
+                             MapDataElement* dataElement);
+static MapResult mapClearUntimed(Map map);
+#ifdef MAP_LATENCY_HISTOGRAMS
+static unsigned long long mapLatencyStart(Map map);
+static void mapLatencyStop(Map map, MapOperation operation,
+                           unsigned long long start);
+#endif
+static size_t mapNodeElementsSize(Map map, MapKeyElement key,
+                                  MapDataElement data,
+                                  sizeMapKeyElements sizeKeyElement,
+                                  sizeMapDataElements sizeDataElement);
 
 //-----------------------------------------------------------------------//
 //                            MAP: STRUCT                                //
 //-----------------------------------------------------------------------//
 
-struct Map_t{
-    Node list;
+/** A reader thread's handle on a map with concurrent reads. */
+struct MapReader_t{
+    Map map;
+    EpochReader epoch_reader;
+};
+
+/** A parallel pass over the map: every range is handled by one task. */
+typedef struct map_parallel_job_t{
+    Node* range_starts; // ranges+1 entries, the last one is NULL.
+    Map map; // Split by index instead of range_starts, if it's frozen.
+    int ranges;
+    mapEntryFunction function;
+    mapAccumulateFunction accumulate;
+    char* accumulators; // One accumulator of accumulator_size per range.
+    size_t accumulator_size;
+    void* context;
+    /* One decoding buffer per range, if the frozen map's keys are front
+     * coded. */
+    char* key_buffers;
+} *MapParallelJob;
+
+/** A parallel copy: every range copies its live entries into the arrays, at
+ * the indices of the entries. */
+typedef struct map_copy_job_t{
+    Map map;
+    Node* range_starts; // NULL if the map is frozen.
+    int ranges;
+    char* key_buffers; // As in a parallel job.
+    MapKeyElement* keys; // NULL where an entry expired or wasn't copied.
+    MapDataElement* data;
+    bool* failed; // Per range: whether a copy failed.
+} *MapCopyJob;
+
+/** A parallel merge sort of the indices of an array of keys. */
+typedef struct map_sort_job_t{
+    MapKeyElement* keys;
+    compareMapKeyElements compare;
+    int* source; // The sorted runs.
+    int* target; // Will hold the merged runs.
+    int* bounds; // runs+1 entries: run i is [bounds[i], bounds[i+1]).
+    int runs;
+} *MapSortJob;
+
+/** A flush of a disk tiered map: its nodes merged with its removed keys. */
+typedef struct map_disk_flush_t{
+    Map map;
+    Node node; // Next node to write.
+    MapKeyElement removed; // Next removed key to write as a tombstone.
+} MapDiskFlush;
+
+/** An equality search of a key, asked about the nodes of its fingerprint. */
+typedef struct map_key_search_t{
+    Map map;
+    MapKeyElement key;
+} *MapKeySearch;
+
+/** Recency list of a bounded map, and its cache counters. */
+typedef struct map_lru_t{
+    int capacity; // Maximal number of entries.
+    Node head; // Most recently used node.
+    Node tail; // Least recently used node.
+    long hits;
+    long misses;
+    long evictions;
+} *MapLru;
+
+/** A frozen map has no nodes: its entries are in these sorted arrays. */
+typedef struct map_frozen_t{
+    MapKeyElement* keys;
+    MapDataElement* data;
+    WheelTick* expiry; // NULL if no entry had a TTL.
+    int capacity; // Number of entries the arrays were allocated for.
+    int iterator; // Index of the iterator's entry, or -1.
+    /* A frozen string keyed map with key compression front codes its keys
+     * in these blocks instead of keys, and decodes them into buffers of
+     * key_size bytes: the iterator's, and a scratch one for the operations
+     * which don't touch the iterator (a single allocation). */
+    KeyBlocks blocks;
+    char* key;
+    char* scratch;
+    size_t key_size;
+    KeyBlocksCursor cursor; // Of the iterator's buffer.
+} *MapFrozen;
+
+/** With a disk tier the nodes are a memtable, flushed into a new run once
+ * they and the removed keys reach the threshold. */
+typedef struct map_disk_t{
+    DiskTier tier;
+    Map removed; // Keys removed from the memtable which runs may hold.
+    int threshold;
+    int size; // Entries in the memtable and the runs together.
+    TierCursor cursor; // Runs side of the iterator, NULL if none.
+    MapKeyElement removed_key; // Removed keys side of the iterator.
+    bool nodes_done; // Whether the iterator is past the last node.
+    int advance; // Sides of the iterator on the last returned key.
+    /* Data mapGet read from the runs, by key. Kept until the next change
+     * of the map, like the data of the memtable. */
+    Map read;
+} *MapDisk;
+
+/** State of the optional features. Allocated by the first feature a map
+ * uses; until then the map shares map_no_features, which has them all off
+ * and is never written. */
+typedef struct map_features_t{
+    TimingWheel wheel; // Created with the first entry which has a TTL.
+    hashMapKeyElements hashKeyElement; // NULL if there is no Bloom filter.
+    BloomFilter bloom;
+    int bloom_removals; // Removals since the filter was last built.
+    bool compress_keys; // Whether mapFreeze front codes the keys.
+    hashMapKeyElements fingerprintKeyElement; // NULL if not fingerprinted.
+    HashIndex fingerprints; // The nodes by the fingerprints of their keys.
+    RadixTree radix; // Index of the keys of a string keyed map, else NULL.
+    TraceWriter trace; // NULL unless the operations are being traced.
+    hashMapKeyElements traceKeyElement; // Key identifiers for the trace.
+    ChangeLog change_log; // NULL unless the changes have a subscriber.
+    unsigned long long change_sequence; // Sequence of the next change.
+#ifdef MAP_LATENCY_HISTOGRAMS
+    /* A histogram per MapOperation, NULL unless latencies are recorded. */
+    LatencyHistogram* latency;
+#endif
+    /* Set once readers may run concurrently with the writer: unlinked
+     * nodes then wait in the retired lists (linked through their previous
+     * links, which readers don't follow) until no reader can reach them. */
+    EpochDomain epochs;
+    Node retired[MAP_RETIRED_LISTS];
+    /* Nodes laid out in key order by mapCompact. The block is freed once
+     * all of its nodes were destroyed. */
+    char* compact_nodes;
+    int compact_capacity; // Number of nodes the block was allocated for.
+    int compact_live; // Nodes of the block which weren't destroyed yet.
+    /* Interned data elements, shared with the map's copies. NULL unless
+     * the map interns its values. */
+    ValuePool values;
+} *MapFeatures;
+
+/** What a map needs beyond its small form: the state of its nodes and
+ * allocator, and its optional parts. Allocated once the map is promoted to
+ * nodes, is created with allocation hooks or uses a feature; until then
+ * the map shares map_no_extension, which is never written. */
+typedef struct map_extension_t{
+    struct allocator_t allocator; // Every internal allocation goes here.
+    Node last; // Tail of the ordered list.
     Node iterator;
+    unsigned long version; // Changed whenever a node is freed.
+    /* Parts of the nodes: the data unless the map is key-only, recency
+     * links if bounded and a timer once an entry has a TTL. */
+    NodeLayout layout;
+    MapLru lru; // NULL for an unbounded map.
+    MapFrozen frozen; // NULL unless the map is frozen.
+    MapDisk disk; // NULL unless the map spills to disk.
+    MapFeatures features;
+} *MapExtension;
+
+/** The map itself is kept as small as the original list head was: a small
+ * map with none of the features is this struct and its entries block. */
+struct Map_t{
     copyMapDataElements copyDataElement;
     copyMapKeyElements copyKeyElement;
     freeMapDataElements freeDataElement;
     freeMapKeyElements freeKeyElement;
     compareMapKeyElements compareKeyElements;
+    /* A small map keeps its entries sorted in a block of small_capacity
+     * keys followed by as many data elements (none if the map is key-only),
+     * and has no nodes; it switches to nodes for good once it outgrows
+     * MAP_SMALL_CAPACITY entries or uses a feature which needs nodes. */
+    union map_entries_t{
+        Node list; // Of a map with nodes.
+        MapKeyElement* small; // Of a small map, NULL while it's empty.
+    } entries;
+    MapExtension extension;
     int mapSize;
+    signed char small_iterator; // Iterator index of a small map, or -1.
+    unsigned char small_capacity;
+    bool is_small;
+    bool is_frozen;
 };
 
+static const struct map_features_t map_no_features = {NULL};
+
+static const struct map_extension_t map_no_extension = {
+        {NULL, NULL, NULL, 0}, NULL, NULL, 0, NODE_DATA, NULL, NULL, NULL,
+        (MapFeatures)&map_no_features};
+
+/** The data of every entry of a key-only map, which stores none. */
+static int map_no_data;
+
 //-----------------------------------------------------------------------//
 //                            MAP: FUNCTIONS                             //
 //-----------------------------------------------------------------------//
@@ -43,6 +412,9 @@ struct Map_t{
 /**
 ***** Function: mapCreate *****
 * Description: Allocates a new empty map.
+* The map starts small: its first MAP_SMALL_CAPACITY entries are kept in
+* a sorted block which grows with them, and it promotes itself to nodes
+* once it outgrows it or a feature needing nodes is used.
 *
 * @param copyDataElement - Function pointer to be used for copying data
 * elements into the map or when copying the map.
@@ -64,12 +436,58 @@ Map mapCreate(copyMapDataElements copyDataElement,
               freeMapDataElements freeDataElement,
               freeMapKeyElements freeKeyElement,
               compareMapKeyElements compareKeyElements){
+    return mapCreateWithAllocator(copyDataElement,copyKeyElement,
+                                  freeDataElement,freeKeyElement,
+                                  compareKeyElements,NULL,NULL,NULL);
+}
 
-    Map map = malloc(sizeof(*map));
-    if(!map || !copyDataElement || !copyKeyElement || !freeDataElement
-       || !freeKeyElement || !compareKeyElements){
+/**
+***** Function: mapCreateWithAllocator *****
+* Description: Allocates a new empty map which takes all of its internal
+* memory (the map itself, its nodes, timers, index and filter) from the
+* given hooks instead of malloc. The elements are still allocated by the
+* copy functions. Copies of the map use the same hooks.
+*
+* @param copyDataElement - Function pointer to be used for copying data
+* elements into the map or when copying the map.
+* @param copyKeyElement - Function pointer to be used for copying key
+* elements into the map or when copying the map.
+* @param freeDataElement - Function pointer to be used for removing data
+* elements from the map.
+* @param freeKeyElement - Function pointer to be used for removing key
+* elements from the map.
+* @param compareKeyElements - Function pointer to be used for comparing key
+* elements inside the map.
+* @param allocate - Allocates a block of a given size. NULL for malloc.
+* @param deallocate - Frees a block, given its size. NULL for free. Must be
+* NULL exactly when allocate is.
+* @param context - Passed as is to the hooks.
+* @return
+* NULL - if one of the parameters is NULL (other than the hooks and the
+* context), only one hook was given or allocations failed.
+* A new Map in case of success.
+*/
+Map mapCreateWithAllocator(copyMapDataElements copyDataElement,
+                           copyMapKeyElements copyKeyElement,
+                           freeMapDataElements freeDataElement,
+                           freeMapKeyElements freeKeyElement,
+                           compareMapKeyElements compareKeyElements,
+                           mapAllocateFunction allocate,
+                           mapDeallocateFunction deallocate,
+                           void* context){
+    if(!copyDataElement || !copyKeyElement || !freeDataElement
+       || !freeKeyElement || !compareKeyElements ||
+       (!allocate != !deallocate)){
         /* At least one of the given arguments is NULL. */
-        free(map);
+        return NULL;
+    }
+    /* The map allocated with hooks holds its own allocator, so it is set
+     * up on the stack for allocating the map and then moved into it. A map
+     * without hooks gets one only if it ever needs an extension. */
+    struct allocator_t allocator;
+    allocatorInit(&allocator,allocate,deallocate,context);
+    Map map = allocatorAllocate(&allocator,sizeof(*map));
+    if(!map){
         return NULL;
     }
     map->copyDataElement = copyDataElement;
@@ -77,9 +495,130 @@ Map mapCreate(copyMapDataElements copyDataElement,
     map->freeDataElement = freeDataElement;
     map->freeKeyElement = freeKeyElement;
     map->compareKeyElements = compareKeyElements;
-    map->list = NULL;
-    map->iterator = NULL;
-    map->mapSize=0;
+    map->entries.small = NULL;
+    map->extension = (MapExtension)&map_no_extension;
+    map->mapSize = 0;
+    map->small_iterator = -1;
+    map->small_capacity = 0;
+    map->is_small = true;
+    map->is_frozen = false;
+    if(allocate && !mapExtendWith(map,&allocator)){
+        allocatorFree(&allocator,map,sizeof(*map));
+        return NULL;
+    }
+    return map;
+}
+
+/**
+***** Function: mapCreateLRU *****
+* Description: Allocates a new empty map which holds at most 'capacity'
+* elements. Entries are kept in a recency list: mapGet and mapPut mark an
+* entry as most recently used, and when a new key is put into a full map
+* the least recently used entry is evicted using the stored free
+* functions. Only the nodes of bounded maps hold recency links.
+*
+* @param capacity - Maximal number of elements in the map.
+* @param copyDataElement - Function pointer to be used for copying data
+* elements into the map or when copying the map.
+* @param copyKeyElement - Function pointer to be used for copying key
+* elements into the map or when copying the map.
+* @param freeDataElement - Function pointer to be used for removing data
+* elements from the map.
+* @param freeKeyElement - Function pointer to be used for removing key
+* elements from the map.
+* @param compareKeyElements - Function pointer to be used for comparing key
+* elements inside the map.
+* @return
+* NULL - if one of the parameters is NULL, capacity is not positive or
+* allocations failed.
+* A new Map in case of success.
+*/
+Map mapCreateLRU(int capacity, copyMapDataElements copyDataElement,
+                 copyMapKeyElements copyKeyElement,
+                 freeMapDataElements freeDataElement,
+                 freeMapKeyElements freeKeyElement,
+                 compareMapKeyElements compareKeyElements){
+    if(capacity<=0){
+        return NULL;
+    }
+    Map map = mapCreate(copyDataElement,copyKeyElement,freeDataElement,
+                        freeKeyElement,compareKeyElements);
+    if(!map){
+        return NULL;
+    }
+    if(mapMakeBounded(map,capacity)!=MAP_SUCCESS){
+        mapDestroy(map);
+        return NULL;
+    }
+    return map;
+}
+
+/**
+***** Function: mapCreateStringKeyed *****
+* Description: Allocates a new empty map which keys are C strings, ordered
+* like strcmp. The keys are indexed by an adaptive radix tree, so finding a
+* key costs time proportional to its length rather than to the size of the
+* map, and mapPrefixScan can be used on the map. Keys are copied and freed
+* by the map.
+*
+* @param copyDataElement - Function pointer to be used for copying data
+* elements into the map or when copying the map.
+* @param freeDataElement - Function pointer to be used for removing data
+* elements from the map.
+* @return
+* NULL - if one of the parameters is NULL or allocations failed.
+* A new Map in case of success.
+*/
+Map mapCreateStringKeyed(copyMapDataElements copyDataElement,
+                         freeMapDataElements freeDataElement){
+    Map map = mapCreate(copyDataElement,mapCopyString,freeDataElement,
+                        mapFreeString,mapCompareStrings);
+    if(!map){
+        return NULL;
+    }
+    if(!mapExtendFeatures(map)){
+        mapDestroy(map);
+        return NULL;
+    }
+    map->is_small = false; // The radix tree indexes nodes.
+    map->extension->features->radix = radixTreeCreate(mapGetNodeString,
+                                                      mapAllocator(map));
+    if(!map->extension->features->radix){
+        mapDestroy(map);
+        return NULL;
+    }
+    return map;
+}
+
+/**
+***** Function: mapCreateKeyOnly *****
+* Description: Allocates a new empty map which entries have no data, like
+* the elements of a set. The nodes and the small block then hold keys only.
+* The data given to the map is ignored, and every key in the map has the
+* same data: a marker which must not be used or freed.
+*
+* @param copyKeyElement - Function pointer to be used for copying key
+* elements into the map or when copying the map.
+* @param freeKeyElement - Function pointer to be used for removing key
+* elements from the map.
+* @param compareKeyElements - Function pointer to be used for comparing key
+* elements inside the map.
+* @return
+* NULL - if one of the parameters is NULL or allocations failed.
+* A new Map in case of success.
+*/
+Map mapCreateKeyOnly(copyMapKeyElements copyKeyElement,
+                     freeMapKeyElements freeKeyElement,
+                     compareMapKeyElements compareKeyElements){
+    Map map = mapCreate(mapAdoptElement,copyKeyElement,mapKeepElement,
+                        freeKeyElement,compareKeyElements);
+    if(!map){
+        return NULL;
+    }
+    if(!mapDropData(map)){
+        mapDestroy(map);
+        return NULL;
+    }
     return map;
 }
 
@@ -95,8 +634,40 @@ void mapDestroy(Map map){
     if(!map){
         return;
     }
-    mapClear(map);
-    free(map);
+    mapTraceStop(map);
+    mapUnsubscribeChanges(map);
+    mapSetLatencyHistograms(map,false);
+    mapFrozenFree(map);
+    mapClearUntimed(map);
+    MapExtension extension = map->extension;
+    if(!mapHasExtension(map)){
+        /* The map came from malloc, and its entries are gone. */
+        allocatorFree(NULL,map,sizeof(*map));
+        return;
+    }
+    MapFeatures features = extension->features;
+    if(mapHasFeatures(map)){
+        for(int i=0;i<MAP_RETIRED_LISTS;i++){
+            mapFreeRetired(map,i);
+        }
+        epochDomainDestroy(features->epochs);
+        timingWheelDestroy(features->wheel);
+        bloomFilterDestroy(features->bloom);
+        radixTreeDestroy(features->radix);
+        hashIndexDestroy(features->fingerprints);
+        valuePoolDestroy(features->values);
+        mapDeallocate(map,features,sizeof(*features));
+    }
+    if(extension->disk){
+        diskTierDestroy(extension->disk->tier);
+        mapDestroy(extension->disk->removed);
+        mapDestroy(extension->disk->read);
+        mapDeallocate(map,extension->disk,sizeof(*extension->disk));
+    }
+    mapDeallocate(map,extension->lru,sizeof(*extension->lru));
+    struct allocator_t allocator = extension->allocator;
+    allocatorFree(&allocator,extension,sizeof(*extension));
+    allocatorFree(&allocator,map,sizeof(*map));
 }
 
 /**
@@ -104,36 +675,182 @@ void mapDestroy(Map map){
 * Description: Creates a copy of target map.
 * Iterator values for both maps is undefined after this operation.
 *
+* Entries with a TTL keep their expiry time in the copy, expired entries are
+* not copied. The copy of a disk tiered map gets a new tier in the same
+* directory, with the same memtable capacity.
+*
 * @param map - Target map.
 * @return
 * NULL if a NULL was sent or a memory allocation failed.
 * A Map containing the same elements as map otherwise.
 */
 Map mapCopy(Map map){
+    MAP_LATENCY_START(map);
+    Map copy = mapCopyUntimed(map);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_COPY);
+    return copy;
+}
+
+/**
+ ***** Function: mapCopyUntimed *****
+ * Description: mapCopy, without recording its latency.
+ */
+static Map mapCopyUntimed(Map map){
     if(!map){
         return NULL;
     }
-    Map new_map=mapCreate(map->copyDataElement,map->copyKeyElement,
-                          map->freeDataElement,map->freeKeyElement,
-                          map->compareKeyElements);
+    if(map->extension->disk){
+        return mapDiskCopy(map);
+    }
+    Map new_map=mapCreateEmptyCopy(map);
+    mapResetIterator(map);
     if(!new_map){
-        map->iterator=NULL;
         return NULL;
     }
-    MAP_FOREACH(MapKeyElement,current_key,map){
-        if(mapPut(new_map,current_key,mapGet(map,
-                                             current_key))!=MAP_SUCCESS){
+    if(map->is_small){
+        for(int i=0;i<map->mapSize;i++){
+            if(mapSmallInsert(new_map,i,mapSmallKeys(map)[i],
+                              mapSmallGetData(map,i))!=MAP_SUCCESS){
+                mapDestroy(new_map);
+                return NULL;
+            }
+        }
+        return new_map;
+    }
+    KeyBlocksCursor cursor = KEY_BLOCKS_CURSOR_INITIALIZER;
+    MapFrozen frozen = map->extension->frozen;
+    for(int i=0;map->is_frozen && i<map->mapSize;i++){
+        Node new_node = NULL;
+        if(mapFrozenIsLive(map,i) &&
+           (mapPutNode(new_map,mapFrozenKey(map,i,frozen->scratch,&cursor),
+                       frozen->data[i],NULL,&new_node)!=MAP_SUCCESS ||
+            (frozen->expiry && frozen->expiry[i]!=MAP_NO_EXPIRY &&
+             mapSetNodeExpiry(new_map,new_node,
+                              frozen->expiry[i])!=MAP_SUCCESS))){
+            mapDestroy(new_map);
+            return NULL;
+        }
+    }
+    /* A bounded map is copied from its least recently used entry to its
+     * most recently used one so the copy keeps the same recency order. */
+    Node current_node = map->extension->lru ? map->extension->lru->tail :
+                        map->entries.list;
+    while(current_node){
+        WheelTimer timer = mapGetNodeTimer(map,current_node);
+        Node new_node = NULL;
+        if(!mapIsExpired(map,current_node) &&
+           (mapPutNode(new_map,nodeGetKey(current_node),
+                       mapNodeData(map,current_node),NULL,
+                       &new_node)!=MAP_SUCCESS ||
+            (timer && mapSetNodeExpiry(new_map,new_node,
+                                       timerGetExpiry(timer))!=MAP_SUCCESS))){
             /* Memory allocation fail. */
             mapDestroy(new_map);
             return NULL;
         }
+        current_node = map->extension->lru ? nodeGetLruPrevious(current_node) :
+                       nodeGetNext(current_node);
+    }
+    return new_map;
+}
+
+/**
+***** Function: mapCopyParallel *****
+* Description: Creates a copy of target map like mapCopy, calling the copy
+* functions of the keys and the data from up to 'threads' threads. The
+* entries are split into contiguous ranges in key order, every range is
+* copied on its own thread, and the copies are linked into the new map in
+* order on the calling thread. Worth it when copying the elements is
+* expensive; the copy functions must then be safe to call concurrently.
+* Small, bounded, value interned and disk tiered maps are copied by
+* mapCopy.
+* Iterator values for both maps is undefined after this operation.
+*
+* @param map - Target map.
+* @param threads - Maximal number of threads to use, including the calling
+* one. At most one thread per online processor is used.
+* @return
+* NULL if a NULL was sent or a memory allocation failed.
+* A Map containing the same elements as map otherwise.
+*/
+Map mapCopyParallel(Map map, int threads){
+    MAP_LATENCY_START(map);
+    Map copy = mapCopyParallelUntimed(map,threads);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_COPY);
+    return copy;
+}
+
+/**
+ ***** Function: mapCopyParallelUntimed *****
+ * Description: mapCopyParallel, without recording its latency.
+ */
+static Map mapCopyParallelUntimed(Map map, int threads){
+    if(!map){
+        return NULL;
+    }
+    threads = workerPoolLimitThreads(threads);
+    /* A bounded map is copied in recency order, interned values are shared
+     * rather than copied, and a disk tiered map is read in one merged
+     * iteration. */
+    if(threads<=1 || map->is_small || map->extension->lru ||
+       map->extension->features->values || map->extension->disk ||
+       map->mapSize==0){
+        return mapCopyUntimed(map);
+    }
+    mapResetIterator(map);
+    int size = map->mapSize;
+    Map new_map = mapCreateEmptyCopy(map);
+    Node* range_starts = map->is_frozen ? NULL : mapSplitRanges(map,threads);
+    MapKeyElement* keys = mapAllocate(map,sizeof(*keys)*size);
+    MapDataElement* data = mapAllocate(map,sizeof(*data)*size);
+    bool* failed = mapAllocate(map,sizeof(*failed)*threads);
+    MapFrozen frozen = map->extension->frozen;
+    size_t key_buffers_size = map->is_frozen && frozen->blocks ?
+                              frozen->key_size*threads : 0;
+    char* key_buffers = key_buffers_size ?
+                        mapAllocate(map,key_buffers_size) : NULL;
+    bool copied = new_map && (range_starts || map->is_frozen) && keys &&
+                  data && failed && (!key_buffers_size || key_buffers);
+    if(copied){
+        /* Only the copy functions run on the workers: the allocator of the
+         * maps belongs to the calling thread. */
+        for(int i=0;i<threads;i++){
+            failed[i] = false;
+        }
+        struct map_copy_job_t job = {map, range_starts, threads,
+                                     key_buffers, keys, data, failed};
+        workerPoolRun(threads,threads,mapCopyRange,&job);
+        for(int i=0;i<threads;i++){
+            copied = copied && !failed[i];
+        }
+        copied = copied &&
+                 mapStitchCopies(new_map,map,keys,data)==MAP_SUCCESS;
+        /* What wasn't taken over by the new map is freed. */
+        for(int i=0;i<size;i++){
+            if(keys[i]){
+                map->freeKeyElement(keys[i]);
+            }
+            if(data[i]){
+                map->freeDataElement(data[i]);
+            }
+        }
+    }
+    if(!copied){
+        mapDestroy(new_map);
+        new_map = NULL;
     }
+    mapDeallocate(map,range_starts,sizeof(*range_starts)*(threads+1));
+    mapDeallocate(map,keys,sizeof(*keys)*size);
+    mapDeallocate(map,data,sizeof(*data)*size);
+    mapDeallocate(map,failed,sizeof(*failed)*threads);
+    mapDeallocate(map,key_buffers,key_buffers_size);
     return new_map;
 }
 
 /**
 ***** Function: mapGetSize *****
-* Description: Returns the number of elements in a map.
+* Description: Returns the number of elements in a map. Expired entries
+* which were not reclaimed yet are counted.
 *
 * @param map - The map which size is requested.
 * @return
@@ -144,7 +861,7 @@ int mapGetSize(Map map){
     if(!map){
         return ILLEGAL_VALUE;
     }
-    return map->mapSize;
+    return map->extension->disk ? map->extension->disk->size : map->mapSize;
 }
 
 /**
@@ -154,7 +871,8 @@ int mapGetSize(Map map){
 * determined equal using the comparison function used to initialize the
 * map.
 *
-* Notice: This Resets the iterator.
+* Notice: This Resets the iterator. An expired entry is considered absent
+* and is reclaimed.
 *
 * @param map - The map to search in.
 * @param element - The element to look for. Will be compared using the
@@ -165,16 +883,46 @@ int mapGetSize(Map map){
 * true - if the key element was found in the map.
 */
 bool mapContains(Map map, MapKeyElement element){
+    MAP_LATENCY_START(map);
+    bool found = mapContainsUntimed(map,element);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_GET);
+    return found;
+}
+
+/**
+ ***** Function: mapContainsUntimed *****
+ * Description: mapContains, without recording its latency.
+ */
+static bool mapContainsUntimed(Map map, MapKeyElement element){
     if(!map){
         return false;
     }
-    MAP_FOREACH(MapKeyElement,current,map){
-        if(map->compareKeyElements(current,element)==0){
-            /* Found needed key. */
-            return true;
-        }
+    mapTrace(map,TRACE_CONTAINS,element);
+    mapResetIterator(map);
+    if(!element){
+        return false;
+    }
+    if(map->is_frozen){
+        bool found = false;
+        int index = mapFrozenFind(map,element,&found);
+        return found && mapFrozenIsLive(map,index);
     }
-    return false;
+    if(map->is_small){
+        bool found = false;
+        mapSmallFind(map,element,&found);
+        return found;
+    }
+    mapSweepExpired(map,MAP_TTL_SWEEP_BUDGET);
+    Node node = mapGetNodeByKey(map,element);
+    if(node && mapIsExpired(map,node)){
+        /* Lazy expiry. */
+        mapExpireNode(node,map);
+        return false;
+    }
+    if(!node && map->extension->disk){
+        return mapDiskFind(map,element,NULL) == DISK_TIER_FOUND;
+    }
+    return node != NULL;
 }
 
 /**
@@ -196,337 +944,5283 @@ bool mapContains(Map map, MapKeyElement element){
 * MAP_SUCCESS the paired elements had been inserted successfully.
 */
 MapResult mapPut(Map map, MapKeyElement keyElement, MapDataElement dataElement) {
+    MAP_LATENCY_START(map);
+    MapResult status = mapPutUntimed(map,keyElement,dataElement);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_PUT);
+    return status;
+}
+
+/**
+ ***** Function: mapPutUntimed *****
+ * Description: mapPut, without recording its latency.
+ */
+static MapResult mapPutUntimed(Map map, MapKeyElement keyElement,
+                               MapDataElement dataElement) {
     if (!map) {
         /* Map is NULL. */
         return MAP_NULL_ARGUMENT;
     }
-    if(!keyElement || !dataElement){
-        map->iterator = NULL;
-        return MAP_NULL_ARGUMENT;
+    mapTrace(map,TRACE_PUT,keyElement);
+    if(map->is_frozen){
+        return MAP_FROZEN;
     }
-    if (!mapContains(map, keyElement)) {
-        /* Item doesn't exist and we need to add it */
-        MapResult status = mapAddNewData(map, keyElement, dataElement);
-        if(status!=MAP_SUCCESS){
-            /* Failed to add new data. */
-            map->iterator = NULL;
-            return MAP_OUT_OF_MEMORY;
-        }
-        /* New data added successfully. */
-        map->iterator = NULL;
-        return MAP_SUCCESS;
+    if(map->is_small){
+        map->small_iterator = -1;
+        return mapSmallPut(map,keyElement,dataElement);
     }
-    /* Item exist in map and we need to modify its data.*/
-    MapResult status = mapModifyData(map,keyElement,dataElement);
-    if(status!=MAP_SUCCESS){
-        /* Failed to modify key.*/
-        map->iterator = NULL;
-        return MAP_OUT_OF_MEMORY;
+    if(map->extension->disk){
+        return mapDiskPut(map,keyElement,dataElement);
     }
-    /* Key modified successfully. */
-    map->iterator = NULL;
-    return MAP_SUCCESS;
+    mapSweepExpired(map,MAP_TTL_SWEEP_BUDGET);
+    Node node = NULL;
+    MapResult status = mapPutNode(map,keyElement,dataElement,NULL,&node);
+    if(status==MAP_SUCCESS){
+        /* A plain put makes the entry permanent. */
+        mapClearNodeExpiry(map,node);
+    }
+    map->extension->iterator = NULL;
+    return status;
 }
 
-
 /**
-***** Function: mapGet *****
-* Description: Returns the data associated with a specific key in the map.
-* Iterator status unchanged.
+****** Function: mapPutHint *****
+* Description: Like mapPut, but the search for the key's position starts at
+* a hint: the position of a previous put. Putting keys near the hint costs
+* time proportional to their distance from it, so keys arriving in (almost)
+* sorted order are put in O(1) each.
+* Iterator's value is undefined after this operation.
 *
-* @param map - The map for which to get the data element from.
-* @param keyElement - The key element which need to be found and who's data
-* we want to get.
+* @param map - The map for which to reassign the data element.
+* @param hint - The hint. Initialize it with MAP_HINT_INITIALIZER; every
+* successful call updates it to the position of the put key. A hint which
+* is outdated (some entry was freed since it was set) or belongs to another
+* map is ignored. NULL to put without a hint.
+* @param keyElement - The key element which need to be reassigned.
+* @param dataElement - The new data element to associate with the given
+* key. A copy of the element will be inserted.
 * @return
-* NULL if a NULL pointer was sent or if the map does not contain the
-* requested key.
-* The data element associated with the key otherwise.
+* MAP_NULL_ARGUMENT if a NULL was sent as map, key or data.
+* MAP_OUT_OF_MEMORY if an allocation failed.
+* MAP_SUCCESS the paired elements had been inserted successfully.
 */
-MapDataElement mapGet(Map map, MapKeyElement keyElement){
-    if(!map || !keyElement){
-        /* At least one of the given arguments is NULL. */
-        return NULL;
-    }
-    Node current_node = mapGetNodeByKey(map,keyElement);
-    if(!current_node){
-        /* Key does not exist. */
-        return NULL;
-    }
-    assert(current_node);
-    MapDataElement current_node_data = nodeGetData(current_node);
-    /* Current_node_data will be NULL if copyDataElement failed*/
-    return current_node_data;
+MapResult mapPutHint(Map map, MapHint* hint, MapKeyElement keyElement,
+                     MapDataElement dataElement){
+    MAP_LATENCY_START(map);
+    MapResult status = mapPutHintUntimed(map,hint,keyElement,dataElement);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_PUT);
+    return status;
 }
 
 /**
-***** Function: mapRemove *****
-* Description: Removes a pair of key and data elements from the map. The
-* elements are found using the comparison function given at initialization.
-* Once found, the elements are removed and deallocated using the free
-* functions supplied at initialzation.
-* Iterator's value is undefined after this operation.
-*
-* @param map -The map to remove the elements from.
-* @param keyElement -The key element to find and remove from the map. The
-* element will be freed using the free function given at initialization.
-* The data element associated with this key will also be freed using the
-* free function given at initialization.
-* @return
-* MAP_NULL_ARGUMENT if a NULL was sent to the function.
-* MAP_ITEM_DOES_NOT_EXIST if an equal key item does not already exists in
-* the map.
-* MAP_SUCCESS the paired elements had been removed successfully.
-*/
-MapResult mapRemove(Map map, MapKeyElement keyElement){
+ ***** Function: mapPutHintUntimed *****
+ * Description: mapPutHint, without recording its latency.
+ */
+static MapResult mapPutHintUntimed(Map map, MapHint* hint,
+                                   MapKeyElement keyElement,
+                                   MapDataElement dataElement){
     if(!map){
         /* Map is NULL. */
         return MAP_NULL_ARGUMENT;
     }
-    if(!keyElement){
-        /* Key is NULL.*/
-        map->iterator = NULL;
-        return MAP_NULL_ARGUMENT;
+    mapTrace(map,TRACE_PUT,keyElement);
+    if(map->is_frozen){
+        return MAP_FROZEN;
     }
-    Node node = mapGetNodeByKey(map,keyElement);
-    if(!node){
-        /* Key element does not exist in map. */
-        map->iterator = NULL; // Resetting iterator.
-        return MAP_ITEM_DOES_NOT_EXIST;
+    if(map->is_small){
+        /* A small map is searched in a few steps anyway. */
+        map->small_iterator = -1;
+        return mapSmallPut(map,keyElement,dataElement);
     }
-    Node previous_node = mapGetPreviousNode(map,node);
-    /* If the previous node is NULL it means that the current node is
-     * the first in the map. */
-    if(!previous_node){
-        /* Node with given key is first. */
-        map->list = nodeGetNext(node);
-        nodeDestroy(node,map->freeDataElement,map->freeKeyElement);
-        map->iterator = NULL; // Resetting iterator.
-        return MAP_SUCCESS;
+    if(map->extension->disk){
+        /* A flush frees the hinted node anyway. */
+        return mapDiskPut(map,keyElement,dataElement);
     }
-    nodeSetNext(previous_node,nodeGetNext(node));
-    nodeDestroy(node,map->freeDataElement,map->freeKeyElement);
-    /* Sucessfully removed. */
-    map->iterator = NULL; // Resetting iterator.
-    return MAP_SUCCESS;
+    mapSweepExpired(map,MAP_TTL_SWEEP_BUDGET);
+    Node start = NULL;
+    if(hint && hint->map == map && hint->version == map->extension->version){
+        /* The hinted node wasn't freed since the hint was set. */
+        start = hint->position;
+    }
+    Node node = NULL;
+    MapResult status = mapPutNode(map,keyElement,dataElement,start,&node);
+    if(status==MAP_SUCCESS){
+        /* A plain put makes the entry permanent. */
+        mapClearNodeExpiry(map,node);
+        if(hint){
+            hint->map = map;
+            hint->position = node;
+            hint->version = map->extension->version;
+        }
+    }
+    map->extension->iterator = NULL;
+    return status;
 }
 
 /**
-***** Function: mapGetFirst *****
-* Description: Sets the internal iterator (also called current key element)
-* to the first key element in the map. There doesn't need to be an internal
-* order of the keys so the "first" key element is any key element.
-* Use this to start iterating over the map.
-* To continue iteration use mapGetNext.
+****** Function: mapPutWithTTL *****
+* Description: Gives a specified key a specific value which is valid for
+* 'ttl' milliseconds. Once expired, the entry is treated as absent by the
+* map and is reclaimed incrementally by later map operations. The first
+* entry with a TTL moves the nodes of the map, like mapCompact, into nodes
+* with room for a timer.
+* Iterator's value is undefined after this operation.
 *
-* @param map - The map for which to set the iterator and return the first
-* key element.
+* @param map - The map for which to reassign the data element.
+* @param keyElement - The key element which need to be reassigned.
+* @param dataElement - The new data element to associate with the given
+* key. A copy of the element will be inserted.
+* @param ttl - Time to live of the entry in milliseconds. A non positive
+* value makes the entry expire immediately.
 * @return
-* NULL if a NULL pointer was sent or the map is empty.
-* The first key element of the map otherwise.
+* MAP_NULL_ARGUMENT if a NULL was sent as map, key or data.
+* MAP_OUT_OF_MEMORY if an allocation failed.
+* MAP_SUCCESS the paired elements had been inserted successfully.
 */
-MapKeyElement mapGetFirst(Map map){
+MapResult mapPutWithTTL(Map map, MapKeyElement keyElement,
+                        MapDataElement dataElement, long ttl){
+    MAP_LATENCY_START(map);
+    MapResult status = mapPutWithTTLUntimed(map,keyElement,dataElement,ttl);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_PUT);
+    return status;
+}
+
+/**
+ ***** Function: mapPutWithTTLUntimed *****
+ * Description: mapPutWithTTL, without recording its latency.
+ */
+static MapResult mapPutWithTTLUntimed(Map map, MapKeyElement keyElement,
+                                      MapDataElement dataElement, long ttl){
     if(!map){
         /* Map is NULL. */
-        return NULL;
+        return MAP_NULL_ARGUMENT;
     }
-    /* In case of empty map returns NULL.*/
-    if(!map->list){
-        return NULL;
+    mapTrace(map,TRACE_PUT,keyElement);
+    if(map->is_frozen){
+        return MAP_FROZEN;
     }
-    map->iterator = map->list;
-    return nodeGetKey(map->iterator);
-}
-
-/**
-***** Function: mapGetNext *****
-* Description: Advances the map iterator to the next key element and
-* returns it.
-* The next key element is any key element not previously returned by the
-* iterator.
+    if(map->extension->features->epochs || map->extension->disk){
+        /* Readers can't tell expired entries apart, and neither can runs. */
+        return MAP_UNSUPPORTED_MODE;
+    }
+    mapResetIterator(map);
+    if(!keyElement || !dataElement){
+        return MAP_NULL_ARGUMENT;
+    }
+    /* The wheel is part of the map's feature state. */
+    if(!mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    if(!(map->extension->layout & NODE_TIMER)){
+        /* The nodes get room for a timer with the first TTL. */
+        if(!map->is_small && map->entries.list &&
+           mapMoveNodes(map,map->extension->layout | NODE_TIMER)!=MAP_SUCCESS){
+            return MAP_OUT_OF_MEMORY;
+        }
+        map->extension->layout |= NODE_TIMER;
+    }
+    if(mapPromote(map)!=MAP_SUCCESS){
+        return MAP_OUT_OF_MEMORY;
+    }
+    map->extension->iterator = NULL;
+    mapSweepExpired(map,MAP_TTL_SWEEP_BUDGET);
+    WheelTick expiry = mapTimeNow() + (WheelTick)(ttl>0 ? ttl : 0);
+    MapFeatures features = map->extension->features;
+    if(!features->wheel){
+        features->wheel = timingWheelCreate(mapTimeNow(),mapAllocator(map));
+        if(!features->wheel){
+            return MAP_OUT_OF_MEMORY;
+        }
+    }
+    Node previous_node = NULL;
+    Node node = mapFindLowerBound(map,keyElement,&previous_node);
+    bool is_new = !node ||
+                  map->compareKeyElements(nodeGetKey(node),keyElement)!=0;
+    MapResult status = is_new ?
+                       mapAddNewData(map,keyElement,dataElement,
+                                     previous_node,node,&node) :
+                       mapModifyData(map,&node,dataElement);
+    if(status!=MAP_SUCCESS){
+        return status;
+    }
+    status = mapSetNodeExpiry(map,node,expiry);
+    if(status!=MAP_SUCCESS && is_new){
+        /* Not leaving a permanent entry behind. */
+        mapDeleteNode(map,node);
+    } else {
+        mapPublishChange(map,MAP_CHANGE_PUT,nodeGetKey(node),
+                         mapNodeData(map,node));
+    }
+    map->extension->iterator = NULL;
+    return status;
+}
+
+/**
+***** Function: mapReclaimExpired *****
+* Description: Reclaims expired entries, handling at most 'budget' entries.
+* Every other map operation already does a small amount of this work; this
+* function lets idle time be used for it.
+* Iterator's value is undefined after this operation.
 *
-* @param map - The map for which to advance the iterator.
+* @param map - The map to reclaim entries from.
+* @param budget - Maximal amount of entries to handle.
 * @return
-* NULL if reached the end of the map, or the iterator is at an invalid
-* state or a NULL sent as argument.
-* The next key element on the map in case of success.
+* ILLEGAL_VALUE if a NULL map was sent.
+* The number of entries handled otherwise.
 */
-MapKeyElement mapGetNext(Map map){
+int mapReclaimExpired(Map map, int budget){
     if(!map){
-        /* Map is NULL. */
-        return NULL;
+        return ILLEGAL_VALUE;
     }
-    if(!map->iterator){
-        /* Reached end of the map. */
-        return NULL;
+    if(map->is_frozen){
+        return ILLEGAL_VALUE;
     }
-    map->iterator = nodeGetNext(map->iterator);
-    return nodeGetKey(map->iterator);
+    mapResetIterator(map);
+    return mapSweepExpired(map,budget);
 }
 
+
 /**
-***** Function: mapClear *****
-* Description: Removes all key and data elements from target map.
-* The elements are deallocated using the stored free functions.
+****** Function: mapCompute *****
+* Description: Lets a function modify the data of a key in place, finding
+* the key once and without copying or freeing the data. If the key is
+* missing and a default data element is given, a copy of it is inserted
+* first and then passed to the function.
+* Iterator's value is undefined after this operation.
 *
-* @param map - Target map to remove all element from.
+* @param map - The map to modify.
+* @param keyElement - The key element which data should be modified.
+* @param compute - Called with the stored data element and 'context'. May
+* modify the data element in place, must not modify the map.
+* @param context - Passed as is to 'compute'.
+* @param defaultData - Data element to insert if the key is missing. NULL to
+* leave missing keys alone.
 * @return
-* MAP_NULL_ARGUMENT - if a NULL pointer was sent.
-* MAP_SUCCESS - Otherwise.
+* MAP_NULL_ARGUMENT if a NULL was sent as map, key or function.
+* MAP_ITEM_DOES_NOT_EXIST if the key is missing and no default was given.
+* MAP_UNSUPPORTED_MODE if the map is disk tiered or key-only.
+* MAP_OUT_OF_MEMORY if an allocation failed.
+* MAP_SUCCESS if the function was called.
 */
-MapResult mapClear(Map map) {
+MapResult mapCompute(Map map, MapKeyElement keyElement,
+                     mapComputeFunction compute, void* context,
+                     MapDataElement defaultData){
+    MAP_LATENCY_START(map);
+    MapResult status = mapComputeUntimed(map,keyElement,compute,context,
+                                         defaultData);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_PUT);
+    return status;
+}
+
+/**
+ ***** Function: mapComputeUntimed *****
+ * Description: mapCompute, without recording its latency.
+ */
+static MapResult mapComputeUntimed(Map map, MapKeyElement keyElement,
+                                   mapComputeFunction compute, void* context,
+                                   MapDataElement defaultData){
     if(!map){
         return MAP_NULL_ARGUMENT;
     }
-    for(int i=0;i<map->mapSize;i++){
-        mapRemove(map,mapGetFirst(map));
+    if(compute){
+        /* The trace keeps keys only: with a default the key ends up in the
+         * map like after a put, without one the set of keys is unchanged. */
+        mapTrace(map,defaultData ? TRACE_PUT : TRACE_GET,keyElement);
+    }
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    if(map->extension->disk || !mapHasData(map)){
+        /* The data may only be on disk, or there is none. */
+        return MAP_UNSUPPORTED_MODE;
+    }
+    mapResetIterator(map);
+    if(!keyElement || !compute){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_small){
+        bool found = false;
+        int index = mapSmallFind(map,keyElement,&found);
+        if(!found && !defaultData){
+            return MAP_ITEM_DOES_NOT_EXIST;
+        }
+        if(found || map->mapSize<MAP_SMALL_CAPACITY){
+            if(!found){
+                MapResult status = mapSmallInsert(map,index,keyElement,
+                                                  defaultData);
+                if(status!=MAP_SUCCESS){
+                    return status;
+                }
+            }
+            if(map->extension->features->values){
+                /* The data is shared: it's computed on a copy. */
+                MapDataElement data = mapComputeData(map,
+                                                     mapSmallGetData(map,index),
+                                                     compute,context);
+                if(!data){
+                    return MAP_OUT_OF_MEMORY;
+                }
+                mapFreeData(map,mapSmallGetData(map,index));
+                mapSmallData(map)[index] = data;
+            } else {
+                compute(mapSmallGetData(map,index),context);
+            }
+            mapPublishChange(map,MAP_CHANGE_PUT,mapSmallKeys(map)[index],
+                             mapSmallGetData(map,index));
+            return MAP_SUCCESS;
+        }
+        /* No room for the new key. */
+        if(mapPromote(map)!=MAP_SUCCESS){
+            return MAP_OUT_OF_MEMORY;
+        }
+        map->extension->iterator = NULL;
+    }
+    mapSweepExpired(map,MAP_TTL_SWEEP_BUDGET);
+    if(!defaultData && !mapBloomMayContain(map,keyElement)){
+        /* Definitely missing, and nothing to insert. */
+        return MAP_ITEM_DOES_NOT_EXIST;
+    }
+    Node previous_node = NULL;
+    Node node = mapFindLowerBound(map,keyElement,&previous_node);
+    bool found = node &&
+                 map->compareKeyElements(nodeGetKey(node),keyElement)==0;
+    if(found && mapIsExpired(map,node)){
+        /* Expired entries are absent. */
+        Node next_node = nodeGetNext(node);
+        mapExpireNode(node,map);
+        node = next_node;
+        found = false;
     }
+    if(!found){
+        if(!defaultData){
+            return MAP_ITEM_DOES_NOT_EXIST;
+        }
+        MapResult status = mapAddNewData(map,keyElement,defaultData,
+                                         previous_node,node,&node);
+        if(status!=MAP_SUCCESS){
+            return status;
+        }
+    } else {
+        mapTouchNode(map,node);
+    }
+    if(map->extension->features->epochs){
+        /* Readers may be on the data: it's computed on a copy. */
+        MapResult status = mapReplaceNode(map,&node,mapNodeData(map,node),
+                                          compute,context);
+        if(status!=MAP_SUCCESS){
+            return status;
+        }
+    } else if(map->extension->features->values){
+        /* The data is shared: it's computed on a copy. */
+        MapDataElement old_data = mapNodeData(map,node);
+        MapDataElement data = mapComputeData(map,old_data,compute,context);
+        if(!data){
+            return MAP_OUT_OF_MEMORY;
+        }
+        nodeSetData(node,map->extension->layout,data,mapAdoptElement,
+                    mapKeepElement);
+        mapFreeData(map,old_data);
+    } else {
+        compute(mapNodeData(map,node),context);
+    }
+    mapPublishChange(map,MAP_CHANGE_PUT,nodeGetKey(node),
+                     mapNodeData(map,node));
     return MAP_SUCCESS;
 }
 
-//-----------------------------------------------------------------------//
-//                        MAP: STATIC FUNCTIONS                          //
-//-----------------------------------------------------------------------//
-
 /**
-***** Static function: mapGetNodeByKey *****
-* Description: Finds the node which the given key belongs to.
-*
-* @param map - The map to search the node in.
-* @param key - The key element which belongs to the node we are looking
-* for.
+***** Function: mapGet *****
+* Description: Returns the data associated with a specific key in the map.
+* Iterator status unchanged.
 *
+* @param map - The map for which to get the data element from.
+* @param keyElement - The key element which need to be found and who's data
+* we want to get.
 * @return
-* Node which contains the given key.
-* NULL if the key was not found in the map.
+* NULL if a NULL pointer was sent or if the map does not contain the
+* requested key (or its entry expired).
+* The data element associated with the key otherwise.
 */
-static Node mapGetNodeByKey(Map map,MapKeyElement key){
-    assert(key);
-    Node current_node = map->list; // Resetting to first node.
-    MapKeyElement current_node_key;
-    while(current_node) {
-        current_node_key = nodeGetKey(current_node);
-        if (map->compareKeyElements(current_node_key, key) == 0){
-            /* Node was found. */
-            return current_node;
+MapDataElement mapGet(Map map, MapKeyElement keyElement){
+    MAP_LATENCY_START(map);
+    MapDataElement data = mapGetUntimed(map,keyElement);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_GET);
+    return data;
+}
+
+/**
+ ***** Function: mapGetUntimed *****
+ * Description: mapGet, without recording its latency.
+ */
+static MapDataElement mapGetUntimed(Map map, MapKeyElement keyElement){
+    if(!map || !keyElement){
+        /* At least one of the given arguments is NULL. */
+        return NULL;
+    }
+    mapTrace(map,TRACE_GET,keyElement);
+    if(map->is_frozen){
+        bool found = false;
+        int index = mapFrozenFind(map,keyElement,&found);
+        if(!found || !mapFrozenIsLive(map,index)){
+            mapCountLookup(map,false);
+            return NULL;
         }
-        /* Steping to the next node. */
-        current_node = nodeGetNext(current_node);
+        mapCountLookup(map,true);
+        return map->extension->frozen->data[index];
     }
-    /* Node with that key wasn't found. */
-    return NULL;
+    if(map->is_small){
+        bool found = false;
+        int index = mapSmallFind(map,keyElement,&found);
+        if(!found){
+            return NULL;
+        }
+        return mapSmallGetData(map,index);
+    }
+    Node current_node = mapGetNodeByKey(map,keyElement);
+    if(!current_node && map->extension->disk){
+        return mapDiskGet(map,keyElement);
+    }
+    if(!current_node || mapIsExpired(map,current_node)){
+        /* Key does not exist. An expired entry isn't reclaimed here since
+         * this must not disturb the iterator. */
+        mapCountLookup(map,false);
+        return NULL;
+    }
+    assert(current_node);
+    mapCountLookup(map,true);
+    mapTouchNode(map,current_node);
+    MapDataElement current_node_data = mapNodeData(map,current_node);
+    /* Current_node_data will be NULL if copyDataElement failed*/
+    return current_node_data;
 }
+
 /**
-***** Function: mapGetPreviousNode *****
-* Description: Finds the node in the map that points to the given node.
- *
-* @param map - The map to search the node in.
-* @param Node - A node that we want to find its previous.
+***** Function: mapRemove *****
+* Description: Removes a pair of key and data elements from the map. The
+* elements are found using the comparison function given at initialization.
+* Once found, the elements are removed and deallocated using the free
+* functions supplied at initialzation.
+* Iterator's value is undefined after this operation.
 *
+* @param map -The map to remove the elements from.
+* @param keyElement -The key element to find and remove from the map. The
+* element will be freed using the free function given at initialization.
+* The data element associated with this key will also be freed using the
+* free function given at initialization.
 * @return
-* The previous node of the given node.
-* NULL in case the map is empty or the given node is first.
+* MAP_NULL_ARGUMENT if a NULL was sent to the function.
+* MAP_ITEM_DOES_NOT_EXIST if an equal key item does not already exists in
+* the map.
+* MAP_SUCCESS the paired elements had been removed successfully.
 */
-static Node mapGetPreviousNode(Map map, Node node) {
-    assert(map);
-    Node node_iterator;
-    MAP_FOREACH(MapKeyElement, iterator, map) {
-        node_iterator = mapGetNodeByKey(map, iterator);
-        if (nodeGetNext(node_iterator) == node) {
-            /* Previous node was found. */
-            return node_iterator;
-        }
-    }
-    /* If we got here then map is empty or the given node is first. */
-    return NULL;
+MapResult mapRemove(Map map, MapKeyElement keyElement){
+    MAP_LATENCY_START(map);
+    MapResult status = mapRemoveUntimed(map,keyElement);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_REMOVE);
+    return status;
 }
 
 /**
- ***** Function: mapAddNewData *****
- * Description: Gets a data and a key which doesn't already exist in the
- * map and puts it in the map.
- *
- * @param map - Map to add to.
- * @param keyElement - Key element to add to the map.
- * @param dataElement - Data element to add to the map.
- *
- * @return
- * MAP_OUT_OF_MEMORY - Any memory error.
- * MAP_SUCCESS - Sucessfully added.
+ ***** Function: mapRemoveUntimed *****
+ * Description: mapRemove, without recording its latency.
  */
-static MapResult mapAddNewData(Map map, MapKeyElement keyElement,
-                               MapDataElement dataElement){
+static MapResult mapRemoveUntimed(Map map, MapKeyElement keyElement){
+    if(!map){
+        /* Map is NULL. */
+        return MAP_NULL_ARGUMENT;
+    }
+    mapTrace(map,TRACE_REMOVE,keyElement);
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    if(!keyElement){
+        /* Key is NULL.*/
+        mapResetIterator(map);
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_small){
+        map->small_iterator = -1;
+        bool found = false;
+        int index = mapSmallFind(map,keyElement,&found);
+        if(!found){
+            return MAP_ITEM_DOES_NOT_EXIST;
+        }
+        mapPublishChange(map,MAP_CHANGE_REMOVE,mapSmallKeys(map)[index],NULL);
+        mapSmallRemove(map,index);
+        return MAP_SUCCESS;
+    }
+    if(map->extension->disk){
+        return mapDiskRemove(map,keyElement);
+    }
+    mapSweepExpired(map,MAP_TTL_SWEEP_BUDGET);
+    Node node = mapGetNodeByKey(map,keyElement);
+    if(!node){
+        /* Key element does not exist in map. */
+        map->extension->iterator = NULL; // Resetting iterator.
+        return MAP_ITEM_DOES_NOT_EXIST;
+    }
+    if(mapIsExpired(map,node)){
+        /* Expired entries are absent, but it's reclaimed anyway. */
+        mapExpireNode(node,map);
+        map->extension->iterator = NULL; // Resetting iterator.
+        return MAP_ITEM_DOES_NOT_EXIST;
+    }
+    mapPublishChange(map,MAP_CHANGE_REMOVE,nodeGetKey(node),NULL);
+    mapDeleteNode(map,node);
+    /* Sucessfully removed. */
+    map->extension->iterator = NULL; // Resetting iterator.
+    return MAP_SUCCESS;
+}
 
-    /* Item does not exist and we need to create it and add it. */
-    Node new_node = nodeCreate(dataElement, keyElement,
-                               map->copyDataElement, map->copyKeyElement,
-                               map->freeKeyElement); // Creating the new node.
-    if(!new_node){
-        return MAP_OUT_OF_MEMORY;
+/**
+***** Function: mapRemoveIf *****
+* Description: Removes every pair of key and data elements for which the
+* given predicate returns true, in a single pass over the map. The removed
+* elements are deallocated using the stored free functions.
+* Iterator's value is undefined after this operation.
+*
+* @param map - The map to remove the elements from.
+* @param predicate - Called once for every entry with its key, its data and
+* 'context'. Must not modify the map.
+* @param context - Passed as is to the predicate.
+* @return
+* ILLEGAL_VALUE if a NULL map or predicate was sent, or if the map is disk
+* tiered and an allocation or a read or write of its runs failed. The
+* entries removed until then stay removed.
+* The number of removed entries otherwise.
+*/
+int mapRemoveIf(Map map, mapEntryPredicate predicate, void* context){
+    if(!map){
+        return ILLEGAL_VALUE;
+    }
+    if(map->is_frozen || !predicate){
+        return ILLEGAL_VALUE;
+    }
+    if(map->extension->disk){
+        return mapDiskRemoveIf(map,predicate,context,
+                               map->extension->disk->size);
     }
-    /* Adding the new node: Trying to find its place. */
-    MAP_FOREACH(MapKeyElement, current, map) {
-        /* Looking for the first key that is bigger than our key. */
-        if (map->compareKeyElements(current, keyElement) > 0) {
-            Node current_node = mapGetNodeByKey(map, current);
-            Node previous_node = mapGetPreviousNode(map, current_node);
-            if (previous_node){
-                /* This is not the beginning of the list. */
-                nodeSetNext(previous_node, new_node);
-                nodeSetNext(new_node, current_node);
-                map->mapSize++;
-                return MAP_SUCCESS;
+    mapResetIterator(map);
+    int removed = 0;
+    if(map->is_small){
+        int index = 0;
+        while(index<map->mapSize){
+            if(predicate(mapSmallKeys(map)[index],mapSmallGetData(map,index),
+                         context)){
+                mapPublishChange(map,MAP_CHANGE_REMOVE,
+                                 mapSmallKeys(map)[index],NULL);
+                mapSmallRemove(map,index);
+                removed++;
+            } else {
+                index++;
             }
-            /* If previous_node is NULL then the new node should be
-             * * added to the beginning of the list.*/
-            map->list = new_node;
-            nodeSetNext(new_node, current_node);
-            map->mapSize++;
-            return MAP_SUCCESS;
         }
+        return removed;
     }
-    /* If we got here then the new node should be at the end. */
-    Node previous_node = mapGetPreviousNode(map,NULL);
-    if(!previous_node){
-        /* List is empty*/
-        map->list = new_node;
-        map->mapSize++;
-        return MAP_SUCCESS;
+    Node node = map->entries.list;
+    while(node){
+        Node next_node = nodeGetNext(node);
+        if(mapIsExpired(map,node)){
+            /* Already absent, reclaimed on the way. */
+            mapExpireNode(node,map);
+        } else if(predicate(nodeGetKey(node),mapNodeData(map,node),context)){
+            mapPublishChange(map,MAP_CHANGE_REMOVE,nodeGetKey(node),NULL);
+            mapDeleteNode(map,node);
+            removed++;
+        }
+        node = next_node;
     }
-    /* List is not empty. */
-    nodeSetNext(previous_node,new_node);
-    nodeSetNext(new_node,NULL);
-    map->mapSize++;
-    return MAP_SUCCESS;
+    return removed;
 }
 
 /**
- ***** Function: mapModifyData *****
- * Description: Modify an existing key in the map.
- *
- * @param map - Map of the key.
- * @param keyElement - Key to modify.
- * @param new_data - New data.
- * @return
- * MAP_OUT_OF_MEMORY - Any memory error.
- * MAP_SUCCESS - Key successfully modified.
- */
-static MapResult mapModifyData(Map map, MapKeyElement keyElement,
-                               MapDataElement new_data){
+***** Function: mapPrefixScan *****
+* Description: Calls a function for every entry which key starts with a
+* given prefix, in key order. Only the matching entries are visited: the
+* first one is found in time proportional to the prefix's length.
+* Iterator status unchanged.
+*
+* @param map - A map created by mapCreateStringKeyed.
+* @param prefix - The prefix. The empty string matches every key.
+* @param function - Called with every matching key, its data and 'context'.
+* Must not modify the map.
+* @param context - Passed as is to the function.
+* @return
+* ILLEGAL_VALUE if a NULL was sent or the map isn't string keyed.
+* The number of entries visited otherwise.
+*/
+int mapPrefixScan(Map map, const char* prefix, mapEntryFunction function,
+                  void* context){
+    if(!map || !prefix || !function || !map->extension->features->radix){
+        return ILLEGAL_VALUE;
+    }
+    size_t prefix_length = strlen(prefix);
+    int visited = 0;
+    if(map->is_frozen){
+        bool found = false;
+        KeyBlocksCursor cursor = KEY_BLOCKS_CURSOR_INITIALIZER;
+        char* scratch = map->extension->frozen->scratch;
+        for(int i=mapFrozenFind(map,(MapKeyElement)prefix,&found);
+            i<map->mapSize;i++){
+            MapKeyElement key = mapFrozenKey(map,i,scratch,&cursor);
+            if(strncmp(key,prefix,prefix_length)!=0){
+                break;
+            }
+            if(mapFrozenIsLive(map,i)){
+                function(key,map->extension->frozen->data[i],context);
+                visited++;
+            }
+        }
+        return visited;
+    }
+    for(Node node = radixTreeLowerBound(map->extension->features->radix,prefix);
+        node && strncmp(nodeGetKey(node),prefix,prefix_length)==0;
+        node = nodeGetNext(node)){
+        if(!mapIsExpired(map,node)){
+            function(nodeGetKey(node),mapNodeData(map,node),context);
+            visited++;
+        }
+    }
+    return visited;
+}
 
-    MAP_FOREACH(MapKeyElement, current, map) {
-        if (map->compareKeyElements(current, keyElement) == 0) {
-            /* Found our key. */
-            if (nodeSetData(map->iterator, new_data,
-                            map->copyDataElement, map->freeDataElement) != NODE_SUCCESS){
-                /*  Memory Error .*/
+/**
+***** Function: mapParallelForEach *****
+* Description: Calls a function for every entry of the map, using up to
+* 'threads' threads. The entries are split into contiguous ranges in key
+* order, one range per thread. The function may run concurrently for
+* different entries, so it must be thread safe and must not modify the
+* map. Iterator status unchanged.
+*
+* @param map - The map to go over.
+* @param function - Called with every key, its data and 'context'.
+* @param context - Passed as is to the function.
+* @param threads - Maximal number of threads to use, including the calling
+* one. At most one thread per online processor is used.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map or function was sent.
+* MAP_OUT_OF_MEMORY - if an allocation failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapParallelForEach(Map map, mapEntryFunction function,
+                             void* context, int threads){
+    if(!map || !function){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->extension->disk){
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(map->is_small){
+        /* Too few entries to be worth more threads. */
+        for(int i=0;i<map->mapSize;i++){
+            function(mapSmallKeys(map)[i],mapSmallGetData(map,i),context);
+        }
+        return MAP_SUCCESS;
+    }
+    /* The ranges are as many as the threads which can run them. */
+    threads = workerPoolLimitThreads(threads);
+    if(map->is_frozen){
+        struct map_parallel_job_t job = {NULL, map, threads, function, NULL,
+                                         NULL, 0, context, NULL};
+        MapFrozen frozen = map->extension->frozen;
+        if(frozen->blocks){
+            job.key_buffers = mapAllocate(map,frozen->key_size*threads);
+            if(!job.key_buffers){
                 return MAP_OUT_OF_MEMORY;
             }
-            /* Sucessfully modified. */
-            return MAP_SUCCESS;
         }
+        workerPoolRun(threads,threads,mapForEachFrozenRange,&job);
+        mapDeallocate(map,job.key_buffers,frozen->key_size*threads);
+        return MAP_SUCCESS;
+    }
+    Node* range_starts = mapSplitRanges(map,threads);
+    if(!range_starts){
+        return MAP_OUT_OF_MEMORY;
     }
-    /* Shouldn't get here. */
-    return MAP_OUT_OF_MEMORY;
+    struct map_parallel_job_t job = {range_starts, map, threads, function,
+                                     NULL, NULL, 0, context, NULL};
+    workerPoolRun(threads,threads,mapForEachRange,&job);
+    mapDeallocate(map,range_starts,sizeof(*range_starts)*(threads+1));
+    return MAP_SUCCESS;
 }
 
+/**
+***** Function: mapParallelReduce *****
+* Description: Folds all the entries of the map into a single result, using
+* up to 'threads' threads. The entries are split into contiguous ranges in
+* key order. Every range gets its own accumulator of 'accumulatorSize'
+* bytes, initialized as a copy of 'result' (which should therefore hold the
+* identity value), and every entry of the range is accumulated into it.
+* The accumulators are then combined into 'result' in key order.
+* Iterator status unchanged.
+*
+* @param map - The map to go over.
+* @param accumulate - Adds an entry to an accumulator. Runs concurrently
+* for different ranges and must not modify the map.
+* @param combine - Merges an accumulator into the result. Runs on the
+* calling thread.
+* @param result - Holds the identity value and will hold the result.
+* @param accumulatorSize - Size in bytes of 'result' and the accumulators.
+* @param context - Passed as is to 'accumulate' and 'combine'.
+* @param threads - Maximal number of threads to use, including the calling
+* one. At most one thread per online processor is used.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map, function or result was sent.
+* MAP_OUT_OF_MEMORY - if an allocation failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapParallelReduce(Map map, mapAccumulateFunction accumulate,
+                            mapCombineFunction combine, void* result,
+                            size_t accumulatorSize, void* context,
+                            int threads){
+    if(!map || !accumulate || !combine || !result){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->extension->disk){
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(map->is_small){
+        /* A single range, accumulated on the calling thread. */
+        void* accumulator = mapAllocate(map,accumulatorSize + 1);
+        if(!accumulator){
+            return MAP_OUT_OF_MEMORY;
+        }
+        memcpy(accumulator,result,accumulatorSize);
+        for(int i=0;i<map->mapSize;i++){
+            accumulate(accumulator,mapSmallKeys(map)[i],mapSmallGetData(map,i),
+                       context);
+        }
+        combine(result,accumulator,context);
+        mapDeallocate(map,accumulator,accumulatorSize + 1);
+        return MAP_SUCCESS;
+    }
+    /* The ranges are as many as the threads which can run them. */
+    threads = workerPoolLimitThreads(threads);
+    Node* range_starts = map->is_frozen ? NULL :
+                         mapSplitRanges(map,threads);
+    char* accumulators = mapAllocate(map,accumulatorSize*threads + 1);
+    MapFrozen frozen = map->extension->frozen;
+    size_t key_buffers_size = map->is_frozen && frozen->blocks ?
+                              frozen->key_size*threads : 0;
+    char* key_buffers = key_buffers_size ?
+                        mapAllocate(map,key_buffers_size) : NULL;
+    if((!range_starts && !map->is_frozen) || !accumulators ||
+       (key_buffers_size && !key_buffers)){
+        mapDeallocate(map,range_starts,sizeof(*range_starts)*(threads+1));
+        mapDeallocate(map,accumulators,accumulatorSize*threads + 1);
+        mapDeallocate(map,key_buffers,key_buffers_size);
+        return MAP_OUT_OF_MEMORY;
+    }
+    for(int i=0;i<threads;i++){
+        memcpy(accumulators+accumulatorSize*i,result,accumulatorSize);
+    }
+    struct map_parallel_job_t job = {range_starts, map, threads, NULL,
+                                     accumulate, accumulators,
+                                     accumulatorSize, context, key_buffers};
+    workerPoolRun(threads,threads,map->is_frozen ? mapReduceFrozenRange :
+                                  mapReduceRange,&job);
+    for(int i=0;i<threads;i++){
+        combine(result,accumulators+accumulatorSize*i,context);
+    }
+    mapDeallocate(map,accumulators,accumulatorSize*threads + 1);
+    mapDeallocate(map,range_starts,sizeof(*range_starts)*(threads+1));
+    mapDeallocate(map,key_buffers,key_buffers_size);
+    return MAP_SUCCESS;
+}
 
+/**
+***** Function: mapBuildFromUnsorted *****
+* Description: Puts n pairs of keys and data given in any order, as a bulk
+* load. The keys are sorted with a stable merge sort on up to 'threads'
+* threads: every thread sorts a contiguous run of the input, and the runs
+* are then merged pairwise, also in parallel. The sorted pairs are put in a
+* single pass, each one next to the previous, so building an empty map
+* takes linear time after the sort. Of equal keys the one given last wins,
+* as if the pairs were put one by one in their given order.
+* Iterator's value is undefined after this operation.
+*
+* @param map - The map to put in.
+* @param keys - n keys. Compared concurrently with the map's comparison
+* function, which must therefore be thread safe.
+* @param values - n data elements; values[i] is put with keys[i].
+* @param n - Number of pairs.
+* @param threads - Maximal number of threads to use, including the calling
+* one. At most one thread per online processor is used.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map, or NULL arrays or elements were sent.
+* Nothing is put then.
+* MAP_FROZEN - if the map is frozen.
+* MAP_OUT_OF_MEMORY - if an allocation failed. The pairs before the failed
+* one in key order were put.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapBuildFromUnsorted(Map map, MapKeyElement* keys,
+                               MapDataElement* values, int n, int threads){
+    if(!map || (n>0 && (!keys || !values))){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    for(int i=0;i<n;i++){
+        if(!keys[i] || !values[i]){
+            return MAP_NULL_ARGUMENT;
+        }
+    }
+    if(n<=0){
+        return MAP_SUCCESS;
+    }
+    threads = workerPoolLimitThreads(threads);
+    threads = threads>n ? n : threads;
+    /* The puts may give the map an allocator of its own: the buffers are
+     * freed with the one they were allocated with. */
+    Allocator allocator = mapAllocator(map);
+    int* order = allocatorAllocate(allocator,sizeof(*order)*n);
+    int* buffer = allocatorAllocate(allocator,sizeof(*buffer)*n);
+    int* bounds = allocatorAllocate(allocator,sizeof(*bounds)*(threads+1));
+    MapResult status = order && buffer && bounds ? MAP_SUCCESS :
+                       MAP_OUT_OF_MEMORY;
+    if(status==MAP_SUCCESS){
+        for(int i=0;i<n;i++){
+            order[i] = i;
+        }
+        for(int i=0;i<=threads;i++){
+            bounds[i] = (int)((long)n*i/threads);
+        }
+        struct map_sort_job_t job = {keys, map->compareKeyElements, order,
+                                     buffer, bounds, threads};
+        workerPoolRun(threads,threads,mapSortRun,&job);
+        while(job.runs>1){
+            int pairs = (job.runs+1)/2;
+            workerPoolRun(threads,pairs,mapMergeRunPair,&job);
+            for(int i=1;i<=pairs;i++){
+                bounds[i] = bounds[2*i<job.runs ? 2*i : job.runs];
+            }
+            job.runs = pairs;
+            int* merged = job.target;
+            job.target = job.source;
+            job.source = merged;
+        }
+        /* Every put starts its search at the previous one, and the keys
+         * only grow. */
+        MapHint hint = MAP_HINT_INITIALIZER;
+        int* sorted = job.source;
+        for(int i=0;i<n && status==MAP_SUCCESS;i++){
+            if(i+1<n && map->compareKeyElements(keys[sorted[i]],
+                                                keys[sorted[i+1]])==0){
+                /* A later pair has the same key. */
+                continue;
+            }
+            status = mapPutHintUntimed(map,&hint,keys[sorted[i]],
+                                       values[sorted[i]]);
+        }
+    }
+    allocatorFree(allocator,order,sizeof(*order)*n);
+    allocatorFree(allocator,buffer,sizeof(*buffer)*n);
+    allocatorFree(allocator,bounds,sizeof(*bounds)*(threads+1));
+    return status;
+}
+
+/**
+***** Function: mapGetFirst *****
+* Description: Sets the internal iterator (also called current key element)
+* to the first key element in the map. There doesn't need to be an internal
+* order of the keys so the "first" key element is any key element.
+* Use this to start iterating over the map.
+* To continue iteration use mapGetNext.
+*
+* @param map - The map for which to set the iterator and return the first
+* key element.
+* @return
+* NULL if a NULL pointer was sent or the map is empty.
+* The first key element of the map otherwise.
+*/
+MapKeyElement mapGetFirst(Map map){
+    MAP_LATENCY_START(map);
+    MapKeyElement key = mapGetFirstUntimed(map);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_ITERATE);
+    return key;
+}
+
+/**
+ ***** Function: mapGetFirstUntimed *****
+ * Description: mapGetFirst, without recording its latency.
+ */
+static MapKeyElement mapGetFirstUntimed(Map map){
+    if(!map){
+        /* Map is NULL. */
+        return NULL;
+    }
+    mapTrace(map,TRACE_GET_FIRST,NULL);
+    if(map->extension->disk){
+        return mapDiskFirst(map);
+    }
+    if(map->is_frozen){
+        MapFrozen frozen = map->extension->frozen;
+        frozen->iterator = mapFrozenSkipExpired(map,0);
+        return frozen->iterator<0 ? NULL :
+               mapFrozenKey(map,frozen->iterator,frozen->key,
+                            &frozen->cursor);
+    }
+    if(map->is_small){
+        map->small_iterator = map->mapSize ? 0 : -1;
+        return map->mapSize ? mapSmallKeys(map)[0] : NULL;
+    }
+    /* In case of empty map returns NULL.*/
+    map->extension->iterator = mapSkipExpired(map,map->entries.list);
+    return nodeGetKey(map->extension->iterator);
+}
+
+/**
+***** Function: mapGetNext *****
+* Description: Advances the map iterator to the next key element and
+* returns it.
+* The next key element is any key element not previously returned by the
+* iterator.
+*
+* @param map - The map for which to advance the iterator.
+* @return
+* NULL if reached the end of the map, or the iterator is at an invalid
+* state or a NULL sent as argument.
+* The next key element on the map in case of success.
+*/
+MapKeyElement mapGetNext(Map map){
+    MAP_LATENCY_START(map);
+    MapKeyElement key = mapGetNextUntimed(map);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_ITERATE);
+    return key;
+}
+
+/**
+ ***** Function: mapGetNextUntimed *****
+ * Description: mapGetNext, without recording its latency.
+ */
+static MapKeyElement mapGetNextUntimed(Map map){
+    if(!map){
+        /* Map is NULL. */
+        return NULL;
+    }
+    mapTrace(map,TRACE_GET_NEXT,NULL);
+    if(map->extension->disk){
+        return mapDiskStep(map);
+    }
+    if(map->is_frozen){
+        MapFrozen frozen = map->extension->frozen;
+        if(frozen->iterator<0){
+            return NULL;
+        }
+        frozen->iterator = mapFrozenSkipExpired(map,frozen->iterator+1);
+        return frozen->iterator<0 ? NULL :
+               mapFrozenKey(map,frozen->iterator,frozen->key,
+                            &frozen->cursor);
+    }
+    if(map->is_small){
+        if(map->small_iterator<0 ||
+           ++map->small_iterator>=map->mapSize){
+            /* Reached end of the map. */
+            map->small_iterator = -1;
+            return NULL;
+        }
+        return mapSmallKeys(map)[map->small_iterator];
+    }
+    if(!map->extension->iterator){
+        /* Reached end of the map. */
+        return NULL;
+    }
+    map->extension->iterator = mapSkipExpired(map,
+                                              nodeGetNext(
+                                                  map->extension->iterator));
+    return nodeGetKey(map->extension->iterator);
+}
+
+/**
+***** Function: mapGetLast *****
+* Description: Sets the internal iterator to the last (greatest) key
+* element in the map and returns it. Use this to start iterating over the
+* map backwards with mapGetPrev; mapGetNext continues forward from it as
+* well. O(1), not counting expired entries at the end of the map.
+* A disk tiered map can only be iterated forward.
+*
+* @param map - The map for which to set the iterator and return the last
+* key element.
+* @return
+* NULL if a NULL pointer was sent, the map is empty or disk tiered.
+* The last key element of the map otherwise.
+*/
+MapKeyElement mapGetLast(Map map){
+    MAP_LATENCY_START(map);
+    MapKeyElement key = mapGetLastUntimed(map);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_ITERATE);
+    return key;
+}
+
+/**
+ ***** Function: mapGetLastUntimed *****
+ * Description: mapGetLast, without recording its latency.
+ */
+static MapKeyElement mapGetLastUntimed(Map map){
+    if(!map || map->extension->disk){
+        return NULL;
+    }
+    if(map->is_frozen){
+        MapFrozen frozen = map->extension->frozen;
+        frozen->iterator = mapFrozenSkipExpiredBackward(map,map->mapSize-1);
+        return frozen->iterator<0 ? NULL :
+               mapFrozenKey(map,frozen->iterator,frozen->key,
+                            &frozen->cursor);
+    }
+    if(map->is_small){
+        map->small_iterator = map->mapSize-1;
+        return map->mapSize ? mapSmallKeys(map)[map->mapSize-1] : NULL;
+    }
+    map->extension->iterator = mapSkipExpiredBackward(map,
+                                                      map->extension->last);
+    return nodeGetKey(map->extension->iterator);
+}
+
+/**
+***** Function: mapGetPrev *****
+* Description: Moves the map iterator back to the previous (smaller) key
+* element and returns it. mapGetNext and mapGetPrev may be mixed on the
+* same iteration.
+*
+* @param map - The map for which to move the iterator.
+* @return
+* NULL if moved before the start of the map, or the iterator is at an
+* invalid state, the map is disk tiered or a NULL sent as argument.
+* The previous key element on the map in case of success.
+*/
+MapKeyElement mapGetPrev(Map map){
+    MAP_LATENCY_START(map);
+    MapKeyElement key = mapGetPrevUntimed(map);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_ITERATE);
+    return key;
+}
+
+/**
+ ***** Function: mapGetPrevUntimed *****
+ * Description: mapGetPrev, without recording its latency.
+ */
+static MapKeyElement mapGetPrevUntimed(Map map){
+    if(!map || map->extension->disk){
+        return NULL;
+    }
+    if(map->is_frozen){
+        MapFrozen frozen = map->extension->frozen;
+        if(frozen->iterator<0){
+            return NULL;
+        }
+        frozen->iterator = mapFrozenSkipExpiredBackward(map,
+                                                        frozen->iterator-1);
+        /* Reached the start of the map, or not. */
+        return frozen->iterator<0 ? NULL :
+               mapFrozenKey(map,frozen->iterator,frozen->key,
+                            &frozen->cursor);
+    }
+    if(map->is_small){
+        if(map->small_iterator<0){
+            return NULL;
+        }
+        map->small_iterator--;
+        if(map->small_iterator<0){
+            /* Reached the start of the map. */
+            return NULL;
+        }
+        return mapSmallKeys(map)[map->small_iterator];
+    }
+    if(!map->extension->iterator){
+        /* Reached the start of the map. */
+        return NULL;
+    }
+    map->extension->iterator = mapSkipExpiredBackward(map,
+                                      nodeGetPrevious(
+                                          map->extension->iterator));
+    return nodeGetKey(map->extension->iterator);
+}
+
+/**
+***** Function: mapPopFirst *****
+* Description: Removes the entry with the smallest key in O(1) and hands
+* its elements over to the caller, so the map can serve as a priority
+* queue. If the map has concurrent readers or interns its values, the
+* caller gets copies of the elements instead, since the map's own ones may
+* still be in use.
+* Iterator's value is undefined after this operation.
+*
+* @param map - The map to remove the entry from.
+* @param keyElement - Will hold the key element, which the caller frees
+* with the map's key free function. If NULL, the key is freed.
+* @param dataElement - Will hold the data element, which the caller frees
+* with the map's data free function. If NULL, the data is freed.
+* @return
+* MAP_NULL_ARGUMENT if a NULL was sent as map.
+* MAP_FROZEN if the map is frozen.
+* MAP_UNSUPPORTED_MODE if the map is disk tiered.
+* MAP_ITEM_DOES_NOT_EXIST if the map is empty.
+* MAP_OUT_OF_MEMORY if copying an element failed. The map is unchanged.
+* MAP_SUCCESS the entry was removed.
+*/
+MapResult mapPopFirst(Map map, MapKeyElement* keyElement,
+                      MapDataElement* dataElement){
+    MAP_LATENCY_START(map);
+    MapResult status = mapPopEntry(map,false,keyElement,dataElement);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_REMOVE);
+    return status;
+}
+
+/**
+***** Function: mapPopLast *****
+* Description: Removes the entry with the greatest key in O(1), like
+* mapPopFirst.
+* Iterator's value is undefined after this operation.
+*
+* @param map - The map to remove the entry from.
+* @param keyElement - Will hold the key element. If NULL, it is freed.
+* @param dataElement - Will hold the data element. If NULL, it is freed.
+* @return
+* As mapPopFirst.
+*/
+MapResult mapPopLast(Map map, MapKeyElement* keyElement,
+                     MapDataElement* dataElement){
+    MAP_LATENCY_START(map);
+    MapResult status = mapPopEntry(map,true,keyElement,dataElement);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_REMOVE);
+    return status;
+}
+
+/**
+ ***** Function: mapPopEntry *****
+ * Description: mapPopFirst and mapPopLast, without recording their
+ * latency.
+ *
+ * @param map - The map to remove the entry from.
+ * @param last - Whether to remove the last entry rather than the first.
+ * @param keyElement - Will hold the key element. May be NULL.
+ * @param dataElement - Will hold the data element. May be NULL.
+ * @return
+ * As mapPopFirst.
+ */
+static MapResult mapPopEntry(Map map, bool last, MapKeyElement* keyElement,
+                             MapDataElement* dataElement){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    if(map->extension->disk){
+        return MAP_UNSUPPORTED_MODE;
+    }
+    mapResetIterator(map);
+    int index = last ? map->mapSize-1 : 0;
+    Node node = NULL;
+    if(!map->is_small){
+        mapSweepExpired(map,MAP_TTL_SWEEP_BUDGET);
+        node = last ? mapSkipExpiredBackward(map,map->extension->last) :
+               mapSkipExpired(map,map->entries.list);
+    }
+    if(map->is_small ? map->mapSize==0 : !node){
+        return MAP_ITEM_DOES_NOT_EXIST;
+    }
+    MapKeyElement key = node ? nodeGetKey(node) : mapSmallKeys(map)[index];
+    MapDataElement data = node ? mapNodeData(map,node) :
+                          mapSmallGetData(map,index);
+    /* Readers may still be on the elements of a node, and interned values
+     * are shared: the caller gets copies of those. */
+    MapFeatures features = map->extension->features;
+    bool hand_key = keyElement && !features->epochs;
+    bool hand_data = dataElement && !features->epochs && !features->values;
+    MapKeyElement key_out = hand_key || !keyElement ? key :
+                            map->copyKeyElement(key);
+    MapDataElement data_out = hand_data || !dataElement ? data :
+                              map->copyDataElement(data);
+    if(!key_out || !data_out){
+        if(key_out && !hand_key && keyElement){
+            map->freeKeyElement(key_out);
+        }
+        if(data_out && !hand_data && dataElement){
+            map->freeDataElement(data_out);
+        }
+        return MAP_OUT_OF_MEMORY;
+    }
+    mapTrace(map,TRACE_REMOVE,key);
+    mapPublishChange(map,MAP_CHANGE_REMOVE,key,NULL);
+    if(map->is_small){
+        if(!hand_key){
+            map->freeKeyElement(key);
+        }
+        if(!hand_data){
+            mapFreeData(map,data);
+        }
+        mapSmallDetach(map,index);
+    } else if(map->extension->features->epochs){
+        mapDeleteNode(map,node);
+    } else {
+        mapUnlinkNode(map,node);
+        mapNodeDestroy(map,node,
+                       hand_data ? mapKeepElement : map->freeDataElement,
+                       hand_key ? mapKeepElement : map->freeKeyElement);
+    }
+    if(keyElement){
+        *keyElement = key_out;
+    }
+    if(dataElement){
+        *dataElement = data_out;
+    }
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapClear *****
+* Description: Removes all key and data elements from target map in a
+* single pass. The elements are deallocated using the stored free
+* functions.
+*
+* @param map - Target map to remove all element from.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL pointer was sent.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapClear(Map map) {
+    MAP_LATENCY_START(map);
+    MapResult status = mapClearUntimed(map);
+    MAP_LATENCY_STOP(map,MAP_OPERATION_CLEAR);
+    return status;
+}
+
+/**
+ ***** Function: mapClearUntimed *****
+ * Description: mapClear, without recording its latency.
+ */
+static MapResult mapClearUntimed(Map map) {
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    mapTrace(map,TRACE_CLEAR,NULL);
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    mapPublishChange(map,MAP_CHANGE_CLEAR,NULL,NULL);
+    map->small_iterator = -1;
+    while(map->is_small && map->mapSize){
+        mapSmallRemove(map,map->mapSize-1);
+    }
+    if(map->extension->disk){
+        mapDiskEndIteration(map);
+        diskTierClear(map->extension->disk->tier);
+        mapClearUntimed(map->extension->disk->removed);
+        mapClearUntimed(map->extension->disk->read);
+        map->extension->disk->size = 0;
+    }
+    mapDropNodes(map);
+    map->is_small = mapCanBeSmall(map);
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapDropNodes *****
+ * Description: Frees all the nodes of the map at once, without reporting
+ * them as removed.
+ *
+ * @param map - The map.
+ */
+static void mapDropNodes(Map map){
+    if(map->is_small){
+        return;
+    }
+    Node node = map->entries.list;
+    mapSetFirstNode(map,NULL);
+    while(node){
+        /* The lists are dropped as a whole, so nodes aren't unlinked one by
+         * one. */
+        Node next_node = nodeGetNext(node);
+        mapClearNodeExpiry(map,node);
+        if(map->extension->features->epochs){
+            mapRetireNode(map,node);
+        } else {
+            mapNodeDestroy(map,node,map->freeDataElement,map->freeKeyElement);
+        }
+        node = next_node;
+    }
+    map->extension->last = NULL;
+    map->extension->iterator = NULL;
+    if(map->extension->lru){
+        map->extension->lru->head = NULL;
+        map->extension->lru->tail = NULL;
+    }
+    map->mapSize = 0;
+    map->extension->version++;
+    MapFeatures features = map->extension->features;
+    if(features->radix){
+        radixTreeClear(features->radix);
+    }
+    if(features->fingerprints){
+        hashIndexClear(features->fingerprints);
+    }
+    if(features->bloom){
+        bloomFilterClear(features->bloom);
+        features->bloom_removals = 0;
+    }
+}
+
+/**
+***** Function: mapClearStep *****
+* Description: Removes at most 'budget' key and data elements from target
+* map, starting with the smallest keys. Lets a large map be cleared (or
+* destroyed, by calling mapDestroy once it's empty) over several calls.
+* Iterator's value is undefined after this operation.
+*
+* @param map - Target map to remove elements from.
+* @param budget - Maximal amount of elements to remove.
+* @return
+* ILLEGAL_VALUE - if a NULL pointer was sent, or if the map is disk tiered
+* and an allocation or a read or write of its runs failed.
+* The number of elements left in the map otherwise.
+*/
+int mapClearStep(Map map, int budget){
+    if(!map){
+        return ILLEGAL_VALUE;
+    }
+    if(map->is_frozen){
+        return ILLEGAL_VALUE;
+    }
+    if(map->extension->disk){
+        return budget>0 && mapDiskRemoveIf(map,NULL,NULL,budget)==
+                           ILLEGAL_VALUE ? ILLEGAL_VALUE :
+               map->extension->disk->size;
+    }
+    mapResetIterator(map);
+    for(int i=0;i<budget && map->is_small && map->mapSize;i++){
+        mapPublishChange(map,MAP_CHANGE_REMOVE,mapSmallKeys(map)[0],NULL);
+        mapSmallRemove(map,0);
+    }
+    for(int i=0;i<budget && !map->is_small && map->entries.list;i++){
+        mapPublishChange(map,MAP_CHANGE_REMOVE,nodeGetKey(map->entries.list),
+                         NULL);
+        mapDeleteNode(map,map->entries.list);
+    }
+    MapFeatures features = map->extension->features;
+    if(!map->mapSize && features->bloom){
+        bloomFilterClear(features->bloom);
+        features->bloom_removals = 0;
+    }
+    return map->mapSize;
+}
+
+/**
+***** Function: mapSetBloomFilter *****
+* Description: Enables a Bloom filter over the map's keys, which lets
+* lookups of absent keys return without scanning the map. The filter is
+* kept up to date by every insertion and is rebuilt lazily (by the next
+* lookup) once the map outgrew it or many entries were removed since it
+* was built.
+*
+* @param map - The map.
+* @param hashKeyElement - Hash function of the keys; equal keys must have
+* equal hashes. NULL disables the filter.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_OUT_OF_MEMORY - if an allocation failed. The map is left without a
+* filter.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetBloomFilter(Map map, hashMapKeyElements hashKeyElement){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    if((map->extension->features->epochs || map->extension->disk) &&
+       hashKeyElement){
+        /* The filter is rebuilt by lookups, which readers must not do. A
+         * disk tier has filters of its own. */
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(!hashKeyElement && !mapHasFeatures(map)){
+        /* No filter to disable. */
+        return MAP_SUCCESS;
+    }
+    if(hashKeyElement && (mapPromote(map)!=MAP_SUCCESS ||
+                          !mapExtendFeatures(map))){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    bloomFilterDestroy(features->bloom);
+    features->bloom = NULL;
+    features->hashKeyElement = hashKeyElement;
+    if(!hashKeyElement){
+        return MAP_SUCCESS;
+    }
+    MapResult status = mapBloomRebuild(map);
+    if(status!=MAP_SUCCESS){
+        features->hashKeyElement = NULL;
+    }
+    return status;
+}
+
+/**
+***** Function: mapSetKeyFingerprint *****
+* Description: Lets the map keep a fingerprint (a condensed hash) of every
+* key, in a hash index of its nodes. Looking a key up by equality (mapGet,
+* mapContains, mapRemove) then probes the index, and only calls the
+* compare function on nodes which fingerprint matches; a missing key is
+* usually found missing without any call. Useful for keys which are
+* expensive to compare.
+*
+* @param map - The map.
+* @param fingerprintKeyElement - Hash function of the keys; equal keys must
+* have equal hashes. NULL stops using fingerprints.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_FROZEN - if the map is frozen.
+* MAP_OUT_OF_MEMORY - if an allocation failed. The map is unchanged.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetKeyFingerprint(Map map,
+                               hashMapKeyElements fingerprintKeyElement){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    if(!fingerprintKeyElement){
+        if(mapHasFeatures(map)){
+            MapFeatures features = map->extension->features;
+            hashIndexDestroy(features->fingerprints);
+            features->fingerprints = NULL;
+            features->fingerprintKeyElement = NULL;
+        }
+        return MAP_SUCCESS;
+    }
+    if(mapPromote(map)!=MAP_SUCCESS || !mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    HashIndex fingerprints = hashIndexCreate(mapAllocator(map));
+    if(!fingerprints){
+        return MAP_OUT_OF_MEMORY;
+    }
+    hashMapKeyElements previous = features->fingerprintKeyElement;
+    features->fingerprintKeyElement = fingerprintKeyElement;
+    for(Node node = map->entries.list; node; node = nodeGetNext(node)){
+        if(hashIndexInsert(fingerprints,
+                           mapKeyFingerprint(map,nodeGetKey(node)),
+                           node)!=HASH_INDEX_SUCCESS){
+            hashIndexDestroy(fingerprints);
+            features->fingerprintKeyElement = previous;
+            return MAP_OUT_OF_MEMORY;
+        }
+    }
+    hashIndexDestroy(features->fingerprints);
+    features->fingerprints = fingerprints;
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapSetValueInterning *****
+* Description: Makes the map keep a single reference counted copy of every
+* distinct data element instead of a copy per key. The map and its copies
+* share the values. Can only be set on an empty map.
+*
+* @param map - The map.
+* @param hashDataElement - Hash function of the data elements. NULL stops
+* interning.
+* @param equalDataElements - Equality function of the data elements.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent, or a hash function without an
+* equality function.
+* MAP_UNSUPPORTED_MODE - if the map isn't empty or is key-only.
+* MAP_OUT_OF_MEMORY - if an allocation failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetValueInterning(Map map, hashMapDataElements hashDataElement,
+                               equalMapDataElements equalDataElements){
+    if(!map || (hashDataElement && !equalDataElements)){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->mapSize || map->extension->disk || !mapHasData(map)){
+        /* The stored values weren't interned, or there are none. */
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(!hashDataElement && !mapHasFeatures(map)){
+        /* Not interning anyway. */
+        return MAP_SUCCESS;
+    }
+    if(!mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    ValuePool values = NULL;
+    if(hashDataElement){
+        values = valuePoolCreate(hashDataElement,equalDataElements,
+                                 map->copyDataElement,map->freeDataElement,
+                                 mapAllocator(map));
+        if(!values){
+            return MAP_OUT_OF_MEMORY;
+        }
+    }
+    valuePoolDestroy(map->extension->features->values);
+    map->extension->features->values = values;
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapSetKeyCompression *****
+* Description: Makes mapFreeze of a string keyed map store its keys front
+* coded in blocks, instead of a copy per key.
+*
+* @param map - A map created by mapCreateStringKeyed.
+* @param enabled - Whether to compress the keys of the frozen map.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_FROZEN - if the map is frozen.
+* MAP_UNSUPPORTED_MODE - if compression is enabled on a map which isn't
+* string keyed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetKeyCompression(Map map, bool enabled){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    if(enabled && !map->extension->features->radix){
+        /* Only strings can be front coded. */
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(mapHasFeatures(map)){
+        /* Without feature state the keys aren't compressed anyway. */
+        map->extension->features->compress_keys = enabled;
+    }
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapSetDiskTier *****
+* Description: Makes the map's nodes a memtable, written to a new run on
+* disk whenever it holds memtableCapacity entries and removals. Can only be
+* set on an empty map.
+*
+* @param map - The map.
+* @param directory - Existing directory to keep the run files in.
+* @param memtableCapacity - Entries and removals kept in memory.
+* @param hashKeyElement - Hash function of the key elements.
+* @param writeKeyElement - Writes a key element to a run.
+* @param readKeyElement - Reads back a key element.
+* @param writeDataElement - Writes a data element to a run.
+* @param readDataElement - Reads back a data element.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL argument was sent.
+* MAP_FROZEN - if the map is frozen.
+* MAP_UNSUPPORTED_MODE - if the map isn't empty or can't have a disk tier.
+* MAP_OUT_OF_MEMORY - if an allocation failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetDiskTier(Map map, const char* directory,
+                         int memtableCapacity,
+                         hashMapKeyElements hashKeyElement,
+                         writeMapElement writeKeyElement,
+                         readMapElement readKeyElement,
+                         writeMapElement writeDataElement,
+                         readMapElement readDataElement){
+    if(!map || !directory || !hashKeyElement || !writeKeyElement ||
+       !readKeyElement || !writeDataElement || !readDataElement){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    MapFeatures features = map->extension->features;
+    if(map->mapSize || map->extension->disk || map->extension->lru ||
+       features->radix || features->wheel || features->epochs ||
+       features->values || features->bloom || !mapHasData(map) ||
+       memtableCapacity <= 0){
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(mapPromote(map)!=MAP_SUCCESS){
+        return MAP_OUT_OF_MEMORY;
+    }
+    TierFormat format = {writeKeyElement, readKeyElement,
+                         map->freeKeyElement, writeDataElement,
+                         readDataElement, map->freeDataElement,
+                         map->compareKeyElements, hashKeyElement};
+    return mapAttachDisk(map,diskTierCreate(directory,&format,
+                                            mapAllocator(map)),
+                         memtableCapacity);
+}
+
+/**
+***** Function: mapFlush *****
+* Description: Writes the memtable of a disk tiered map to a new run, and
+* waits for a background merge of the runs to finish.
+* Iterator's value is undefined after this operation.
+*
+* @param map - The map.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_UNSUPPORTED_MODE - if the map has no disk tier.
+* MAP_IO_ERROR - if writing the run or merging the runs failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapFlush(Map map){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(!map->extension->disk){
+        return MAP_UNSUPPORTED_MODE;
+    }
+    MapResult status = mapDiskFlush(map);
+    if(status!=MAP_SUCCESS){
+        return status;
+    }
+    return diskTierWait(map->extension->disk->tier) ? MAP_SUCCESS :
+                                                      MAP_IO_ERROR;
+}
+
+/**
+***** Function: mapGetDiskRuns *****
+* Description: Returns the number of runs of a disk tiered map.
+*
+* @param map - The map.
+* @return
+* ILLEGAL_VALUE if a NULL map was sent.
+* 0 if the map has no disk tier.
+* The number of runs otherwise.
+*/
+int mapGetDiskRuns(Map map){
+    if(!map){
+        return ILLEGAL_VALUE;
+    }
+    return map->extension->disk ?
+           diskTierGetRunsNumber(map->extension->disk->tier) : 0;
+}
+
+/**
+***** Function: mapGetBloomFilterStatistics *****
+* Description: Reports the state of the map's Bloom filter.
+*
+* @param map - The map.
+* @param falsePositiveRate - Will hold the estimated probability that a
+* lookup of an absent key still scans the map (1 if there is no filter).
+* Ignored if NULL.
+* @param memoryBytes - Will hold the number of bytes held by the filter.
+* Ignored if NULL.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapGetBloomFilterStatistics(Map map, double* falsePositiveRate,
+                                      size_t* memoryBytes){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    BloomFilter bloom = map->extension->features->bloom;
+    if(falsePositiveRate){
+        *falsePositiveRate = bloom ? bloomFilterGetFalsePositiveRate(bloom) :
+                                     1;
+    }
+    if(memoryBytes){
+        *memoryBytes = bloom ? bloomFilterGetMemoryUsage(bloom) : 0;
+    }
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapGetMemoryUsage *****
+* Description: Reports the memory held by the map. The map's own bytes
+* (the map, its nodes, timers, index and filter) are counted as they are
+* allocated, so they are returned in O(1). The bytes held by the elements
+* are only known to the user: they are summed over all the entries, in
+* O(n), with the given size functions. The keys of a string keyed map are
+* measured by the map if no key size function is given.
+* Iterator status unchanged.
+*
+* @param map - The map.
+* @param sizeKeyElement - Returns the bytes held by a key element. NULL to
+* count no bytes for the keys.
+* @param sizeDataElement - Returns the bytes held by a data element. NULL
+* to count no bytes for the data.
+* @param structureBytes - Will hold the bytes held by the map itself.
+* Ignored if NULL.
+* @param elementBytes - Will hold the bytes held by the elements. Ignored if
+* NULL (and then the entries aren't visited).
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapGetMemoryUsage(Map map, sizeMapKeyElements sizeKeyElement,
+                            sizeMapDataElements sizeDataElement,
+                            size_t* structureBytes, size_t* elementBytes){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(structureBytes){
+        *structureBytes = mapHasExtension(map) ?
+                          map->extension->allocator.bytes :
+                          sizeof(*map)+mapSmallBlockSize(map);
+    }
+    if(!elementBytes){
+        return MAP_SUCCESS;
+    }
+    size_t bytes = 0;
+    if(map->is_small || map->is_frozen){
+        MapKeyElement* keys = map->is_small ? mapSmallKeys(map) :
+                              map->extension->frozen->keys;
+        for(int i=0;i<map->mapSize;i++){
+            MapDataElement data = map->is_small ? mapSmallGetData(map,i) :
+                                  map->extension->frozen->data[i];
+            if(!keys){
+                /* Front coded keys are part of the map itself. */
+                bytes += sizeDataElement && mapHasData(map) ?
+                         sizeDataElement(data) : 0;
+                continue;
+            }
+            bytes += mapNodeElementsSize(map,keys[i],data,sizeKeyElement,
+                                         sizeDataElement);
+        }
+    }
+    for(Node node = map->is_small ? NULL : map->entries.list; node;
+        node = nodeGetNext(node)){
+        bytes += mapNodeElementsSize(map,nodeGetKey(node),
+                                     mapNodeData(map,node),sizeKeyElement,
+                                     sizeDataElement);
+    }
+    *elementBytes = bytes;
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapTraceStart *****
+* Description: Starts recording the operations done on the map into a
+* trace file: every mapPut (and its variants), mapGet, mapContains,
+* mapRemove, mapGetFirst, mapGetNext and mapClear is logged with its time
+* and an identifier of its key. The trace can be replayed with map_replay.
+* A trace already being recorded is stopped first.
+*
+* @param map - The map to trace.
+* @param path - Path of the trace file. An existing file is replaced.
+* @param traceKeyElement - Gives the identifier recorded for a key. Equal
+* keys should get equal identifiers.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL argument was sent.
+* MAP_IO_ERROR - if the file can't be created.
+* MAP_OUT_OF_MEMORY - if an allocation failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapTraceStart(Map map, const char* path,
+                        hashMapKeyElements traceKeyElement){
+    if(!map || !path || !traceKeyElement){
+        return MAP_NULL_ARGUMENT;
+    }
+    mapTraceStop(map);
+    if(!mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    features->trace = traceWriterCreate(path);
+    if(!features->trace){
+        return MAP_IO_ERROR;
+    }
+    features->traceKeyElement = traceKeyElement;
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapTraceStop *****
+* Description: Stops recording the map's operations and closes the trace
+* file. Does nothing if the map isn't traced.
+*
+* @param map - The traced map.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_IO_ERROR - if writing any part of the trace failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapTraceStop(Map map){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(!mapHasFeatures(map)){
+        /* Never traced. */
+        return MAP_SUCCESS;
+    }
+    MapFeatures features = map->extension->features;
+    bool written = traceWriterDestroy(features->trace);
+    features->trace = NULL;
+    features->traceKeyElement = NULL;
+    return written ? MAP_SUCCESS : MAP_IO_ERROR;
+}
+
+/**
+***** Function: mapSetLatencyHistograms *****
+* Description: Starts or stops recording the latency of the map's public
+* operations into a log-bucket histogram per operation. Stopping frees the
+* histograms.
+*
+* @param map - The map.
+* @param enabled - Whether latencies should be recorded.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_UNSUPPORTED_MODE - if built without MAP_LATENCY_HISTOGRAMS.
+* MAP_OUT_OF_MEMORY - if an allocation failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetLatencyHistograms(Map map, bool enabled){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+#ifdef MAP_LATENCY_HISTOGRAMS
+    if(!enabled && !mapHasFeatures(map)){
+        /* Never recorded. */
+        return MAP_SUCCESS;
+    }
+    if(!mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    if(!enabled){
+        mapDeallocate(map,features->latency,
+                      sizeof(LatencyHistogram)*MAP_OPERATIONS_NUMBER);
+        features->latency = NULL;
+        return MAP_SUCCESS;
+    }
+    if(!features->latency){
+        features->latency = mapAllocate(map,sizeof(LatencyHistogram)*
+                                            MAP_OPERATIONS_NUMBER);
+        if(!features->latency){
+            return MAP_OUT_OF_MEMORY;
+        }
+        mapResetLatencyHistograms(map);
+    }
+    return MAP_SUCCESS;
+#else
+    return enabled ? MAP_UNSUPPORTED_MODE : MAP_SUCCESS;
+#endif
+}
+
+/**
+***** Function: mapGetLatencyHistogram *****
+* Description: Copies out the latency histogram of an operation. The
+* histogram is empty if latencies aren't recorded.
+*
+* @param map - The map.
+* @param operation - The operation.
+* @param histogram - Will hold the histogram.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL was sent.
+* MAP_UNSUPPORTED_MODE - if built without MAP_LATENCY_HISTOGRAMS.
+* MAP_ITEM_DOES_NOT_EXIST - if the operation is not a MapOperation.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapGetLatencyHistogram(Map map, MapOperation operation,
+                                 LatencyHistogram* histogram){
+    if(!map || !histogram){
+        return MAP_NULL_ARGUMENT;
+    }
+#ifdef MAP_LATENCY_HISTOGRAMS
+    if(operation<0 || operation>=MAP_OPERATIONS_NUMBER){
+        return MAP_ITEM_DOES_NOT_EXIST;
+    }
+    if(!map->extension->features->latency){
+        latencyHistogramReset(histogram);
+        return MAP_SUCCESS;
+    }
+    *histogram = map->extension->features->latency[operation];
+    return MAP_SUCCESS;
+#else
+    return MAP_UNSUPPORTED_MODE;
+#endif
+}
+
+/**
+***** Function: mapResetLatencyHistograms *****
+* Description: Empties the latency histograms of all the operations.
+*
+* @param map - The map.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_UNSUPPORTED_MODE - if built without MAP_LATENCY_HISTOGRAMS.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapResetLatencyHistograms(Map map){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+#ifdef MAP_LATENCY_HISTOGRAMS
+    LatencyHistogram* latency = map->extension->features->latency;
+    for(int i=0;latency && i<MAP_OPERATIONS_NUMBER;i++){
+        latencyHistogramReset(&latency[i]);
+    }
+    return MAP_SUCCESS;
+#else
+    return MAP_UNSUPPORTED_MODE;
+#endif
+}
+
+/**
+***** Function: mapSubscribeChanges *****
+* Description: Starts logging every change of the map into a bounded
+* single producer / single consumer ring buffer, drained by a consumer
+* thread with mapDrainChanges. Logging a change copies its key and data
+* with the copy functions and never waits for the consumer: a change which
+* doesn't fit (or can't be copied) is lost, leaving a gap in the sequence
+* numbers. A subscription already in place is replaced.
+*
+* @param map - The map.
+* @param capacity - Minimal number of changes the buffer holds.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_OUT_OF_MEMORY - if capacity isn't positive or an allocation failed.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSubscribeChanges(Map map, int capacity){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    mapUnsubscribeChanges(map);
+    if(!mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    features->change_log = changeLogCreate(capacity,sizeof(MapChange),
+                                           mapAllocator(map));
+    return features->change_log ? MAP_SUCCESS : MAP_OUT_OF_MEMORY;
+}
+
+/**
+***** Function: mapUnsubscribeChanges *****
+* Description: Stops logging the map's changes, and frees the changes which
+* weren't taken. The consumer must not be draining anymore.
+*
+* @param map - The map.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapUnsubscribeChanges(Map map){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(!map->extension->features->change_log){
+        return MAP_SUCCESS;
+    }
+    MapFeatures features = map->extension->features;
+    MapChange changes[MAP_CHANGES_BATCH];
+    int taken = 0;
+    while((taken = changeLogDrain(features->change_log,changes,
+                                  MAP_CHANGES_BATCH))>0){
+        mapFreeChanges(map,changes,taken);
+    }
+    changeLogDestroy(features->change_log);
+    features->change_log = NULL;
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapDrainChanges *****
+* Description: Takes the oldest logged changes of the map, in the order
+* they were made. Called by the single consumer thread, concurrently with
+* the writer.
+*
+* @param map - The map.
+* @param changes - Array of at least 'max' changes to fill.
+* @param max - Maximal number of changes to take.
+* @return
+* ILLEGAL_VALUE - if a NULL was sent or the map has no subscription.
+* The number of changes taken otherwise.
+*/
+int mapDrainChanges(Map map, MapChange* changes, int max){
+    if(!map || !changes || !map->extension->features->change_log){
+        return ILLEGAL_VALUE;
+    }
+    return changeLogDrain(map->extension->features->change_log,changes,max);
+}
+
+/**
+***** Function: mapFreeChanges *****
+* Description: Frees the elements of taken changes with the map's free
+* functions.
+*
+* @param map - The map the changes were taken from.
+* @param changes - The changes.
+* @param count - Number of changes.
+*/
+void mapFreeChanges(Map map, MapChange* changes, int count){
+    if(!map || !changes){
+        return;
+    }
+    for(int i=0;i<count;i++){
+        if(changes[i].key){
+            map->freeKeyElement(changes[i].key);
+        }
+        if(changes[i].data){
+            map->freeDataElement(changes[i].data);
+        }
+        changes[i].key = NULL;
+        changes[i].data = NULL;
+    }
+}
+
+/**
+***** Function: mapGetPendingChanges *****
+* Description: Returns the number of logged changes which weren't taken
+* yet.
+*
+* @param map - The map.
+* @return
+* ILLEGAL_VALUE - if a NULL map was sent or the map has no subscription.
+* The number of pending changes otherwise.
+*/
+int mapGetPendingChanges(Map map){
+    if(!map || !map->extension->features->change_log){
+        return ILLEGAL_VALUE;
+    }
+    return changeLogGetSize(map->extension->features->change_log);
+}
+
+/**
+***** Function: mapEnableConcurrentReads *****
+* Description: Lets reader threads search the map while a single writer
+* thread keeps modifying it, without locks (read-copy-update). Readers use
+* their own handles (see mapReaderCreate) and never block the writer: the
+* writer links new nodes in with release stores, replaces a node instead
+* of changing its data, and frees unlinked nodes only once no reader can
+* still be on them (epoch based reclamation), using the free functions.
+* Features which modify the map on lookups (LRU order, TTLs, a Bloom
+* filter) or index it outside of the list (string keys) can't be used in
+* this mode, and the map stops being small. The mode lasts until the map is
+* destroyed.
+*
+* @param map - The map.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_FROZEN - if the map is frozen.
+* MAP_UNSUPPORTED_MODE - if the map is bounded, string keyed, has a Bloom
+* filter or has ever had an entry with a TTL.
+* MAP_OUT_OF_MEMORY - if an allocation failed.
+* MAP_SUCCESS - Otherwise (also if the mode was already on).
+*/
+MapResult mapEnableConcurrentReads(Map map){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_frozen){
+        return MAP_FROZEN;
+    }
+    if(map->extension->features->epochs){
+        return MAP_SUCCESS;
+    }
+    MapFeatures features = map->extension->features;
+    if(map->extension->lru || features->radix || features->bloom ||
+       features->wheel || map->extension->disk){
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(mapPromote(map)!=MAP_SUCCESS || !mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    features = map->extension->features;
+    features->epochs = epochDomainCreate(mapAllocator(map));
+    return features->epochs ? MAP_SUCCESS : MAP_OUT_OF_MEMORY;
+}
+
+/**
+***** Function: mapReaderCreate *****
+* Description: Creates a handle for a reader thread of a map with
+* concurrent reads. May be called from the reader thread.
+*
+* @param map - The map.
+* @return
+* NULL if a NULL map was sent, concurrent reads are not enabled or in case
+* of memory fail.
+* A new reader otherwise.
+*/
+MapReader mapReaderCreate(Map map){
+    if(!map || !map->extension->features->epochs){
+        return NULL;
+    }
+    /* Readers are created on their own threads, so they don't use the
+     * map's allocator. */
+    MapReader reader = malloc(sizeof(*reader));
+    if(!reader){
+        return NULL;
+    }
+    reader->map = map;
+    reader->epoch_reader =
+            epochReaderRegister(map->extension->features->epochs);
+    if(!reader->epoch_reader){
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+/**
+***** Function: mapReaderDestroy *****
+* Description: Frees a reader handle. Must be called outside of a read
+* section, and before the map is destroyed.
+*
+* @param reader - The reader. If NULL nothing will be done.
+*/
+void mapReaderDestroy(MapReader reader){
+    if(!reader){
+        return;
+    }
+    epochReaderUnregister(reader->epoch_reader);
+    free(reader);
+}
+
+/**
+***** Function: mapReadBegin *****
+* Description: Starts a read section. Entries reached inside the section
+* (and the elements returned by mapReaderGet) stay valid until mapReadEnd.
+* Takes no lock and never waits. Sections don't nest.
+*
+* @param reader - The reader.
+*/
+void mapReadBegin(MapReader reader){
+    assert(reader);
+    epochReaderEnter(reader->epoch_reader);
+}
+
+/**
+***** Function: mapReadEnd *****
+* Description: Ends a read section. The writer may free entries the reader
+* saw from now on.
+*
+* @param reader - The reader.
+*/
+void mapReadEnd(MapReader reader){
+    assert(reader);
+    epochReaderExit(reader->epoch_reader);
+}
+
+/**
+***** Function: mapReaderGet *****
+* Description: Returns the data associated with a key, as seen by a reader.
+* Must be called inside a read section.
+*
+* @param reader - The reader.
+* @param keyElement - The key to look for.
+* @return
+* NULL if a NULL was sent or the key isn't in the map.
+* The data element otherwise, valid until the end of the read section.
+*/
+MapDataElement mapReaderGet(MapReader reader, MapKeyElement keyElement){
+    if(!reader || !keyElement){
+        return NULL;
+    }
+    Map map = reader->map;
+    Node node = __atomic_load_n(&map->entries.list, __ATOMIC_ACQUIRE);
+    while(node){
+        int compare = map->compareKeyElements(nodeGetKey(node), keyElement);
+        if(compare >= 0){
+            /* The list is sorted: the key is here or nowhere. */
+            return compare == 0 ? mapNodeData(map,node) : NULL;
+        }
+        node = nodeReadNext(node);
+    }
+    return NULL;
+}
+
+/**
+***** Function: mapReaderContains *****
+* Description: Checks whether a key is in the map, as seen by a reader.
+* Must be called inside a read section.
+*
+* @param reader - The reader.
+* @param keyElement - The key to look for.
+* @return
+* true if the key is in the map, false otherwise (or if a NULL was sent).
+*/
+bool mapReaderContains(MapReader reader, MapKeyElement keyElement){
+    return mapReaderGet(reader, keyElement) != NULL;
+}
+
+/**
+***** Function: mapReaderForEach *****
+* Description: Calls a function for every entry, in key order, as seen by a
+* reader. Entries put or removed concurrently may or may not be visited.
+* Must be called inside a read section.
+*
+* @param reader - The reader.
+* @param function - Called with every key, data and the context. Must not
+* modify the map.
+* @param context - Passed as is to the function.
+* @return
+* ILLEGAL_VALUE if a NULL was sent.
+* The number of entries visited otherwise.
+*/
+int mapReaderForEach(MapReader reader, mapEntryFunction function,
+                     void* context){
+    if(!reader || !function){
+        return ILLEGAL_VALUE;
+    }
+    int visited = 0;
+    Node node = __atomic_load_n(&reader->map->entries.list, __ATOMIC_ACQUIRE);
+    while(node){
+        function(nodeGetKey(node), mapNodeData(reader->map,node), context);
+        visited++;
+        node = nodeReadNext(node);
+    }
+    return visited;
+}
+
+/**
+***** Function: mapCompact *****
+* Description: Moves all the nodes of the map into one contiguous block, in
+* key order, and relinks them, so iterating and searching the map walk
+* memory sequentially again after long churn. Takes time and memory
+* proportional to the size of the map; the number of nodes moved is
+* reported so the caller can schedule it for idle time. Positions kept in
+* hints are invalidated. Small and frozen maps are already contiguous.
+* Iterator's value is unchanged.
+*
+* @param map - The map.
+* @param relocated - Will hold the number of nodes moved. May be NULL.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_UNSUPPORTED_MODE - if the map has concurrent readers.
+* MAP_OUT_OF_MEMORY - if an allocation failed. The map is unchanged.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapCompact(Map map, int* relocated){
+    if(relocated){
+        *relocated = 0;
+    }
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->extension->features->epochs){
+        /* Readers may be on the nodes. */
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(map->is_frozen || map->is_small || !map->entries.list){
+        return MAP_SUCCESS;
+    }
+    MapResult status = mapMoveNodes(map,map->extension->layout);
+    if(status==MAP_SUCCESS && relocated){
+        *relocated = map->mapSize;
+    }
+    return status;
+}
+
+/**
+***** Function: mapFreeze *****
+* Description: Turns the map into an immutable, read optimized form: its
+* entries are moved (not copied) into flat arrays sorted by key, and all the
+* nodes are freed. Lookups are a branch free binary search over the
+* arrays and iteration walks them in order. Every function which would
+* modify the map fails with MAP_FROZEN (or -1) until mapThaw is called.
+* Expired entries are freed; entries with a TTL keep it, and become absent
+* once it passes. Iterator's value is undefined after this operation.
+*
+* @param map - The map to freeze.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_OUT_OF_MEMORY - if an allocation failed. The map is unchanged.
+* MAP_SUCCESS - The map is frozen (also if it already was).
+*/
+MapResult mapFreeze(Map map){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(map->is_frozen){
+        return MAP_SUCCESS;
+    }
+    if(map->extension->features->epochs || map->extension->disk){
+        /* Freezing frees all the nodes at once, readers may be on them. */
+        return MAP_UNSUPPORTED_MODE;
+    }
+    if(!mapExtend(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    mapResetIterator(map);
+    MapFeatures features = map->extension->features;
+    bool has_expiry = features->wheel &&
+                      timingWheelGetSize(features->wheel)>0;
+    int capacity = map->mapSize;
+    MapFrozen frozen = allocatorAllocateZeroed(mapAllocator(map),
+                                               sizeof(*frozen));
+    MapKeyElement* keys = mapAllocate(map,sizeof(*keys)*capacity + 1);
+    MapDataElement* data = mapAllocate(map,sizeof(*data)*capacity + 1);
+    WheelTick* expiry = has_expiry ?
+                        mapAllocate(map,sizeof(*expiry)*capacity + 1) : NULL;
+    if(!frozen || !keys || !data || (has_expiry && !expiry)){
+        mapDeallocate(map,frozen,sizeof(*frozen));
+        mapDeallocate(map,keys,sizeof(*keys)*capacity + 1);
+        mapDeallocate(map,data,sizeof(*data)*capacity + 1);
+        mapDeallocate(map,expiry,sizeof(*expiry)*capacity + 1);
+        return MAP_OUT_OF_MEMORY;
+    }
+    int size = 0;
+    if(map->is_small){
+        size = map->mapSize;
+        memcpy(keys,mapSmallKeys(map),sizeof(*keys)*size);
+        for(int i=0;i<size;i++){
+            data[i] = mapSmallGetData(map,i);
+        }
+        mapDeallocate(map,map->entries.small,mapSmallBlockSize(map));
+        map->entries.small = NULL;
+        map->small_capacity = 0;
+        map->is_small = false;
+    }
+    Node node = map->entries.list;
+    while(node){
+        Node next_node = nodeGetNext(node);
+        WheelTimer timer = mapGetNodeTimer(map,node);
+        if(mapIsExpired(map,node)){
+            /* Dropped like mapExpireNode does, subscribers see it go. */
+            mapPublishChange(map, MAP_CHANGE_REMOVE, nodeGetKey(node), NULL);
+            mapClearNodeExpiry(map,node);
+            mapNodeDestroy(map,node,map->freeDataElement,map->freeKeyElement);
+        } else {
+            /* The arrays take over the elements. */
+            keys[size] = nodeGetKey(node);
+            data[size] = mapNodeData(map,node);
+            if(expiry){
+                expiry[size] = timer ? timerGetExpiry(timer) : MAP_NO_EXPIRY;
+            }
+            size++;
+            mapClearNodeExpiry(map,node);
+            mapNodeDestroy(map,node,mapKeepElement,mapKeepElement);
+        }
+        node = next_node;
+    }
+    map->entries.list = NULL;
+    map->extension->last = NULL;
+    if(map->extension->lru){
+        map->extension->lru->head = NULL;
+        map->extension->lru->tail = NULL;
+    }
+    if(features->radix){
+        radixTreeClear(features->radix);
+    }
+    if(features->fingerprints){
+        hashIndexClear(features->fingerprints);
+    }
+    map->mapSize = size;
+    map->extension->version++;
+    frozen->keys = keys;
+    frozen->capacity = capacity;
+    frozen->data = data;
+    frozen->expiry = expiry;
+    frozen->iterator = -1;
+    frozen->cursor = (KeyBlocksCursor)KEY_BLOCKS_CURSOR_INITIALIZER;
+    map->extension->frozen = frozen;
+    map->is_frozen = true;
+    if(features->compress_keys){
+        /* Best effort: without memory the keys stay as they are. */
+        mapFrozenCompressKeys(map);
+    }
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapThaw *****
+* Description: Turns a frozen map back into a modifiable one. The entries
+* are moved back into nodes, in key order; a bounded map's recency order
+* becomes the key order (the greatest key is the most recently used).
+* Iterator's value is undefined after this operation.
+*
+* @param map - The map to thaw.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_OUT_OF_MEMORY - if an allocation failed. The map stays frozen.
+* MAP_SUCCESS - The map is modifiable (also if it wasn't frozen).
+*/
+MapResult mapThaw(Map map){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    if(!map->is_frozen){
+        return MAP_SUCCESS;
+    }
+    map->small_iterator = -1;
+    int size = map->mapSize;
+    MapFrozen frozen = map->extension->frozen;
+    if(mapCanBeSmall(map) && size<=MAP_SMALL_CAPACITY){
+        /* Only string keyed maps compress their keys, and they have no
+         * small form. */
+        assert(!frozen->blocks);
+        int capacity = 1;
+        while(capacity<size){
+            capacity *= 2;
+        }
+        /* A frozen map has no block yet. */
+        map->is_small = true;
+        map->mapSize = 0;
+        if(size && !mapSmallResize(map,capacity)){
+            map->is_small = false;
+            map->mapSize = size;
+            return MAP_OUT_OF_MEMORY;
+        }
+        memcpy(mapSmallKeys(map),frozen->keys,sizeof(MapKeyElement)*size);
+        if(mapHasData(map)){
+            memcpy(mapSmallData(map),frozen->data,
+                   sizeof(MapDataElement)*size);
+        }
+        map->mapSize = size;
+    } else {
+        /* The nodes take over the elements: nothing may be copied or freed
+         * on the way. */
+        copyMapKeyElements copy_key = map->copyKeyElement;
+        copyMapDataElements copy_data = map->copyDataElement;
+        freeMapKeyElements free_key = map->freeKeyElement;
+        freeMapDataElements free_data = map->freeDataElement;
+        MapFeatures features = map->extension->features;
+        ValuePool values = features->values;
+        if(values){
+            features->values = NULL;
+        }
+        map->copyKeyElement = mapAdoptElement;
+        map->copyDataElement = mapAdoptElement;
+        map->freeKeyElement = mapKeepElement;
+        map->freeDataElement = mapKeepElement;
+        map->mapSize = 0;
+        /* Front coded keys are decoded into new copies, which the nodes
+         * own. */
+        bool copy_keys = frozen->blocks != NULL;
+        KeyBlocksCursor cursor = KEY_BLOCKS_CURSOR_INITIALIZER;
+        int index = 0;
+        for(;index<size;index++){
+            Node node = NULL;
+            MapKeyElement key = mapFrozenKey(map,index,frozen->scratch,
+                                             &cursor);
+            key = copy_keys ? copy_key(key) : key;
+            if(!key || mapAddNewData(map,key,frozen->data[index],
+                                     map->extension->last,NULL,
+                                     &node)!=MAP_SUCCESS){
+                if(key && copy_keys){
+                    free_key(key);
+                }
+                break;
+            }
+            if(frozen->expiry && frozen->expiry[index]!=MAP_NO_EXPIRY &&
+               mapSetNodeExpiry(map,node,frozen->expiry[index])!=
+               MAP_SUCCESS){
+                mapDeleteNode(map,node);
+                if(copy_keys){
+                    free_key(key);
+                }
+                break;
+            }
+        }
+        if(index<size){
+            /* Memory fail: handing the elements back to the arrays. */
+            while(map->extension->last){
+                MapKeyElement key = nodeGetKey(map->extension->last);
+                mapDeleteNode(map,map->extension->last);
+                if(copy_keys){
+                    free_key(key);
+                }
+            }
+            map->mapSize = size;
+        }
+        map->copyKeyElement = copy_key;
+        map->copyDataElement = copy_data;
+        map->freeKeyElement = free_key;
+        map->freeDataElement = free_data;
+        if(values){
+            features->values = values;
+        }
+        if(index<size){
+            return MAP_OUT_OF_MEMORY;
+        }
+    }
+    mapFrozenFreeArrays(map);
+    map->is_frozen = false;
+    map->extension->iterator = NULL;
+    return MAP_SUCCESS;
+}
+
+/**
+***** Function: mapGetCacheStatistics *****
+* Description: Returns the lookup counters of the map. A hit is a mapGet
+* call which found its key and a miss is a mapGet call which didn't.
+* Evictions are entries removed by a bounded map to make room for a new
+* key (see mapCreateLRU). Only bounded maps count, others report zeros.
+*
+* @param map - The map which statistics are requested.
+* @param hits - Will hold the number of hits. Ignored if NULL.
+* @param misses - Will hold the number of misses. Ignored if NULL.
+* @param evictions - Will hold the number of evictions. Ignored if NULL.
+* @return
+* MAP_NULL_ARGUMENT - if a NULL map was sent.
+* MAP_SUCCESS - Otherwise.
+*/
+MapResult mapGetCacheStatistics(Map map, long* hits, long* misses,
+                                long* evictions){
+    if(!map){
+        return MAP_NULL_ARGUMENT;
+    }
+    /* Only bounded maps count their lookups. */
+    MapLru lru = map->extension->lru;
+    if(hits){
+        *hits = lru ? lru->hits : 0;
+    }
+    if(misses){
+        *misses = lru ? lru->misses : 0;
+    }
+    if(evictions){
+        *evictions = lru ? lru->evictions : 0;
+    }
+    return MAP_SUCCESS;
+}
+
+//-----------------------------------------------------------------------//
+//                        MAP: STATIC FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+***** Static function: mapGetNodeByKey *****
+* Description: Finds the node which the given key belongs to.
+*
+* @param map - The map to search the node in.
+* @param key - The key element which belongs to the node we are looking
+* for.
+*
+* @return
+* Node which contains the given key.
+* NULL if the key was not found in the map.
+*/
+static Node mapGetNodeByKey(Map map,MapKeyElement key){
+    assert(key);
+    if(!mapBloomMayContain(map,key)){
+        /* Definitely not in the map. */
+        return NULL;
+    }
+    if(map->extension->features->radix){
+        return radixTreeFind(map->extension->features->radix, key);
+    }
+    if(map->extension->features->fingerprintKeyElement){
+        return mapFindByFingerprint(map, key);
+    }
+    Node previous_node = NULL;
+    Node current_node = mapFindLowerBound(map, key, &previous_node);
+    if (current_node &&
+        map->compareKeyElements(nodeGetKey(current_node), key) == 0){
+        /* Node was found. */
+        return current_node;
+    }
+    /* Node with that key wasn't found. */
+    return NULL;
+}
+
+/**
+***** Static function: mapFindByFingerprint *****
+* Description: Finds the node of a key in the map's index of fingerprints,
+* calling the compare function only on nodes which fingerprint matches the
+* key's.
+*
+* @param map - The map to search the node in. Must have a fingerprint
+* function.
+* @param key - The key element to look for.
+*
+* @return
+* Node which contains the given key.
+* NULL if the key was not found in the map.
+*/
+static Node mapFindByFingerprint(Map map, MapKeyElement key){
+    struct map_key_search_t search = {map, key};
+    return hashIndexFind(map->extension->features->fingerprints,
+                         mapKeyFingerprint(map, key), mapNodeHasKey,
+                         &search);
+}
+
+/**
+***** Static function: mapKeyFingerprint *****
+* Description: Computes the fingerprint of a key.
+*
+* @param map - The map. Must have a fingerprint function.
+* @param key - The key element.
+*
+* @return
+* The key's hash, folded into an unsigned int.
+*/
+static unsigned int mapKeyFingerprint(Map map, MapKeyElement key){
+    unsigned long hash = map->extension->features->fingerprintKeyElement(key);
+    /* Folding the upper half (if any) so it isn't lost. */
+    return (unsigned int)(hash ^ (hash >> 16 >> 16));
+}
+
+/**
+***** Static function: mapNodeHasKey *****
+* Description: Match function of the index of fingerprints.
+*
+* @param node - A node which fingerprint is the searched key's.
+* @param search - The search.
+*
+* @return
+* Whether the node holds the searched key.
+*/
+static bool mapNodeHasKey(void* node, void* search){
+    MapKeySearch key_search = search;
+    return key_search->map->compareKeyElements(nodeGetKey(node),
+                                               key_search->key) == 0;
+}
+
+/**
+***** Static function: mapFindLowerBound *****
+* Description: Finds the first node which key is not smaller than the given
+* key. Since the list is sorted, this is where the key is or should be.
+*
+* @param map - The map to search the node in.
+* @param key - The key element to look for.
+* @param previous_node - Will hold the node before the returned one (the
+* last node if NULL is returned, NULL if the returned node is first).
+*
+* @return
+* The first node which key is greater or equal to the given key.
+* NULL if all the keys are smaller.
+*/
+static Node mapFindLowerBound(Map map, MapKeyElement key,
+                              Node* previous_node){
+    if(map->extension->last &&
+       map->compareKeyElements(nodeGetKey(map->extension->last), key) < 0){
+        /* Appending after the greatest key, which is the common case for
+         * keys arriving in increasing order. */
+        *previous_node = map->extension->last;
+        return NULL;
+    }
+    if(map->extension->features->radix){
+        Node node = radixTreeLowerBound(map->extension->features->radix, key);
+        *previous_node = node ? nodeGetPrevious(node) : map->extension->last;
+        return node;
+    }
+    return mapFindLowerBoundFrom(map, map->entries.list, key, previous_node);
+}
+
+/**
+***** Static function: mapFindLowerBoundFrom *****
+* Description: Like mapFindLowerBound, but the search starts at a given
+* node and walks forwards or backwards from it, so the cost is the distance
+* between that node and the result.
+*
+* @param map - The map to search the node in.
+* @param start - A node of the map to start from. NULL to start from the
+* first node.
+* @param key - The key element to look for.
+* @param previous_node - Will hold the node before the returned one.
+*
+* @return
+* The first node which key is greater or equal to the given key.
+* NULL if all the keys are smaller.
+*/
+static Node mapFindLowerBoundFrom(Map map, Node start, MapKeyElement key,
+                                  Node* previous_node){
+    Node current_node = start ? start : map->entries.list;
+    if(current_node &&
+       map->compareKeyElements(nodeGetKey(current_node), key) >= 0){
+        /* Walking backwards to the last node with a smaller key. */
+        Node previous = nodeGetPrevious(current_node);
+        while(previous &&
+              map->compareKeyElements(nodeGetKey(previous), key) >= 0){
+            current_node = previous;
+            previous = nodeGetPrevious(previous);
+        }
+        *previous_node = previous;
+        return current_node;
+    }
+    Node previous = current_node ? nodeGetPrevious(current_node) : NULL;
+    while(current_node &&
+          map->compareKeyElements(nodeGetKey(current_node), key) < 0){
+        /* Steping to the next node. */
+        previous = current_node;
+        current_node = nodeGetNext(current_node);
+    }
+    *previous_node = previous;
+    return current_node;
+}
+/**
+ ***** Function: mapPutNode *****
+ * Description: Puts a pair of key and data in the map and returns the node
+ * holding them. The iterator is not reset.
+ *
+ * @param map - Map to put in.
+ * @param keyElement - Key element to put.
+ * @param dataElement - Data element to put.
+ * @param hint - Node to start searching from. NULL to search the whole map.
+ * @param put_node - Will hold the node of the key.
+ *
+ * @return
+ * MAP_NULL_ARGUMENT - key or data are NULL.
+ * MAP_OUT_OF_MEMORY - Any memory error.
+ * MAP_SUCCESS - Sucessfully put.
+ */
+static MapResult mapPutNode(Map map, MapKeyElement keyElement,
+                            MapDataElement dataElement, Node hint,
+                            Node* put_node){
+    if(!keyElement || !dataElement){
+        return MAP_NULL_ARGUMENT;
+    }
+    assert(!map->is_small);
+    Node previous_node = NULL;
+    Node node = hint ?
+                mapFindLowerBoundFrom(map, hint, keyElement, &previous_node) :
+                mapFindLowerBound(map, keyElement, &previous_node);
+    MapResult status = MAP_SUCCESS;
+    if(!node || map->compareKeyElements(nodeGetKey(node), keyElement) != 0){
+        /* Item doesn't exist and we need to add it */
+        status = mapAddNewData(map, keyElement, dataElement, previous_node,
+                               node, put_node);
+    } else {
+        /* Item exist in map and we need to modify its data.*/
+        *put_node = node;
+        status = mapModifyData(map, put_node, dataElement);
+    }
+    if(status == MAP_SUCCESS){
+        mapPublishChange(map, MAP_CHANGE_PUT, keyElement, dataElement);
+    }
+    return status;
+}
+
+/**
+ ***** Function: mapAddNewData *****
+ * Description: Gets a data and a key which doesn't already exist in the
+ * map and puts it in the map, between the two given neighbours. If the map
+ * is bounded and full, the least recently used entry is evicted once the
+ * new node was created.
+ *
+ * @param map - Map to add to.
+ * @param keyElement - Key element to add to the map.
+ * @param dataElement - Data element to add to the map.
+ * @param previous_node - The last node with a smaller key (NULL if none).
+ * @param next_node - The first node with a greater key (NULL if none).
+ * @param added_node - Will hold the new node.
+ *
+ * @return
+ * MAP_OUT_OF_MEMORY - Any memory error.
+ * MAP_SUCCESS - Sucessfully added.
+ */
+static MapResult mapAddNewData(Map map, MapKeyElement keyElement,
+                               MapDataElement dataElement,
+                               Node previous_node, Node next_node,
+                               Node* added_node){
+
+    /* Item does not exist and we need to create it and add it. */
+    MapDataElement data_copy = mapCopyData(map, dataElement);
+    if(!data_copy){
+        return MAP_OUT_OF_MEMORY;
+    }
+    Node new_node = nodeCreate(data_copy, keyElement,
+                               mapAdoptElement, map->copyKeyElement,
+                               map->freeKeyElement, map->extension->layout,
+                               mapAllocator(map)); // Creating the new node.
+    if(!new_node){
+        mapFreeData(map, data_copy);
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    if(features->radix && radixTreeInsert(features->radix, new_node) !=
+                          RADIX_TREE_SUCCESS){
+        mapNodeDestroy(map, new_node,
+                       map->freeDataElement, map->freeKeyElement);
+        return MAP_OUT_OF_MEMORY;
+    }
+    if(features->fingerprints &&
+       hashIndexInsert(features->fingerprints,
+                       mapKeyFingerprint(map, keyElement),
+                       new_node) != HASH_INDEX_SUCCESS){
+        if(features->radix){
+            radixTreeRemove(features->radix, nodeGetKey(new_node));
+        }
+        mapNodeDestroy(map, new_node,
+                       map->freeDataElement, map->freeKeyElement);
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapLru lru = map->extension->lru;
+    if(lru && map->mapSize>=lru->capacity){
+        /* Map is full: making room for the new node. The victim may be one
+         * of the neighbours. */
+        if(lru->tail == previous_node){
+            previous_node = nodeGetPrevious(previous_node);
+        } else if(lru->tail == next_node){
+            next_node = nodeGetNext(next_node);
+        }
+        mapEvictLeastRecent(map);
+    }
+    nodeSetPrevious(new_node, previous_node);
+    nodeSetNext(new_node, next_node);
+    if(previous_node){
+        /* This is not the beginning of the list. */
+        nodeSetNext(previous_node, new_node);
+    } else {
+        /* The new node should be added to the beginning of the list. */
+        mapSetFirstNode(map, new_node);
+    }
+    if(next_node){
+        nodeSetPrevious(next_node, new_node);
+    } else {
+        /* New node is last. */
+        map->extension->last = new_node;
+    }
+    mapLruPushFront(map, new_node);
+    map->mapSize++;
+    if(features->bloom){
+        bloomFilterAdd(features->bloom, features->hashKeyElement(keyElement));
+    }
+    *added_node = new_node;
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapModifyData *****
+ * Description: Modify the data of an existing node in the map.
+ *
+ * @param map - Map of the key.
+ * @param node - Node to modify. Will hold the node holding the new data,
+ * which is a new one if the map has concurrent readers.
+ * @param new_data - New data.
+ * @return
+ * MAP_OUT_OF_MEMORY - Any memory error.
+ * MAP_SUCCESS - Key successfully modified.
+ */
+static MapResult mapModifyData(Map map, Node* node, MapDataElement new_data){
+    if(!mapHasData(map)){
+        /* A key-only map has no data to modify. */
+        mapTouchNode(map, *node);
+        return MAP_SUCCESS;
+    }
+    if(map->extension->features->epochs){
+        /* Readers may be on the old data: the node is replaced instead. */
+        return mapReplaceNode(map, node, new_data, NULL, NULL);
+    }
+    MapDataElement data_copy = mapCopyData(map, new_data);
+    if(!data_copy){
+        /*  Memory Error .*/
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapDataElement old_data = mapNodeData(map, *node);
+    nodeSetData(*node, map->extension->layout, data_copy, mapAdoptElement,
+                mapKeepElement);
+    mapFreeData(map, old_data);
+    /* Sucessfully modified. */
+    mapTouchNode(map, *node);
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapUnlinkNode *****
+ * Description: Detaches a node from the map's ordered list and from the
+ * recency list. The node itself is not destroyed.
+ *
+ * @param map - Map of the node.
+ * @param node - The node to detach.
+ */
+static void mapUnlinkNode(Map map, Node node){
+    assert(map && node);
+    Node previous_node = nodeGetPrevious(node);
+    Node next_node = nodeGetNext(node);
+    if(previous_node){
+        nodeSetNext(previous_node, next_node);
+    } else {
+        /* Node is first. */
+        mapSetFirstNode(map, next_node);
+    }
+    if(next_node){
+        nodeSetPrevious(next_node, previous_node);
+    } else {
+        /* Node is last. */
+        map->extension->last = previous_node;
+    }
+    mapLruUnlink(map, node);
+    mapClearNodeExpiry(map, node);
+    MapFeatures features = map->extension->features;
+    if(features->radix){
+        radixTreeRemove(features->radix, nodeGetKey(node));
+    }
+    if(features->fingerprints){
+        hashIndexRemove(features->fingerprints,
+                        mapKeyFingerprint(map, nodeGetKey(node)), node);
+    }
+    map->mapSize--;
+    map->extension->version++;
+    if(features->bloom){
+        features->bloom_removals++;
+    }
+}
+
+/**
+ ***** Function: mapDeleteNode *****
+ * Description: Detaches a node from the map and frees it using the stored
+ * free functions. If the iterator was on the node it becomes invalid.
+ *
+ * @param map - Map of the node.
+ * @param node - The node to delete.
+ */
+static void mapDeleteNode(Map map, Node node){
+    if(map->extension->iterator == node){
+        map->extension->iterator = NULL;
+    }
+    mapUnlinkNode(map, node);
+    if(map->extension->features->epochs){
+        mapRetireNode(map, node);
+        return;
+    }
+    mapNodeDestroy(map, node, map->freeDataElement, map->freeKeyElement);
+}
+
+/**
+ ***** Function: mapLruPushFront *****
+ * Description: Puts a detached node at the head of the recency list, making
+ * it the most recently used one. Does nothing for unbounded maps.
+ *
+ * @param map - Map of the node.
+ * @param node - The node to push.
+ */
+static void mapLruPushFront(Map map, Node node){
+    MapLru lru = map->extension->lru;
+    if(!lru){
+        return;
+    }
+    nodeSetLruPrevious(node, NULL);
+    nodeSetLruNext(node, lru->head);
+    if(lru->head){
+        nodeSetLruPrevious(lru->head, node);
+    } else {
+        /* Recency list was empty. */
+        lru->tail = node;
+    }
+    lru->head = node;
+}
+
+/**
+ ***** Function: mapLruUnlink *****
+ * Description: Detaches a node from the recency list. Does nothing for
+ * unbounded maps.
+ *
+ * @param map - Map of the node.
+ * @param node - The node to detach.
+ */
+static void mapLruUnlink(Map map, Node node){
+    MapLru lru = map->extension->lru;
+    if(!lru){
+        return;
+    }
+    Node more_recent = nodeGetLruPrevious(node);
+    Node less_recent = nodeGetLruNext(node);
+    if(more_recent){
+        nodeSetLruNext(more_recent, less_recent);
+    } else {
+        lru->head = less_recent;
+    }
+    if(less_recent){
+        nodeSetLruPrevious(less_recent, more_recent);
+    } else {
+        lru->tail = more_recent;
+    }
+    nodeSetLruNext(node, NULL);
+    nodeSetLruPrevious(node, NULL);
+}
+
+/**
+ ***** Function: mapTouchNode *****
+ * Description: Marks a node as the most recently used one in O(1).
+ *
+ * @param map - Map of the node.
+ * @param node - The node which was used.
+ */
+static void mapTouchNode(Map map, Node node){
+    if(!map->extension->lru || map->extension->lru->head == node){
+        return;
+    }
+    mapLruUnlink(map, node);
+    mapLruPushFront(map, node);
+}
+
+/**
+ ***** Function: mapEvictLeastRecent *****
+ * Description: Removes the least recently used entry of a bounded map and
+ * frees it using the stored free functions.
+ *
+ * @param map - The map to evict from.
+ */
+static void mapEvictLeastRecent(Map map){
+    Node victim = map->extension->lru->tail;
+    if(!victim){
+        return;
+    }
+    mapPublishChange(map, MAP_CHANGE_REMOVE, nodeGetKey(victim), NULL);
+    mapDeleteNode(map, victim);
+    map->extension->lru->evictions++;
+}
+
+/**
+ ***** Function: mapTimeNow *****
+ * Description: Returns a monotonic time stamp in milliseconds.
+ *
+ * @return
+ * The current time in milliseconds.
+ */
+static WheelTick mapTimeNow(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (WheelTick)now.tv_sec * 1000 + (WheelTick)now.tv_nsec / 1000000;
+}
+
+/**
+ ***** Function: mapGetNodeTimer *****
+ * Description: Returns the expiry timer of a node of the map.
+ *
+ * @param map - Map of the node.
+ * @param node - The node.
+ * @return
+ * The node's timer, NULL if it has none or the map's nodes have no room for
+ * one.
+ */
+static WheelTimer mapGetNodeTimer(Map map, Node node){
+    NodeLayout layout = map->extension->layout;
+    return (layout & NODE_TIMER) ? nodeGetTimer(node, layout) : NULL;
+}
+
+/**
+ ***** Function: mapIsExpired *****
+ * Description: Checks whether a node's TTL has passed.
+ *
+ * @param map - Map of the node.
+ * @param node - The node to check.
+ * @return
+ * true - The node has a TTL which has passed.
+ * false - Otherwise.
+ */
+static bool mapIsExpired(Map map, Node node){
+    WheelTimer timer = mapGetNodeTimer(map, node);
+    return timer && timerGetExpiry(timer) <= mapTimeNow();
+}
+
+/**
+ ***** Function: mapSkipExpired *****
+ * Description: Returns the first node, starting at the given one, which
+ * didn't expire.
+ *
+ * @param map - Map of the node.
+ * @param node - The node to start from. May be NULL.
+ * @return
+ * The first node which didn't expire, NULL if there is none.
+ */
+static Node mapSkipExpired(Map map, Node node){
+    while(node && mapIsExpired(map, node)){
+        node = nodeGetNext(node);
+    }
+    return node;
+}
+
+/**
+ ***** Function: mapSkipExpiredBackward *****
+ * Description: Returns the last node, up to the given one, which didn't
+ * expire.
+ *
+ * @param map - Map of the node.
+ * @param node - The node to start from. May be NULL.
+ * @return
+ * The last node which didn't expire, NULL if there is none.
+ */
+static Node mapSkipExpiredBackward(Map map, Node node){
+    while(node && mapIsExpired(map, node)){
+        node = nodeGetPrevious(node);
+    }
+    return node;
+}
+
+/**
+ ***** Function: mapSetNodeExpiry *****
+ * Description: Schedules the expiry of a node in the map's timing wheel,
+ * replacing its previous expiry if it had one.
+ *
+ * @param map - Map of the node.
+ * @param node - The node.
+ * @param expiry - Expiry time in milliseconds.
+ * @return
+ * MAP_OUT_OF_MEMORY - Any memory error.
+ * MAP_SUCCESS - Expiry scheduled.
+ */
+static MapResult mapSetNodeExpiry(Map map, Node node, WheelTick expiry){
+    if(!mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    if(!features->wheel){
+        features->wheel = timingWheelCreate(mapTimeNow(),mapAllocator(map));
+        if(!features->wheel){
+            return MAP_OUT_OF_MEMORY;
+        }
+    }
+    assert(map->extension->layout & NODE_TIMER);
+    WheelTimer timer = nodeGetTimer(node, map->extension->layout);
+    if(!timer){
+        timer = timerCreate(node,mapAllocator(map));
+        if(!timer){
+            return MAP_OUT_OF_MEMORY;
+        }
+        nodeSetTimer(node, map->extension->layout, timer);
+    }
+    timingWheelCancel(map->extension->features->wheel, timer);
+    timingWheelSchedule(map->extension->features->wheel, timer, expiry);
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapClearNodeExpiry *****
+ * Description: Removes the TTL of a node, if it has one.
+ *
+ * @param map - Map of the node.
+ * @param node - The node.
+ */
+static void mapClearNodeExpiry(Map map, Node node){
+    WheelTimer timer = mapGetNodeTimer(map, node);
+    if(!timer){
+        return;
+    }
+    timingWheelCancel(map->extension->features->wheel, timer);
+    timerDestroy(timer,mapAllocator(map));
+    nodeSetTimer(node, map->extension->layout, NULL);
+}
+
+/**
+ ***** Function: mapSweepExpired *****
+ * Description: Advances the map's timing wheel, reclaiming at most
+ * 'budget' expired entries. Does nothing for maps without TTL entries.
+ *
+ * @param map - The map to sweep.
+ * @param budget - Maximal amount of entries to handle.
+ * @return
+ * The amount of entries handled.
+ */
+static int mapSweepExpired(Map map, int budget){
+    TimingWheel wheel = map->extension->features->wheel;
+    if(!wheel || !timingWheelGetSize(wheel)){
+        return 0;
+    }
+    return timingWheelAdvance(wheel, mapTimeNow(), budget, mapExpireNode,
+                              map);
+}
+
+/**
+ ***** Function: mapExpireNode *****
+ * Description: Removes an expired node from the map and frees it. Used as
+ * the timing wheel's expire function.
+ *
+ * @param node - The expired node.
+ * @param map - Map of the node.
+ */
+static void mapExpireNode(void* node, void* map){
+    mapPublishChange(map, MAP_CHANGE_REMOVE, nodeGetKey(node), NULL);
+    mapDeleteNode(map, node);
+}
+
+/**
+ ***** Function: mapBloomMayContain *****
+ * Description: Consults the map's Bloom filter, rebuilding it first if it
+ * became too crowded or too stale.
+ *
+ * @param map - The map.
+ * @param key - The key to look for.
+ * @return
+ * false - The key is definitely not in the map.
+ * true - The key may be in the map (always, if there is no filter).
+ */
+static bool mapBloomMayContain(Map map, MapKeyElement key){
+    MapFeatures features = map->extension->features;
+    if(!features->bloom){
+        return true;
+    }
+    int capacity = bloomFilterGetCapacity(features->bloom);
+    if(map->mapSize>capacity || features->bloom_removals>capacity/2){
+        /* If rebuilding fails the old filter is still correct. */
+        mapBloomRebuild(map);
+    }
+    return bloomFilterMayContain(features->bloom,
+                                 features->hashKeyElement(key));
+}
+
+/**
+ ***** Function: mapBloomRebuild *****
+ * Description: Replaces the map's Bloom filter with a new one sized for the
+ * current map and holding exactly its keys.
+ *
+ * @param map - The map. Its hash function must be set.
+ * @return
+ * MAP_OUT_OF_MEMORY - Any memory error. The old filter is kept.
+ * MAP_SUCCESS - Filter rebuilt.
+ */
+static MapResult mapBloomRebuild(Map map){
+    BloomFilter bloom = bloomFilterCreate(map->mapSize *
+                                          MAP_BLOOM_GROWTH_FACTOR,
+                                          mapAllocator(map));
+    if(!bloom){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    for(Node node = map->entries.list; node; node = nodeGetNext(node)){
+        bloomFilterAdd(bloom, features->hashKeyElement(nodeGetKey(node)));
+    }
+    bloomFilterDestroy(features->bloom);
+    features->bloom = bloom;
+    features->bloom_removals = 0;
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapSplitRanges *****
+ * Description: Splits the map's list into contiguous ranges of (almost)
+ * equal length, in a single walk over the list.
+ *
+ * @param map - The map to split.
+ * @param ranges - Number of ranges.
+ * @return
+ * An array of ranges+1 nodes: range i runs from entry i up to (not
+ * including) entry i+1. Ranges may be empty. The last entry is NULL.
+ * NULL in case of memory error.
+ */
+static Node* mapSplitRanges(Map map, int ranges){
+    Node* range_starts = mapAllocate(map,sizeof(*range_starts)*(ranges+1));
+    if(!range_starts){
+        return NULL;
+    }
+    Node node = map->entries.list;
+    int index = 0;
+    for(int range=0;range<ranges;range++){
+        range_starts[range] = node;
+        long range_end = (long)map->mapSize*(range+1)/ranges;
+        while(index<range_end && node){
+            node = nodeGetNext(node);
+            index++;
+        }
+    }
+    range_starts[ranges] = NULL;
+    return range_starts;
+}
+
+/**
+ ***** Function: mapSortRun *****
+ * Description: Task of mapBuildFromUnsorted: sorts a run of the job's
+ * source with a bottom up merge sort, using the target as scratch.
+ *
+ * @param run - Index of the run.
+ * @param job - The sort job.
+ */
+static void mapSortRun(int run, void* job){
+    MapSortJob sort = job;
+    int start = sort->bounds[run];
+    int end = sort->bounds[run+1];
+    int* from = sort->source;
+    int* to = sort->target;
+    for(long width=1;width<end-start;width*=2){
+        for(long left=start;left<end;left+=2*width){
+            long middle = left+width<end ? left+width : end;
+            long right = left+2*width<end ? left+2*width : end;
+            mapMergeIndices(sort->keys,sort->compare,from,(int)left,
+                            (int)middle,(int)right,to);
+        }
+        int* merged = to;
+        to = from;
+        from = merged;
+    }
+    if(from!=sort->source){
+        memcpy(sort->source+start,from+start,sizeof(int)*(end-start));
+    }
+}
+
+/**
+ ***** Function: mapMergeRunPair *****
+ * Description: Task of mapBuildFromUnsorted: merges two neighbouring runs
+ * of the job's source into its target. The last run is copied as is if it
+ * has no pair.
+ *
+ * @param pair - Index of the pair: runs 2*pair and 2*pair+1.
+ * @param job - The sort job.
+ */
+static void mapMergeRunPair(int pair, void* job){
+    MapSortJob sort = job;
+    int middle_run = 2*pair+1<sort->runs ? 2*pair+1 : sort->runs;
+    int end_run = 2*pair+2<sort->runs ? 2*pair+2 : sort->runs;
+    mapMergeIndices(sort->keys,sort->compare,sort->source,
+                    sort->bounds[2*pair],sort->bounds[middle_run],
+                    sort->bounds[end_run],sort->target);
+}
+
+/**
+ ***** Function: mapMergeIndices *****
+ * Description: Stable merge of two sorted neighbouring ranges of indices:
+ * of indices with equal keys, the ones of the first range come first.
+ *
+ * @param keys - The keys of the indices.
+ * @param compare - Compares the keys.
+ * @param source - Holds the ranges [start, middle) and [middle, end).
+ * @param start - Start of the first range.
+ * @param middle - End of the first range and start of the second.
+ * @param end - End of the second range.
+ * @param target - Will hold the merged range at [start, end).
+ */
+static void mapMergeIndices(MapKeyElement* keys,
+                            compareMapKeyElements compare, const int* source,
+                            int start, int middle, int end, int* target){
+    int left = start;
+    int right = middle;
+    for(int i=start;i<end;i++){
+        if(right>=end || (left<middle &&
+                          compare(keys[source[left]],
+                                  keys[source[right]])<=0)){
+            target[i] = source[left++];
+        } else {
+            target[i] = source[right++];
+        }
+    }
+}
+
+/**
+ ***** Function: mapForEachRange *****
+ * Description: Task of mapParallelForEach: calls the job's function for
+ * every live entry of a range.
+ *
+ * @param range - Index of the range.
+ * @param job - The parallel job.
+ */
+static void mapForEachRange(int range, void* job){
+    MapParallelJob for_each = job;
+    Node end = for_each->range_starts[range+1];
+    for(Node node = for_each->range_starts[range]; node != end;
+        node = nodeGetNext(node)){
+        if(!mapIsExpired(for_each->map,node)){
+            for_each->function(nodeGetKey(node),
+                               mapNodeData(for_each->map,node),
+                               for_each->context);
+        }
+    }
+}
+
+/**
+ ***** Function: mapReduceRange *****
+ * Description: Task of mapParallelReduce: accumulates every live entry of
+ * a range into the range's accumulator.
+ *
+ * @param range - Index of the range.
+ * @param job - The parallel job.
+ */
+static void mapReduceRange(int range, void* job){
+    MapParallelJob reduce = job;
+    void* accumulator = reduce->accumulators+reduce->accumulator_size*range;
+    Node end = reduce->range_starts[range+1];
+    for(Node node = reduce->range_starts[range]; node != end;
+        node = nodeGetNext(node)){
+        if(!mapIsExpired(reduce->map,node)){
+            reduce->accumulate(accumulator,nodeGetKey(node),
+                               mapNodeData(reduce->map,node),
+                               reduce->context);
+        }
+    }
+}
+
+/**
+ ***** Function: mapCopyString *****
+ * Description: Key copy function of string keyed maps.
+ *
+ * @param key - The string to copy.
+ * @return
+ * A copy of the string, NULL in case of memory fail.
+ */
+static MapKeyElement mapCopyString(MapKeyElement key){
+    char* copy = malloc(strlen(key)+1);
+    if(!copy){
+        return NULL;
+    }
+    strcpy(copy, key);
+    return copy;
+}
+
+/**
+ ***** Function: mapFreeString *****
+ * Description: Key free function of string keyed maps.
+ *
+ * @param key - The string to free.
+ */
+static void mapFreeString(MapKeyElement key){
+    free(key);
+}
+
+/**
+ ***** Function: mapCompareStrings *****
+ * Description: Key compare function of string keyed maps. Orders the keys
+ * like their radix tree does.
+ *
+ * @param first - A string.
+ * @param second - A string.
+ * @return
+ * The result of strcmp.
+ */
+static int mapCompareStrings(MapKeyElement first, MapKeyElement second){
+    return strcmp(first, second);
+}
+
+/**
+ ***** Function: mapGetNodeString *****
+ * Description: Returns the key of a node of a string keyed map. Used by
+ * the map's radix tree.
+ *
+ * @param node - The node.
+ * @return
+ * The node's key.
+ */
+static const char* mapGetNodeString(void* node){
+    return nodeGetKey(node);
+}
+
+/**
+ ***** Function: mapCanBeSmall *****
+ * Description: Checks whether a map uses no feature which needs nodes, so
+ * it may keep its entries in a block.
+ *
+ * @param map - The map.
+ * @return
+ * true if the map may be small, false otherwise.
+ */
+static bool mapCanBeSmall(Map map){
+    MapFeatures features = map->extension->features;
+    return !map->extension->lru && !features->radix && !features->bloom &&
+           !features->fingerprintKeyElement && !features->wheel &&
+           !features->epochs && !map->extension->disk;
+}
+
+/**
+ ***** Function: mapPromote *****
+ * Description: Moves the entries of a small map into nodes. The nodes take
+ * over the stored elements, nothing is copied. Does nothing if the map
+ * already uses nodes.
+ *
+ * @param map - The map.
+ * @return
+ * MAP_OUT_OF_MEMORY - Any memory error. The map is unchanged.
+ * MAP_SUCCESS - The map uses nodes.
+ */
+static MapResult mapPromote(Map map){
+    if(!map->is_small){
+        return MAP_SUCCESS;
+    }
+    if(!mapExtend(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    Node nodes[MAP_SMALL_CAPACITY];
+    for(int i=0;i<map->mapSize;i++){
+        nodes[i] = nodeCreate(mapSmallGetData(map,i), mapSmallKeys(map)[i],
+                              mapAdoptElement, mapAdoptElement,
+                              mapKeepElement, map->extension->layout,
+                              mapAllocator(map));
+        if(!nodes[i]){
+            while(i--){
+                mapNodeDestroy(map, nodes[i], mapKeepElement, mapKeepElement);
+            }
+            return MAP_OUT_OF_MEMORY;
+        }
+    }
+    for(int i=0;i<map->mapSize;i++){
+        nodeSetPrevious(nodes[i], i>0 ? nodes[i-1] : NULL);
+        nodeSetNext(nodes[i], i+1<map->mapSize ? nodes[i+1] : NULL);
+    }
+    mapDeallocate(map, map->entries.small, mapSmallBlockSize(map));
+    map->small_capacity = 0;
+    map->entries.list = map->mapSize ? nodes[0] : NULL;
+    map->extension->last = map->mapSize ? nodes[map->mapSize-1] : NULL;
+    /* The iterator stays on the same entry. */
+    map->extension->iterator = map->small_iterator>=0 ?
+                               nodes[map->small_iterator] : NULL;
+    map->small_iterator = -1;
+    map->is_small = false;
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapSmallFind *****
+ * Description: Binary search of a key in the block of a small map.
+ *
+ * @param map - A small map.
+ * @param key - The key to look for.
+ * @param found - Will hold whether the key is in the map.
+ * @return
+ * The index of the first key which is not smaller than the given key.
+ */
+static int mapSmallFind(Map map, MapKeyElement key, bool* found){
+    int low = 0;
+    int high = map->mapSize;
+    while(low<high){
+        int middle = (low+high)/2;
+        if(map->compareKeyElements(mapSmallKeys(map)[middle], key) < 0){
+            low = middle+1;
+        } else {
+            high = middle;
+        }
+    }
+    *found = low<map->mapSize &&
+             map->compareKeyElements(mapSmallKeys(map)[low], key) == 0;
+    return low;
+}
+
+/**
+ ***** Function: mapSmallInsert *****
+ * Description: Inserts copies of a new key and its data into a small map
+ * which has room for them.
+ *
+ * @param map - A small map with less than MAP_SMALL_CAPACITY entries.
+ * @param index - Position of the key, as returned by mapSmallFind.
+ * @param key - The key element.
+ * @param data - The data element.
+ * @return
+ * MAP_OUT_OF_MEMORY - A copy function failed. The map is unchanged.
+ * MAP_SUCCESS - Inserted.
+ */
+static MapResult mapSmallInsert(Map map, int index, MapKeyElement key,
+                                MapDataElement data){
+    assert(map->is_small && map->mapSize<MAP_SMALL_CAPACITY);
+    if(map->mapSize==map->small_capacity &&
+       !mapSmallResize(map,map->small_capacity ? map->small_capacity*2 : 1)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapKeyElement key_copy = map->copyKeyElement(key);
+    if(!key_copy){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapDataElement data_copy = mapCopyData(map, data);
+    if(!data_copy){
+        map->freeKeyElement(key_copy);
+        return MAP_OUT_OF_MEMORY;
+    }
+    int moved = map->mapSize-index;
+    memmove(mapSmallKeys(map)+index+1, mapSmallKeys(map)+index,
+            sizeof(*mapSmallKeys(map))*moved);
+    mapSmallKeys(map)[index] = key_copy;
+    if(mapHasData(map)){
+        memmove(mapSmallData(map)+index+1, mapSmallData(map)+index,
+                sizeof(*mapSmallData(map))*moved);
+        mapSmallData(map)[index] = data_copy;
+    }
+    map->mapSize++;
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapSmallPut *****
+ * Description: mapPut of a small map. A map which is full and gets a new
+ * key is promoted to nodes first.
+ *
+ * @param map - A small map.
+ * @param key - The key element.
+ * @param data - The data element.
+ * @return
+ * MAP_NULL_ARGUMENT - key or data are NULL.
+ * MAP_OUT_OF_MEMORY - Any memory error.
+ * MAP_SUCCESS - Sucessfully put.
+ */
+static MapResult mapSmallPut(Map map, MapKeyElement key, MapDataElement data){
+    if(!key || !data){
+        return MAP_NULL_ARGUMENT;
+    }
+    bool found = false;
+    int index = mapSmallFind(map, key, &found);
+    if(found){
+        MapDataElement data_copy = mapCopyData(map, data);
+        if(!data_copy){
+            return MAP_OUT_OF_MEMORY;
+        }
+        mapFreeData(map, mapSmallGetData(map,index));
+        if(mapHasData(map)){
+            mapSmallData(map)[index] = data_copy;
+        }
+        mapPublishChange(map, MAP_CHANGE_PUT, key, data);
+        return MAP_SUCCESS;
+    }
+    if(map->mapSize<MAP_SMALL_CAPACITY){
+        MapResult status = mapSmallInsert(map, index, key, data);
+        if(status == MAP_SUCCESS){
+            mapPublishChange(map, MAP_CHANGE_PUT, key, data);
+        }
+        return status;
+    }
+    if(mapPromote(map)!=MAP_SUCCESS){
+        return MAP_OUT_OF_MEMORY;
+    }
+    map->extension->iterator = NULL;
+    Node node = NULL;
+    return mapPutNode(map, key, data, NULL, &node);
+}
+
+/**
+ ***** Function: mapSmallRemove *****
+ * Description: Removes an entry of a small map and frees its elements.
+ *
+ * @param map - A small map.
+ * @param index - Index of the entry.
+ */
+static void mapSmallRemove(Map map, int index){
+    map->freeKeyElement(mapSmallKeys(map)[index]);
+    mapFreeData(map, mapSmallGetData(map,index));
+    mapSmallDetach(map, index);
+}
+
+/**
+ ***** Function: mapSmallDetach *****
+ * Description: Removes an entry of a small map without freeing its
+ * elements.
+ *
+ * @param map - A small map.
+ * @param index - Index of the entry.
+ */
+static void mapSmallDetach(Map map, int index){
+    int moved = map->mapSize-index-1;
+    memmove(mapSmallKeys(map)+index, mapSmallKeys(map)+index+1,
+            sizeof(*mapSmallKeys(map))*moved);
+    if(mapHasData(map)){
+        memmove(mapSmallData(map)+index, mapSmallData(map)+index+1,
+                sizeof(*mapSmallData(map))*moved);
+    }
+    map->mapSize--;
+    if(map->mapSize==0){
+        mapSmallResize(map,0); // Freeing the block can't fail.
+    }
+}
+
+/**
+ ***** Function: mapAdoptElement *****
+ * Description: "Copy" function handing an element over as is. Used to move
+ * elements into nodes.
+ *
+ * @param element - The element.
+ * @return
+ * The same element.
+ */
+static void* mapAdoptElement(void* element){
+    return element;
+}
+
+/**
+ ***** Function: mapKeepElement *****
+ * Description: "Free" function leaving an element alone. Used to drop a
+ * node without freeing the elements it took over.
+ *
+ * @param element - The element.
+ */
+static void mapKeepElement(void* element){
+}
+
+/**
+ ***** Function: mapFrozenFind *****
+ * Description: Binary search of a key in the arrays of a frozen map. The
+ * search range is narrowed with a conditional move instead of a branch,
+ * since the outcome of every comparison is unpredictable.
+ *
+ * @param map - A frozen map.
+ * @param key - The key to look for.
+ * @param found - Will hold whether the key is in the arrays.
+ * @return
+ * The index of the first key which is not smaller than the given key.
+ */
+static int mapFrozenFind(Map map, MapKeyElement key, bool* found){
+    *found = false;
+    if(!map->mapSize){
+        return 0;
+    }
+    MapFrozen frozen = map->extension->frozen;
+    if(frozen->blocks){
+        return keyBlocksFind(frozen->blocks, key, found);
+    }
+    MapKeyElement* base = frozen->keys;
+    int length = map->mapSize;
+    while(length>1){
+        int half = length/2;
+        base = map->compareKeyElements(base[half], key) < 0 ? base+half :
+               base;
+        length -= half;
+    }
+    int index = (int)(base-frozen->keys) +
+                (map->compareKeyElements(*base, key) < 0);
+    *found = index<map->mapSize &&
+             map->compareKeyElements(frozen->keys[index], key) == 0;
+    return index;
+}
+
+/**
+ ***** Function: mapFrozenIsLive *****
+ * Description: Checks whether an entry of a frozen map didn't expire.
+ *
+ * @param map - A frozen map.
+ * @param index - Index of the entry.
+ * @return
+ * true if the entry didn't expire, false otherwise.
+ */
+static bool mapFrozenIsLive(Map map, int index){
+    WheelTick* expiry = map->extension->frozen->expiry;
+    return !expiry || expiry[index]==MAP_NO_EXPIRY ||
+           expiry[index]>mapTimeNow();
+}
+
+/**
+ ***** Function: mapFrozenSkipExpired *****
+ * Description: Returns the first entry of a frozen map, starting at a given
+ * index, which didn't expire.
+ *
+ * @param map - A frozen map.
+ * @param index - The index to start from.
+ * @return
+ * The index of the entry, -1 if there is none.
+ */
+static int mapFrozenSkipExpired(Map map, int index){
+    while(index<map->mapSize && !mapFrozenIsLive(map, index)){
+        index++;
+    }
+    return index<map->mapSize ? index : -1;
+}
+
+/**
+ ***** Function: mapFrozenSkipExpiredBackward *****
+ * Description: Returns the last entry of a frozen map, up to a given index,
+ * which didn't expire.
+ *
+ * @param map - A frozen map.
+ * @param index - The index to start from.
+ * @return
+ * The index of the entry, -1 if there is none.
+ */
+static int mapFrozenSkipExpiredBackward(Map map, int index){
+    while(index>=0 && !mapFrozenIsLive(map, index)){
+        index--;
+    }
+    return index;
+}
+
+/**
+ ***** Function: mapFrozenFree *****
+ * Description: Frees the entries and the arrays of a frozen map, leaving
+ * it empty and not frozen. Does nothing if the map isn't frozen.
+ *
+ * @param map - The map.
+ */
+static void mapFrozenFree(Map map){
+    if(!map->is_frozen){
+        return;
+    }
+    MapFrozen frozen = map->extension->frozen;
+    for(int i=0;i<map->mapSize;i++){
+        if(frozen->keys){
+            map->freeKeyElement(frozen->keys[i]);
+        }
+        mapFreeData(map, frozen->data[i]);
+    }
+    mapFrozenFreeArrays(map);
+    map->mapSize = 0;
+    map->is_frozen = false;
+}
+
+/**
+ ***** Function: mapForEachFrozenRange *****
+ * Description: Task of mapParallelForEach on a frozen map: calls the job's
+ * function for every live entry of a range of indices.
+ *
+ * @param range - Index of the range.
+ * @param job - The parallel job.
+ */
+static void mapForEachFrozenRange(int range, void* job){
+    MapParallelJob for_each = job;
+    Map map = for_each->map;
+    char* buffer = for_each->key_buffers ? for_each->key_buffers +
+                   map->extension->frozen->key_size*range : NULL;
+    KeyBlocksCursor cursor = KEY_BLOCKS_CURSOR_INITIALIZER;
+    int end = (int)((long)map->mapSize*(range+1)/for_each->ranges);
+    for(int i=(int)((long)map->mapSize*range/for_each->ranges);i<end;i++){
+        if(mapFrozenIsLive(map, i)){
+            for_each->function(mapFrozenKey(map, i, buffer, &cursor),
+                               map->extension->frozen->data[i],
+                               for_each->context);
+        }
+    }
+}
+
+/**
+ ***** Function: mapReduceFrozenRange *****
+ * Description: Task of mapParallelReduce on a frozen map: accumulates every
+ * live entry of a range of indices into the range's accumulator.
+ *
+ * @param range - Index of the range.
+ * @param job - The parallel job.
+ */
+static void mapReduceFrozenRange(int range, void* job){
+    MapParallelJob reduce = job;
+    Map map = reduce->map;
+    void* accumulator = reduce->accumulators+reduce->accumulator_size*range;
+    char* buffer = reduce->key_buffers ? reduce->key_buffers +
+                   map->extension->frozen->key_size*range : NULL;
+    KeyBlocksCursor cursor = KEY_BLOCKS_CURSOR_INITIALIZER;
+    int end = (int)((long)map->mapSize*(range+1)/reduce->ranges);
+    for(int i=(int)((long)map->mapSize*range/reduce->ranges);i<end;i++){
+        if(mapFrozenIsLive(map, i)){
+            reduce->accumulate(accumulator,mapFrozenKey(map, i, buffer,
+                                                        &cursor),
+                               map->extension->frozen->data[i],reduce->context);
+        }
+    }
+}
+
+/**
+ ***** Function: mapCreateEmptyCopy *****
+ * Description: Creates an empty map with the functions, the allocator and
+ * the settings of a given map, as the target of a copy.
+ *
+ * @param map - The map to copy.
+ * @return
+ * The new map, NULL in case of memory fail.
+ */
+static Map mapCreateEmptyCopy(Map map){
+    Allocator allocator = mapAllocator(map);
+    Map new_map=mapCreateWithAllocator(map->copyDataElement,
+                                       map->copyKeyElement,
+                                       map->freeDataElement,
+                                       map->freeKeyElement,
+                                       map->compareKeyElements,
+                                       allocator ? allocator->allocate : NULL,
+                                       allocator ? allocator->deallocate :
+                                                   NULL,
+                                       allocator ? allocator->context : NULL);
+    if(!new_map){
+        return NULL;
+    }
+    MapFeatures features = map->extension->features;
+    if(features->values){
+        if(!mapExtendFeatures(new_map)){
+            mapDestroy(new_map);
+            return NULL;
+        }
+        /* The copy refers to the same values. */
+        new_map->extension->features->values = valuePoolShare(features->values);
+    }
+    if(!mapHasData(map) && !mapDropData(new_map)){
+        mapDestroy(new_map);
+        return NULL;
+    }
+    if(map->is_small){
+        return new_map;
+    }
+    if(map->extension->lru){
+        if(mapMakeBounded(new_map,map->extension->lru->capacity)!=
+           MAP_SUCCESS){
+            mapDestroy(new_map);
+            return NULL;
+        }
+    } else if(!mapExtend(new_map) ||
+              (features->compress_keys && !mapExtendFeatures(new_map))){
+        mapDestroy(new_map);
+        return NULL;
+    }
+    new_map->is_small = false;
+    new_map->extension->layout = map->extension->layout;
+    if(features->compress_keys){
+        new_map->extension->features->compress_keys = true;
+    }
+    if(features->fingerprintKeyElement &&
+       mapSetKeyFingerprint(new_map,features->fingerprintKeyElement)!=
+       MAP_SUCCESS){
+        mapDestroy(new_map);
+        return NULL;
+    }
+    if(features->radix){
+        if(!mapExtendFeatures(new_map)){
+            mapDestroy(new_map);
+            return NULL;
+        }
+        new_map->extension->features->radix =
+                radixTreeCreate(mapGetNodeString,mapAllocator(new_map));
+        if(!new_map->extension->features->radix){
+            mapDestroy(new_map);
+            return NULL;
+        }
+    }
+    if(features->bloom &&
+       mapSetBloomFilter(new_map,features->hashKeyElement)!=MAP_SUCCESS){
+        mapDestroy(new_map);
+        return NULL;
+    }
+    return new_map;
+}
+
+/**
+ ***** Function: mapCopyRange *****
+ * Description: Task of mapCopyParallel: copies every live entry of a range
+ * into the job's arrays. Stops copying at the first failure of the range.
+ *
+ * @param range - Index of the range.
+ * @param job - The copy job.
+ */
+static void mapCopyRange(int range, void* job){
+    MapCopyJob copy = job;
+    Map map = copy->map;
+    Node node = map->is_frozen ? NULL : copy->range_starts[range];
+    char* buffer = copy->key_buffers ? copy->key_buffers +
+                   map->extension->frozen->key_size*range : NULL;
+    KeyBlocksCursor cursor = KEY_BLOCKS_CURSOR_INITIALIZER;
+    int end = (int)((long)map->mapSize*(range+1)/copy->ranges);
+    for(int i=(int)((long)map->mapSize*range/copy->ranges);i<end;i++){
+        bool is_live = node ? !mapIsExpired(map,node) :
+                       mapFrozenIsLive(map,i);
+        copy->keys[i] = NULL;
+        copy->data[i] = NULL;
+        if(is_live && !copy->failed[range]){
+            copy->keys[i] = map->copyKeyElement(
+                    node ? nodeGetKey(node) :
+                    mapFrozenKey(map,i,buffer,&cursor));
+            copy->data[i] = copy->keys[i] ? map->copyDataElement(
+                    node ? mapNodeData(map,node) :
+                    map->extension->frozen->data[i]) : NULL;
+            copy->failed[range] = !copy->data[i];
+        }
+        node = node ? nodeGetNext(node) : NULL;
+    }
+}
+
+/**
+ ***** Function: mapStitchCopies *****
+ * Description: Appends the entries copied by mapCopyParallel to the new
+ * map in key order, with the expiry times of the original entries. The
+ * new map takes over the copies, whose array slots are set to NULL.
+ *
+ * @param new_map - The empty copy.
+ * @param map - The copied map.
+ * @param keys - The copies of the keys, NULL for entries not copied.
+ * @param data - The copies of the data.
+ * @return
+ * MAP_OUT_OF_MEMORY - if an allocation failed. The copies which weren't
+ * taken over are still in the arrays.
+ * MAP_SUCCESS - Otherwise.
+ */
+static MapResult mapStitchCopies(Map new_map, Map map, MapKeyElement* keys,
+                                 MapDataElement* data){
+    copyMapKeyElements copy_key = new_map->copyKeyElement;
+    copyMapDataElements copy_data = new_map->copyDataElement;
+    freeMapKeyElements free_key = new_map->freeKeyElement;
+    freeMapDataElements free_data = new_map->freeDataElement;
+    new_map->copyKeyElement = mapAdoptElement;
+    new_map->copyDataElement = mapAdoptElement;
+    new_map->freeKeyElement = mapKeepElement;
+    new_map->freeDataElement = mapKeepElement;
+    MapResult result = MAP_SUCCESS;
+    Node source = map->is_frozen ? NULL : map->entries.list;
+    for(int i=0;i<map->mapSize && result==MAP_SUCCESS;i++){
+        WheelTimer timer = source ? mapGetNodeTimer(map,source) : NULL;
+        WheelTick expiry = timer ? timerGetExpiry(timer) : MAP_NO_EXPIRY;
+        if(map->is_frozen && map->extension->frozen->expiry){
+            expiry = map->extension->frozen->expiry[i];
+        }
+        source = source ? nodeGetNext(source) : NULL;
+        Node node = NULL;
+        if(!keys[i]){
+            continue;
+        }
+        result = mapAddNewData(new_map,keys[i],data[i],
+                               new_map->extension->last,NULL,&node);
+        if(result!=MAP_SUCCESS){
+            break;
+        }
+        keys[i] = NULL;
+        data[i] = NULL;
+        if(expiry!=MAP_NO_EXPIRY){
+            result = mapSetNodeExpiry(new_map,node,expiry);
+        }
+    }
+    new_map->copyKeyElement = copy_key;
+    new_map->copyDataElement = copy_data;
+    new_map->freeKeyElement = free_key;
+    new_map->freeDataElement = free_data;
+    return result;
+}
+
+/**
+ ***** Function: mapAllocate *****
+ * Description: Allocates memory through the map's allocator.
+ *
+ * @param map - The map.
+ * @param size - Size of the block in bytes.
+ * @return
+ * The block, NULL in case of memory fail.
+ */
+static void* mapAllocate(Map map, size_t size){
+    return allocatorAllocate(mapAllocator(map), size);
+}
+
+/**
+ ***** Function: mapDeallocate *****
+ * Description: Frees memory given by mapAllocate.
+ *
+ * @param map - The map.
+ * @param memory - The block. If NULL nothing will be done.
+ * @param size - The size the block was allocated with.
+ */
+static void mapDeallocate(Map map, void* memory, size_t size){
+    allocatorFree(mapAllocator(map), memory, size);
+}
+
+/**
+ ***** Function: mapHasExtension *****
+ * Description: Checks whether the map has an extension of its own, or
+ * shares map_no_extension.
+ *
+ * @param map - The map.
+ * @return
+ * true if the extension is the map's own.
+ */
+static bool mapHasExtension(Map map){
+    return map->extension != &map_no_extension;
+}
+
+/**
+ ***** Function: mapHasFeatures *****
+ * Description: Checks whether the map has feature state of its own, or
+ * shares map_no_features.
+ *
+ * @param map - The map.
+ * @return
+ * true if the feature state is the map's own.
+ */
+static bool mapHasFeatures(Map map){
+    return map->extension->features != &map_no_features;
+}
+
+/**
+ ***** Function: mapAllocator *****
+ * Description: Returns the allocator of the map's memory.
+ *
+ * @param map - The map.
+ * @return
+ * The map's allocator, NULL for a map which uses malloc and has no
+ * extension.
+ */
+static Allocator mapAllocator(Map map){
+    return mapHasExtension(map) ? &map->extension->allocator : NULL;
+}
+
+/**
+ ***** Function: mapExtendWith *****
+ * Description: Gives a map without an extension one, allocated through the
+ * given allocator. The allocator, which counts the extension too, is then
+ * kept in it.
+ *
+ * @param map - A map without an extension.
+ * @param allocator - The allocator the map was allocated with.
+ * @return
+ * true in case of success, false in case of memory fail.
+ */
+static bool mapExtendWith(Map map, Allocator allocator){
+    assert(!mapHasExtension(map));
+    MapExtension extension = allocatorAllocate(allocator,sizeof(*extension));
+    if(!extension){
+        return false;
+    }
+    *extension = map_no_extension;
+    extension->allocator = *allocator;
+    extension->version = 1;
+    map->extension = extension;
+    return true;
+}
+
+/**
+ ***** Function: mapExtend *****
+ * Description: Makes sure the map has an extension of its own. A map
+ * without one was allocated with malloc, and so is its extension.
+ *
+ * @param map - The map.
+ * @return
+ * true in case of success, false in case of memory fail.
+ */
+static bool mapExtend(Map map){
+    if(mapHasExtension(map)){
+        return true;
+    }
+    struct allocator_t allocator;
+    allocatorInit(&allocator,NULL,NULL,NULL);
+    /* What the map took before is counted from now on. */
+    allocator.bytes = sizeof(*map)+mapSmallBlockSize(map);
+    return mapExtendWith(map,&allocator);
+}
+
+/**
+ ***** Function: mapExtendFeatures *****
+ * Description: Makes sure the map has an extension and feature state of
+ * its own.
+ *
+ * @param map - The map.
+ * @return
+ * true in case of success, false in case of memory fail.
+ */
+static bool mapExtendFeatures(Map map){
+    if(!mapExtend(map)){
+        return false;
+    }
+    if(mapHasFeatures(map)){
+        return true;
+    }
+    MapFeatures features = mapAllocate(map,sizeof(*features));
+    if(!features){
+        return false;
+    }
+    *features = map_no_features;
+    map->extension->features = features;
+    return true;
+}
+
+/**
+ ***** Function: mapDropData *****
+ * Description: Makes an empty map key-only: its entries keep no data.
+ *
+ * @param map - An empty map.
+ * @return
+ * true in case of success, false in case of memory fail.
+ */
+static bool mapDropData(Map map){
+    assert(map->mapSize==0);
+    if(!mapExtend(map)){
+        return false;
+    }
+    map->extension->layout &= ~(NodeLayout)NODE_DATA;
+    return true;
+}
+
+/**
+ ***** Function: mapMakeBounded *****
+ * Description: Turns an empty map into one holding at most 'capacity'
+ * entries, kept in recency order.
+ *
+ * @param map - An empty map.
+ * @param capacity - The maximal number of entries.
+ * @return
+ * MAP_OUT_OF_MEMORY - Any memory error.
+ * MAP_SUCCESS - The map is bounded.
+ */
+static MapResult mapMakeBounded(Map map, int capacity){
+    assert(map->mapSize==0);
+    if(!mapExtend(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapLru lru = mapAllocate(map,sizeof(*lru));
+    if(!lru){
+        return MAP_OUT_OF_MEMORY;
+    }
+    lru->capacity = capacity;
+    lru->head = NULL;
+    lru->tail = NULL;
+    lru->hits = 0;
+    lru->misses = 0;
+    lru->evictions = 0;
+    map->extension->lru = lru;
+    map->extension->layout |= NODE_RECENCY;
+    map->is_small = false; // The recency list needs nodes.
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapResetIterator *****
+ * Description: Leaves the map's iterator undefined, whatever form the map
+ * has.
+ *
+ * @param map - The map.
+ */
+static void mapResetIterator(Map map){
+    map->small_iterator = -1;
+    if(!mapHasExtension(map)){
+        return;
+    }
+    map->extension->iterator = NULL;
+    if(map->extension->frozen){
+        map->extension->frozen->iterator = -1;
+    }
+}
+
+/**
+ ***** Function: mapCountLookup *****
+ * Description: Counts a lookup of a bounded map as a hit or a miss. The
+ * counters are kept by bounded maps only.
+ *
+ * @param map - The map.
+ * @param hit - Whether the key was found.
+ */
+static void mapCountLookup(Map map, bool hit){
+    MapLru lru = map->extension->lru;
+    if(!lru){
+        return;
+    }
+    if(hit){
+        lru->hits++;
+    } else {
+        lru->misses++;
+    }
+}
+
+/**
+ ***** Function: mapHasData *****
+ * Description: Checks whether the map stores data, or is key-only.
+ *
+ * @param map - The map.
+ * @return
+ * true unless the map is key-only.
+ */
+static bool mapHasData(Map map){
+    return map->extension->layout & NODE_DATA;
+}
+
+/**
+ ***** Function: mapNodeData *****
+ * Description: Returns the data of a node of the map.
+ *
+ * @param map - Map of the node.
+ * @param node - The node.
+ * @return
+ * The node's data, map_no_data for a node of a key-only map.
+ */
+static MapDataElement mapNodeData(Map map, Node node){
+    NodeLayout layout = map->extension->layout;
+    return (layout & NODE_DATA) ? nodeGetData(node,layout) : &map_no_data;
+}
+
+/**
+ ***** Function: mapSmallKeys *****
+ * Description: Returns the keys of a small map, which start its block.
+ *
+ * @param map - A small map.
+ * @return
+ * The sorted keys.
+ */
+static MapKeyElement* mapSmallKeys(Map map){
+    return map->entries.small;
+}
+
+/**
+ ***** Function: mapSmallData *****
+ * Description: Returns the data elements of a small map, which follow its
+ * keys in its block.
+ *
+ * @param map - A small map.
+ * @return
+ * The data elements, in the order of their keys.
+ */
+static MapDataElement* mapSmallData(Map map){
+    return (MapDataElement*)(map->entries.small+map->small_capacity);
+}
+
+/**
+ ***** Function: mapSmallGetData *****
+ * Description: Returns the data of an entry of a small map.
+ *
+ * @param map - A small map.
+ * @param index - Index of the entry.
+ * @return
+ * The entry's data, map_no_data for an entry of a key-only map.
+ */
+static MapDataElement mapSmallGetData(Map map, int index){
+    return mapHasData(map) ? mapSmallData(map)[index] : &map_no_data;
+}
+
+/**
+ ***** Function: mapSmallEntrySize *****
+ * Description: Returns the bytes an entry takes in a small map's block.
+ *
+ * @param map - The map.
+ * @return
+ * The size of a key, and of a data element unless the map is key-only.
+ */
+static size_t mapSmallEntrySize(Map map){
+    return sizeof(MapKeyElement)+(mapHasData(map) ? sizeof(MapDataElement) :
+                                  0);
+}
+
+/**
+ ***** Function: mapSmallBlockSize *****
+ * Description: Returns the size of a small map's block of entries.
+ *
+ * @param map - The map.
+ * @return
+ * The size in bytes, 0 if the map has no block.
+ */
+static size_t mapSmallBlockSize(Map map){
+    if(!map->is_small || map->is_frozen){
+        return 0;
+    }
+    return mapSmallEntrySize(map)*map->small_capacity;
+}
+
+/**
+ ***** Function: mapSmallResize *****
+ * Description: Moves the entries of a small map into a block with room for
+ * 'capacity' entries. A capacity of 0 frees the block.
+ *
+ * @param map - A small map with no more than 'capacity' entries.
+ * @param capacity - The new capacity, up to MAP_SMALL_CAPACITY.
+ * @return
+ * true in case of success, false in case of memory fail. The map is
+ * unchanged then.
+ */
+static bool mapSmallResize(Map map, int capacity){
+    assert(map->mapSize<=capacity && capacity<=MAP_SMALL_CAPACITY);
+    MapKeyElement* block = NULL;
+    if(capacity>0){
+        block = mapAllocate(map,mapSmallEntrySize(map)*capacity);
+        if(!block){
+            return false;
+        }
+        if(map->mapSize && mapHasData(map)){
+            memcpy(block+capacity,mapSmallData(map),
+                   sizeof(MapDataElement)*map->mapSize);
+        }
+        if(map->mapSize){
+            memcpy(block,mapSmallKeys(map),sizeof(*block)*map->mapSize);
+        }
+    }
+    mapDeallocate(map,map->entries.small,mapSmallBlockSize(map));
+    map->entries.small = block;
+    map->small_capacity = (unsigned char)capacity;
+    return true;
+}
+
+/**
+ ***** Function: mapFrozenFreeArrays *****
+ * Description: Frees the arrays of a frozen map, not the elements in them,
+ * and the rest of its frozen state.
+ *
+ * @param map - The map.
+ */
+static void mapFrozenFreeArrays(Map map){
+    MapFrozen frozen = map->extension->frozen;
+    size_t capacity = (size_t)frozen->capacity;
+    mapDeallocate(map, frozen->keys, sizeof(*frozen->keys)*capacity + 1);
+    mapDeallocate(map, frozen->data, sizeof(*frozen->data)*capacity + 1);
+    mapDeallocate(map, frozen->expiry,
+                  sizeof(*frozen->expiry)*capacity + 1);
+    keyBlocksDestroy(frozen->blocks);
+    mapDeallocate(map, frozen->key, frozen->key_size*2);
+    mapDeallocate(map, frozen, sizeof(*frozen));
+    map->extension->frozen = NULL;
+}
+
+/**
+ ***** Function: mapFrozenCompressKeys *****
+ * Description: Replaces the keys of a frozen map with front coded blocks
+ * and frees them. Does nothing if the map is empty.
+ *
+ * @param map - A frozen string keyed map.
+ * @return
+ * false in case of memory fail (the keys are kept), true otherwise.
+ */
+static bool mapFrozenCompressKeys(Map map){
+    if(!map->mapSize){
+        return true;
+    }
+    MapFrozen frozen = map->extension->frozen;
+    KeyBlocks blocks = keyBlocksCreate(frozen->keys, map->mapSize,
+                                       mapAllocator(map));
+    if(!blocks){
+        return false;
+    }
+    size_t key_size = keyBlocksGetMaxLength(blocks) + 1;
+    char* buffers = mapAllocate(map, key_size*2);
+    if(!buffers){
+        keyBlocksDestroy(blocks);
+        return false;
+    }
+    for(int i=0;i<map->mapSize;i++){
+        map->freeKeyElement(frozen->keys[i]);
+    }
+    mapDeallocate(map, frozen->keys,
+                  sizeof(*frozen->keys)*frozen->capacity + 1);
+    frozen->keys = NULL;
+    frozen->blocks = blocks;
+    frozen->key = buffers;
+    frozen->scratch = buffers + key_size;
+    frozen->key_size = key_size;
+    frozen->cursor = (KeyBlocksCursor)KEY_BLOCKS_CURSOR_INITIALIZER;
+    return true;
+}
+
+/**
+ ***** Function: mapFrozenKey *****
+ * Description: Returns a key of a frozen map, decoded into a buffer if the
+ * keys are front coded.
+ *
+ * @param map - A frozen map.
+ * @param index - Index of the key.
+ * @param buffer - Buffer of the frozen key size, holding the key last
+ * decoded with cursor.
+ * @param cursor - The buffer's cursor.
+ * @return
+ * The key, valid until the buffer is used again.
+ */
+static MapKeyElement mapFrozenKey(Map map, int index, char* buffer,
+                                  KeyBlocksCursor* cursor){
+    MapFrozen frozen = map->extension->frozen;
+    if(!frozen->blocks){
+        return frozen->keys[index];
+    }
+    keyBlocksGet(frozen->blocks, index, buffer, cursor);
+    return buffer;
+}
+
+/**
+ ***** Function: mapNodeElementsSize *****
+ * Description: Returns the bytes held by the elements of one entry.
+ *
+ * @param map - The map.
+ * @param key - The entry's key element.
+ * @param data - The entry's data element.
+ * @param sizeKeyElement - Size function of the keys, or NULL.
+ * @param sizeDataElement - Size function of the data, or NULL.
+ * @return
+ * The number of bytes.
+ */
+static size_t mapNodeElementsSize(Map map, MapKeyElement key,
+                                  MapDataElement data,
+                                  sizeMapKeyElements sizeKeyElement,
+                                  sizeMapDataElements sizeDataElement){
+    size_t bytes = sizeDataElement && mapHasData(map) ?
+                   sizeDataElement(data) : 0;
+    if(sizeKeyElement){
+        bytes += sizeKeyElement(key);
+    } else if(map->extension->features->radix){
+        /* The map copied the string itself. */
+        bytes += strlen(key) + 1;
+    }
+    return bytes;
+}
+
+/**
+ ***** Function: mapTrace *****
+ * Description: Records an operation in the map's trace, if it has one.
+ *
+ * @param map - The map.
+ * @param operation - The operation.
+ * @param key - The operation's key, NULL for operations without a key.
+ */
+static void mapTrace(Map map, TraceOperation operation, MapKeyElement key){
+    if(!map->extension->features->trace){
+        return;
+    }
+    if(traceOperationHasKey(operation) && !key){
+        /* The operation fails without touching the map. */
+        return;
+    }
+    MapFeatures features = map->extension->features;
+    traceWriterRecord(features->trace, operation,
+                      key ? features->traceKeyElement(key) : 0);
+}
+
+/**
+ ***** Function: mapSetFirstNode *****
+ * Description: Sets the head of the ordered list. The store is a release,
+ * so concurrent readers see the node fully initialized.
+ *
+ * @param map - The map.
+ * @param node - The new first node, or NULL.
+ */
+static void mapSetFirstNode(Map map, Node node){
+    __atomic_store_n(&map->entries.list, node, __ATOMIC_RELEASE);
+}
+
+/**
+ ***** Function: mapReplaceNode *****
+ * Description: Replaces a node of a map with concurrent readers by a new
+ * node holding the same key and a copy of the given data, and retires the
+ * old node. The new node is only published once complete, so readers see
+ * either the old entry or the new one.
+ *
+ * @param map - The map.
+ * @param node - The node to replace. Will hold the new node.
+ * @param data - Data element for the new node (copied).
+ * @param compute - Applied to the new node's data before it's published.
+ * May be NULL.
+ * @param context - Passed as is to compute.
+ * @return
+ * MAP_OUT_OF_MEMORY - Any memory error. The map is unchanged.
+ * MAP_SUCCESS - Node replaced.
+ */
+static MapResult mapReplaceNode(Map map, Node* replaced,
+                                MapDataElement data,
+                                mapComputeFunction compute, void* context){
+    Node node = *replaced;
+    MapDataElement data_copy = compute ?
+                               mapComputeData(map, data, compute, context) :
+                               mapCopyData(map, data);
+    if(!data_copy){
+        return MAP_OUT_OF_MEMORY;
+    }
+    Node replacement = nodeCreate(data_copy, nodeGetKey(node),
+                                  mapAdoptElement, map->copyKeyElement,
+                                  map->freeKeyElement, map->extension->layout,
+                                  mapAllocator(map));
+    if(!replacement){
+        mapFreeData(map, data_copy);
+        return MAP_OUT_OF_MEMORY;
+    }
+    if(map->extension->features->fingerprints){
+        hashIndexReplace(map->extension->features->fingerprints,
+                         mapKeyFingerprint(map, nodeGetKey(node)), node,
+                         replacement);
+    }
+    Node previous_node = nodeGetPrevious(node);
+    Node next_node = nodeGetNext(node);
+    nodeSetPrevious(replacement, previous_node);
+    nodeSetNext(replacement, next_node);
+    /* The old node keeps its links, readers on it go on to the next one. */
+    if(previous_node){
+        nodeSetNext(previous_node, replacement);
+    } else {
+        mapSetFirstNode(map, replacement);
+    }
+    if(next_node){
+        nodeSetPrevious(next_node, replacement);
+    } else {
+        map->extension->last = replacement;
+    }
+    if(map->extension->iterator == node){
+        map->extension->iterator = replacement;
+    }
+    map->extension->version++;
+    mapRetireNode(map, node);
+    *replaced = replacement;
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapRetireNode *****
+ * Description: Hands an unlinked node of a map with concurrent readers to
+ * epoch based reclamation: it's freed once no reader can reach it. Frees
+ * the nodes which became unreachable since the last call.
+ *
+ * @param map - The map.
+ * @param node - The unlinked node.
+ */
+static void mapRetireNode(Map map, Node node){
+    MapFeatures features = map->extension->features;
+    int list = (int)(epochGetCurrent(features->epochs) % MAP_RETIRED_LISTS);
+    nodeSetPrevious(node, features->retired[list]);
+    features->retired[list] = node;
+    if(epochTryAdvance(features->epochs)){
+        /* Nodes retired two epochs ago are unreachable now. */
+        mapFreeRetired(map, (int)(epochGetCurrent(features->epochs) %
+                                  MAP_RETIRED_LISTS));
+    }
+}
+
+/**
+ ***** Function: mapFreeRetired *****
+ * Description: Frees the nodes in one of the retired lists.
+ *
+ * @param map - The map.
+ * @param list - Index of the list.
+ */
+static void mapFreeRetired(Map map, int list){
+    Node node = map->extension->features->retired[list];
+    while(node){
+        Node next_node = nodeGetPrevious(node);
+        mapNodeDestroy(map, node, map->freeDataElement, map->freeKeyElement);
+        node = next_node;
+    }
+    map->extension->features->retired[list] = NULL;
+}
+
+/**
+ ***** Function: mapPublishChange *****
+ * Description: Logs a change of the map for its subscriber, if it has one.
+ * The change gets the next sequence number even if it's lost.
+ *
+ * @param map - The map.
+ * @param type - Kind of the change.
+ * @param key - Key of the change (copied), NULL for a clear.
+ * @param data - New data of a put (copied), NULL otherwise.
+ */
+static void mapPublishChange(Map map, MapChangeType type, MapKeyElement key,
+                             MapDataElement data){
+    if(!map->extension->features->change_log){
+        return;
+    }
+    MapFeatures features = map->extension->features;
+    MapChange change = {type, features->change_sequence++, NULL, NULL};
+    change.key = key ? map->copyKeyElement(key) : NULL;
+    change.data = data ? map->copyDataElement(data) : NULL;
+    if((key && !change.key) || (data && !change.data) ||
+       !changeLogPush(features->change_log, &change)){
+        /* Lost: the consumer finds the gap in the sequence. */
+        mapFreeChanges(map, &change, 1);
+    }
+}
+#ifdef MAP_LATENCY_HISTOGRAMS
+/**
+ ***** Function: mapLatencyStart *****
+ * Description: Starts timing an operation of the map.
+ *
+ * @param map - The map. May be NULL.
+ * @return
+ * The time stamp the operation started at, 0 if it isn't timed.
+ */
+static unsigned long long mapLatencyStart(Map map){
+    return map && map->extension->features->latency ? latencyNow() : 0;
+}
+
+/**
+ ***** Function: mapLatencyStop *****
+ * Description: Records the latency of an operation of the map, if it was
+ * timed.
+ *
+ * @param map - The map. May be NULL.
+ * @param operation - The operation.
+ * @param start - Returned by mapLatencyStart when the operation started.
+ */
+static void mapLatencyStop(Map map, MapOperation operation,
+                           unsigned long long start){
+    if(!map || !map->extension->features->latency || !start){
+        /* Not timed, or the recording started during the operation. */
+        return;
+    }
+    latencyHistogramRecord(&map->extension->features->latency[operation],
+                           latencyNow()-start);
+}
+#endif
+
+/**
+ ***** Function: mapNodeDestroy *****
+ * Description: Destroys a node of the map. A node moved by mapCompact only
+ * has its elements freed; its block is freed with its last node.
+ *
+ * @param map - Map of the node.
+ * @param node - The node, already unlinked.
+ * @param freeDataElement - Frees the node's data element.
+ * @param freeKeyElement - Frees the node's key element.
+ */
+static void mapNodeDestroy(Map map, Node node,
+                           freeMapDataElements freeDataElement,
+                           freeMapKeyElements freeKeyElement){
+    MapFeatures features = map->extension->features;
+    if(features->values && freeDataElement == map->freeDataElement){
+        /* The data is shared: only the node's reference is dropped. */
+        valuePoolRelease(features->values, mapNodeData(map,node));
+        freeDataElement = mapKeepElement;
+    }
+    size_t block_size = nodeGetSize(map->extension->layout)*
+                        (size_t)features->compact_capacity;
+    uintptr_t address = (uintptr_t)node;
+    uintptr_t block = (uintptr_t)features->compact_nodes;
+    if(!features->compact_nodes || address < block ||
+       address >= block + block_size){
+        nodeDestroy(node, map->extension->layout, freeDataElement,
+                    freeKeyElement, mapAllocator(map));
+        return;
+    }
+    freeDataElement(mapNodeData(map,node));
+    freeKeyElement(nodeGetKey(node));
+    if(--features->compact_live == 0){
+        mapDeallocate(map, features->compact_nodes, block_size);
+        features->compact_nodes = NULL;
+        features->compact_capacity = 0;
+    }
+}
+
+/**
+ ***** Function: mapCopyData *****
+ * Description: Returns a data element to be stored in the map: an interned
+ * reference if the map interns its values, a new copy otherwise.
+ *
+ * @param map - The map.
+ * @param data - The data element.
+ * @return
+ * The element to store, NULL in case of memory fail.
+ */
+static MapDataElement mapCopyData(Map map, MapDataElement data){
+    if(map->extension->features->values){
+        return valuePoolAcquire(map->extension->features->values, data);
+    }
+    return map->copyDataElement(data);
+}
+
+/**
+ ***** Function: mapFreeData *****
+ * Description: Lets go of a data element given by mapCopyData.
+ *
+ * @param map - The map.
+ * @param data - The data element.
+ */
+static void mapFreeData(Map map, MapDataElement data){
+    if(map->extension->features->values){
+        valuePoolRelease(map->extension->features->values, data);
+        return;
+    }
+    map->freeDataElement(data);
+}
+
+/**
+ ***** Function: mapComputeData *****
+ * Description: Applies a compute function to a private copy of a data
+ * element, and returns the result as mapCopyData would have. The given
+ * element is left alone.
+ *
+ * @param map - The map.
+ * @param data - The data element.
+ * @param compute - Applied to the copy.
+ * @param context - Passed as is to compute.
+ * @return
+ * The element to store, NULL in case of memory fail.
+ */
+static MapDataElement mapComputeData(Map map, MapDataElement data,
+                                     mapComputeFunction compute,
+                                     void* context){
+    MapDataElement data_copy = map->copyDataElement(data);
+    if(!data_copy){
+        return NULL;
+    }
+    compute(data_copy, context);
+    if(!map->extension->features->values){
+        return data_copy;
+    }
+    MapDataElement interned = valuePoolAdopt(map->extension->features->values,
+                                             data_copy);
+    if(!interned){
+        map->freeDataElement(data_copy);
+    }
+    return interned;
+}
+
+/**
+ ***** Function: mapCompactForward *****
+ * Description: Returns the copy of a node during mapCompact, which the
+ * original points to through its previous link.
+ *
+ * @param node - An original node, or NULL.
+ * @return
+ * The node's copy, NULL if node is NULL.
+ */
+static void* mapCompactForward(void* node){
+    return node ? nodeGetPrevious(node) : NULL;
+}
+
+/**
+ ***** Function: mapMoveNodes *****
+ * Description: Moves all the nodes of a node map into one contiguous block,
+ * in key order, as nodes of the given layout, and relinks them. Positions
+ * kept in hints are invalidated.
+ *
+ * @param map - The map. Must have nodes, and no concurrent readers.
+ * @param layout - The parts of the moved nodes. Must include the map's.
+ * @return
+ * MAP_OUT_OF_MEMORY - if an allocation failed. The map is unchanged.
+ * MAP_SUCCESS - Otherwise.
+ */
+static MapResult mapMoveNodes(Map map, NodeLayout layout){
+    /* The block is kept with the map's feature state. */
+    if(!mapExtendFeatures(map)){
+        return MAP_OUT_OF_MEMORY;
+    }
+    MapFeatures features = map->extension->features;
+    size_t node_size = nodeGetSize(layout);
+    int count = map->mapSize;
+    char* block = mapAllocate(map,node_size*(size_t)count);
+    if(!block){
+        return MAP_OUT_OF_MEMORY;
+    }
+    int index = 0;
+    for(Node node=map->entries.list;node;node=nodeGetNext(node)){
+        nodeCopyTo(node,map->extension->layout,layout,block+node_size*index++);
+    }
+    assert(index==count);
+    /* Every original points to its copy through its previous link, which
+     * the copy still holds until it's relinked below. */
+    Node original = map->entries.list;
+    for(index=0;index<count;index++){
+        Node copy = (Node)(block+node_size*index);
+        Node next_original = nodeGetNext(copy);
+        nodeSetPrevious(original,copy);
+        original = next_original;
+    }
+    MapLru lru = map->extension->lru;
+    if(lru){
+        lru->head = mapCompactForward(lru->head);
+        lru->tail = mapCompactForward(lru->tail);
+    }
+    map->extension->iterator = mapCompactForward(map->extension->iterator);
+    for(index=0;index<count;index++){
+        Node copy = (Node)(block+node_size*index);
+        if(map->extension->layout & NODE_RECENCY){
+            nodeSetLruNext(copy,mapCompactForward(nodeGetLruNext(copy)));
+            nodeSetLruPrevious(copy,
+                               mapCompactForward(nodeGetLruPrevious(copy)));
+        }
+        WheelTimer timer = (layout & NODE_TIMER) ?
+                           nodeGetTimer(copy,layout) : NULL;
+        if(timer){
+            timerSetOwner(timer,copy);
+        }
+        if(features->radix){
+            /* Replaces the original, no allocation is needed. */
+            radixTreeInsert(features->radix,copy);
+        }
+    }
+    if(features->fingerprints){
+        hashIndexMoveValues(features->fingerprints,mapCompactForward);
+    }
+    original = map->entries.list;
+    for(index=0;index<count;index++){
+        Node copy = (Node)(block+node_size*index);
+        Node next_original = nodeGetNext(copy);
+        mapNodeDestroy(map,original,mapKeepElement,mapKeepElement);
+        original = next_original;
+    }
+    /* The previous block (if any) held originals only, so it's gone. */
+    map->extension->layout = layout;
+    assert(!features->compact_nodes);
+    for(index=0;index<count;index++){
+        Node copy = (Node)(block+node_size*index);
+        nodeSetPrevious(copy,index ? (Node)(block+node_size*(index-1)) :
+                             NULL);
+        nodeSetNext(copy,index+1<count ? (Node)(block+node_size*(index+1)) :
+                         NULL);
+    }
+    mapSetFirstNode(map,(Node)block);
+    map->extension->last = (Node)(block+node_size*(count-1));
+    features->compact_nodes = block;
+    features->compact_capacity = count;
+    features->compact_live = count;
+    map->extension->version++;
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapDiskFind *****
+ * Description: Looks up a key of a disk tiered map which isn't in its
+ * memtable: in its removed keys, then in its runs. The iterator of the
+ * removed keys isn't disturbed.
+ *
+ * @param map - The map.
+ * @param key - The key.
+ * @param data - Will hold the key's data if found on disk, which belongs to
+ * the caller. May be NULL if the data isn't needed.
+ * @return
+ * The result of the lookup, DISK_TIER_REMOVED for a removed key.
+ */
+static DiskTierLookup mapDiskFind(Map map, MapKeyElement key,
+                                  MapDataElement* data){
+    if(mapGetUntimed(map->extension->disk->removed, key)){
+        /* Removed since the last flush. */
+        return DISK_TIER_REMOVED;
+    }
+    return diskTierFind(map->extension->disk->tier, key, data);
+}
+
+/**
+ ***** Function: mapDiskGet *****
+ * Description: mapGet of a key which isn't in the memtable. The data read
+ * from disk is kept by the map until its next change, so it stays valid as
+ * long as the data of the memtable does; reading the key again until then
+ * returns the same data.
+ *
+ * @param map - The map.
+ * @param key - The key.
+ * @return
+ * The key's data, NULL if it's absent or couldn't be read (or kept).
+ */
+static MapDataElement mapDiskGet(Map map, MapKeyElement key){
+    MapDisk disk = map->extension->disk;
+    MapDataElement data = mapGetUntimed(disk->read, key);
+    if(data){
+        return data;
+    }
+    if(mapDiskFind(map, key, &data)!=DISK_TIER_FOUND){
+        return NULL;
+    }
+    if(mapPutUntimed(disk->read, key, data)!=MAP_SUCCESS){
+        map->freeDataElement(data);
+        return NULL;
+    }
+    return data;
+}
+
+/**
+ ***** Function: mapDiskPut *****
+ * Description: mapPut of a disk tiered map. The key is put in the memtable,
+ * which is flushed if it's full.
+ *
+ * @param map - The map.
+ * @param key - The key.
+ * @param data - The data.
+ * @return
+ * MAP_NULL_ARGUMENT - key or data are NULL.
+ * MAP_IO_ERROR - Looking the key up on disk failed.
+ * MAP_OUT_OF_MEMORY - Any memory error.
+ * MAP_SUCCESS - Sucessfully put.
+ */
+static MapResult mapDiskPut(Map map, MapKeyElement key, MapDataElement data){
+    if(!key || !data){
+        return MAP_NULL_ARGUMENT;
+    }
+    mapDiskEndIteration(map);
+    Node node = mapGetNodeByKey(map, key);
+    bool is_new = false;
+    if(!node){
+        /* Only a put of a key which isn't on disk either adds an entry. */
+        DiskTierLookup lookup = mapDiskFind(map, key, NULL);
+        if(lookup==DISK_TIER_IO_ERROR){
+            return MAP_IO_ERROR;
+        }
+        is_new = lookup!=DISK_TIER_FOUND;
+    }
+    Node put_node = NULL;
+    MapResult status = mapPutNode(map, key, data, NULL, &put_node);
+    if(status!=MAP_SUCCESS){
+        return status;
+    }
+    if(!node){
+        /* The new entry hides the key's tombstone, if any. */
+        mapRemoveUntimed(map->extension->disk->removed, key);
+    }
+    if(is_new){
+        map->extension->disk->size++;
+    }
+    /* Only freed now, since the put data may be one of them. */
+    mapClearUntimed(map->extension->disk->read);
+    mapDiskFlushIfFull(map);
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapDiskRemove *****
+ * Description: mapRemove of a disk tiered map. The key is removed from the
+ * memtable, and kept as removed if the runs hold it.
+ *
+ * @param map - The map.
+ * @param key - The key.
+ * @return
+ * MAP_ITEM_DOES_NOT_EXIST - The key isn't in the map.
+ * MAP_IO_ERROR - Looking the key up on disk failed.
+ * MAP_OUT_OF_MEMORY - Any memory error.
+ * MAP_SUCCESS - Sucessfully removed.
+ */
+static MapResult mapDiskRemove(Map map, MapKeyElement key){
+    mapDiskEndIteration(map);
+    Node node = mapGetNodeByKey(map, key);
+    DiskTierLookup lookup = mapDiskFind(map, key, NULL);
+    if(lookup==DISK_TIER_IO_ERROR){
+        return MAP_IO_ERROR;
+    }
+    if(!node && lookup!=DISK_TIER_FOUND){
+        return MAP_ITEM_DOES_NOT_EXIST;
+    }
+    if(lookup==DISK_TIER_FOUND &&
+       mapPutUntimed(map->extension->disk->removed, key, map)!=MAP_SUCCESS){
+        return MAP_OUT_OF_MEMORY;
+    }
+    mapPublishChange(map, MAP_CHANGE_REMOVE, key, NULL);
+    if(node){
+        mapDeleteNode(map, node);
+    }
+    map->extension->disk->size--;
+    mapClearUntimed(map->extension->disk->read);
+    mapDiskFlushIfFull(map);
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapDiskFlush *****
+ * Description: Writes the memtable and the removed keys of a disk tiered
+ * map to a new run, then empties them.
+ *
+ * @param map - The map.
+ * @return
+ * MAP_IO_ERROR - Writing the run failed. The map is unchanged.
+ * MAP_SUCCESS - Otherwise.
+ */
+static MapResult mapDiskFlush(Map map){
+    mapDiskEndIteration(map);
+    MapDiskFlush flush = {map, map->entries.list,
+                          mapGetFirstUntimed(map->extension->disk->removed)};
+    if(!diskTierFlush(map->extension->disk->tier, mapDiskNextEntry, &flush)){
+        return MAP_IO_ERROR;
+    }
+    mapDropNodes(map);
+    mapClearUntimed(map->extension->disk->removed);
+    mapClearUntimed(map->extension->disk->read);
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapDiskFlushIfFull *****
+ * Description: Flushes a disk tiered map if its memtable and removed keys
+ * reached its threshold. A failed flush leaves them in memory, so a later
+ * call tries again.
+ *
+ * @param map - The map.
+ */
+static void mapDiskFlushIfFull(Map map){
+    MapDisk disk = map->extension->disk;
+    if(map->mapSize+mapGetSize(disk->removed) >= disk->threshold){
+        mapDiskFlush(map);
+    }
+}
+
+/**
+ ***** Function: mapDiskNextEntry *****
+ * Description: Hands the entries of a flush to the tier: the nodes and the
+ * removed keys (as tombstones) merged in key order. They never share a key.
+ *
+ * @param flush - The flush.
+ * @param key - Will hold the entry's key.
+ * @param data - Will hold the entry's data, NULL for a tombstone.
+ * @return
+ * false if there are no entries left, true otherwise.
+ */
+static bool mapDiskNextEntry(void* flush, void** key, void** data){
+    MapDiskFlush* state = flush;
+    if(!state->node && !state->removed){
+        return false;
+    }
+    if(state->node && (!state->removed ||
+       state->map->compareKeyElements(nodeGetKey(state->node),
+                                      state->removed) < 0)){
+        *key = nodeGetKey(state->node);
+        *data = mapNodeData(state->map,state->node);
+        state->node = nodeGetNext(state->node);
+        return true;
+    }
+    *key = state->removed;
+    *data = NULL;
+    state->removed = mapGetNextUntimed(state->map->extension->disk->removed);
+    return true;
+}
+
+/**
+ ***** Function: mapDiskFirst *****
+ * Description: mapGetFirst of a disk tiered map. Starts a merged iteration
+ * over the memtable, which hides the runs, and the runs, less the removed
+ * keys.
+ *
+ * @param map - The map.
+ * @return
+ * The smallest key, NULL if the map is empty or the runs can't be read.
+ */
+static MapKeyElement mapDiskFirst(Map map){
+    mapDiskEndIteration(map);
+    MapDisk disk = map->extension->disk;
+    disk->cursor = tierCursorCreate(disk->tier);
+    if(!disk->cursor){
+        return NULL;
+    }
+    map->extension->iterator = map->entries.list;
+    disk->nodes_done = !map->entries.list;
+    disk->removed_key = mapGetFirstUntimed(disk->removed);
+    disk->advance = 0;
+    return mapDiskStep(map);
+}
+
+/**
+ ***** Function: mapDiskStep *****
+ * Description: Moves the merged iteration of a disk tiered map past the
+ * last returned key and returns the next one. A key of the runs belongs to
+ * the iteration and is valid until its next step.
+ *
+ * @param map - The map.
+ * @return
+ * The next key, NULL at the end of the map or if the iteration is invalid.
+ */
+static MapKeyElement mapDiskStep(Map map){
+    MapDisk disk = map->extension->disk;
+    TierCursor cursor = disk->cursor;
+    if(!cursor){
+        return NULL;
+    }
+    if(!disk->nodes_done && !map->extension->iterator){
+        /* The iterator's node was removed. */
+        mapDiskEndIteration(map);
+        return NULL;
+    }
+    if(disk->advance & MAP_DISK_ADVANCE_NODES){
+        map->extension->iterator = nodeGetNext(map->extension->iterator);
+        disk->nodes_done = !map->extension->iterator;
+    }
+    if(disk->advance & MAP_DISK_ADVANCE_RUNS){
+        /* A failed read ends the runs' side early. */
+        tierCursorNext(cursor);
+    }
+    disk->advance = 0;
+    while(true){
+        MapKeyElement node_key = disk->nodes_done ? NULL :
+                                 nodeGetKey(map->extension->iterator);
+        MapKeyElement run_key = tierCursorGetKey(cursor);
+        if(!node_key && !run_key){
+            mapDiskEndIteration(map);
+            return NULL;
+        }
+        int order = !run_key ? -1 : !node_key ? 1 :
+                    map->compareKeyElements(node_key, run_key);
+        if(order <= 0){
+            /* The memtable hides the runs' entry of the same key. */
+            disk->advance = MAP_DISK_ADVANCE_NODES |
+                            (order==0 ? MAP_DISK_ADVANCE_RUNS : 0);
+            return node_key;
+        }
+        while(disk->removed_key &&
+              map->compareKeyElements(disk->removed_key, run_key) < 0){
+            disk->removed_key = mapGetNextUntimed(disk->removed);
+        }
+        bool is_removed = disk->removed_key &&
+                map->compareKeyElements(disk->removed_key, run_key)==0;
+        if(tierCursorGetData(cursor) && !is_removed){
+            disk->advance = MAP_DISK_ADVANCE_RUNS;
+            return run_key;
+        }
+        tierCursorNext(cursor);
+    }
+}
+
+/**
+ ***** Function: mapDiskEndIteration *****
+ * Description: Ends the merged iteration of a disk tiered map, if any.
+ *
+ * @param map - The map.
+ */
+static void mapDiskEndIteration(Map map){
+    MapDisk disk = map->extension->disk;
+    tierCursorDestroy(disk->cursor);
+    disk->cursor = NULL;
+    disk->nodes_done = true;
+    map->extension->iterator = NULL;
+}
+
+/**
+ ***** Function: mapAttachDisk *****
+ * Description: Makes an empty map disk tiered, keeping its memtable in
+ * memory until it holds 'threshold' entries and removals.
+ *
+ * @param map - The map, promoted.
+ * @param tier - The tier of the map, destroyed on failure. May be NULL.
+ * @param threshold - Capacity of the memtable.
+ * @return
+ * MAP_OUT_OF_MEMORY - A NULL tier was sent or an allocation failed.
+ * MAP_SUCCESS - Otherwise.
+ */
+static MapResult mapAttachDisk(Map map, DiskTier tier, int threshold){
+    Allocator allocator = mapAllocator(map);
+    MapDisk disk = tier ? allocatorAllocateZeroed(allocator,sizeof(*disk)) :
+                   NULL;
+    if(!disk){
+        diskTierDestroy(tier);
+        return MAP_OUT_OF_MEMORY;
+    }
+    /* The removed keys map to the map itself, which is never copied. The
+     * data read from the runs is adopted by the map of reads. */
+    disk->removed = mapCreateWithAllocator(mapAdoptElement,
+                                           map->copyKeyElement,
+                                           mapKeepElement,
+                                           map->freeKeyElement,
+                                           map->compareKeyElements,
+                                           allocator->allocate,
+                                           allocator->deallocate,
+                                           allocator->context);
+    disk->read = mapCreateWithAllocator(mapAdoptElement,map->copyKeyElement,
+                                        map->freeDataElement,
+                                        map->freeKeyElement,
+                                        map->compareKeyElements,
+                                        allocator->allocate,
+                                        allocator->deallocate,
+                                        allocator->context);
+    if(!disk->removed || !disk->read){
+        mapDestroy(disk->removed);
+        mapDestroy(disk->read);
+        mapDeallocate(map,disk,sizeof(*disk));
+        diskTierDestroy(tier);
+        return MAP_OUT_OF_MEMORY;
+    }
+    disk->tier = tier;
+    disk->threshold = threshold;
+    map->extension->disk = disk;
+    return MAP_SUCCESS;
+}
+
+/**
+ ***** Function: mapDiskCopy *****
+ * Description: mapCopy of a disk tiered map. Puts every live entry, in
+ * order, into a copy with a new tier in the same directory and with the
+ * same format and memtable capacity.
+ *
+ * @param map - The map.
+ * @return
+ * The copy, NULL if an allocation failed or the runs can't be read or
+ * written.
+ */
+static Map mapDiskCopy(Map map){
+    MapDisk disk = map->extension->disk;
+    Map new_map = mapCreateEmptyCopy(map);
+    if(!new_map || mapAttachDisk(new_map,
+                                 diskTierCreateLike(disk->tier,
+                                                    mapAllocator(new_map)),
+                                 disk->threshold)!=MAP_SUCCESS){
+        mapDestroy(new_map);
+        mapDiskEndIteration(map);
+        return NULL;
+    }
+    for(MapKeyElement key = mapDiskFirst(map);key;key = mapDiskStep(map)){
+        MapDataElement data = disk->advance & MAP_DISK_ADVANCE_NODES ?
+                              mapNodeData(map,map->extension->iterator) :
+                              tierCursorGetData(disk->cursor);
+        if(mapDiskPut(new_map,key,data)!=MAP_SUCCESS){
+            mapDiskEndIteration(map);
+            mapDestroy(new_map);
+            return NULL;
+        }
+    }
+    /* A failed read ends the iteration early. */
+    if(new_map->extension->disk->size!=disk->size){
+        mapDestroy(new_map);
+        return NULL;
+    }
+    return new_map;
+}
+
+/**
+ ***** Function: mapDiskRemoveIf *****
+ * Description: mapRemoveIf and mapClearStep of a disk tiered map. Copies
+ * the keys of at most 'budget' matching entries, in order, then removes
+ * them. The keys of the runs only live until the next step of the merged
+ * iteration, and a removal ends it.
+ *
+ * @param map - The map.
+ * @param predicate - The predicate. NULL matches every entry.
+ * @param context - Passed as is to the predicate.
+ * @param budget - Maximal amount of entries to remove, positive.
+ * @return
+ * ILLEGAL_VALUE if an allocation or a read or write of the runs failed.
+ * The number of removed entries otherwise.
+ */
+static int mapDiskRemoveIf(Map map, mapEntryPredicate predicate,
+                           void* context, int budget){
+    MapDisk disk = map->extension->disk;
+    int capacity = budget < disk->size ? budget : disk->size;
+    MapKeyElement* keys = mapAllocate(map,sizeof(*keys)*(capacity+1));
+    if(!keys){
+        return ILLEGAL_VALUE;
+    }
+    int matched = 0;
+    int visited = 0;
+    bool failed = false;
+    MapKeyElement key = mapDiskFirst(map);
+    while(key && matched<capacity && !failed){
+        MapDataElement data = disk->advance & MAP_DISK_ADVANCE_NODES ?
+                              mapNodeData(map,map->extension->iterator) :
+                              tierCursorGetData(disk->cursor);
+        if(!predicate || predicate(key,data,context)){
+            keys[matched] = map->copyKeyElement(key);
+            failed = !keys[matched];
+            matched += !failed;
+        }
+        visited++;
+        key = mapDiskStep(map);
+    }
+    mapDiskEndIteration(map);
+    /* A failed read ends the iteration early. */
+    failed = failed || (matched<capacity && visited!=disk->size);
+    int removed = 0;
+    for(int i=0;i<matched;i++){
+        if(!failed){
+            failed = mapDiskRemove(map,keys[i])!=MAP_SUCCESS;
+            removed += !failed;
+        }
+        map->freeKeyElement(keys[i]);
+    }
+    mapDeallocate(map,keys,sizeof(*keys)*(capacity+1));
+    return failed ? ILLEGAL_VALUE : removed;
+}
@@ -2,6 +2,9 @@
 #define MAP_MTM_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "latency_histogram.h"
 
 /**
 * Generic Map Container
@@ -13,40 +16,141 @@
 *
 * The following functions are available:
 *   mapCreate		- Creates a new empty map
+*   mapCreateLRU	- Creates a new empty map bounded to a given capacity,
+*   				  evicting its least recently used entry when full
+*   mapCreateStringKeyed - Creates a new empty map keyed by C strings,
+*   				  indexed by a radix tree
+*   mapCreateKeyOnly	- Creates a new empty map which entries have keys
+*   				  and no data
+*   mapCreateWithAllocator - Creates a new empty map taking its memory from
+*   				  user given allocation hooks
 *   mapDestroy		- Deletes an existing map and frees all resources
 *   mapCopy		- Copies an existing map
+*   mapCopyParallel - Copies an existing map, copying the elements on
+*   				  several threads.
 *   mapGetSize		- Returns the size of a given map
 *   mapContains	- returns weather or not a key exists inside the map.
 *   				  This resets the internal iterator.
 *   mapPut		    - Gives a specific key a given value.
 *   				  If the key exists, the value is overridden.
 *   				  This resets the internal iterator.
+*   mapPutHint	- Like mapPut, but searches for the key's position starting
+*   				  at the position of a previous put.
+*   mapPutWithTTL	- Like mapPut, but the entry expires after a given time.
+*   				  Expired entries are treated as absent.
+*   mapReclaimExpired - Frees a bounded amount of expired entries.
+*   mapCompute	- Lets a function modify the data of a key in place,
+*   				  optionally inserting a default value first.
+*   				  This resets the internal iterator.
 *   mapGet  	    - Returns the data paired to a key which matches the given key.
 *					  Iterator status unchanged
 *   mapRemove		- Removes a pair of (key,data) elements for which the key
 *                    matches a given element (by the key compare function).
 *   				  This resets the internal iterator.
+*   mapRemoveIf	- Removes all the pairs matching a predicate in a single
+*   				  pass. This resets the internal iterator.
+*   mapPrefixScan	- Calls a function for every entry which string key
+*   				  starts with a given prefix.
+*   mapParallelForEach - Calls a function for every entry, on several threads.
+*   mapParallelReduce - Folds all the entries into a single result, on
+*   				  several threads.
+*   mapBuildFromUnsorted - Puts an unsorted array of pairs, sorting it on
+*   				  several threads.
 *   mapGetFirst	- Sets the internal iterator to the first key in the
 *   				  map, and returns it.
 *   mapGetNext		- Advances the internal iterator to the next key and
 *   				  returns it.
+*   mapGetLast		- Sets the internal iterator to the last key in the
+*   				  map, and returns it.
+*   mapGetPrev		- Moves the internal iterator back to the previous key
+*   				  and returns it.
+*   mapPopFirst	- Removes the entry with the smallest key and hands its
+*   				  elements over.
+*   mapPopLast		- Removes the entry with the greatest key and hands its
+*   				  elements over.
 *	mapClear		- Clears the contents of the map. Frees all the elements of
 *	 				  the map using the free function.
+*	mapClearStep	- Removes a bounded number of elements, so a large map can
+*	 				  be cleared over several calls.
+*   mapTraceStart	- Starts recording the map's operations into a trace
+*   				  file, which map_replay can replay.
+*   mapTraceStop	- Stops recording the map's operations.
+*   mapSetLatencyHistograms - Starts or stops recording the latency of the
+*   				  map's operations (needs MAP_LATENCY_HISTOGRAMS).
+*   mapGetLatencyHistogram - Returns the latency histogram of an operation.
+*   mapResetLatencyHistograms - Empties the latency histograms.
+*   mapSubscribeChanges - Starts logging the map's changes for a consumer
+*   				  thread.
+*   mapUnsubscribeChanges - Stops logging the map's changes.
+*   mapDrainChanges - Takes a batch of logged changes, on the consumer thread.
+*   mapFreeChanges	- Frees the elements of taken changes.
+*   mapGetPendingChanges - Returns the number of logged changes not taken yet.
+*   mapEnableConcurrentReads - Lets reader threads search the map while a
+*   				  single writer modifies it, without locks.
+*   mapReaderCreate - Creates the handle of a reader thread.
+*   mapReaderDestroy - Frees the handle of a reader thread.
+*   mapReadBegin	- Starts a read section of a reader.
+*   mapReadEnd		- Ends a read section of a reader.
+*   mapReaderGet	- mapGet for a reader thread.
+*   mapReaderContains - mapContains for a reader thread.
+*   mapReaderForEach - Calls a function for every entry, on a reader thread.
+*   mapCompact		- Moves the map's nodes into one contiguous block, in key
+*   				  order.
+*   mapFreeze		- Turns the map into an immutable array based form, fast
+*   				  to search and iterate.
+*   mapThaw		- Makes a frozen map modifiable again.
+*   mapGetCacheStatistics - Returns the hit/miss/eviction counters of the map
+*   mapSetBloomFilter - Enables a Bloom filter answering lookups of absent
+*   				  keys without scanning the map.
+*   mapSetKeyFingerprint - Keeps a hash of every key, so lookups only call
+*   				  the compare function on keys with a matching hash.
+*   mapSetValueInterning - Stores equal data elements once, shared by all
+*   				  the keys (and copies of the map) holding them.
+*   mapSetKeyCompression - Makes a frozen string keyed map store its keys
+*   				  front coded in blocks.
+*   mapSetDiskTier - Keeps only a bounded memtable in memory and spills the
+*   				  rest of the entries to sorted runs on disk.
+*   mapFlush		- Writes the memtable of a disk tiered map to a run.
+*   mapGetDiskRuns - Returns the number of runs of a disk tiered map.
+*   mapGetBloomFilterStatistics - Reports the filter's false positive rate
+*   				  and memory usage.
+*   mapGetMemoryUsage - Reports the bytes held by the map itself and by its
+*   				  elements.
 * 	MAP_FOREACH	- A macro for iterating over the map's elements.
+* 	MAP_FOREACH_REVERSE - A macro for iterating over the map's elements
+* 				  from the greatest key down.
 */
 
 /** Type for defining the map */
 typedef struct Map_t *Map;
 
+/** Handle of a reader thread on a map with concurrent reads */
+typedef struct MapReader_t *MapReader;
+
 /** Type used for returning error codes from map functions */
 typedef enum MapResult_t {
 	MAP_SUCCESS,
 	MAP_OUT_OF_MEMORY,
 	MAP_NULL_ARGUMENT,
 	MAP_ITEM_ALREADY_EXISTS,
-	MAP_ITEM_DOES_NOT_EXIST
+	MAP_ITEM_DOES_NOT_EXIST,
+	MAP_FROZEN,
+	MAP_IO_ERROR,
+	MAP_UNSUPPORTED_MODE
 } MapResult;
 
+/**
+* Position hint for mapPutHint. Initialize with MAP_HINT_INITIALIZER and
+* don't modify its fields.
+*/
+typedef struct MapHint_t {
+	const void* map;
+	void* position;
+	unsigned long version;
+} MapHint;
+
+#define MAP_HINT_INITIALIZER {NULL, NULL, 0}
+
 /** Data element data type for map container */
 typedef void* MapDataElement;
 
@@ -75,8 +179,117 @@ typedef void(*freeMapKeyElements)(MapKeyElement);
 */
 typedef int(*compareMapKeyElements)(MapKeyElement, MapKeyElement);
 
+/**
+* Type of function used by the map to hash key elements. Equal key elements
+* (by the compare function) must have equal hash values.
+*/
+typedef unsigned long(*hashMapKeyElements)(MapKeyElement);
+
+/**
+* Type of function used by the map to hash data elements. Equal data
+* elements must have equal hash values.
+*/
+typedef unsigned long(*hashMapDataElements)(MapDataElement);
+
+/** Type of function telling whether two data elements are equal */
+typedef bool(*equalMapDataElements)(MapDataElement, MapDataElement);
+
+/**
+* Type of function writing a key or data element to a file, so that the
+* matching readMapElement reads it back. Returns false on failure.
+*/
+typedef bool(*writeMapElement)(void*, FILE*);
+
+/**
+* Type of function reading an element written by a writeMapElement. Returns
+* a new element (freed with the map's free function), NULL on failure.
+*/
+typedef void*(*readMapElement)(FILE*);
+
+/**
+* Type of function used to select entries of the map. Gets the key element,
+* the data element and a user context.
+*/
+typedef bool(*mapEntryPredicate)(MapKeyElement, MapDataElement, void*);
+
+/**
+* Type of function modifying a data element of the map in place. Gets the
+* stored data element and a user context.
+*/
+typedef void(*mapComputeFunction)(MapDataElement, void*);
+
+/**
+* Type of function called for entries of the map. Gets the key element,
+* the data element and a user context.
+*/
+typedef void(*mapEntryFunction)(MapKeyElement, MapDataElement, void*);
+
+/**
+* Type of function adding an entry of the map to an accumulator. Gets the
+* accumulator, the key element, the data element and a user context.
+*/
+typedef void(*mapAccumulateFunction)(void*, MapKeyElement, MapDataElement,
+	void*);
+
+/**
+* Type of function merging an accumulator (second argument) into a result
+* (first argument). The third argument is a user context.
+*/
+typedef void(*mapCombineFunction)(void*, void*, void*);
+
+/** Type of function returning the number of bytes held by a key element */
+typedef size_t(*sizeMapKeyElements)(MapKeyElement);
+
+/** Type of function returning the number of bytes held by a data element */
+typedef size_t(*sizeMapDataElements)(MapDataElement);
+
+/**
+* Type of function allocating memory for a map. Gets the size in bytes and
+* the allocator's context, returns NULL on failure.
+*/
+typedef void*(*mapAllocateFunction)(size_t, void*);
+
+/**
+* Type of function freeing memory given by a mapAllocateFunction. Gets the
+* block, the size it was allocated with and the allocator's context.
+*/
+typedef void(*mapDeallocateFunction)(void*, size_t, void*);
+
+/** Kinds of changes reported to a map's change subscriber */
+typedef enum MapChangeType_t {
+	MAP_CHANGE_PUT,
+	MAP_CHANGE_REMOVE,
+	MAP_CHANGE_CLEAR
+} MapChangeType;
+
+/** Operations which latencies are recorded by mapSetLatencyHistograms */
+typedef enum MapOperation_t {
+	MAP_OPERATION_PUT, // mapPut, mapPutHint, mapPutWithTTL and mapCompute.
+	MAP_OPERATION_GET, // mapGet and mapContains.
+	MAP_OPERATION_REMOVE, // mapRemove, mapPopFirst and mapPopLast.
+	MAP_OPERATION_COPY,
+	MAP_OPERATION_CLEAR,
+	MAP_OPERATION_ITERATE, // mapGetFirst, mapGetNext, mapGetLast, mapGetPrev.
+	MAP_OPERATIONS_NUMBER
+} MapOperation;
+
+/**
+* A change of a map, as taken by mapDrainChanges. The key and data are
+* copies owned by the change, freed with mapFreeChanges. A removal has no
+* data, and a clear has neither key nor data. Sequence numbers grow by one
+* for every change; a gap means changes were lost.
+*/
+typedef struct MapChange_t {
+	MapChangeType type;
+	unsigned long long sequence;
+	MapKeyElement key;
+	MapDataElement data;
+} MapChange;
+
 /**
 * mapCreate: Allocates a new empty map.
+* Up to 16 entries are kept in a single sorted block, without an
+* allocation per entry; past that the map switches to linked nodes.
 *
 * @param copyDataElement - Function pointer to be used for copying data elements into
 *  	the map or when copying the map.
@@ -96,6 +309,81 @@ Map mapCreate(copyMapDataElements copyDataElement, copyMapKeyElements copyKeyEle
 	freeMapDataElements freeDataElement, freeMapKeyElements freeKeyElement,
 	compareMapKeyElements compareKeyElements);
 
+/**
+* mapCreateLRU: Allocates a new empty map which holds at most 'capacity'
+* elements. mapGet and mapPut mark the entry they reach as the most recently
+* used one (in O(1)). When a new key is put into a full map, the least
+* recently used entry is evicted using the free functions. The recency
+* links take two more pointers per entry, which unbounded maps don't pay.
+*
+* @param capacity - Maximal number of elements in the map. Must be positive.
+* @param copyDataElement, copyKeyElement, freeDataElement, freeKeyElement,
+* 		compareKeyElements - As in mapCreate.
+* @return
+* 	NULL - if one of the parameters is NULL, capacity is not positive or
+* 		allocations failed.
+* 	A new Map in case of success.
+*/
+Map mapCreateLRU(int capacity, copyMapDataElements copyDataElement,
+	copyMapKeyElements copyKeyElement, freeMapDataElements freeDataElement,
+	freeMapKeyElements freeKeyElement, compareMapKeyElements compareKeyElements);
+
+/**
+* mapCreateStringKeyed: Allocates a new empty map which keys are C strings,
+* ordered like strcmp. The keys are copied and freed by the map and indexed
+* by an adaptive radix tree: finding a key costs time proportional to its
+* length, not to the size of the map.
+*
+* @param copyDataElement, freeDataElement - As in mapCreate.
+* @return
+* 	NULL - if one of the parameters is NULL or allocations failed.
+* 	A new Map in case of success.
+*/
+Map mapCreateStringKeyed(copyMapDataElements copyDataElement,
+	freeMapDataElements freeDataElement);
+
+/**
+* mapCreateKeyOnly: Allocates a new empty map which entries have no data,
+* e.g. to hold the elements of a set. Its nodes (and its small block) keep
+* a key per entry and no data pointer. The data given to mapPut and the
+* like is ignored but must not be NULL; mapGet and the functions handing
+* out entries give the same marker as the data of every key, which must not
+* be used or freed. mapCompute, value interning and disk tiers are
+* unsupported.
+*
+* @param copyKeyElement, freeKeyElement, compareKeyElements - As in
+* 		mapCreate.
+* @return
+* 	NULL - if one of the parameters is NULL or allocations failed.
+* 	A new Map in case of success.
+*/
+Map mapCreateKeyOnly(copyMapKeyElements copyKeyElement,
+	freeMapKeyElements freeKeyElement, compareMapKeyElements compareKeyElements);
+
+/**
+* mapCreateWithAllocator: Allocates a new empty map which takes all of its
+* internal memory (the map itself, its nodes, timers, index and filter) from
+* the given hooks instead of malloc, e.g. to place it in an arena or to
+* enforce a memory budget. Elements are still allocated by the copy
+* functions. Copies of the map use the same hooks.
+*
+* @param copyDataElement, copyKeyElement, freeDataElement, freeKeyElement,
+* 		compareKeyElements - As in mapCreate.
+* @param allocate - Allocates a block of a given size. NULL for malloc.
+* @param deallocate - Frees a block, and is told its size. NULL for free.
+* 		Must be NULL exactly when allocate is.
+* @param context - Passed as is to the hooks.
+* @return
+* 	NULL - if one of the element functions is NULL, only one hook was given
+* 		or allocations failed.
+* 	A new Map in case of success.
+*/
+Map mapCreateWithAllocator(copyMapDataElements copyDataElement,
+	copyMapKeyElements copyKeyElement, freeMapDataElements freeDataElement,
+	freeMapKeyElements freeKeyElement, compareMapKeyElements compareKeyElements,
+	mapAllocateFunction allocate, mapDeallocateFunction deallocate,
+	void* context);
+
 /**
 * mapDestroy: Deallocates an existing map. Clears all elements by using the
 * stored free functions.
@@ -117,7 +405,26 @@ void mapDestroy(Map map);
 Map mapCopy(Map map);
 
 /**
-* mapGetSize: Returns the number of elements in a map
+* mapCopyParallel: Creates a copy of target map like mapCopy, calling the
+* copy functions of the keys and the data from up to 'threads' threads. The
+* entries are split into contiguous ranges in key order, one per thread,
+* and the copies are linked into the new map in order on the calling
+* thread. The copy functions must be thread safe. Small, bounded, value
+* interned and disk tiered maps are copied by mapCopy.
+* Iterator values for both maps is undefined after this operation.
+*
+* @param map - Target map.
+* @param threads - Maximal number of threads, including the calling one.
+* 		At most one thread per online processor is used.
+* @return
+* 	NULL if a NULL was sent or a memory allocation failed.
+* 	A Map containing the same elements as map otherwise.
+*/
+Map mapCopyParallel(Map map, int threads);
+
+/**
+* mapGetSize: Returns the number of elements in a map. Expired entries
+* which were not reclaimed yet are counted.
 * @param map - The map which size is requested
 * @return
 * 	-1 if a NULL pointer was sent.
@@ -157,6 +464,90 @@ bool mapContains(Map map, MapKeyElement element);
 */
 MapResult mapPut(Map map, MapKeyElement keyElement, MapDataElement dataElement);
 
+/**
+*	mapPutHint: Like mapPut, but the search for the key's position starts at
+*	a hint, which is the position of a previous put. Putting a key near the
+*	hint costs time proportional to its distance from it. (Keys greater than
+*	all the keys in the map are appended in O(1) even without a hint.)
+*  Iterator's value is undefined after this operation.
+*
+* @param map - The map for which to reassign the data element
+* @param hint - The hint, initialized with MAP_HINT_INITIALIZER. Every
+* 	successful call sets it to the position of the put key. A hint which is
+* 	outdated (an entry was freed since it was set) or which belongs to
+* 	another map is ignored. NULL to put without a hint.
+* @param keyElement - The key element which need to be reassigned
+* @param dataElement - The new data element to associate with the given key.
+* @return
+* 	MAP_NULL_ARGUMENT if a NULL was sent as map, key or data
+* 	MAP_OUT_OF_MEMORY if an allocation failed
+* 	MAP_SUCCESS the paired elements had been inserted successfully
+*/
+MapResult mapPutHint(Map map, MapHint* hint, MapKeyElement keyElement,
+	MapDataElement dataElement);
+
+/**
+*	mapPutWithTTL: Gives a specified key a specific value which is valid for
+*  'ttl' milliseconds. Once expired, the entry is treated as absent by
+*  mapGet, mapContains, mapRemove and the iterator. Expired entries are
+*  reclaimed incrementally: every mapPut, mapPutWithTTL, mapContains and
+*  mapRemove frees a small bounded number of them, so no operation ever
+*  sweeps the whole map. A later mapPut on the key makes it permanent again.
+*  Only the nodes of maps which had a TTL entry have room for a timer: the
+*  first one moves the existing nodes into larger ones, as mapCompact would.
+*  Iterator's value is undefined after this operation.
+*
+* @param map - The map for which to reassign the data element
+* @param keyElement - The key element which need to be reassigned
+* @param dataElement - The new data element to associate with the given key.
+* @param ttl - Time to live in milliseconds. A non positive value makes the
+*      entry expire immediately.
+* @return
+* 	MAP_NULL_ARGUMENT if a NULL was sent as map, key or data
+* 	MAP_OUT_OF_MEMORY if an allocation failed
+* 	MAP_SUCCESS the paired elements had been inserted successfully
+*/
+MapResult mapPutWithTTL(Map map, MapKeyElement keyElement,
+	MapDataElement dataElement, long ttl);
+
+/**
+*	mapReclaimExpired: Frees expired entries, handling at most 'budget'
+*	entries. Lets idle time be used for reclaiming memory.
+*  Iterator's value is undefined after this operation.
+*
+* @param map - The map to reclaim entries from.
+* @param budget - Maximal amount of entries to handle.
+* @return
+* 	-1 if a NULL pointer was sent.
+* 	Otherwise the number of entries handled.
+*/
+int mapReclaimExpired(Map map, int budget);
+
+/**
+*	mapCompute: Lets a function modify the data of a key in place. The key
+*	is looked up once and the data is neither copied nor freed, so updates
+*	such as incrementing a counter cost a single lookup and no allocation.
+*	If the key is missing and 'defaultData' isn't NULL, a copy of it is
+*	inserted first and then passed to the function.
+*  Iterator's value is undefined after this operation.
+*
+* @param map - The map to modify.
+* @param keyElement - The key element which data should be modified.
+* @param compute - Called with the stored data element and 'context'. May
+* 	modify the data element in place, must not modify the map.
+* @param context - Passed as is to 'compute'.
+* @param defaultData - Data element to insert for a missing key. NULL to
+* 	leave missing keys alone.
+* @return
+* 	MAP_NULL_ARGUMENT if a NULL was sent as map, key or function
+* 	MAP_ITEM_DOES_NOT_EXIST if the key is missing and no default was given
+* 	MAP_UNSUPPORTED_MODE if the map is disk tiered or key-only
+* 	MAP_OUT_OF_MEMORY if an allocation failed
+* 	MAP_SUCCESS if the function was called
+*/
+MapResult mapCompute(Map map, MapKeyElement keyElement,
+	mapComputeFunction compute, void* context, MapDataElement defaultData);
+
 /**
 *	mapGet: Returns the data associated with a specific key in the map.
 *			Iterator status unchanged
@@ -190,6 +581,113 @@ MapDataElement mapGet(Map map, MapKeyElement keyElement);
 */
 MapResult mapRemove(Map map, MapKeyElement keyElement);
 
+/**
+* 	mapRemoveIf: Removes every pair of key and data elements for which the
+*  predicate returns true, in a single pass over the map. The removed elements
+*  are deallocated using the free functions supplied at initialization.
+*  Iterator's value is undefined after this operation.
+*
+* @param map - The map to remove the elements from.
+* @param predicate - Called once for every entry with its key, its data and
+* 	'context'. Must not modify the map.
+* @param context - Passed as is to the predicate.
+* @return
+* 	-1 if a NULL map or predicate was sent, or if the map is disk tiered
+* 	and an allocation or a read or write of its runs failed. The pairs
+* 	removed until then stay removed.
+* 	Otherwise the number of removed pairs.
+*/
+int mapRemoveIf(Map map, mapEntryPredicate predicate, void* context);
+
+/**
+*	mapPrefixScan: Calls a function for every entry which key starts with a
+* given prefix, in key order. Only the matching entries are visited.
+* Iterator status unchanged.
+*
+* @param map - A map created by mapCreateStringKeyed.
+* @param prefix - The prefix. The empty string matches every key.
+* @param function - Called with every matching key, its data and 'context'.
+* 		Must not modify the map.
+* @param context - Passed as is to the function.
+* @return
+* 	-1 if a NULL was sent or the map isn't string keyed.
+* 	The number of entries visited otherwise.
+*/
+int mapPrefixScan(Map map, const char* prefix, mapEntryFunction function,
+	void* context);
+
+/**
+*	mapParallelForEach: Calls a function for every entry of the map, using
+*	up to 'threads' threads. The entries are split into contiguous ranges in
+*	key order, one per thread. The function runs concurrently for different
+*	entries, so it must be thread safe and must not modify the map.
+*	Iterator status unchanged.
+*
+* @param map - The map to go over.
+* @param function - Called with every key, its data and 'context'.
+* @param context - Passed as is to the function.
+* @param threads - Maximal number of threads, including the calling one.
+* 		At most one thread per online processor is used.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map or function was sent.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapParallelForEach(Map map, mapEntryFunction function,
+	void* context, int threads);
+
+/**
+*	mapParallelReduce: Folds all the entries of the map into 'result', using
+*	up to 'threads' threads. The entries are split into contiguous ranges in
+*	key order, and every range gets its own accumulator of 'accumulatorSize'
+*	bytes, initialized as a copy of 'result' (which should hold the identity
+*	value). Once all ranges are accumulated, the accumulators are combined
+*	into 'result' in key order on the calling thread.
+*	Iterator status unchanged.
+*
+* @param map - The map to go over.
+* @param accumulate - Adds an entry to an accumulator. Runs concurrently for
+* 	different ranges and must not modify the map.
+* @param combine - Merges an accumulator into the result.
+* @param result - Holds the identity value and will hold the result.
+* @param accumulatorSize - Size in bytes of 'result' and the accumulators.
+* @param context - Passed as is to 'accumulate' and 'combine'.
+* @param threads - Maximal number of threads, including the calling one.
+* 		At most one thread per online processor is used.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map, function or result was sent.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapParallelReduce(Map map, mapAccumulateFunction accumulate,
+	mapCombineFunction combine, void* result, size_t accumulatorSize,
+	void* context, int threads);
+
+/**
+*	mapBuildFromUnsorted: Puts n pairs of keys and data given in any order,
+*	as a bulk load. The pairs are sorted with a stable parallel merge sort on
+*	up to 'threads' threads, then put in a single pass in key order, each
+*	next to the previous one: an empty map is built in linear time after the
+*	sort. Of equal keys the one given last wins, as with repeated mapPut.
+*	Iterator's value is undefined after this operation.
+*
+* @param map - The map to put in.
+* @param keys - n keys. They are compared concurrently, so the map's
+* 	comparison function must be thread safe.
+* @param values - n data elements; values[i] is put with keys[i].
+* @param n - Number of pairs.
+* @param threads - Maximal number of threads, including the calling one.
+* 		At most one thread per online processor is used.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map, or NULL arrays or elements were sent.
+* 	MAP_FROZEN - if the map is frozen.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed. The pairs before the
+* 	failed one in key order were put.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapBuildFromUnsorted(Map map, MapKeyElement* keys,
+	MapDataElement* values, int n, int threads);
+
 /**
 *	mapGetFirst: Sets the internal iterator (also called current key element) to
 *	the first key element in the map. There doesn't need to be an internal order
@@ -216,6 +714,69 @@ MapKeyElement mapGetFirst(Map map);
 */
 MapKeyElement mapGetNext(Map map);
 
+/**
+*	mapGetLast: Sets the internal iterator to the last (greatest) key element
+*	in the map and returns it, in O(1). Use this to start iterating over the
+*	map backwards with mapGetPrev; mapGetNext continues forward from it too.
+*	A disk tiered map can only be iterated forward.
+*
+* @param map - The map for which to set the iterator and return the last
+* 		key element.
+* @return
+* 	NULL if a NULL pointer was sent, the map is empty or disk tiered.
+* 	The last key element of the map otherwise
+*/
+MapKeyElement mapGetLast(Map map);
+
+/**
+*	mapGetPrev: Moves the map iterator back to the previous (smaller) key
+*	element and returns it. mapGetNext and mapGetPrev may be mixed.
+* @param map - The map for which to move the iterator
+* @return
+* 	NULL if moved before the start of the map, the iterator is at an invalid
+* 	state, the map is disk tiered or a NULL sent as argument
+* 	The previous key element on the map in case of success
+*/
+MapKeyElement mapGetPrev(Map map);
+
+/**
+*	mapPopFirst: Removes the entry with the smallest key in O(1) and hands
+*	its elements over to the caller, so the map can serve as a priority
+*	queue. If the map has concurrent readers or interns its values, the
+*	caller gets copies of the elements instead.
+*	Iterator's value is undefined after this operation.
+*
+* @param map - The map to remove the entry from.
+* @param keyElement - Will hold the key element, to be freed by the caller
+* 	with the key free function. If NULL the key is freed.
+* @param dataElement - Will hold the data element, to be freed by the
+* 	caller with the data free function. If NULL the data is freed.
+* @return
+* 	MAP_NULL_ARGUMENT if a NULL was sent as map.
+* 	MAP_FROZEN if the map is frozen.
+* 	MAP_UNSUPPORTED_MODE if the map is disk tiered.
+* 	MAP_ITEM_DOES_NOT_EXIST if the map is empty.
+* 	MAP_OUT_OF_MEMORY if copying an element failed. The map is unchanged.
+* 	MAP_SUCCESS the entry was removed.
+*/
+MapResult mapPopFirst(Map map, MapKeyElement* keyElement,
+	MapDataElement* dataElement);
+
+/**
+*	mapPopLast: Removes the entry with the greatest key in O(1), like
+*	mapPopFirst.
+*	Iterator's value is undefined after this operation.
+*
+* @param map - The map to remove the entry from.
+* @param keyElement - Will hold the key element. If NULL the key is freed.
+* @param dataElement - Will hold the data element. If NULL the data is
+* 	freed.
+* @return
+* 	As mapPopFirst.
+*/
+MapResult mapPopLast(Map map, MapKeyElement* keyElement,
+	MapDataElement* dataElement);
+
 
 /**
 * mapClear: Removes all key and data elements from target map.
@@ -228,6 +789,536 @@ MapKeyElement mapGetNext(Map map);
 */
 MapResult mapClear(Map map);
 
+/**
+* mapClearStep: Removes at most 'budget' key and data elements from target
+* map, starting with the smallest keys. Lets a large map be cleared, or
+* destroyed (by calling mapDestroy once it is empty), over several calls
+* without a single long pause.
+* Iterator's value is undefined after this operation.
+*
+* @param map - Target map to remove elements from.
+* @param budget - Maximal amount of elements to remove.
+* @return
+* 	-1 - if a NULL pointer was sent, or if the map is disk tiered and an
+* 	allocation or a read or write of its runs failed.
+* 	Otherwise the number of elements left in the map.
+*/
+int mapClearStep(Map map, int budget);
+
+/**
+* mapTraceStart: Starts recording the operations done on the map into a
+* compact binary trace file: every mapPut (and its variants), mapGet,
+* mapContains, mapRemove, mapGetFirst, mapGetNext and mapClear is logged
+* with its time and an identifier of its key, never the key itself. The
+* trace can be replayed against any map configuration with map_replay.
+* mapCompute is logged as a put when given a default data element, and as
+* a get otherwise, which leaves a replayed map with the same keys.
+* A trace already being recorded is stopped first.
+*
+* @param map - The map to trace.
+* @param path - Path of the trace file. An existing file is replaced.
+* @param traceKeyElement - Gives the identifier recorded for a key. Equal
+* 		keys should get equal identifiers.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL argument was sent.
+* 	MAP_IO_ERROR - if the file can't be created.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapTraceStart(Map map, const char* path,
+	hashMapKeyElements traceKeyElement);
+
+/**
+* mapTraceStop: Stops recording the map's operations and closes the trace
+* file. Does nothing if the map isn't traced. mapDestroy stops the trace
+* too.
+*
+* @param map - The traced map.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_IO_ERROR - if writing any part of the trace failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapTraceStop(Map map);
+
+/**
+* mapSetLatencyHistograms: Starts or stops recording how long every call of
+* the map's public operations takes (see MapOperation), in nanoseconds, into
+* a log-bucket histogram per operation, so percentiles such as p99 can be
+* read with latencyHistogramPercentile. A call costs two reads of a
+* monotonic clock while recording. Recording is only compiled in when the
+* library is built with MAP_LATENCY_HISTOGRAMS defined; otherwise no
+* operation is timed at all. Stopping discards the histograms.
+*
+* @param map - The map.
+* @param enabled - Whether latencies should be recorded.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_UNSUPPORTED_MODE - if enabling without MAP_LATENCY_HISTOGRAMS.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetLatencyHistograms(Map map, bool enabled);
+
+/**
+* mapGetLatencyHistogram: Copies out the latency histogram of an operation.
+* The histogram is empty if latencies aren't being recorded.
+*
+* @param map - The map.
+* @param operation - The operation.
+* @param histogram - Will hold the histogram.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL was sent.
+* 	MAP_UNSUPPORTED_MODE - if built without MAP_LATENCY_HISTOGRAMS.
+* 	MAP_ITEM_DOES_NOT_EXIST - if operation isn't a MapOperation.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapGetLatencyHistogram(Map map, MapOperation operation,
+	LatencyHistogram* histogram);
+
+/**
+* mapResetLatencyHistograms: Empties the latency histograms of all the
+* operations, keeping the recording on.
+*
+* @param map - The map.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_UNSUPPORTED_MODE - if built without MAP_LATENCY_HISTOGRAMS.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapResetLatencyHistograms(Map map);
+
+/**
+* mapSubscribeChanges: Starts logging every change of the map into a
+* bounded lock-free buffer, which a single consumer thread drains with
+* mapDrainChanges while the map keeps being modified. Mirroring the map
+* then costs time proportional to the number of changes instead of scans.
+* Every successful mapPut (and its variants, and mapCompute) logs a put
+* with the new data; mapRemove, mapRemoveIf, mapClearStep, evictions and
+* reclaimed expired entries log removals, and mapClear logs a clear. The
+* TTL of an entry isn't logged. Changes which don't fit into the buffer
+* (or which elements can't be copied) are lost, leaving a gap in the
+* sequence numbers; the consumer should then resynchronize with a full
+* scan. A subscription already in place is replaced, and its changes which
+* weren't taken are freed.
+*
+* @param map - The map.
+* @param capacity - Minimal number of changes the buffer holds.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_OUT_OF_MEMORY - if capacity isn't positive or an allocation failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSubscribeChanges(Map map, int capacity);
+
+/**
+* mapUnsubscribeChanges: Stops logging the map's changes and frees the
+* changes which weren't taken. The consumer must not be draining. Does
+* nothing if the map has no subscription. mapDestroy unsubscribes too.
+*
+* @param map - The map.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapUnsubscribeChanges(Map map);
+
+/**
+* mapDrainChanges: Takes the oldest logged changes of the map, in the order
+* they were made. Called from the single consumer thread, concurrently with
+* the thread modifying the map.
+*
+* @param map - The map.
+* @param changes - Array of at least 'max' changes to fill.
+* @param max - Maximal number of changes to take.
+* @return
+* 	-1 if a NULL was sent or the map has no subscription.
+* 	The number of changes taken otherwise.
+*/
+int mapDrainChanges(Map map, MapChange* changes, int max);
+
+/**
+* mapFreeChanges: Frees the elements of changes taken with mapDrainChanges,
+* using the map's free functions. May be called from the consumer thread.
+*
+* @param map - The map the changes were taken from.
+* @param changes - The changes.
+* @param count - Number of changes.
+*/
+void mapFreeChanges(Map map, MapChange* changes, int count);
+
+/**
+* mapGetPendingChanges: Returns the number of logged changes which weren't
+* taken yet. Lets the writer slow down before changes get lost.
+*
+* @param map - The map.
+* @return
+* 	-1 if a NULL map was sent or the map has no subscription.
+* 	The number of pending changes otherwise.
+*/
+int mapGetPendingChanges(Map map);
+
+/**
+* mapEnableConcurrentReads: Lets reader threads search the map while a
+* single writer thread keeps modifying it (read-copy-update). Readers work
+* through their own handles and never take locks or block the writer;
+* entries removed or replaced by the writer are freed, with the free
+* functions, once no reader can still see them (epoch based reclamation).
+* All the other map functions stay for the writer thread only. Bounded and
+* string keyed maps, Bloom filters and TTLs can't be used in this mode
+* (mapPutWithTTL, mapSetBloomFilter and mapFreeze return
+* MAP_UNSUPPORTED_MODE). The mode lasts until the map is destroyed.
+*
+* @param map - The map.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_FROZEN - if the map is frozen.
+* 	MAP_UNSUPPORTED_MODE - if the map uses a feature which can't be used in
+* 		this mode.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapEnableConcurrentReads(Map map);
+
+/**
+* mapReaderCreate: Creates the handle of a reader thread of a map with
+* concurrent reads. Every reader thread needs its own handle.
+*
+* @param map - The map.
+* @return
+* 	NULL if a NULL map was sent, concurrent reads aren't enabled or
+* 		allocations failed.
+* 	A new reader otherwise.
+*/
+MapReader mapReaderCreate(Map map);
+
+/**
+* mapReaderDestroy: Frees a reader handle. Must be called outside of a read
+* section, and before the map is destroyed.
+*
+* @param reader - The reader. If NULL nothing will be done.
+*/
+void mapReaderDestroy(MapReader reader);
+
+/**
+* mapReadBegin: Starts a read section. Entries seen inside it, and the data
+* returned by mapReaderGet, stay valid until mapReadEnd. Sections should be
+* short, as nothing removed meanwhile can be freed. Sections don't nest.
+*
+* @param reader - The reader.
+*/
+void mapReadBegin(MapReader reader);
+
+/**
+* mapReadEnd: Ends a read section.
+*
+* @param reader - The reader.
+*/
+void mapReadEnd(MapReader reader);
+
+/**
+* mapReaderGet: Returns the data paired with a key, as seen by a reader.
+* Must be called inside a read section.
+*
+* @param reader - The reader.
+* @param keyElement - The key to look for.
+* @return
+* 	NULL if a NULL was sent or the key isn't in the map.
+* 	The data element otherwise, valid until the end of the read section.
+*/
+MapDataElement mapReaderGet(MapReader reader, MapKeyElement keyElement);
+
+/**
+* mapReaderContains: Checks whether a key is in the map, as seen by a
+* reader. Must be called inside a read section.
+*
+* @param reader - The reader.
+* @param keyElement - The key to look for.
+* @return
+* 	true if the key is in the map, false otherwise (or if a NULL was sent).
+*/
+bool mapReaderContains(MapReader reader, MapKeyElement keyElement);
+
+/**
+* mapReaderForEach: Calls a function for every entry, in key order, as seen
+* by a reader. Entries put or removed concurrently may or may not be
+* visited. Must be called inside a read section.
+*
+* @param reader - The reader.
+* @param function - Called with every key, data and the context.
+* @param context - Passed as is to the function.
+* @return
+* 	-1 if a NULL was sent.
+* 	The number of entries visited otherwise.
+*/
+int mapReaderForEach(MapReader reader, mapEntryFunction function,
+	void* context);
+
+/**
+* mapCompact: Moves all the entries of the map into one contiguous block of
+* memory, in key order, and relinks them. After long churn the entries are
+* scattered over the heap and every step of an iteration or a search is a
+* cache miss; a compacted map is walked sequentially again, as fast as a
+* freshly built one. Takes time and memory proportional to the size of the
+* map, and reports the number of entries moved, so it can be run during
+* idle periods. Hints of mapPutHint are invalidated; the internal iterator
+* is kept. Small and frozen maps are already contiguous and are left
+* alone.
+*
+* @param map - The map.
+* @param relocated - Will hold the number of entries moved. May be NULL.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_UNSUPPORTED_MODE - if concurrent reads are enabled.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed. The map is unchanged.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapCompact(Map map, int* relocated);
+
+/**
+* mapFreeze: Turns the map into an immutable, read optimized form. The
+* entries are moved into flat arrays sorted by key and the nodes are freed:
+* mapGet and mapContains do a branch free binary search, and MAP_FOREACH
+* walks the arrays sequentially. While frozen, every function which would
+* modify the map (including mapClear) fails with MAP_FROZEN, or -1 for the
+* functions returning a number. mapCopy of a frozen map returns a map which
+* isn't frozen. Iterator's value is undefined after this operation.
+*
+* @param map - The map to freeze.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed. The map is unchanged.
+* 	MAP_SUCCESS - The map is frozen (also if it already was).
+*/
+MapResult mapFreeze(Map map);
+
+/**
+* mapThaw: Makes a frozen map modifiable again, moving its entries back
+* into nodes. A bounded map's recency order becomes the key order.
+* Iterator's value is undefined after this operation.
+*
+* @param map - The map to thaw.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed. The map stays frozen.
+* 	MAP_SUCCESS - The map is modifiable (also if it wasn't frozen).
+*/
+MapResult mapThaw(Map map);
+
+/**
+* mapGetCacheStatistics: Returns the lookup counters of the map.
+* A hit is a mapGet call which found its key, a miss is a mapGet call which
+* didn't. An eviction is an entry removed by a bounded map (see mapCreateLRU)
+* to make room for a new key. The counters are kept by bounded maps only;
+* any other map reports zeros.
+*
+* @param map - The map which statistics are requested.
+* @param hits - Will hold the number of hits. Ignored if NULL.
+* @param misses - Will hold the number of misses. Ignored if NULL.
+* @param evictions - Will hold the number of evictions. Ignored if NULL.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapGetCacheStatistics(Map map, long* hits, long* misses,
+	long* evictions);
+
+/**
+* mapSetBloomFilter: Enables a Bloom filter over the map's keys. A lookup
+* (mapGet, mapContains, mapRemove, mapPut) of a key which is definitely not
+* in the map then returns without scanning the map. The filter is updated by
+* every insertion and is rebuilt lazily, by the next lookup, once the map
+* outgrew it or many entries were removed since it was built.
+*
+* @param map - The map.
+* @param hashKeyElement - Hash function of the keys. NULL disables the filter.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed. The map is left without a
+* 		filter.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetBloomFilter(Map map, hashMapKeyElements hashKeyElement);
+
+/**
+* mapSetKeyFingerprint: Lets the map keep a fingerprint (a condensed hash) of
+* every key, in a hash index of its entries. Lookups by equality (mapGet,
+* mapContains, mapRemove) probe the index and only call the compare function
+* on keys which fingerprint matches, which pays off for keys that are
+* expensive to compare; a missing key costs about as much as a present one.
+* The index takes between 21 and 43 bytes per entry.
+*
+* @param map - The map.
+* @param fingerprintKeyElement - Hash function of the keys; equal keys must
+* 		have equal hashes. NULL stops using fingerprints.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_FROZEN - if the map is frozen.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed. The map is unchanged.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetKeyFingerprint(Map map,
+	hashMapKeyElements fingerprintKeyElement);
+
+/**
+* mapSetValueInterning: Makes the map keep a single reference counted copy
+* of every distinct data element (by the given hash and equality functions)
+* instead of a copy per key. copyDataElement then only runs when a value is
+* first stored and freeDataElement when its last key lets go of it, and
+* mapCopy shares the stored values with the copy instead of copying them.
+* Stored data elements are shared, so they must not be modified in place;
+* mapCompute works on a private copy which is interned afterwards. A map
+* and its copies share the values and must be used from one thread at a
+* time. Can only be set on an empty map.
+*
+* @param map - The map.
+* @param hashDataElement - Hash function of the data elements. NULL stops
+* 		interning.
+* @param equalDataElements - Equality function of the data elements.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent, or a hash function without
+* 		an equality function.
+* 	MAP_UNSUPPORTED_MODE - if the map isn't empty or is key-only.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetValueInterning(Map map, hashMapDataElements hashDataElement,
+	equalMapDataElements equalDataElements);
+
+/**
+* mapSetKeyCompression: Makes mapFreeze of a string keyed map store its keys
+* front coded instead of as a copy per key: every key is kept as the length
+* of the prefix it shares with the previous key and the rest of its bytes,
+* and every 16th key is kept whole so lookups stay logarithmic (a binary
+* search of the whole keys, then a scan of at most 16 keys). Keys sharing
+* long prefixes, like paths or URLs, take a fraction of their usual memory.
+* The keys returned by the iteration functions (mapGetFirst, mapGetNext,
+* mapGetLast, mapGetPrev) of such a frozen map are decoded into a buffer of
+* the map, valid until the next of these calls,
+* and the keys passed to the functions of mapPrefixScan, mapParallelForEach
+* and mapParallelReduce are only valid during the call. If the blocks can't
+* be allocated, mapFreeze keeps the keys as they are. mapThaw copies the
+* keys back into nodes.
+*
+* @param map - A map created by mapCreateStringKeyed.
+* @param enabled - Whether to compress the keys of the frozen map.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_FROZEN - if the map is frozen.
+* 	MAP_UNSUPPORTED_MODE - if compression is enabled on a map which isn't
+* 		string keyed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetKeyCompression(Map map, bool enabled);
+
+/**
+* mapSetDiskTier: Turns the map into a log structured merge tree: its nodes
+* become a memtable of at most memtableCapacity entries and removals, which
+* is then written to disk as a new immutable run of sorted entries. Every
+* run has a Bloom filter and a sparse index, so a lookup missing the
+* memtable reads at most a short stretch of the runs which may hold the
+* key. Once there are a few runs a background thread merges them into one;
+* the element functions (read, write, compare, hash and free) may thus be
+* called from that thread as well.
+* mapGetSize counts all the entries, mapGetFirst and mapGetNext iterate
+* over all of them in order, and mapGet returns data read from disk which
+* stays valid until the map next changes, like the data of the memtable
+* (which a flush frees). mapCopy gives the copy a new tier in the same
+* directory. mapPutWithTTL, mapCompute, mapFreeze, mapParallelForEach,
+* mapParallelReduce, mapEnableConcurrentReads, Bloom filters and value
+* interning are unsupported on such a map, and mapGetMemoryUsage only
+* accounts for the memtable. Can only be set on an
+* empty map which has data and no capacity, radix index, expiry or
+* concurrent readers.
+* The run files are deleted by mapClear and mapDestroy.
+*
+* @param map - The map.
+* @param directory - Existing directory to keep the run files in.
+* @param memtableCapacity - Entries and removals kept in memory.
+* @param hashKeyElement - Hash function of the key elements.
+* @param writeKeyElement - Writes a key element to a run.
+* @param readKeyElement - Reads back a key element.
+* @param writeDataElement - Writes a data element to a run.
+* @param readDataElement - Reads back a data element.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL argument was sent.
+* 	MAP_FROZEN - if the map is frozen.
+* 	MAP_UNSUPPORTED_MODE - if the map isn't empty, already has a disk tier
+* 		or another mode which can't be combined with one, or
+* 		memtableCapacity isn't positive.
+* 	MAP_OUT_OF_MEMORY - if an allocation failed.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapSetDiskTier(Map map, const char* directory,
+	int memtableCapacity, hashMapKeyElements hashKeyElement,
+	writeMapElement writeKeyElement, readMapElement readKeyElement,
+	writeMapElement writeDataElement, readMapElement readDataElement);
+
+/**
+* mapFlush: Writes the memtable of a disk tiered map to a new run and waits
+* for a background merge of the runs, if any, to finish.
+* Iterator's value is undefined after this operation.
+*
+* @param map - The map.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_UNSUPPORTED_MODE - if the map has no disk tier.
+* 	MAP_IO_ERROR - if writing the run or merging the runs failed. The map
+* 		is unchanged.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapFlush(Map map);
+
+/**
+* mapGetDiskRuns: Returns the number of runs of a disk tiered map.
+*
+* @param map - The map.
+* @return
+* 	-1 if a NULL map was sent.
+* 	0 if the map has no disk tier.
+* 	The number of runs otherwise.
+*/
+int mapGetDiskRuns(Map map);
+
+/**
+* mapGetBloomFilterStatistics: Reports the state of the map's Bloom filter.
+*
+* @param map - The map.
+* @param falsePositiveRate - Will hold the estimated probability that a
+* 		lookup of an absent key still scans the map (1 if there is no
+* 		filter). Ignored if NULL.
+* @param memoryBytes - Will hold the number of bytes held by the filter.
+* 		Ignored if NULL.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapGetBloomFilterStatistics(Map map, double* falsePositiveRate,
+	size_t* memoryBytes);
+
+/**
+* mapGetMemoryUsage: Reports the memory held by the map. The bytes held by
+* the map itself (the map, its nodes, timers, index and filter) are tracked
+* as they are allocated and returned in O(1). The bytes held by the
+* elements are summed over all the entries with the given size functions.
+* The keys of a string keyed map are measured by the map when no key size
+* function is given. Iterator status unchanged.
+*
+* @param map - The map.
+* @param sizeKeyElement - Bytes held by a key element. NULL counts none.
+* @param sizeDataElement - Bytes held by a data element. NULL counts none.
+* @param structureBytes - Will hold the bytes held by the map itself.
+* 		Ignored if NULL.
+* @param elementBytes - Will hold the bytes held by the elements. Ignored if
+* 		NULL.
+* @return
+* 	MAP_NULL_ARGUMENT - if a NULL map was sent.
+* 	MAP_SUCCESS - Otherwise.
+*/
+MapResult mapGetMemoryUsage(Map map, sizeMapKeyElements sizeKeyElement,
+	sizeMapDataElements sizeDataElement, size_t* structureBytes,
+	size_t* elementBytes);
+
 /*!
 * Macro for iterating over a map.
 * Declares a new iterator for the loop.
@@ -237,4 +1328,13 @@ MapResult mapClear(Map map);
 		iterator ;\
 		iterator = mapGetNext(map))
 
+/*!
+* Macro for iterating over a map from its greatest key down.
+* Declares a new iterator for the loop.
+*/
+#define MAP_FOREACH_REVERSE(type,iterator,map) \
+	for(type iterator = (type) mapGetLast(map) ; \
+		iterator ;\
+		iterator = mapGetPrev(map))
+
 #endif /* MAP_MTM_H_ */
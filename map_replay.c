@@ -0,0 +1,398 @@
+#define _POSIX_C_SOURCE 199309L
+#include "map_mtm.h"
+#include "map_trace.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+* Map Replay
+*
+* Replays a trace recorded with mapTraceStart against a chosen map
+* configuration, as fast as possible, and reports the throughput and the
+* latency percentiles of every kind of operation.
+*
+* Usage: map_replay <trace file> [backend]
+* Backends: list (default), lru:<capacity>, bloom, fingerprint, string.
+* Keys are the identifiers from the trace; the string backend uses their
+* decimal form as string keys.
+*/
+
+//-----------------------------------------------------------------------//
+//                           REPLAY: DEFINES                             //
+//-----------------------------------------------------------------------//
+
+/* Long enough for the decimal form of any 64 bit identifier. */
+#define REPLAY_KEY_STRING_LENGTH 21
+#define REPLAY_INITIAL_RECORDS 1024
+
+//-----------------------------------------------------------------------//
+//                           REPLAY: STRUCTS                             //
+//-----------------------------------------------------------------------//
+
+typedef struct replay_record_t{
+    TraceOperation operation;
+    unsigned long long key;
+} ReplayRecord;
+
+static const char* const replay_operation_names[TRACE_OPERATIONS_NUMBER] = {
+        "put", "get", "contains", "remove", "getFirst", "getNext", "clear"
+};
+
+//-----------------------------------------------------------------------//
+//                   REPLAY: STATIC FUNCTIONS DECLARATIONS               //
+//-----------------------------------------------------------------------//
+
+static MapKeyElement replayCopyKey(MapKeyElement key);
+static void replayFreeKey(MapKeyElement key);
+static int replayCompareKeys(MapKeyElement first, MapKeyElement second);
+static unsigned long replayHashKey(MapKeyElement key);
+static int replayCompareLatencies(const void* first, const void* second);
+static unsigned long long replayTimeNow(void);
+static ReplayRecord* replayLoad(const char* path, long* records_number);
+static Map replayCreateMap(const char* backend, bool* string_keys);
+static void replayRun(Map map, ReplayRecord* records, long records_number,
+                      void** keys, unsigned long long* latencies);
+static void replayReport(const char* backend, ReplayRecord* records,
+                         long records_number,
+                         unsigned long long* latencies);
+
+//-----------------------------------------------------------------------//
+//                                MAIN                                   //
+//-----------------------------------------------------------------------//
+
+int main(int argc, char** argv){
+    if(argc<2 || argc>3){
+        fprintf(stderr, "Usage: %s <trace file> [list|lru:<capacity>|"
+                        "bloom|fingerprint|string]\n", argv[0]);
+        return 1;
+    }
+    const char* backend = argc==3 ? argv[2] : "list";
+    long records_number = 0;
+    ReplayRecord* records = replayLoad(argv[1], &records_number);
+    if(!records){
+        return 1;
+    }
+    bool string_keys = false;
+    Map map = replayCreateMap(backend, &string_keys);
+    if(!map){
+        fprintf(stderr, "Unknown backend or out of memory: %s\n", backend);
+        free(records);
+        return 1;
+    }
+    /* Keys are prepared up front so converting them isn't measured. */
+    void** keys = malloc(sizeof(*keys)*records_number + 1);
+    char* strings = string_keys ?
+                    malloc(REPLAY_KEY_STRING_LENGTH*records_number + 1) :
+                    NULL;
+    unsigned long long* latencies = malloc(sizeof(*latencies)*records_number
+                                           + 1);
+    if(!keys || !latencies || (string_keys && !strings)){
+        fprintf(stderr, "Out of memory\n");
+        free(keys);
+        free(strings);
+        free(latencies);
+        free(records);
+        mapDestroy(map);
+        return 1;
+    }
+    for(long i=0;i<records_number;i++){
+        if(string_keys){
+            keys[i] = strings + REPLAY_KEY_STRING_LENGTH*i;
+            sprintf(keys[i], "%llu", records[i].key);
+        } else {
+            keys[i] = &records[i].key;
+        }
+    }
+    replayRun(map, records, records_number, keys, latencies);
+    replayReport(backend, records, records_number, latencies);
+    mapDestroy(map);
+    free(keys);
+    free(strings);
+    free(latencies);
+    free(records);
+    return 0;
+}
+
+//-----------------------------------------------------------------------//
+//                        REPLAY: STATIC FUNCTIONS                       //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Static function: replayCopyKey *****
+ * Description: Copies a key identifier (also used for the data).
+ *
+ * @param key - The identifier.
+ * @return
+ * The copy, NULL in case of memory fail.
+ */
+static MapKeyElement replayCopyKey(MapKeyElement key){
+    unsigned long long* copy = malloc(sizeof(*copy));
+    if(copy){
+        *copy = *(unsigned long long*)key;
+    }
+    return copy;
+}
+
+/**
+ ***** Static function: replayFreeKey *****
+ * Description: Frees a copy of a key identifier.
+ *
+ * @param key - The copy.
+ */
+static void replayFreeKey(MapKeyElement key){
+    free(key);
+}
+
+/**
+ ***** Static function: replayCompareKeys *****
+ * Description: Orders key identifiers.
+ *
+ * @param first - The first identifier.
+ * @param second - The second identifier.
+ * @return
+ * Negative, zero or positive like strcmp.
+ */
+static int replayCompareKeys(MapKeyElement first, MapKeyElement second){
+    unsigned long long a = *(unsigned long long*)first;
+    unsigned long long b = *(unsigned long long*)second;
+    return (a>b) - (a<b);
+}
+
+/**
+ ***** Static function: replayHashKey *****
+ * Description: Hashes a key identifier, for the Bloom filter and the
+ * fingerprints.
+ *
+ * @param key - The identifier.
+ * @return
+ * The hash.
+ */
+static unsigned long replayHashKey(MapKeyElement key){
+    unsigned long long hash = *(unsigned long long*)key;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (unsigned long)hash;
+}
+
+/**
+ ***** Static function: replayCompareLatencies *****
+ * Description: Orders latencies, for qsort.
+ *
+ * @param first - The first latency.
+ * @param second - The second latency.
+ * @return
+ * Negative, zero or positive like strcmp.
+ */
+static int replayCompareLatencies(const void* first, const void* second){
+    unsigned long long a = *(const unsigned long long*)first;
+    unsigned long long b = *(const unsigned long long*)second;
+    return (a>b) - (a<b);
+}
+
+/**
+ ***** Static function: replayTimeNow *****
+ * Description: Returns the time of the monotonic clock.
+ *
+ * @return
+ * The time in nanoseconds.
+ */
+static unsigned long long replayTimeNow(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec*1000000000ULL +
+           (unsigned long long)now.tv_nsec;
+}
+
+/**
+ ***** Static function: replayLoad *****
+ * Description: Reads all the records of a trace into memory.
+ *
+ * @param path - Path of the trace.
+ * @param records_number - Will hold the number of records.
+ * @return
+ * The records, NULL if the trace can't be read (an error is printed).
+ */
+static ReplayRecord* replayLoad(const char* path, long* records_number){
+    TraceReader reader = traceReaderCreate(path);
+    if(!reader){
+        fprintf(stderr, "Can't read a trace from %s\n", path);
+        return NULL;
+    }
+    long capacity = REPLAY_INITIAL_RECORDS;
+    ReplayRecord* records = malloc(sizeof(*records)*capacity);
+    long count = 0;
+    TraceReadResult status = TRACE_READ_SUCCESS;
+    while(records){
+        TraceOperation operation;
+        unsigned long long key;
+        unsigned long long time;
+        status = traceReaderNext(reader, &operation, &key, &time);
+        if(status != TRACE_READ_SUCCESS){
+            break;
+        }
+        if(count == capacity){
+            capacity *= 2;
+            ReplayRecord* grown = realloc(records,
+                                          sizeof(*records)*capacity);
+            if(!grown){
+                free(records);
+                records = NULL;
+                break;
+            }
+            records = grown;
+        }
+        records[count].operation = operation;
+        records[count].key = key;
+        count++;
+    }
+    traceReaderDestroy(reader);
+    if(!records){
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    if(status == TRACE_READ_CORRUPT){
+        /* A trace cut short (e.g. by a crash) is replayed up to the cut. */
+        fprintf(stderr, "Warning: %s is corrupt after %ld records\n", path,
+                count);
+    }
+    *records_number = count;
+    return records;
+}
+
+/**
+ ***** Static function: replayCreateMap *****
+ * Description: Creates an empty map of the chosen configuration.
+ *
+ * @param backend - Name of the configuration.
+ * @param string_keys - Will hold whether the map is keyed by strings.
+ * @return
+ * The map, NULL if the backend is unknown or in case of memory fail.
+ */
+static Map replayCreateMap(const char* backend, bool* string_keys){
+    *string_keys = false;
+    if(strcmp(backend, "string") == 0){
+        *string_keys = true;
+        return mapCreateStringKeyed(replayCopyKey, replayFreeKey);
+    }
+    if(strncmp(backend, "lru:", strlen("lru:")) == 0){
+        return mapCreateLRU(atoi(backend + strlen("lru:")), replayCopyKey,
+                            replayCopyKey, replayFreeKey, replayFreeKey,
+                            replayCompareKeys);
+    }
+    bool bloom = strcmp(backend, "bloom") == 0;
+    bool fingerprint = strcmp(backend, "fingerprint") == 0;
+    if(!bloom && !fingerprint && strcmp(backend, "list") != 0){
+        return NULL;
+    }
+    Map map = mapCreate(replayCopyKey, replayCopyKey, replayFreeKey,
+                        replayFreeKey, replayCompareKeys);
+    if(map && ((bloom && mapSetBloomFilter(map, replayHashKey) !=
+                         MAP_SUCCESS) ||
+               (fingerprint && mapSetKeyFingerprint(map, replayHashKey) !=
+                               MAP_SUCCESS))){
+        mapDestroy(map);
+        return NULL;
+    }
+    return map;
+}
+
+/**
+ ***** Static function: replayRun *****
+ * Description: Does the operations of the records on the map, timing each
+ * one of them.
+ *
+ * @param map - The map.
+ * @param records - The records.
+ * @param records_number - Number of records.
+ * @param keys - The key of every record, in the map's key type.
+ * @param latencies - Will hold the nanoseconds every operation took.
+ */
+static void replayRun(Map map, ReplayRecord* records, long records_number,
+                      void** keys, unsigned long long* latencies){
+    for(long i=0;i<records_number;i++){
+        unsigned long long start = replayTimeNow();
+        switch(records[i].operation){
+            case TRACE_PUT:
+                mapPut(map, keys[i], &records[i].key);
+                break;
+            case TRACE_GET:
+                mapGet(map, keys[i]);
+                break;
+            case TRACE_CONTAINS:
+                mapContains(map, keys[i]);
+                break;
+            case TRACE_REMOVE:
+                mapRemove(map, keys[i]);
+                break;
+            case TRACE_GET_FIRST:
+                mapGetFirst(map);
+                break;
+            case TRACE_GET_NEXT:
+                mapGetNext(map);
+                break;
+            case TRACE_CLEAR:
+                mapClear(map);
+                break;
+            default:
+                break;
+        }
+        latencies[i] = replayTimeNow() - start;
+    }
+}
+
+/**
+ ***** Static function: replayReport *****
+ * Description: Prints the throughput and the latency percentiles of every
+ * kind of operation. Reorders the latencies.
+ *
+ * @param backend - Name of the map's configuration.
+ * @param records - The records.
+ * @param records_number - Number of records.
+ * @param latencies - The latency of every record.
+ */
+static void replayReport(const char* backend, ReplayRecord* records,
+                         long records_number,
+                         unsigned long long* latencies){
+    unsigned long long total = 0;
+    for(long i=0;i<records_number;i++){
+        total += latencies[i];
+    }
+    printf("Backend %s: %ld operations in %.3f ms", backend, records_number,
+           total/1e6);
+    if(total){
+        printf(", %.0f operations per second", records_number*1e9/total);
+    }
+    printf("\n%-10s %10s %10s %10s %10s %10s %10s\n", "operation", "count",
+           "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns");
+    /* Latencies are grouped by operation in place, one group at a time. */
+    long start = 0;
+    for(int operation=0;operation<TRACE_OPERATIONS_NUMBER;operation++){
+        long end = start;
+        for(long i=start;i<records_number;i++){
+            if(records[i].operation == operation){
+                unsigned long long latency = latencies[i];
+                ReplayRecord record = records[i];
+                latencies[i] = latencies[end];
+                records[i] = records[end];
+                latencies[end] = latency;
+                records[end] = record;
+                end++;
+            }
+        }
+        long count = end - start;
+        if(!count){
+            continue;
+        }
+        unsigned long long* group = latencies + start;
+        qsort(group, count, sizeof(*group), replayCompareLatencies);
+        printf("%-10s %10ld %10llu %10llu %10llu %10llu %10llu\n",
+               replay_operation_names[operation], count,
+               group[count*50/100], group[count*90/100],
+               group[count*99/100], group[count*999/1000], group[count-1]);
+        start = end;
+    }
+}
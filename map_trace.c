@@ -0,0 +1,306 @@
+#define _POSIX_C_SOURCE 199309L
+#include "map_trace.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+//-----------------------------------------------------------------------//
+//                          MAP TRACE: DEFINES                           //
+//-----------------------------------------------------------------------//
+
+#define TRACE_MAGIC "MAPTRACE"
+#define TRACE_MAGIC_LENGTH 8
+#define TRACE_VERSION 1
+/* A 64 bit value takes at most 10 varint bytes. */
+#define TRACE_VARINT_MAX_BYTES 10
+
+//-----------------------------------------------------------------------//
+//                          MAP TRACE: STRUCTS                           //
+//-----------------------------------------------------------------------//
+
+struct trace_writer_t{
+    FILE* file;
+    unsigned long long start; // Nanoseconds, when the trace was created.
+    unsigned long long last_time; // Of the previous record.
+    unsigned long long last_key; // Of the previous record with a key.
+    bool failed;
+};
+
+struct trace_reader_t{
+    FILE* file;
+    unsigned long long time;
+    unsigned long long last_key;
+};
+
+//-----------------------------------------------------------------------//
+//                MAP TRACE: STATIC FUNCTIONS DECLARATIONS               //
+//-----------------------------------------------------------------------//
+
+static unsigned long long traceTimeNow(void);
+static bool traceWriteVarint(FILE* file, unsigned long long value);
+static bool traceReadVarint(FILE* file, unsigned long long* value);
+
+//-----------------------------------------------------------------------//
+//                         MAP TRACE: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: traceOperationHasKey *****
+ * Description: Checks whether records of an operation hold a key.
+ *
+ * @param operation - The operation.
+ *
+ * @return
+ * true if the operation takes a key, false otherwise.
+ */
+bool traceOperationHasKey(TraceOperation operation){
+    return operation == TRACE_PUT || operation == TRACE_GET ||
+           operation == TRACE_CONTAINS || operation == TRACE_REMOVE;
+}
+
+/**
+ ***** Function: traceWriterCreate *****
+ * Description: Creates a new trace file (replacing an existing one) and
+ * writes its header. Time is measured from this call.
+ *
+ * @param path - Path of the file.
+ *
+ * @return
+ * A new writer in case of success.
+ * NULL if the file can't be written or in case of memory fail.
+ */
+TraceWriter traceWriterCreate(const char* path){
+    if(!path){
+        return NULL;
+    }
+    TraceWriter writer = malloc(sizeof(*writer));
+    if(!writer){
+        return NULL;
+    }
+    writer->file = fopen(path, "wb");
+    if(!writer->file){
+        free(writer);
+        return NULL;
+    }
+    if(fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LENGTH, writer->file) !=
+       TRACE_MAGIC_LENGTH || fputc(TRACE_VERSION, writer->file) == EOF){
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+    writer->start = traceTimeNow();
+    writer->last_time = 0;
+    writer->last_key = 0;
+    writer->failed = false;
+    return writer;
+}
+
+/**
+ ***** Function: traceWriterRecord *****
+ * Description: Appends a record of an operation done now. Records are
+ * buffered, a failed write is only reported by traceWriterDestroy.
+ *
+ * @param writer - The writer.
+ * @param operation - The operation.
+ * @param key - Identifier of the operation's key. Ignored for operations
+ * without a key.
+ */
+void traceWriterRecord(TraceWriter writer, TraceOperation operation,
+                       unsigned long long key){
+    assert(writer && operation < TRACE_OPERATIONS_NUMBER);
+    if(writer->failed){
+        return;
+    }
+    unsigned long long time = traceTimeNow() - writer->start;
+    bool written = fputc(operation, writer->file) != EOF &&
+                   traceWriteVarint(writer->file, time - writer->last_time);
+    writer->last_time = time;
+    if(written && traceOperationHasKey(operation)){
+        /* Zigzag: small differences either way take few bytes. */
+        unsigned long long delta = key - writer->last_key;
+        delta = (delta << 1) ^ (0 - (delta >> 63));
+        written = traceWriteVarint(writer->file, delta);
+        writer->last_key = key;
+    }
+    writer->failed = !written;
+}
+
+/**
+ ***** Function: traceWriterDestroy *****
+ * Description: Flushes and closes the trace file and frees the writer.
+ *
+ * @param writer - The writer. If NULL nothing will be done.
+ *
+ * @return
+ * false if writing any part of the trace failed, true otherwise.
+ */
+bool traceWriterDestroy(TraceWriter writer){
+    if(!writer){
+        return true;
+    }
+    bool succeeded = !writer->failed;
+    if(fclose(writer->file) == EOF){
+        succeeded = false;
+    }
+    free(writer);
+    return succeeded;
+}
+
+/**
+ ***** Function: traceReaderCreate *****
+ * Description: Opens a trace file for reading and checks its header.
+ *
+ * @param path - Path of the file.
+ *
+ * @return
+ * A new reader in case of success.
+ * NULL if the file can't be read, isn't a trace or in case of memory fail.
+ */
+TraceReader traceReaderCreate(const char* path){
+    if(!path){
+        return NULL;
+    }
+    TraceReader reader = malloc(sizeof(*reader));
+    if(!reader){
+        return NULL;
+    }
+    reader->file = fopen(path, "rb");
+    if(!reader->file){
+        free(reader);
+        return NULL;
+    }
+    char magic[TRACE_MAGIC_LENGTH];
+    if(fread(magic, 1, TRACE_MAGIC_LENGTH, reader->file) !=
+       TRACE_MAGIC_LENGTH || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LENGTH)
+       || fgetc(reader->file) != TRACE_VERSION){
+        fclose(reader->file);
+        free(reader);
+        return NULL;
+    }
+    reader->time = 0;
+    reader->last_key = 0;
+    return reader;
+}
+
+/**
+ ***** Function: traceReaderNext *****
+ * Description: Reads the next record of the trace.
+ *
+ * @param reader - The reader.
+ * @param operation - Will hold the operation.
+ * @param key - Will hold the key identifier (0 for operations without a
+ * key).
+ * @param time - Will hold the nanoseconds from the start of the trace.
+ *
+ * @return
+ * TRACE_READ_END if there are no records left.
+ * TRACE_READ_CORRUPT if the record is cut or malformed.
+ * TRACE_READ_SUCCESS otherwise.
+ */
+TraceReadResult traceReaderNext(TraceReader reader, TraceOperation* operation,
+                                unsigned long long* key,
+                                unsigned long long* time){
+    assert(reader && operation && key && time);
+    int byte = fgetc(reader->file);
+    if(byte == EOF){
+        return TRACE_READ_END;
+    }
+    if(byte >= TRACE_OPERATIONS_NUMBER){
+        return TRACE_READ_CORRUPT;
+    }
+    unsigned long long delta = 0;
+    if(!traceReadVarint(reader->file, &delta)){
+        return TRACE_READ_CORRUPT;
+    }
+    reader->time += delta;
+    *operation = (TraceOperation)byte;
+    *time = reader->time;
+    *key = 0;
+    if(traceOperationHasKey(*operation)){
+        if(!traceReadVarint(reader->file, &delta)){
+            return TRACE_READ_CORRUPT;
+        }
+        delta = (delta >> 1) ^ (0 - (delta & 1));
+        reader->last_key += delta;
+        *key = reader->last_key;
+    }
+    return TRACE_READ_SUCCESS;
+}
+
+/**
+ ***** Function: traceReaderDestroy *****
+ * Description: Closes the trace file and frees the reader.
+ *
+ * @param reader - The reader. If NULL nothing will be done.
+ */
+void traceReaderDestroy(TraceReader reader){
+    if(!reader){
+        return;
+    }
+    fclose(reader->file);
+    free(reader);
+}
+
+//-----------------------------------------------------------------------//
+//                       MAP TRACE: STATIC FUNCTIONS                     //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Static function: traceTimeNow *****
+ * Description: Returns the time of the monotonic clock.
+ *
+ * @return
+ * The time in nanoseconds.
+ */
+static unsigned long long traceTimeNow(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec*1000000000ULL +
+           (unsigned long long)now.tv_nsec;
+}
+
+/**
+ ***** Static function: traceWriteVarint *****
+ * Description: Writes a value as a varint.
+ *
+ * @param file - The file.
+ * @param value - The value.
+ * @return
+ * true if the value was written, false otherwise.
+ */
+static bool traceWriteVarint(FILE* file, unsigned long long value){
+    unsigned char bytes[TRACE_VARINT_MAX_BYTES];
+    size_t length = 0;
+    while(value >= 0x80){
+        bytes[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[length++] = (unsigned char)value;
+    return fwrite(bytes, 1, length, file) == length;
+}
+
+/**
+ ***** Static function: traceReadVarint *****
+ * Description: Reads a varint.
+ *
+ * @param file - The file.
+ * @param value - Will hold the value.
+ * @return
+ * false if the varint is cut or too long, true otherwise.
+ */
+static bool traceReadVarint(FILE* file, unsigned long long* value){
+    *value = 0;
+    for(int i=0;i<TRACE_VARINT_MAX_BYTES;i++){
+        int byte = fgetc(file);
+        if(byte == EOF){
+            return false;
+        }
+        *value |= (unsigned long long)(byte & 0x7f) << (7*i);
+        if(!(byte & 0x80)){
+            return true;
+        }
+    }
+    return false;
+}
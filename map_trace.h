@@ -0,0 +1,141 @@
+
+#ifndef MTM_EX3_MAP_TRACE_H
+#define MTM_EX3_MAP_TRACE_H
+
+#include <stdbool.h>
+
+/**
+* Map Trace
+*
+* Writes and reads traces of map operations: a compact binary log of which
+* operation was done on which key, and when. Keys are recorded as 64 bit
+* identifiers picked by the user, so a trace can be replayed against any
+* map configuration without the original keys.
+*
+* File format: the 8 bytes "MAPTRACE", a version byte, then one record per
+* operation: the operation byte, the nanoseconds since the previous record
+* as a varint and, for operations taking a key, the difference from the
+* previous key identifier, zigzag encoded as a varint. Varints hold 7 bits
+* per byte, low bits first, with the high bit set on all bytes but the
+* last; so a record of a sequential access usually fits in 3 bytes.
+*/
+
+//-----------------------------------------------------------------------//
+//                          MAP TRACE: TYPEDEFS                          //
+//-----------------------------------------------------------------------//
+
+typedef struct trace_writer_t *TraceWriter;
+
+typedef struct trace_reader_t *TraceReader;
+
+/** Operations recorded in a trace */
+typedef enum TraceOperation_t {
+    TRACE_PUT,
+    TRACE_GET,
+    TRACE_CONTAINS,
+    TRACE_REMOVE,
+    TRACE_GET_FIRST,
+    TRACE_GET_NEXT,
+    TRACE_CLEAR,
+    TRACE_OPERATIONS_NUMBER
+} TraceOperation;
+
+/** Type used for returning the status of reading a trace */
+typedef enum TraceReadResult_t {
+    TRACE_READ_SUCCESS,
+    TRACE_READ_END, // No records left.
+    TRACE_READ_CORRUPT
+} TraceReadResult;
+
+//-----------------------------------------------------------------------//
+//                         MAP TRACE: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: traceOperationHasKey *****
+ * Description: Checks whether records of an operation hold a key.
+ *
+ * @param operation - The operation.
+ *
+ * @return
+ * true if the operation takes a key, false otherwise.
+ */
+bool traceOperationHasKey(TraceOperation operation);
+
+/**
+ ***** Function: traceWriterCreate *****
+ * Description: Creates a new trace file (replacing an existing one) and
+ * writes its header. Time is measured from this call.
+ *
+ * @param path - Path of the file.
+ *
+ * @return
+ * A new writer in case of success.
+ * NULL if the file can't be written or in case of memory fail.
+ */
+TraceWriter traceWriterCreate(const char* path);
+
+/**
+ ***** Function: traceWriterRecord *****
+ * Description: Appends a record of an operation done now. Records are
+ * buffered, a failed write is only reported by traceWriterDestroy.
+ *
+ * @param writer - The writer.
+ * @param operation - The operation.
+ * @param key - Identifier of the operation's key. Ignored for operations
+ * without a key.
+ */
+void traceWriterRecord(TraceWriter writer, TraceOperation operation,
+                       unsigned long long key);
+
+/**
+ ***** Function: traceWriterDestroy *****
+ * Description: Flushes and closes the trace file and frees the writer.
+ *
+ * @param writer - The writer. If NULL nothing will be done.
+ *
+ * @return
+ * false if writing any part of the trace failed, true otherwise.
+ */
+bool traceWriterDestroy(TraceWriter writer);
+
+/**
+ ***** Function: traceReaderCreate *****
+ * Description: Opens a trace file for reading and checks its header.
+ *
+ * @param path - Path of the file.
+ *
+ * @return
+ * A new reader in case of success.
+ * NULL if the file can't be read, isn't a trace or in case of memory fail.
+ */
+TraceReader traceReaderCreate(const char* path);
+
+/**
+ ***** Function: traceReaderNext *****
+ * Description: Reads the next record of the trace.
+ *
+ * @param reader - The reader.
+ * @param operation - Will hold the operation.
+ * @param key - Will hold the key identifier (0 for operations without a
+ * key).
+ * @param time - Will hold the nanoseconds from the start of the trace.
+ *
+ * @return
+ * TRACE_READ_END if there are no records left.
+ * TRACE_READ_CORRUPT if the record is cut or malformed.
+ * TRACE_READ_SUCCESS otherwise.
+ */
+TraceReadResult traceReaderNext(TraceReader reader, TraceOperation* operation,
+                                unsigned long long* key,
+                                unsigned long long* time);
+
+/**
+ ***** Function: traceReaderDestroy *****
+ * Description: Closes the trace file and frees the reader.
+ *
+ * @param reader - The reader. If NULL nothing will be done.
+ */
+void traceReaderDestroy(TraceReader reader);
+
+#endif //MTM_EX3_MAP_TRACE_H
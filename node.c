@@ -1,7 +1,8 @@
 #include "node.h"
-#include <malloc.h>
 #include <assert.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 //-----------------------------------------------------------------------//
 //                           NODE: STRUCT                                //
@@ -9,10 +10,23 @@
 
 struct node_t{
     NodeKeyElement key;
-    NodeDataElement data;
     Node next;
+    Node previous;
+    void* parts[]; // The parts of the node's layout, see nodePart.
 };
 
+/** The parts in the order they are laid out in a node. The recency links
+ * come first, so they are found without knowing the layout. */
+static const NodePart node_parts[] = {NODE_RECENCY, NODE_TIMER, NODE_DATA};
+#define NODE_PARTS_NUMBER (sizeof(node_parts)/sizeof(*node_parts))
+
+//-----------------------------------------------------------------------//
+//                NODE: STATIC FUNCTIONS DECLARATIONS                    //
+//-----------------------------------------------------------------------//
+
+static size_t nodePartSlots(NodePart part);
+static void** nodePart(Node node, NodeLayout layout, NodePart part);
+
 //-----------------------------------------------------------------------//
 //                           NODE: FUNCTIONS                             //
 //-----------------------------------------------------------------------//
@@ -22,15 +36,18 @@ struct node_t{
  * Description: Creates a new node.
  *
  * @param data - The data element which need to be assigned to the new
- * node.
+ * node. Ignored unless the layout has the NODE_DATA part.
  * @param key - The key element which need to be assigned to the new node.
  * @param copyDataElement - Function pointer to be used for copying data
- * elements into the node.
+ * elements into the node. Ignored unless the layout has the NODE_DATA
+ * part.
  * @param copyKeyElement - Function pointer to be used for copying key
  * elements into the node.
  * @param freeKeyElement - Function pointer to be used for removing key
  * element from the node. This free function will be used in case of
  * memory allocation fail of the data copy function.
+ * @param layout - The parts of the node.
+ * @param allocator - Allocator the node is allocated from. May be NULL.
  *
  * @return
  * new node in case of success.
@@ -39,13 +56,15 @@ struct node_t{
 Node nodeCreate(NodeDataElement data, NodeKeyElement key,
                 copyNodeDataElements copyDataElement,
                 copyNodeKeyElements copyKeyElement,
-                freeNodeKeyElements freeKeyElement){
-    if(!copyDataElement || !copyKeyElement || !freeKeyElement || !data ||
-            !key){
+                freeNodeKeyElements freeKeyElement, NodeLayout layout,
+                Allocator allocator){
+    bool has_data = layout & NODE_DATA;
+    if((has_data && (!copyDataElement || !data)) || !copyKeyElement ||
+            !freeKeyElement || !key){
         /* At least one of the given arguments is NULL. */
         return NULL;
     }
-    Node new_node = malloc(sizeof(*new_node));
+    Node new_node = allocatorAllocate(allocator, nodeGetSize(layout));
     if(!new_node){
         /* Failed to allocate memory to node. */
         return NULL;
@@ -53,16 +72,23 @@ Node nodeCreate(NodeDataElement data, NodeKeyElement key,
     new_node->key = copyKeyElement(key);
     if(!new_node->key){
         /* Failed to copy key. */
-        free(new_node);
+        allocatorFree(allocator, new_node, nodeGetSize(layout));
         return NULL;
     }
-    new_node->data = copyDataElement(data);
-    if(!new_node->data){
+    new_node->next = NULL;
+    new_node->previous = NULL;
+    memset(new_node->parts, 0, nodeGetSize(layout) - sizeof(*new_node));
+    if(!has_data){
+        return new_node;
+    }
+    NodeDataElement data_copy = copyDataElement(data);
+    if(!data_copy){
         /* Failed to copy data. */
-        free(new_node);
         freeKeyElement(new_node->key);
+        allocatorFree(allocator, new_node, nodeGetSize(layout));
+        return NULL;
     }
-    new_node->next = NULL;
+    nodePart(new_node, layout, NODE_DATA)[0] = data_copy;
     return new_node;
 }
 
@@ -71,16 +97,21 @@ Node nodeCreate(NodeDataElement data, NodeKeyElement key,
  * Description: Frees all allocated memory of the given node.
  *
  * @param node - The node we want to destroy.
+ * @param layout - The parts of the node, as it was created with.
  * @param freeDataElement - Function pointer to be used for removing data
- * element from the node.
+ * element from the node. Ignored unless the layout has the NODE_DATA part.
  * @param freeKeyElement - Function pointer to be used for removing key
  * element from the node.
+ * @param allocator - Allocator the node was created with.
  */
-void nodeDestroy(Node node, freeNodeDataElements freeDataElement,
-                       freeNodeKeyElements freeKeyElement){
-    freeDataElement(node->data);
+void nodeDestroy(Node node, NodeLayout layout,
+                 freeNodeDataElements freeDataElement,
+                 freeNodeKeyElements freeKeyElement, Allocator allocator){
+    if(layout & NODE_DATA){
+        freeDataElement(nodeGetData(node, layout));
+    }
     freeKeyElement(node->key);
-    free(node);
+    allocatorFree(allocator, node, nodeGetSize(layout));
 }
 
 /**
@@ -102,16 +133,18 @@ NodeKeyElement nodeGetKey(Node node){
  ***** Function: nodeGetData *****
  * Description: Gets a node and returns node's data.
  *
- * @param node - The node which we want to get its data.
+ * @param node - The node which we want to get its data. Must have the
+ * NODE_DATA part.
+ * @param layout - The parts of the node.
  *
  * @return - A copy of the given node's data.
  */
-NodeDataElement nodeGetData(Node node){
+NodeDataElement nodeGetData(Node node, NodeLayout layout){
     if(!node){
         /* Node is NULL. */
         return NULL;
     }
-    return node->data;
+    return nodePart(node, layout, NODE_DATA)[0];
 }
 
 /**
@@ -127,10 +160,25 @@ Node nodeGetNext(Node node){
     return node->next;
 }
 
+/**
+ ***** Function: nodeReadNext *****
+ * Description: Returns the next node of the given node, for readers running
+ * concurrently with a writer (an acquire load).
+ *
+ * @param node - The node which we want to find its next node.
+ *
+ * @return
+ * The next node.
+ */
+Node nodeReadNext(Node node){
+    return __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+}
+
 /**
  ***** Function: nodeSetNext *****
  * Description: Gets a node and a next_node and sets node's next
- * to be 'next_node'.
+ * to be 'next_node'. The store is a release, so a reader following the link
+ * with nodeReadNext sees 'next_node' fully initialized.
  *
  * @param node - The node which we want to change its 'next'.
  * @param next_node - The node which we want to be pointed at by 'node'.
@@ -144,17 +192,165 @@ NodeResult nodeSetNext(Node node, Node next_node){
         /* Node is NULL. */
         return NODE_NULL_ARGUMENT;
     }
-    node->next = next_node;
+    __atomic_store_n(&node->next, next_node, __ATOMIC_RELEASE);
+    return NODE_SUCCESS;
+}
+
+/**
+ ***** Function: nodeGetPrevious *****
+ * Descritpion: Returns the previous node of the given node.
+ *
+ * @param node - The node which we want to find its previous node.
+ *
+ * @return
+ * The previous node.
+ */
+Node nodeGetPrevious(Node node){
+    return node->previous;
+}
+
+/**
+ ***** Function: nodeSetPrevious *****
+ * Description: Gets a node and a previous_node and sets node's previous
+ * to be 'previous_node'.
+ *
+ * @param node - The node which we want to change its 'previous'.
+ * @param previous_node - The node which we want to be pointed at by 'node'.
+ *
+ * @return
+ * NODE_NULL_ARGUMENT - Node is NULL.
+ * NODE_SUCCESS - Success.
+ */
+NodeResult nodeSetPrevious(Node node, Node previous_node){
+    if(!node){
+        /* Node is NULL. */
+        return NODE_NULL_ARGUMENT;
+    }
+    node->previous = previous_node;
+    return NODE_SUCCESS;
+}
+
+/**
+ ***** Function: nodeGetLruNext *****
+ * Descritpion: Returns the next (less recently used) node of the given
+ * node in the recency list.
+ *
+ * @param node - The node which we want to find its next recency node. Must
+ * have the NODE_RECENCY part.
+ *
+ * @return
+ * The next node in the recency list.
+ */
+Node nodeGetLruNext(Node node){
+    return nodePart(node, NODE_RECENCY, NODE_RECENCY)[0];
+}
+
+/**
+ ***** Function: nodeSetLruNext *****
+ * Description: Sets node's next (less recently used) node in the recency
+ * list.
+ *
+ * @param node - The node which we want to change its recency 'next'. Must
+ * have the NODE_RECENCY part.
+ * @param next_node - The node which we want to be pointed at by 'node'.
+ *
+ * @return
+ * NODE_NULL_ARGUMENT - Node is NULL.
+ * NODE_SUCCESS - Success.
+ */
+NodeResult nodeSetLruNext(Node node, Node next_node){
+    if(!node){
+        /* Node is NULL. */
+        return NODE_NULL_ARGUMENT;
+    }
+    nodePart(node, NODE_RECENCY, NODE_RECENCY)[0] = next_node;
+    return NODE_SUCCESS;
+}
+
+/**
+ ***** Function: nodeGetLruPrevious *****
+ * Descritpion: Returns the previous (more recently used) node of the given
+ * node in the recency list.
+ *
+ * @param node - The node which we want to find its previous recency node.
+ * Must have the NODE_RECENCY part.
+ *
+ * @return
+ * The previous node in the recency list.
+ */
+Node nodeGetLruPrevious(Node node){
+    return nodePart(node, NODE_RECENCY, NODE_RECENCY)[1];
+}
+
+/**
+ ***** Function: nodeSetLruPrevious *****
+ * Description: Sets node's previous (more recently used) node in the
+ * recency list.
+ *
+ * @param node - The node which we want to change its recency 'previous'.
+ * Must have the NODE_RECENCY part.
+ * @param previous_node - The node which we want to be pointed at by 'node'.
+ *
+ * @return
+ * NODE_NULL_ARGUMENT - Node is NULL.
+ * NODE_SUCCESS - Success.
+ */
+NodeResult nodeSetLruPrevious(Node node, Node previous_node){
+    if(!node){
+        /* Node is NULL. */
+        return NODE_NULL_ARGUMENT;
+    }
+    nodePart(node, NODE_RECENCY, NODE_RECENCY)[1] = previous_node;
+    return NODE_SUCCESS;
+}
+
+/**
+ ***** Function: nodeGetTimer *****
+ * Description: Returns the expiry timer of the given node.
+ *
+ * @param node - The node which we want to get its timer. Must have the
+ * NODE_TIMER part.
+ * @param layout - The parts of the node.
+ *
+ * @return
+ * The node's timer, NULL if the node has no expiry.
+ */
+WheelTimer nodeGetTimer(Node node, NodeLayout layout){
+    return nodePart(node, layout, NODE_TIMER)[0];
+}
+
+/**
+ ***** Function: nodeSetTimer *****
+ * Description: Sets the expiry timer of the given node.
+ *
+ * @param node - The node which we want to change its timer. Must have the
+ * NODE_TIMER part.
+ * @param layout - The parts of the node.
+ * @param timer - The new timer. NULL if the node has no expiry.
+ *
+ * @return
+ * NODE_NULL_ARGUMENT - Node is NULL.
+ * NODE_SUCCESS - Success.
+ */
+NodeResult nodeSetTimer(Node node, NodeLayout layout, WheelTimer timer){
+    if(!node){
+        /* Node is NULL. */
+        return NODE_NULL_ARGUMENT;
+    }
+    nodePart(node, layout, NODE_TIMER)[0] = timer;
     return NODE_SUCCESS;
 }
 
+
 /**
  ***** Function: nodeSetData *****
  * Description: The function gets a node and a new data and creates a copy
  * of the data. The copy of the new data will be inserted to node's data.
  * Node's old data will be destroyed.
  *
- * @param node - The node which we want to modify its data.
+ * @param node - The node which we want to modify its data. Must have the
+ * NODE_DATA part.
+ * @param layout - The parts of the node.
  * @param new_data - The new data to insert into the node.
  * @param copyDataElement - Pointer to the copy data element function.
  * Will be used to create a copy of the given new data.
@@ -166,7 +362,7 @@ NodeResult nodeSetNext(Node node, Node next_node){
  * NODE_OUT_OF_MEMORY - Any memory error.
  * NODE_SUCCESS - Sucess.
  */
-NodeResult nodeSetData(Node node, NodeDataElement new_data,
+NodeResult nodeSetData(Node node, NodeLayout layout, NodeDataElement new_data,
                        copyNodeDataElements copyDataElement,
                        freeNodeDataElements freeDataElement){
     assert(node);
@@ -181,9 +377,99 @@ NodeResult nodeSetData(Node node, NodeDataElement new_data,
         return NODE_OUT_OF_MEMORY;
     }
     /* New data copy created successfully. */
-    freeDataElement(node->data); // Destroying old data.
-    node->data = data_copy;
+    void** data = nodePart(node, layout, NODE_DATA);
+    freeDataElement(*data); // Destroying old data.
+    *data = data_copy;
     return NODE_SUCCESS;
 }
 
+/**
+ ***** Function: nodeGetSize *****
+ * Description: Returns the size of a node in bytes.
+ *
+ * @param layout - The parts of the node.
+ *
+ * @return - The size of a node with these parts.
+ */
+size_t nodeGetSize(NodeLayout layout){
+    size_t slots = 0;
+    for(size_t i = 0; i < NODE_PARTS_NUMBER; i++){
+        if(layout & node_parts[i]){
+            slots += nodePartSlots(node_parts[i]);
+        }
+    }
+    return sizeof(struct node_t) + slots*sizeof(void*);
+}
+
+/**
+ ***** Function: nodeCopyTo *****
+ * Description: Copies a node into a block of nodeGetSize(new_layout) bytes.
+ * The copy shares the elements, the links and the parts of the original:
+ * the caller relinks it and releases the original without freeing the
+ * elements. The parts only the new layout has are cleared.
+ *
+ * @param node - The node to copy.
+ * @param layout - The parts of the node.
+ * @param new_layout - The parts of the copy. Must include the node's.
+ * @param memory - The block the node is copied into.
+ *
+ * @return - The copy.
+ */
+Node nodeCopyTo(Node node, NodeLayout layout, NodeLayout new_layout,
+                void* memory){
+    assert(node && memory && !(layout & ~new_layout));
+    Node copy = memory;
+    memcpy(copy, node, sizeof(*node));
+    for(size_t i = 0; i < NODE_PARTS_NUMBER; i++){
+        NodePart part = node_parts[i];
+        if(!(new_layout & part)){
+            continue;
+        }
+        size_t size = nodePartSlots(part)*sizeof(void*);
+        if(layout & part){
+            memcpy(nodePart(copy, new_layout, part),
+                   nodePart(node, layout, part), size);
+        } else {
+            memset(nodePart(copy, new_layout, part), 0, size);
+        }
+    }
+    return copy;
+}
+
+//-----------------------------------------------------------------------//
+//                        NODE: STATIC FUNCTIONS                         //
+//-----------------------------------------------------------------------//
 
+/**
+ ***** Function: nodePartSlots *****
+ * Description: Returns the number of pointers a part takes.
+ *
+ * @param part - The part.
+ *
+ * @return - The part's number of pointers.
+ */
+static size_t nodePartSlots(NodePart part){
+    return part == NODE_RECENCY ? 2 : 1;
+}
+
+/**
+ ***** Function: nodePart *****
+ * Description: Returns the first pointer of a part of a node. The parts of
+ * the layout follow each other in the order of node_parts.
+ *
+ * @param node - The node.
+ * @param layout - The parts of the node. Must include 'part'.
+ * @param part - The part.
+ *
+ * @return - The address of the part in the node.
+ */
+static void** nodePart(Node node, NodeLayout layout, NodePart part){
+    assert(layout & part);
+    void** slot = node->parts;
+    for(size_t i = 0; node_parts[i] != part; i++){
+        if(layout & node_parts[i]){
+            slot += nodePartSlots(node_parts[i]);
+        }
+    }
+    return slot;
+}
@@ -2,12 +2,26 @@
 #ifndef MTM_EX3_NODE_H
 #define MTM_EX3_NODE_H
 
+#include "timing_wheel.h"
+#include "allocator.h"
+
 //-----------------------------------------------------------------------//
 //                           NODE: TYPEDEFS                              //
 //-----------------------------------------------------------------------//
 
 typedef struct node_t *Node;
 
+/** Parts a node may have besides its elements and links */
+typedef enum NodePart_t {
+    NODE_RECENCY = 1, // Links of a recency list, for bounded containers.
+    NODE_TIMER = 2, // Expiry timer, for containers with TTL entries.
+    NODE_DATA = 4 // The data element, for containers with data.
+} NodePart;
+
+/** The parts the nodes of a container have: a combination of NodeParts.
+ * Nodes are only as large as their parts need. */
+typedef unsigned int NodeLayout;
+
 /** Type used for returning error codes from node functions */
 typedef enum NodeResult_t {
     NODE_SUCCESS,
@@ -42,15 +56,18 @@ typedef void(*freeNodeKeyElements)(NodeKeyElement);
  * Description: Creates a new node.
  *
  * @param data - The data element which need to be assigned to the new
- * node.
+ * node. Ignored unless the layout has the NODE_DATA part.
  * @param key - The key element which need to be assigned to the new node.
  * @param copyDataElement - Function pointer to be used for copying data
- * elements into the node.
+ * elements into the node. Ignored unless the layout has the NODE_DATA
+ * part.
  * @param copyKeyElement - Function pointer to be used for copying key
  * elements into the node.
  * @param freeKeyElement - Function pointer to be used for removing key
  * element from the node. This free function will be used in case of
  * memory allocation fail of the data copy function.
+ * @param layout - The parts of the node.
+ * @param allocator - Allocator the node is allocated from. May be NULL.
  *
  * @return
  * new node in case of success.
@@ -59,20 +76,24 @@ typedef void(*freeNodeKeyElements)(NodeKeyElement);
 Node nodeCreate(NodeDataElement data, NodeKeyElement key,
                 copyNodeDataElements copyDataElement,
                 copyNodeKeyElements copyKeyElement,
-                freeNodeKeyElements freeKeyElement);
+                freeNodeKeyElements freeKeyElement, NodeLayout layout,
+                Allocator allocator);
 
 /**
  ***** Function: nodeDestroy *****
  * Description: Frees all allocated memory of the given node.
  *
  * @param node - The node we want to destroy.
+ * @param layout - The parts of the node, as it was created with.
  * @param freeDataElement - Function pointer to be used for removing data
- * element from the node.
+ * element from the node. Ignored unless the layout has the NODE_DATA part.
  * @param freeKeyElement - Function pointer to be used for removing key
  * element from the node.
+ * @param allocator - Allocator the node was created with.
  */
-void nodeDestroy(Node node, freeNodeDataElements freeDataElement,
-                 freeNodeKeyElements freeKeyElement);
+void nodeDestroy(Node node, NodeLayout layout,
+                 freeNodeDataElements freeDataElement,
+                 freeNodeKeyElements freeKeyElement, Allocator allocator);
 
 /**
  ***** Function: nodeGetKey *****
@@ -95,10 +116,23 @@ NodeKeyElement nodeGetKey(Node node);
  */
 Node nodeGetNext(Node node);
 
+/**
+ ***** Function: nodeReadNext *****
+ * Description: Returns the next node of the given node, for readers running
+ * concurrently with a writer (an acquire load).
+ *
+ * @param node - The node which we want to find its next node.
+ *
+ * @return
+ * The next node.
+ */
+Node nodeReadNext(Node node);
+
 /**
  ***** Function: nodeSetNext *****
  * Description: Gets a node and a next_node and sets node's next
- * to be 'next_node'.
+ * to be 'next_node'. The store is a release, so a reader following the link
+ * with nodeReadNext sees 'next_node' fully initialized.
  *
  * @param node - The node which we want to change its 'next'.
  * @param next_node - The node which we want to be pointed at by 'node'.
@@ -109,13 +143,125 @@ Node nodeGetNext(Node node);
  */
 NodeResult nodeSetNext(Node node, Node next_node);
 
+/**
+ ***** Function: nodeGetPrevious *****
+ * Descritpion: Returns the previous node of the given node.
+ *
+ * @param node - The node which we want to find its previous node.
+ *
+ * @return
+ * The previous node.
+ */
+Node nodeGetPrevious(Node node);
+
+/**
+ ***** Function: nodeSetPrevious *****
+ * Description: Gets a node and a previous_node and sets node's previous
+ * to be 'previous_node'.
+ *
+ * @param node - The node which we want to change its 'previous'.
+ * @param previous_node - The node which we want to be pointed at by 'node'.
+ *
+ * @return
+ * NODE_NULL_ARGUMENT - Node is NULL.
+ * NODE_SUCCESS - Success.
+ */
+NodeResult nodeSetPrevious(Node node, Node previous_node);
+
+/**
+ ***** Function: nodeGetLruNext *****
+ * Descritpion: Returns the next (less recently used) node of the given
+ * node in the recency list.
+ *
+ * @param node - The node which we want to find its next recency node. Must
+ * have the NODE_RECENCY part.
+ *
+ * @return
+ * The next node in the recency list.
+ */
+Node nodeGetLruNext(Node node);
+
+/**
+ ***** Function: nodeSetLruNext *****
+ * Description: Sets node's next (less recently used) node in the recency
+ * list.
+ *
+ * @param node - The node which we want to change its recency 'next'. Must
+ * have the NODE_RECENCY part.
+ * @param next_node - The node which we want to be pointed at by 'node'.
+ *
+ * @return
+ * NODE_NULL_ARGUMENT - Node is NULL.
+ * NODE_SUCCESS - Success.
+ */
+NodeResult nodeSetLruNext(Node node, Node next_node);
+
+/**
+ ***** Function: nodeGetLruPrevious *****
+ * Descritpion: Returns the previous (more recently used) node of the given
+ * node in the recency list.
+ *
+ * @param node - The node which we want to find its previous recency node.
+ * Must have the NODE_RECENCY part.
+ *
+ * @return
+ * The previous node in the recency list.
+ */
+Node nodeGetLruPrevious(Node node);
+
+/**
+ ***** Function: nodeSetLruPrevious *****
+ * Description: Sets node's previous (more recently used) node in the
+ * recency list.
+ *
+ * @param node - The node which we want to change its recency 'previous'.
+ * Must have the NODE_RECENCY part.
+ * @param previous_node - The node which we want to be pointed at by 'node'.
+ *
+ * @return
+ * NODE_NULL_ARGUMENT - Node is NULL.
+ * NODE_SUCCESS - Success.
+ */
+NodeResult nodeSetLruPrevious(Node node, Node previous_node);
+
+/**
+ ***** Function: nodeGetTimer *****
+ * Description: Returns the expiry timer of the given node.
+ *
+ * @param node - The node which we want to get its timer. Must have the
+ * NODE_TIMER part.
+ * @param layout - The parts of the node.
+ *
+ * @return
+ * The node's timer, NULL if the node has no expiry.
+ */
+WheelTimer nodeGetTimer(Node node, NodeLayout layout);
+
+/**
+ ***** Function: nodeSetTimer *****
+ * Description: Sets the expiry timer of the given node.
+ *
+ * @param node - The node which we want to change its timer. Must have the
+ * NODE_TIMER part.
+ * @param layout - The parts of the node.
+ * @param timer - The new timer. NULL if the node has no expiry.
+ *
+ * @return
+ * NODE_NULL_ARGUMENT - Node is NULL.
+ * NODE_SUCCESS - Success.
+ */
+NodeResult nodeSetTimer(Node node, NodeLayout layout, WheelTimer timer);
+
+
 /**
  ***** Function: nodeSetData *****
  * Description: The function gets a node and a new data and creates a copy
  * of the data. The copy of the new data will be inserted to node's data.
  * Node's old data will be destroyed.
  *
- * @param node - The node which we want to modify its data.
+ * @param node - The node which we want to modify its data. Must have the
+ * NODE_DATA part.
+ * @param layout - The parts of the node.
  * @param new_data - The new data to insert into the node.
  * @param copyDataElement - Pointer to the copy data element function.
  * Will be used to create a copy of the given new data.
@@ -127,7 +273,7 @@ NodeResult nodeSetNext(Node node, Node next_node);
  * NODE_OUT_OF_MEMORY - Any memory error.
  * NODE_SUCCESS - Sucess.
  */
-NodeResult nodeSetData(Node node, NodeDataElement new_data,
+NodeResult nodeSetData(Node node, NodeLayout layout, NodeDataElement new_data,
                        copyNodeDataElements copyDataElement,
                        freeNodeDataElements freeDataElement);
 
@@ -135,11 +281,39 @@ NodeResult nodeSetData(Node node, NodeDataElement new_data,
  ***** Function: nodeGetData *****
  * Description: Gets a node and returns node's data.
  *
- * @param node - The node which we want to get its data.
+ * @param node - The node which we want to get its data. Must have the
+ * NODE_DATA part.
+ * @param layout - The parts of the node.
  *
  * @return - A copy of the given node's data.
  */
-NodeDataElement nodeGetData(Node node);
+NodeDataElement nodeGetData(Node node, NodeLayout layout);
+
+/**
+ ***** Function: nodeGetSize *****
+ * Description: Returns the size of a node in bytes.
+ *
+ * @param layout - The parts of the node.
+ *
+ * @return - The size of a node with these parts.
+ */
+size_t nodeGetSize(NodeLayout layout);
 
+/**
+ ***** Function: nodeCopyTo *****
+ * Description: Copies a node into a block of nodeGetSize(new_layout) bytes.
+ * The copy shares the elements, the links and the parts of the original:
+ * the caller relinks it and releases the original without freeing the
+ * elements. The parts only the new layout has are cleared.
+ *
+ * @param node - The node to copy.
+ * @param layout - The parts of the node.
+ * @param new_layout - The parts of the copy. Must include the node's.
+ * @param memory - The block the node is copied into.
+ *
+ * @return - The copy.
+ */
+Node nodeCopyTo(Node node, NodeLayout layout, NodeLayout new_layout,
+                void* memory);
 
 #endif //MTM_EX3_NODE_H
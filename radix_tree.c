@@ -0,0 +1,950 @@
+#include "radix_tree.h"
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------//
+//                         RADIX TREE: DEFINES                           //
+//-----------------------------------------------------------------------//
+
+/* Number of prefix bytes kept inside a node. Longer prefixes are completed
+ * from the key of a leaf below the node. */
+#define RADIX_MAX_PREFIX 10
+/* Leaves are the values themselves, marked by their lowest bit. */
+#define RADIX_LEAF_TAG ((uintptr_t)1)
+#define RADIX_BYTES 256
+/* A node is replaced by a smaller kind once it has this many children. */
+#define RADIX_NODE16_SHRINK 3
+#define RADIX_NODE48_SHRINK 12
+#define RADIX_NODE256_SHRINK 40
+
+/* Kinds of inner nodes, by the number of children they can hold. */
+enum {
+    RADIX_NODE4,
+    RADIX_NODE16,
+    RADIX_NODE48,
+    RADIX_NODE256
+};
+
+//-----------------------------------------------------------------------//
+//                          RADIX TREE: STRUCT                           //
+//-----------------------------------------------------------------------//
+
+/** Header of every inner node. */
+typedef struct radix_node_t{
+    unsigned char type;
+    unsigned short children_number;
+    size_t prefix_length; // Bytes shared by all the keys below the node.
+    unsigned char prefix[RADIX_MAX_PREFIX];
+} *RadixNode;
+
+/** Up to 4 (or 16) children, sorted by their bytes. */
+typedef struct radix_node4_t{
+    struct radix_node_t header;
+    unsigned char keys[4];
+    void* children[4];
+} RadixNode4;
+
+typedef struct radix_node16_t{
+    struct radix_node_t header;
+    unsigned char keys[16];
+    void* children[16];
+} RadixNode16;
+
+/** Up to 48 children, indexed by byte: index[byte] is slot+1, or 0. */
+typedef struct radix_node48_t{
+    struct radix_node_t header;
+    unsigned char index[RADIX_BYTES];
+    void* children[48];
+} RadixNode48;
+
+typedef struct radix_node256_t{
+    struct radix_node_t header;
+    void* children[RADIX_BYTES];
+} RadixNode256;
+
+/* Size of each kind of inner node. */
+static const size_t radix_node_sizes[] = {sizeof(RadixNode4),
+                                          sizeof(RadixNode16),
+                                          sizeof(RadixNode48),
+                                          sizeof(RadixNode256)};
+
+struct radix_tree_t{
+    void* root; // An inner node, a leaf or NULL.
+    radixTreeGetKey getKey;
+    int size;
+    Allocator allocator;
+};
+
+//-----------------------------------------------------------------------//
+//                RADIX TREE: STATIC FUNCTIONS DECLARATIONS              //
+//-----------------------------------------------------------------------//
+
+static bool radixIsLeaf(void* child);
+static void* radixMakeLeaf(void* value);
+static void* radixLeafValue(void* leaf);
+static const unsigned char* radixLeafKey(RadixTree tree, void* leaf);
+static RadixNode radixNodeCreate(RadixTree tree, int type);
+static void radixNodeDestroy(RadixTree tree, RadixNode node);
+static int radixNodeCapacity(int type);
+static unsigned char* radixSortedKeys(RadixNode node);
+static void** radixSortedChildren(RadixNode node);
+static void** radixFindChild(RadixNode node, unsigned char byte);
+static void* radixFirstChildFrom(RadixNode node, int from);
+static int radixGetChildren(RadixNode node, unsigned char* bytes,
+                            void** children);
+static void* radixMinimumLeaf(void* child);
+static void radixSetPrefix(RadixNode node, const unsigned char* prefix,
+                           size_t length);
+static const unsigned char* radixNodePrefix(RadixTree tree, RadixNode node,
+                                            size_t depth);
+static size_t radixPrefixMismatch(RadixTree tree, RadixNode node,
+                                  const unsigned char* key, size_t depth);
+static bool radixStoredPrefixMatches(RadixNode node,
+                                     const unsigned char* key, size_t depth);
+static RadixNode radixResize(RadixTree tree, RadixNode node, int type);
+static void radixPutChild(RadixNode node, unsigned char byte, void* child);
+static RadixTreeResult radixAddChild(RadixTree tree, void** slot,
+                                     unsigned char byte, void* child);
+static void radixRemoveChild(RadixTree tree, void** slot,
+                             unsigned char byte);
+static RadixTreeResult radixInsert(RadixTree tree, void** slot, void* value,
+                                   const unsigned char* key, size_t depth);
+static void* radixLowerBound(RadixTree tree, void* child,
+                             const unsigned char* key, size_t depth);
+static void radixFreeNode(RadixTree tree, void* child);
+
+//-----------------------------------------------------------------------//
+//                        RADIX TREE: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: radixTreeCreate *****
+ * Description: Creates a new empty tree.
+ *
+ * @param getKey - Returns the key of a stored value.
+ * @param allocator - Allocator for the tree's nodes. May be NULL.
+ *
+ * @return
+ * A new tree in case of success.
+ * NULL if getKey is NULL or in case of memory fail.
+ */
+RadixTree radixTreeCreate(radixTreeGetKey getKey, Allocator allocator){
+    if(!getKey){
+        return NULL;
+    }
+    RadixTree tree = allocatorAllocate(allocator, sizeof(*tree));
+    if(!tree){
+        return NULL;
+    }
+    tree->root = NULL;
+    tree->getKey = getKey;
+    tree->size = 0;
+    tree->allocator = allocator;
+    return tree;
+}
+
+/**
+ ***** Function: radixTreeDestroy *****
+ * Description: Frees the tree. The values are not freed.
+ *
+ * @param tree - The tree to destroy. If NULL nothing will be done.
+ */
+void radixTreeDestroy(RadixTree tree){
+    if(!tree){
+        return;
+    }
+    radixTreeClear(tree);
+    allocatorFree(tree->allocator, tree, sizeof(*tree));
+}
+
+/**
+ ***** Function: radixTreeClear *****
+ * Description: Removes all the values from the tree. The values are not
+ * freed.
+ *
+ * @param tree - The tree to clear.
+ */
+void radixTreeClear(RadixTree tree){
+    assert(tree);
+    radixFreeNode(tree, tree->root);
+    tree->root = NULL;
+    tree->size = 0;
+}
+
+/**
+ ***** Function: radixTreeInsert *****
+ * Description: Inserts a value under its key. A value already stored under
+ * an equal key is replaced.
+ *
+ * @param tree - The tree to insert to.
+ * @param value - The value to insert.
+ *
+ * @return
+ * RADIX_TREE_NULL_ARGUMENT if a NULL was sent.
+ * RADIX_TREE_OUT_OF_MEMORY in case of memory fail. The tree is unchanged.
+ * RADIX_TREE_SUCCESS otherwise.
+ */
+RadixTreeResult radixTreeInsert(RadixTree tree, void* value){
+    if(!tree || !value){
+        return RADIX_TREE_NULL_ARGUMENT;
+    }
+    assert(!((uintptr_t)value & RADIX_LEAF_TAG));
+    const unsigned char* key = (const unsigned char*)tree->getKey(value);
+    return radixInsert(tree, &tree->root, value, key, 0);
+}
+
+/**
+ ***** Function: radixTreeFind *****
+ * Description: Finds the value stored under a key.
+ *
+ * @param tree - The tree to search in.
+ * @param key - The key to look for.
+ *
+ * @return
+ * The value stored under the key.
+ * NULL if there is none.
+ */
+void* radixTreeFind(RadixTree tree, const char* key){
+    if(!tree || !key){
+        return NULL;
+    }
+    const unsigned char* bytes = (const unsigned char*)key;
+    size_t key_length = strlen(key) + 1; // The terminator is a key byte.
+    size_t depth = 0;
+    void* child = tree->root;
+    while(child && !radixIsLeaf(child)){
+        RadixNode node = child;
+        /* Only the stored part of the prefix is checked on the way down;
+         * the leaf's key is compared as a whole at the end. */
+        if(!radixStoredPrefixMatches(node, bytes, depth)){
+            return NULL;
+        }
+        depth += node->prefix_length;
+        if(depth >= key_length){
+            return NULL;
+        }
+        void** next = radixFindChild(node, bytes[depth]);
+        child = next ? *next : NULL;
+        depth++;
+    }
+    if(child && strcmp((const char*)radixLeafKey(tree, child), key) == 0){
+        return radixLeafValue(child);
+    }
+    return NULL;
+}
+
+/**
+ ***** Function: radixTreeLowerBound *****
+ * Description: Finds the value with the smallest key which is not smaller
+ * than a given key.
+ *
+ * @param tree - The tree to search in.
+ * @param key - The key to look for. Doesn't have to be in the tree.
+ *
+ * @return
+ * The value with the first key greater or equal to the given key.
+ * NULL if all the keys are smaller.
+ */
+void* radixTreeLowerBound(RadixTree tree, const char* key){
+    if(!tree || !key){
+        return NULL;
+    }
+    void* leaf = radixLowerBound(tree, tree->root,
+                                 (const unsigned char*)key, 0);
+    return leaf ? radixLeafValue(leaf) : NULL;
+}
+
+/**
+ ***** Function: radixTreeRemove *****
+ * Description: Removes the value stored under a key.
+ *
+ * @param tree - The tree to remove from.
+ * @param key - The key to remove.
+ *
+ * @return
+ * The removed value.
+ * NULL if there was none.
+ */
+void* radixTreeRemove(RadixTree tree, const char* key){
+    if(!tree || !key || !tree->root){
+        return NULL;
+    }
+    const unsigned char* bytes = (const unsigned char*)key;
+    size_t key_length = strlen(key) + 1;
+    if(radixIsLeaf(tree->root)){
+        if(strcmp((const char*)radixLeafKey(tree, tree->root), key) != 0){
+            return NULL;
+        }
+        void* value = radixLeafValue(tree->root);
+        tree->root = NULL;
+        tree->size--;
+        return value;
+    }
+    void** slot = &tree->root;
+    size_t depth = 0;
+    while(true){
+        RadixNode node = *slot;
+        if(!radixStoredPrefixMatches(node, bytes, depth)){
+            return NULL;
+        }
+        depth += node->prefix_length;
+        if(depth >= key_length){
+            return NULL;
+        }
+        void** next = radixFindChild(node, bytes[depth]);
+        if(!next){
+            return NULL;
+        }
+        if(radixIsLeaf(*next)){
+            if(strcmp((const char*)radixLeafKey(tree, *next), key) != 0){
+                return NULL;
+            }
+            void* value = radixLeafValue(*next);
+            radixRemoveChild(tree, slot, bytes[depth]);
+            tree->size--;
+            return value;
+        }
+        slot = next;
+        depth++;
+    }
+}
+
+/**
+ ***** Function: radixTreeGetSize *****
+ * Description: Returns the number of values in the tree.
+ *
+ * @param tree - The tree.
+ *
+ * @return
+ * The number of values.
+ */
+int radixTreeGetSize(RadixTree tree){
+    assert(tree);
+    return tree->size;
+}
+
+//-----------------------------------------------------------------------//
+//                      RADIX TREE: STATIC FUNCTIONS                     //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Static function: radixIsLeaf *****
+ * Description: Checks whether a child pointer is a leaf.
+ *
+ * @param child - A non NULL child pointer.
+ * @return
+ * true if it's a leaf, false if it's an inner node.
+ */
+static bool radixIsLeaf(void* child){
+    return ((uintptr_t)child & RADIX_LEAF_TAG) != 0;
+}
+
+/**
+ ***** Static function: radixMakeLeaf *****
+ * Description: Turns a value into a leaf pointer.
+ *
+ * @param value - The value.
+ * @return
+ * The tagged leaf pointer.
+ */
+static void* radixMakeLeaf(void* value){
+    return (void*)((uintptr_t)value | RADIX_LEAF_TAG);
+}
+
+/**
+ ***** Static function: radixLeafValue *****
+ * Description: Returns the value of a leaf pointer.
+ *
+ * @param leaf - The leaf.
+ * @return
+ * The value.
+ */
+static void* radixLeafValue(void* leaf){
+    return (void*)((uintptr_t)leaf & ~RADIX_LEAF_TAG);
+}
+
+/**
+ ***** Static function: radixLeafKey *****
+ * Description: Returns the key of a leaf.
+ *
+ * @param tree - The tree of the leaf.
+ * @param leaf - The leaf.
+ * @return
+ * The key bytes, including the terminator.
+ */
+static const unsigned char* radixLeafKey(RadixTree tree, void* leaf){
+    return (const unsigned char*)tree->getKey(radixLeafValue(leaf));
+}
+
+/**
+ ***** Static function: radixNodeCreate *****
+ * Description: Creates an empty inner node without a prefix.
+ *
+ * @param tree - The tree the node belongs to.
+ * @param type - The kind of node.
+ * @return
+ * The new node, NULL in case of memory fail.
+ */
+static RadixNode radixNodeCreate(RadixTree tree, int type){
+    RadixNode node = allocatorAllocateZeroed(tree->allocator,
+                                             radix_node_sizes[type]);
+    if(!node){
+        return NULL;
+    }
+    node->type = (unsigned char)type;
+    return node;
+}
+
+/**
+ ***** Static function: radixNodeDestroy *****
+ * Description: Frees a single inner node, not its children.
+ *
+ * @param tree - The tree the node belongs to.
+ * @param node - The node.
+ */
+static void radixNodeDestroy(RadixTree tree, RadixNode node){
+    allocatorFree(tree->allocator, node, radix_node_sizes[node->type]);
+}
+
+/**
+ ***** Static function: radixNodeCapacity *****
+ * Description: Returns how many children a kind of node holds.
+ *
+ * @param type - The kind of node.
+ * @return
+ * The number of children.
+ */
+static int radixNodeCapacity(int type){
+    static const int capacities[] = {4, 16, 48, RADIX_BYTES};
+    return capacities[type];
+}
+
+/**
+ ***** Static function: radixSortedKeys *****
+ * Description: Returns the sorted bytes of a node with 4 or 16 children.
+ *
+ * @param node - The node.
+ * @return
+ * The bytes array.
+ */
+static unsigned char* radixSortedKeys(RadixNode node){
+    assert(node->type == RADIX_NODE4 || node->type == RADIX_NODE16);
+    return node->type == RADIX_NODE4 ? ((RadixNode4*)node)->keys :
+           ((RadixNode16*)node)->keys;
+}
+
+/**
+ ***** Static function: radixSortedChildren *****
+ * Description: Returns the children of a node with 4 or 16 children, in
+ * the order of radixSortedKeys.
+ *
+ * @param node - The node.
+ * @return
+ * The children array.
+ */
+static void** radixSortedChildren(RadixNode node){
+    assert(node->type == RADIX_NODE4 || node->type == RADIX_NODE16);
+    return node->type == RADIX_NODE4 ? ((RadixNode4*)node)->children :
+           ((RadixNode16*)node)->children;
+}
+
+/**
+ ***** Static function: radixFindChild *****
+ * Description: Finds the child of a node reached by a byte.
+ *
+ * @param node - The node.
+ * @param byte - The byte.
+ * @return
+ * The slot holding the child, NULL if there is none.
+ */
+static void** radixFindChild(RadixNode node, unsigned char byte){
+    if(node->type == RADIX_NODE48){
+        RadixNode48* node48 = (RadixNode48*)node;
+        int index = node48->index[byte];
+        return index ? &node48->children[index-1] : NULL;
+    }
+    if(node->type == RADIX_NODE256){
+        RadixNode256* node256 = (RadixNode256*)node;
+        return node256->children[byte] ? &node256->children[byte] : NULL;
+    }
+    unsigned char* keys = radixSortedKeys(node);
+    for(int i=0;i<node->children_number && keys[i]<=byte;i++){
+        if(keys[i] == byte){
+            return &radixSortedChildren(node)[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ ***** Static function: radixFirstChildFrom *****
+ * Description: Finds the child of a node reached by the smallest byte
+ * which is not smaller than a given value.
+ *
+ * @param node - The node.
+ * @param from - The smallest byte to consider, up to 256.
+ * @return
+ * The child, NULL if there is none.
+ */
+static void* radixFirstChildFrom(RadixNode node, int from){
+    if(node->type == RADIX_NODE48){
+        RadixNode48* node48 = (RadixNode48*)node;
+        for(int byte=from;byte<RADIX_BYTES;byte++){
+            if(node48->index[byte]){
+                return node48->children[node48->index[byte]-1];
+            }
+        }
+        return NULL;
+    }
+    if(node->type == RADIX_NODE256){
+        RadixNode256* node256 = (RadixNode256*)node;
+        for(int byte=from;byte<RADIX_BYTES;byte++){
+            if(node256->children[byte]){
+                return node256->children[byte];
+            }
+        }
+        return NULL;
+    }
+    unsigned char* keys = radixSortedKeys(node);
+    for(int i=0;i<node->children_number;i++){
+        if(keys[i] >= from){
+            return radixSortedChildren(node)[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ ***** Static function: radixGetChildren *****
+ * Description: Lists the children of a node in the order of their bytes.
+ *
+ * @param node - The node.
+ * @param bytes - Will hold the bytes of the children.
+ * @param children - Will hold the children.
+ * @return
+ * The number of children.
+ */
+static int radixGetChildren(RadixNode node, unsigned char* bytes,
+                            void** children){
+    int count = 0;
+    if(node->type == RADIX_NODE4 || node->type == RADIX_NODE16){
+        count = node->children_number;
+        memcpy(bytes, radixSortedKeys(node), count);
+        memcpy(children, radixSortedChildren(node), sizeof(void*)*count);
+        return count;
+    }
+    for(int byte=0;byte<RADIX_BYTES;byte++){
+        void** child = radixFindChild(node, (unsigned char)byte);
+        if(child){
+            bytes[count] = (unsigned char)byte;
+            children[count++] = *child;
+        }
+    }
+    return count;
+}
+
+/**
+ ***** Static function: radixMinimumLeaf *****
+ * Description: Finds the leaf with the smallest key below a child.
+ *
+ * @param child - A non NULL child pointer.
+ * @return
+ * The leaf.
+ */
+static void* radixMinimumLeaf(void* child){
+    while(!radixIsLeaf(child)){
+        child = radixFirstChildFrom(child, 0);
+    }
+    return child;
+}
+
+/**
+ ***** Static function: radixSetPrefix *****
+ * Description: Sets the prefix of a node. The given bytes may overlap the
+ * node's current prefix.
+ *
+ * @param node - The node.
+ * @param prefix - The bytes of the prefix (at least the stored part).
+ * @param length - Full length of the prefix.
+ */
+static void radixSetPrefix(RadixNode node, const unsigned char* prefix,
+                           size_t length){
+    node->prefix_length = length;
+    memmove(node->prefix, prefix,
+            length < RADIX_MAX_PREFIX ? length : RADIX_MAX_PREFIX);
+}
+
+/**
+ ***** Static function: radixNodePrefix *****
+ * Description: Returns all the bytes of a node's prefix, taking them from
+ * a leaf below the node if they aren't all stored in it.
+ *
+ * @param tree - The tree of the node.
+ * @param node - The node.
+ * @param depth - Index in the keys where the prefix starts.
+ * @return
+ * The prefix bytes.
+ */
+static const unsigned char* radixNodePrefix(RadixTree tree, RadixNode node,
+                                            size_t depth){
+    if(node->prefix_length <= RADIX_MAX_PREFIX){
+        return node->prefix;
+    }
+    return radixLeafKey(tree, radixMinimumLeaf(node)) + depth;
+}
+
+/**
+ ***** Static function: radixPrefixMismatch *****
+ * Description: Compares a node's whole prefix with a key.
+ *
+ * @param tree - The tree of the node.
+ * @param node - The node.
+ * @param key - The key.
+ * @param depth - Index in the key where the prefix starts.
+ * @return
+ * The index of the first byte of the prefix which differs from the key,
+ * the prefix length if there is none.
+ */
+static size_t radixPrefixMismatch(RadixTree tree, RadixNode node,
+                                  const unsigned char* key, size_t depth){
+    const unsigned char* prefix = radixNodePrefix(tree, node, depth);
+    size_t index = 0;
+    /* Prefixes never contain a terminator, so the key's terminator stops
+     * the loop. */
+    while(index < node->prefix_length && prefix[index] == key[depth+index]){
+        index++;
+    }
+    return index;
+}
+
+/**
+ ***** Static function: radixStoredPrefixMatches *****
+ * Description: Compares the stored part of a node's prefix with a key.
+ *
+ * @param node - The node.
+ * @param key - The key.
+ * @param depth - Index in the key where the prefix starts.
+ * @return
+ * false if the key differs from the stored prefix bytes, true otherwise.
+ */
+static bool radixStoredPrefixMatches(RadixNode node,
+                                     const unsigned char* key, size_t depth){
+    size_t stored = node->prefix_length < RADIX_MAX_PREFIX ?
+                    node->prefix_length : RADIX_MAX_PREFIX;
+    for(size_t i=0;i<stored;i++){
+        if(node->prefix[i] != key[depth+i]){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ ***** Static function: radixResize *****
+ * Description: Creates a node of another kind holding the same prefix and
+ * children as a given node. The given node is not freed.
+ *
+ * @param tree - The tree the node belongs to.
+ * @param node - The node.
+ * @param type - Kind of the new node. Must be able to hold the children.
+ * @return
+ * The new node, NULL in case of memory fail.
+ */
+static RadixNode radixResize(RadixTree tree, RadixNode node, int type){
+    RadixNode resized = radixNodeCreate(tree, type);
+    if(!resized){
+        return NULL;
+    }
+    resized->prefix_length = node->prefix_length;
+    memcpy(resized->prefix, node->prefix, RADIX_MAX_PREFIX);
+    unsigned char bytes[RADIX_BYTES];
+    void* children[RADIX_BYTES];
+    int count = radixGetChildren(node, bytes, children);
+    assert(count <= radixNodeCapacity(type));
+    for(int i=0;i<count;i++){
+        radixPutChild(resized, bytes[i], children[i]);
+    }
+    return resized;
+}
+
+/**
+ ***** Static function: radixPutChild *****
+ * Description: Adds a child to a node which has room for it.
+ *
+ * @param node - The node.
+ * @param byte - The byte reaching the child. Must not be in use.
+ * @param child - The child.
+ */
+static void radixPutChild(RadixNode node, unsigned char byte, void* child){
+    assert(node->children_number < radixNodeCapacity(node->type));
+    if(node->type == RADIX_NODE48){
+        RadixNode48* node48 = (RadixNode48*)node;
+        int slot = 0;
+        while(node48->children[slot]){
+            slot++;
+        }
+        node48->children[slot] = child;
+        node48->index[byte] = (unsigned char)(slot+1);
+    } else if(node->type == RADIX_NODE256){
+        ((RadixNode256*)node)->children[byte] = child;
+    } else {
+        unsigned char* keys = radixSortedKeys(node);
+        void** children = radixSortedChildren(node);
+        int position = 0;
+        while(position < node->children_number && keys[position] < byte){
+            position++;
+        }
+        int moved = node->children_number - position;
+        memmove(keys+position+1, keys+position, moved);
+        memmove(children+position+1, children+position,
+                sizeof(void*)*moved);
+        keys[position] = byte;
+        children[position] = child;
+    }
+    node->children_number++;
+}
+
+/**
+ ***** Static function: radixAddChild *****
+ * Description: Adds a child to a node, replacing the node with a bigger
+ * kind if it's full.
+ *
+ * @param tree - The tree the node belongs to.
+ * @param slot - The slot holding the node.
+ * @param byte - The byte reaching the child. Must not be in use.
+ * @param child - The child.
+ * @return
+ * RADIX_TREE_OUT_OF_MEMORY in case of memory fail. The node is unchanged.
+ * RADIX_TREE_SUCCESS otherwise.
+ */
+static RadixTreeResult radixAddChild(RadixTree tree, void** slot,
+                                     unsigned char byte, void* child){
+    RadixNode node = *slot;
+    if(node->children_number == radixNodeCapacity(node->type)){
+        RadixNode grown = radixResize(tree, node, node->type+1);
+        if(!grown){
+            return RADIX_TREE_OUT_OF_MEMORY;
+        }
+        radixNodeDestroy(tree, node);
+        *slot = node = grown;
+    }
+    radixPutChild(node, byte, child);
+    return RADIX_TREE_SUCCESS;
+}
+
+/**
+ ***** Static function: radixRemoveChild *****
+ * Description: Removes a child from a node. The node is replaced with a
+ * smaller kind once it's sparse enough, and a node left with a single
+ * child is merged into that child.
+ *
+ * @param tree - The tree the node belongs to.
+ * @param slot - The slot holding the node.
+ * @param byte - The byte reaching the child.
+ */
+static void radixRemoveChild(RadixTree tree, void** slot,
+                             unsigned char byte){
+    RadixNode node = *slot;
+    if(node->type == RADIX_NODE48){
+        RadixNode48* node48 = (RadixNode48*)node;
+        node48->children[node48->index[byte]-1] = NULL;
+        node48->index[byte] = 0;
+    } else if(node->type == RADIX_NODE256){
+        ((RadixNode256*)node)->children[byte] = NULL;
+    } else {
+        unsigned char* keys = radixSortedKeys(node);
+        void** children = radixSortedChildren(node);
+        int position = 0;
+        while(keys[position] != byte){
+            position++;
+        }
+        int moved = node->children_number - position - 1;
+        memmove(keys+position, keys+position+1, moved);
+        memmove(children+position, children+position+1,
+                sizeof(void*)*moved);
+    }
+    node->children_number--;
+    if(node->type == RADIX_NODE4 && node->children_number == 1){
+        /* The node only adds its prefix and a byte to its child's path. */
+        void* child = radixSortedChildren(node)[0];
+        if(!radixIsLeaf(child)){
+            RadixNode below = child;
+            unsigned char prefix[RADIX_MAX_PREFIX];
+            size_t stored = node->prefix_length < RADIX_MAX_PREFIX ?
+                            node->prefix_length : RADIX_MAX_PREFIX;
+            memcpy(prefix, node->prefix, stored);
+            if(stored < RADIX_MAX_PREFIX){
+                prefix[stored++] = radixSortedKeys(node)[0];
+            }
+            size_t rest = RADIX_MAX_PREFIX - stored;
+            if(below->prefix_length < rest){
+                rest = below->prefix_length;
+            }
+            memcpy(prefix+stored, below->prefix, rest);
+            below->prefix_length += node->prefix_length + 1;
+            memcpy(below->prefix, prefix, stored+rest);
+        }
+        *slot = child;
+        radixNodeDestroy(tree, node);
+        return;
+    }
+    static const int shrink_at[] = {0, RADIX_NODE16_SHRINK,
+                                    RADIX_NODE48_SHRINK,
+                                    RADIX_NODE256_SHRINK};
+    if(node->type != RADIX_NODE4 &&
+       node->children_number <= shrink_at[node->type]){
+        /* If this fails the bigger node is kept, which is still correct. */
+        RadixNode shrunk = radixResize(tree, node, node->type-1);
+        if(shrunk){
+            radixNodeDestroy(tree, node);
+            *slot = shrunk;
+        }
+    }
+}
+
+/**
+ ***** Static function: radixInsert *****
+ * Description: Inserts a value below a slot.
+ *
+ * @param tree - The tree.
+ * @param slot - The slot to insert below.
+ * @param value - The value.
+ * @param key - The value's key.
+ * @param depth - Number of key bytes consumed above the slot.
+ * @return
+ * RADIX_TREE_OUT_OF_MEMORY in case of memory fail. The tree is unchanged.
+ * RADIX_TREE_SUCCESS otherwise.
+ */
+static RadixTreeResult radixInsert(RadixTree tree, void** slot, void* value,
+                                   const unsigned char* key, size_t depth){
+    void* child = *slot;
+    if(!child){
+        *slot = radixMakeLeaf(value);
+        tree->size++;
+        return RADIX_TREE_SUCCESS;
+    }
+    if(radixIsLeaf(child)){
+        const unsigned char* other = radixLeafKey(tree, child);
+        if(strcmp((const char*)other, (const char*)key) == 0){
+            *slot = radixMakeLeaf(value);
+            return RADIX_TREE_SUCCESS;
+        }
+        /* The keys differ, so they branch before either one ends. */
+        size_t common = 0;
+        while(other[depth+common] == key[depth+common]){
+            common++;
+        }
+        /* The two leaves share 'common' bytes and then branch. */
+        RadixNode node = radixNodeCreate(tree, RADIX_NODE4);
+        if(!node){
+            return RADIX_TREE_OUT_OF_MEMORY;
+        }
+        radixSetPrefix(node, key+depth, common);
+        radixPutChild(node, other[depth+common], child);
+        radixPutChild(node, key[depth+common], radixMakeLeaf(value));
+        *slot = node;
+        tree->size++;
+        return RADIX_TREE_SUCCESS;
+    }
+    RadixNode node = child;
+    size_t mismatch = radixPrefixMismatch(tree, node, key, depth);
+    if(mismatch < node->prefix_length){
+        /* The key leaves the prefix: a new node branches at that byte. */
+        RadixNode parent = radixNodeCreate(tree, RADIX_NODE4);
+        if(!parent){
+            return RADIX_TREE_OUT_OF_MEMORY;
+        }
+        radixSetPrefix(parent, key+depth, mismatch);
+        const unsigned char* prefix = radixNodePrefix(tree, node, depth);
+        unsigned char byte = prefix[mismatch];
+        radixSetPrefix(node, prefix+mismatch+1,
+                       node->prefix_length-mismatch-1);
+        radixPutChild(parent, byte, node);
+        radixPutChild(parent, key[depth+mismatch], radixMakeLeaf(value));
+        *slot = parent;
+        tree->size++;
+        return RADIX_TREE_SUCCESS;
+    }
+    depth += node->prefix_length;
+    void** next = radixFindChild(node, key[depth]);
+    if(next){
+        return radixInsert(tree, next, value, key, depth+1);
+    }
+    RadixTreeResult status = radixAddChild(tree, slot, key[depth],
+                                           radixMakeLeaf(value));
+    if(status == RADIX_TREE_SUCCESS){
+        tree->size++;
+    }
+    return status;
+}
+
+/**
+ ***** Static function: radixLowerBound *****
+ * Description: Finds the leaf with the smallest key which is not smaller
+ * than a given key, below a child.
+ *
+ * @param tree - The tree.
+ * @param child - The child to search below. May be NULL.
+ * @param key - The key.
+ * @param depth - Number of key bytes consumed above the child.
+ * @return
+ * The leaf, NULL if all the keys below the child are smaller.
+ */
+static void* radixLowerBound(RadixTree tree, void* child,
+                             const unsigned char* key, size_t depth){
+    if(!child){
+        return NULL;
+    }
+    if(radixIsLeaf(child)){
+        return strcmp((const char*)radixLeafKey(tree, child),
+                      (const char*)key) >= 0 ? child : NULL;
+    }
+    RadixNode node = child;
+    size_t mismatch = radixPrefixMismatch(tree, node, key, depth);
+    if(mismatch < node->prefix_length){
+        /* All the keys below the node are on the same side of the key. */
+        const unsigned char* prefix = radixNodePrefix(tree, node, depth);
+        return prefix[mismatch] > key[depth+mismatch] ?
+               radixMinimumLeaf(node) : NULL;
+    }
+    depth += node->prefix_length;
+    unsigned char byte = key[depth];
+    void** next = radixFindChild(node, byte);
+    if(next){
+        void* leaf = radixLowerBound(tree, *next, key, depth+1);
+        if(leaf){
+            return leaf;
+        }
+    }
+    void* greater = radixFirstChildFrom(node, byte+1);
+    return greater ? radixMinimumLeaf(greater) : NULL;
+}
+
+/**
+ ***** Static function: radixFreeNode *****
+ * Description: Frees the inner nodes below a child, including it.
+ *
+ * @param tree - The tree the child belongs to.
+ * @param child - The child. May be NULL or a leaf.
+ */
+static void radixFreeNode(RadixTree tree, void* child){
+    if(!child || radixIsLeaf(child)){
+        return;
+    }
+    RadixNode node = child;
+    if(node->type == RADIX_NODE48){
+        for(int i=0;i<48;i++){
+            radixFreeNode(tree, ((RadixNode48*)node)->children[i]);
+        }
+    } else if(node->type == RADIX_NODE256){
+        for(int i=0;i<RADIX_BYTES;i++){
+            radixFreeNode(tree, ((RadixNode256*)node)->children[i]);
+        }
+    } else {
+        for(int i=0;i<node->children_number;i++){
+            radixFreeNode(tree, radixSortedChildren(node)[i]);
+        }
+    }
+    radixNodeDestroy(tree, node);
+}
@@ -0,0 +1,140 @@
+
+#ifndef MTM_EX3_RADIX_TREE_H
+#define MTM_EX3_RADIX_TREE_H
+
+#include <stdbool.h>
+#include "allocator.h"
+
+/**
+* Adaptive Radix Tree
+*
+* An ordered index of values keyed by C strings. Every inner node branches
+* on a single byte of the key and grows (or shrinks) between 4, 16, 48 and
+* 256 children as needed; chains of single-child nodes are compressed into
+* a prefix stored in the node below them. Finding a key costs time
+* proportional to its length, not to the number of keys in the tree, and
+* the keys are visited in the order of strcmp.
+*
+* The tree doesn't copy keys: a value's key is obtained through the
+* function given at creation, and must stay valid and unchanged while the
+* value is in the tree. Values must be aligned to at least two bytes (any
+* allocated object is).
+*/
+
+//-----------------------------------------------------------------------//
+//                         RADIX TREE: TYPEDEFS                          //
+//-----------------------------------------------------------------------//
+
+typedef struct radix_tree_t *RadixTree;
+
+/** Type of function returning the key of a value stored in the tree */
+typedef const char*(*radixTreeGetKey)(void* value);
+
+/** Type used for returning error codes from radix tree functions */
+typedef enum RadixTreeResult_t {
+    RADIX_TREE_SUCCESS,
+    RADIX_TREE_NULL_ARGUMENT,
+    RADIX_TREE_OUT_OF_MEMORY
+} RadixTreeResult;
+
+//-----------------------------------------------------------------------//
+//                        RADIX TREE: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: radixTreeCreate *****
+ * Description: Creates a new empty tree.
+ *
+ * @param getKey - Returns the key of a stored value.
+ * @param allocator - Allocator for the tree's nodes. May be NULL.
+ *
+ * @return
+ * A new tree in case of success.
+ * NULL if getKey is NULL or in case of memory fail.
+ */
+RadixTree radixTreeCreate(radixTreeGetKey getKey, Allocator allocator);
+
+/**
+ ***** Function: radixTreeDestroy *****
+ * Description: Frees the tree. The values are not freed.
+ *
+ * @param tree - The tree to destroy. If NULL nothing will be done.
+ */
+void radixTreeDestroy(RadixTree tree);
+
+/**
+ ***** Function: radixTreeClear *****
+ * Description: Removes all the values from the tree. The values are not
+ * freed.
+ *
+ * @param tree - The tree to clear.
+ */
+void radixTreeClear(RadixTree tree);
+
+/**
+ ***** Function: radixTreeInsert *****
+ * Description: Inserts a value under its key. A value already stored under
+ * an equal key is replaced.
+ *
+ * @param tree - The tree to insert to.
+ * @param value - The value to insert.
+ *
+ * @return
+ * RADIX_TREE_NULL_ARGUMENT if a NULL was sent.
+ * RADIX_TREE_OUT_OF_MEMORY in case of memory fail. The tree is unchanged.
+ * RADIX_TREE_SUCCESS otherwise.
+ */
+RadixTreeResult radixTreeInsert(RadixTree tree, void* value);
+
+/**
+ ***** Function: radixTreeFind *****
+ * Description: Finds the value stored under a key.
+ *
+ * @param tree - The tree to search in.
+ * @param key - The key to look for.
+ *
+ * @return
+ * The value stored under the key.
+ * NULL if there is none.
+ */
+void* radixTreeFind(RadixTree tree, const char* key);
+
+/**
+ ***** Function: radixTreeLowerBound *****
+ * Description: Finds the value with the smallest key which is not smaller
+ * than a given key.
+ *
+ * @param tree - The tree to search in.
+ * @param key - The key to look for. Doesn't have to be in the tree.
+ *
+ * @return
+ * The value with the first key greater or equal to the given key.
+ * NULL if all the keys are smaller.
+ */
+void* radixTreeLowerBound(RadixTree tree, const char* key);
+
+/**
+ ***** Function: radixTreeRemove *****
+ * Description: Removes the value stored under a key.
+ *
+ * @param tree - The tree to remove from.
+ * @param key - The key to remove.
+ *
+ * @return
+ * The removed value.
+ * NULL if there was none.
+ */
+void* radixTreeRemove(RadixTree tree, const char* key);
+
+/**
+ ***** Function: radixTreeGetSize *****
+ * Description: Returns the number of values in the tree.
+ *
+ * @param tree - The tree.
+ *
+ * @return
+ * The number of values.
+ */
+int radixTreeGetSize(RadixTree tree);
+
+#endif //MTM_EX3_RADIX_TREE_H
@@ -0,0 +1,325 @@
+#include "set_mtm.h"
+#include "map_mtm.h"
+#include <stdlib.h>
+
+//-----------------------------------------------------------------------//
+//                              SET: STRUCTS                             //
+//-----------------------------------------------------------------------//
+
+/** The elements are the keys of a key-only map, which stores no data for
+ * them. set_member is the data given to the map, which ignores it. */
+struct Set_t{
+    Map map;
+    copySetElements copyElement;
+    freeSetElements freeElement;
+    compareSetElements compareElements;
+};
+
+static int set_member;
+
+//-----------------------------------------------------------------------//
+//                  SET: STATIC FUNCTIONS DECLARATIONS                   //
+//-----------------------------------------------------------------------//
+
+static Set setWrap(Map map, copySetElements copyElement,
+                   freeSetElements freeElement,
+                   compareSetElements compareElements);
+static Set setMerge(Set first, Set second, bool keep_unique);
+
+//-----------------------------------------------------------------------//
+//                            SET: FUNCTIONS                             //
+//-----------------------------------------------------------------------//
+
+/**
+***** Function: setCreate *****
+* Description: Allocates a new empty set.
+*
+* @param copyElement - Function pointer to be used for copying elements into
+* the set or when copying the set.
+* @param freeElement - Function pointer to be used for removing elements
+* from the set.
+* @param compareElements - Function pointer to be used for ordering the
+* elements and finding equal ones.
+* @return
+* NULL - if one of the parameters is NULL or allocations failed.
+* A new Set in case of success.
+*/
+Set setCreate(copySetElements copyElement, freeSetElements freeElement,
+              compareSetElements compareElements){
+    if(!copyElement || !freeElement || !compareElements){
+        return NULL;
+    }
+    return setWrap(mapCreateKeyOnly(copyElement, freeElement,
+                                    compareElements),
+                   copyElement, freeElement, compareElements);
+}
+
+/**
+***** Function: setDestroy *****
+* Description: Deallocates an existing set. Clears all elements by using
+* the free function.
+*
+* @param set - Target set to be deallocated. If set is NULL nothing will be
+* done.
+*/
+void setDestroy(Set set){
+    if(!set){
+        return;
+    }
+    mapDestroy(set->map);
+    free(set);
+}
+
+/**
+***** Function: setCopy *****
+* Description: Creates a copy of target set.
+* Iterator values for both sets is undefined after this operation.
+*
+* @param set - Target set.
+* @return
+* NULL if a NULL was sent or a memory allocation failed.
+* A Set containing the same elements as set otherwise.
+*/
+Set setCopy(Set set){
+    if(!set){
+        return NULL;
+    }
+    return setWrap(mapCopy(set->map), set->copyElement, set->freeElement,
+                   set->compareElements);
+}
+
+/**
+***** Function: setGetSize *****
+* Description: Returns the number of elements in a set.
+*
+* @param set - The set which size is requested.
+* @return
+* -1 if a NULL pointer was sent.
+* Otherwise the number of elements in the set.
+*/
+int setGetSize(Set set){
+    return set ? mapGetSize(set->map) : -1;
+}
+
+/**
+***** Function: setContains *****
+* Description: Checks if an element exists in the set.
+* This resets the internal iterator.
+*
+* @param set - The set to search in.
+* @param element - The element to look for.
+* @return
+* false - if one or more of the inputs is null, or if the element was not
+* found.
+* true - if the element was found in the set.
+*/
+bool setContains(Set set, SetElement element){
+    return set && mapContains(set->map, element);
+}
+
+/**
+***** Function: setAdd *****
+* Description: Adds a copy of an element to the set.
+* Iterator's value is undefined after this operation.
+*
+* @param set - The set to add to.
+* @param element - The element to add.
+* @return
+* SET_NULL_ARGUMENT if a NULL was sent as set or element.
+* SET_ITEM_ALREADY_EXISTS if an equal element is already in the set.
+* SET_OUT_OF_MEMORY if an allocation failed.
+* SET_SUCCESS the element had been added successfully.
+*/
+SetResult setAdd(Set set, SetElement element){
+    if(!set || !element){
+        return SET_NULL_ARGUMENT;
+    }
+    /* Putting an existing element leaves the map as it was, so a single
+     * search tells whether it was there. */
+    int size = mapGetSize(set->map);
+    if(mapPut(set->map, element, &set_member) != MAP_SUCCESS){
+        return SET_OUT_OF_MEMORY;
+    }
+    return mapGetSize(set->map) == size ? SET_ITEM_ALREADY_EXISTS :
+           SET_SUCCESS;
+}
+
+/**
+***** Function: setRemove *****
+* Description: Removes an element from the set and frees it.
+* Iterator's value is undefined after this operation.
+*
+* @param set - The set to remove the element from.
+* @param element - An element equal to the one to remove.
+* @return
+* SET_NULL_ARGUMENT if a NULL was sent to the function.
+* SET_ITEM_DOES_NOT_EXIST if no equal element is in the set.
+* SET_SUCCESS the element had been removed successfully.
+*/
+SetResult setRemove(Set set, SetElement element){
+    if(!set || !element){
+        return SET_NULL_ARGUMENT;
+    }
+    return mapRemove(set->map, element) == MAP_SUCCESS ? SET_SUCCESS :
+           SET_ITEM_DOES_NOT_EXIST;
+}
+
+/**
+***** Function: setGetFirst *****
+* Description: Sets the internal iterator to the smallest element in the
+* set and returns it.
+*
+* @param set - The set for which to set the iterator.
+* @return
+* NULL if a NULL pointer was sent or the set is empty.
+* The smallest element of the set otherwise.
+*/
+SetElement setGetFirst(Set set){
+    return set ? mapGetFirst(set->map) : NULL;
+}
+
+/**
+***** Function: setGetNext *****
+* Description: Advances the set iterator to the next element and returns
+* it.
+*
+* @param set - The set for which to advance the iterator.
+* @return
+* NULL if reached the end of the set, or the iterator is at an invalid
+* state or a NULL sent as argument.
+* The next element of the set in case of success.
+*/
+SetElement setGetNext(Set set){
+    return set ? mapGetNext(set->map) : NULL;
+}
+
+/**
+***** Function: setClear *****
+* Description: Removes all the elements of target set.
+*
+* @param set - Target set to remove all the elements from.
+* @return
+* SET_NULL_ARGUMENT - if a NULL pointer was sent.
+* SET_SUCCESS - Otherwise.
+*/
+SetResult setClear(Set set){
+    if(!set){
+        return SET_NULL_ARGUMENT;
+    }
+    mapClear(set->map);
+    return SET_SUCCESS;
+}
+
+/**
+***** Function: setUnion *****
+* Description: Creates a new set holding every element of either set, in
+* time linear in the sizes of the sets.
+* Iterator values of both sets are undefined after this operation.
+*
+* @param first - The first set.
+* @param second - The second set.
+* @return
+* NULL if a NULL was sent or a memory allocation failed.
+* The union of the sets otherwise.
+*/
+Set setUnion(Set first, Set second){
+    return setMerge(first, second, true);
+}
+
+/**
+***** Function: setIntersection *****
+* Description: Creates a new set holding the elements which are in both
+* sets, in time linear in the sizes of the sets.
+* Iterator values of both sets are undefined after this operation.
+*
+* @param first - The first set.
+* @param second - The second set.
+* @return
+* NULL if a NULL was sent or a memory allocation failed.
+* The intersection of the sets otherwise.
+*/
+Set setIntersection(Set first, Set second){
+    return setMerge(first, second, false);
+}
+
+//-----------------------------------------------------------------------//
+//                         SET: STATIC FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: setWrap *****
+ * Description: Creates a set around a map of its elements.
+ *
+ * @param map - The map. Owned by the set on success, destroyed otherwise.
+ * May be NULL.
+ * @param copyElement, freeElement, compareElements - The functions of the
+ * elements, as given to setCreate.
+ * @return
+ * The set, NULL if map is NULL or in case of memory fail.
+ */
+static Set setWrap(Map map, copySetElements copyElement,
+                   freeSetElements freeElement,
+                   compareSetElements compareElements){
+    if(!map){
+        return NULL;
+    }
+    Set set = malloc(sizeof(*set));
+    if(!set){
+        mapDestroy(map);
+        return NULL;
+    }
+    set->map = map;
+    set->copyElement = copyElement;
+    set->freeElement = freeElement;
+    set->compareElements = compareElements;
+    return set;
+}
+
+/**
+ ***** Function: setMerge *****
+ * Description: Walks both sets once in order, like a merge of two sorted
+ * lists, and appends to a new set the elements of either set or only the
+ * common ones. Every append starts its search at the previous one, so the
+ * whole merge takes linear time.
+ *
+ * @param first - The first set. The new set uses its functions.
+ * @param second - The second set.
+ * @param keep_unique - Whether to keep the elements of a single set too.
+ * @return
+ * The new set, NULL if a NULL was sent or in case of memory fail.
+ */
+static Set setMerge(Set first, Set second, bool keep_unique){
+    if(!first || !second){
+        return NULL;
+    }
+    if(first == second){
+        /* A single iterator can't walk the set twice at once. */
+        return setCopy(first);
+    }
+    Set merged = setCreate(first->copyElement, first->freeElement,
+                           first->compareElements);
+    if(!merged){
+        return NULL;
+    }
+    MapHint hint = MAP_HINT_INITIALIZER;
+    SetElement left = mapGetFirst(first->map);
+    SetElement right = mapGetFirst(second->map);
+    while(left || right){
+        int order = !left ? 1 : !right ? -1 :
+                    first->compareElements(left, right);
+        SetElement element = order <= 0 ? left : right;
+        if((keep_unique || order == 0) &&
+           mapPutHint(merged->map, &hint, element, &set_member) !=
+           MAP_SUCCESS){
+            setDestroy(merged);
+            return NULL;
+        }
+        if(order <= 0){
+            left = mapGetNext(first->map);
+        }
+        if(order >= 0){
+            right = mapGetNext(second->map);
+        }
+    }
+    return merged;
+}
@@ -0,0 +1,223 @@
+#ifndef SET_MTM_H_
+#define SET_MTM_H_
+
+#include <stdbool.h>
+
+/**
+* Generic Ordered Set Container
+*
+* Implements a set of elements kept in increasing order, on top of the map's
+* ordered engine. Only the elements are stored: the set's nodes have no data
+* pointer and there is no data element per entry, so adding an element costs
+* a single copy and allocation instead of the two a map with dummy data pays.
+* The set has an internal iterator for external use, with the same rules as
+* the map's.
+*
+* The following functions are available:
+*   setCreate		- Creates a new empty set
+*   setDestroy		- Deletes an existing set and frees all resources
+*   setCopy		- Copies an existing set
+*   setGetSize		- Returns the number of elements in the set
+*   setContains	- Returns whether an element is in the set
+*   setAdd			- Adds an element to the set
+*   setRemove		- Removes an element from the set
+*   setGetFirst	- Sets the internal iterator to the smallest element and
+*   				  returns it
+*   setGetNext		- Advances the internal iterator to the next element and
+*   				  returns it
+*   setClear		- Removes all the elements of the set
+*   setUnion		- Creates the union of two sets in linear time
+*   setIntersection - Creates the intersection of two sets in linear time
+* 	SET_FOREACH	- A macro for iterating over the set's elements.
+*/
+
+/** Type for defining the set */
+typedef struct Set_t *Set;
+
+/** Type used for returning error codes from set functions */
+typedef enum SetResult_t {
+	SET_SUCCESS,
+	SET_OUT_OF_MEMORY,
+	SET_NULL_ARGUMENT,
+	SET_ITEM_ALREADY_EXISTS,
+	SET_ITEM_DOES_NOT_EXIST
+} SetResult;
+
+/** Element data type for set container */
+typedef void* SetElement;
+
+/** Type of function for copying an element of the set */
+typedef SetElement(*copySetElements)(SetElement);
+
+/** Type of function for deallocating an element of the set */
+typedef void(*freeSetElements)(SetElement);
+
+/**
+* Type of function used by the set to order its elements.
+* This function should return:
+* 		A positive integer if the first element is greater;
+* 		0 if they're equal;
+*		A negative integer if the second element is greater.
+*/
+typedef int(*compareSetElements)(SetElement, SetElement);
+
+/**
+* setCreate: Allocates a new empty set.
+*
+* @param copyElement - Function pointer to be used for copying elements into
+* 	the set or when copying the set.
+* @param freeElement - Function pointer to be used for removing elements from
+* 	the set.
+* @param compareElements - Function pointer to be used for ordering the
+* 	elements and finding equal ones.
+* @return
+* 	NULL - if one of the parameters is NULL or allocations failed.
+* 	A new Set in case of success.
+*/
+Set setCreate(copySetElements copyElement, freeSetElements freeElement,
+	compareSetElements compareElements);
+
+/**
+* setDestroy: Deallocates an existing set. Clears all elements by using the
+* free function.
+*
+* @param set - Target set to be deallocated. If set is NULL nothing will be
+* 		done
+*/
+void setDestroy(Set set);
+
+/**
+* setCopy: Creates a copy of target set.
+* Iterator values for both sets is undefined after this operation.
+*
+* @param set - Target set.
+* @return
+* 	NULL if a NULL was sent or a memory allocation failed.
+* 	A Set containing the same elements as set otherwise.
+*/
+Set setCopy(Set set);
+
+/**
+* setGetSize: Returns the number of elements in a set.
+* @param set - The set which size is requested
+* @return
+* 	-1 if a NULL pointer was sent.
+* 	Otherwise the number of elements in the set.
+*/
+int setGetSize(Set set);
+
+/**
+* setContains: Checks if an element exists in the set.
+* This resets the internal iterator.
+*
+* @param set - The set to search in
+* @param element - The element to look for. Checked using the comparison
+* 		function.
+* @return
+* 	false - if one or more of the inputs is null, or if the element was not
+* 	found.
+* 	true - if the element was found in the set.
+*/
+bool setContains(Set set, SetElement element);
+
+/**
+*	setAdd: Adds a copy of an element to the set.
+*	Iterator's value is undefined after this operation.
+*
+* @param set - The set to add to.
+* @param element - The element to add. A copy of the element will be
+* 		inserted, made by the copy function given at initialization.
+* @return
+* 	SET_NULL_ARGUMENT if a NULL was sent as set or element.
+* 	SET_ITEM_ALREADY_EXISTS if an equal element is already in the set. The
+* 	set is unchanged.
+* 	SET_OUT_OF_MEMORY if an allocation failed.
+* 	SET_SUCCESS the element had been added successfully.
+*/
+SetResult setAdd(Set set, SetElement element);
+
+/**
+*	setRemove: Removes an element from the set and frees it with the free
+*	function given at initialization.
+*	Iterator's value is undefined after this operation.
+*
+* @param set - The set to remove the element from.
+* @param element - An element equal to the one to remove.
+* @return
+* 	SET_NULL_ARGUMENT if a NULL was sent to the function.
+* 	SET_ITEM_DOES_NOT_EXIST if no equal element is in the set.
+* 	SET_SUCCESS the element had been removed successfully.
+*/
+SetResult setRemove(Set set, SetElement element);
+
+/**
+*	setGetFirst: Sets the internal iterator to the smallest element in the
+*	set and returns it. Use this to start iterating over the set.
+*	To continue iteration use setGetNext.
+*
+* @param set - The set for which to set the iterator.
+* @return
+* 	NULL if a NULL pointer was sent or the set is empty.
+* 	The smallest element of the set otherwise.
+*/
+SetElement setGetFirst(Set set);
+
+/**
+*	setGetNext: Advances the set iterator to the next element and returns it.
+* @param set - The set for which to advance the iterator
+* @return
+* 	NULL if reached the end of the set, or the iterator is at an invalid
+* 	state or a NULL sent as argument
+* 	The next element of the set in case of success
+*/
+SetElement setGetNext(Set set);
+
+/**
+* setClear: Removes all the elements of target set, freeing them with the
+* free function.
+*
+* @param set - Target set to remove all the elements from.
+* @return
+* 	SET_NULL_ARGUMENT - if a NULL pointer was sent.
+* 	SET_SUCCESS - Otherwise.
+*/
+SetResult setClear(Set set);
+
+/**
+* setUnion: Creates a new set holding every element of either set. Both
+* sets are walked once in order, and the result is built by appending, so
+* it takes time linear in the sizes of the sets. The new set uses the
+* functions of the first set, and the sets must be ordered alike.
+* Iterator values of both sets are undefined after this operation.
+*
+* @param first - The first set.
+* @param second - The second set.
+* @return
+* 	NULL if a NULL was sent or a memory allocation failed.
+* 	The union of the sets otherwise.
+*/
+Set setUnion(Set first, Set second);
+
+/**
+* setIntersection: Creates a new set holding the elements which are in both
+* sets, in linear time like setUnion.
+* Iterator values of both sets are undefined after this operation.
+*
+* @param first - The first set.
+* @param second - The second set.
+* @return
+* 	NULL if a NULL was sent or a memory allocation failed.
+* 	The intersection of the sets otherwise.
+*/
+Set setIntersection(Set first, Set second);
+
+/*!
+* Macro for iterating over a set in increasing order.
+* Declares a new iterator for the loop.
+*/
+#define SET_FOREACH(type,iterator,set) \
+	for(type iterator = (type) setGetFirst(set) ; \
+		iterator ;\
+		iterator = setGetNext(set))
+
+#endif /* SET_MTM_H_ */
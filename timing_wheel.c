@@ -0,0 +1,420 @@
+#include "timing_wheel.h"
+#include <assert.h>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------//
+//                        TIMING WHEEL: DEFINES                          //
+//-----------------------------------------------------------------------//
+
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK ((WheelTick)(WHEEL_SLOTS - 1))
+#define WHEEL_NO_SLOT -1
+
+/* Width (in ticks) of a single slot of the given level. */
+#define WHEEL_SHIFT(level) (WHEEL_SLOT_BITS * (level))
+
+//-----------------------------------------------------------------------//
+//                        TIMING WHEEL: STRUCTS                          //
+//-----------------------------------------------------------------------//
+
+struct wheel_timer_t{
+    WheelTick expiry;
+    void* owner;
+    WheelTimer next;
+    WheelTimer previous;
+    int level;
+    int slot; // WHEEL_NO_SLOT while the timer is detached.
+};
+
+struct timing_wheel_t{
+    WheelTimer slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_LEVELS]; // Bit i is set if slot i is not empty.
+    WheelTick current;
+    int size;
+    Allocator allocator;
+};
+
+//-----------------------------------------------------------------------//
+//               TIMING WHEEL: STATIC FUNCTIONS DECLARATIONS             //
+//-----------------------------------------------------------------------//
+
+static void wheelLink(TimingWheel wheel, WheelTimer timer);
+static void wheelUnlink(TimingWheel wheel, WheelTimer timer);
+static int wheelProcessTick(TimingWheel wheel, int budget,
+                            expireWheelTimer expire, void* context);
+static WheelTick wheelGetNextEventTick(TimingWheel wheel);
+
+//-----------------------------------------------------------------------//
+//                       TIMING WHEEL: FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: timingWheelCreate *****
+ * Description: Creates a new empty timing wheel.
+ *
+ * @param now - The current tick.
+ * @param allocator - Allocator for the wheel. May be NULL.
+ *
+ * @return
+ * A new wheel in case of success.
+ * NULL in case of memory fail.
+ */
+TimingWheel timingWheelCreate(WheelTick now, Allocator allocator){
+    TimingWheel wheel = allocatorAllocate(allocator, sizeof(*wheel));
+    if(!wheel){
+        return NULL;
+    }
+    for(int level=0;level<WHEEL_LEVELS;level++){
+        for(int slot=0;slot<WHEEL_SLOTS;slot++){
+            wheel->slots[level][slot] = NULL;
+        }
+        wheel->occupied[level] = 0;
+    }
+    wheel->current = now;
+    wheel->size = 0;
+    wheel->allocator = allocator;
+    return wheel;
+}
+
+/**
+ ***** Function: timingWheelDestroy *****
+ * Description: Frees the wheel. Timers still scheduled are only detached,
+ * they still belong to their owners.
+ *
+ * @param wheel - The wheel to destroy. If NULL nothing will be done.
+ */
+void timingWheelDestroy(TimingWheel wheel){
+    if(!wheel){
+        return;
+    }
+    for(int level=0;level<WHEEL_LEVELS;level++){
+        for(int slot=0;slot<WHEEL_SLOTS;slot++){
+            while(wheel->slots[level][slot]){
+                wheelUnlink(wheel,wheel->slots[level][slot]);
+            }
+        }
+    }
+    allocatorFree(wheel->allocator, wheel, sizeof(*wheel));
+}
+
+/**
+ ***** Function: timingWheelSchedule *****
+ * Description: Links a detached timer into the wheel so it expires at the
+ * given tick.
+ *
+ * @param wheel - The wheel to schedule the timer in.
+ * @param timer - A detached timer.
+ * @param expiry - The tick at which the timer expires.
+ */
+void timingWheelSchedule(TimingWheel wheel, WheelTimer timer,
+                         WheelTick expiry){
+    assert(wheel && timer && timer->slot == WHEEL_NO_SLOT);
+    timer->expiry = expiry;
+    wheelLink(wheel,timer);
+    wheel->size++;
+}
+
+/**
+ ***** Function: timingWheelCancel *****
+ * Description: Detaches a timer from the wheel. Does nothing if the timer
+ * is not scheduled.
+ *
+ * @param wheel - The wheel the timer is scheduled in.
+ * @param timer - The timer to detach.
+ */
+void timingWheelCancel(TimingWheel wheel, WheelTimer timer){
+    assert(wheel && timer);
+    if(timer->slot == WHEEL_NO_SLOT){
+        return;
+    }
+    wheelUnlink(wheel,timer);
+    wheel->size--;
+}
+
+/**
+ ***** Function: timingWheelAdvance *****
+ * Description: Moves the wheel towards 'now', expiring every timer whose
+ * expiry tick was reached. Stops early once 'budget' timers were expired
+ * or cascaded; the next call picks up where this one stopped.
+ *
+ * @param wheel - The wheel to advance.
+ * @param now - The current tick.
+ * @param budget - Maximal amount of timers to handle in this call.
+ * @param expire - Function called with the owner of every expired timer.
+ * @param context - Passed as is to 'expire'.
+ *
+ * @return
+ * The amount of timers handled.
+ */
+int timingWheelAdvance(TimingWheel wheel, WheelTick now, int budget,
+                       expireWheelTimer expire, void* context){
+    assert(wheel && expire);
+    int work = 0;
+    while(true){
+        /* The current tick may have been left half done by a previous
+         * call which ran out of budget. */
+        work += wheelProcessTick(wheel,budget-work,expire,context);
+        if(work>=budget || wheel->current>=now){
+            break;
+        }
+        if(!wheel->size){
+            /* Nothing is scheduled, no need to walk the ticks. */
+            wheel->current = now;
+            break;
+        }
+        WheelTick next_tick = wheelGetNextEventTick(wheel);
+        if(next_tick>now){
+            /* Nothing happens up to now. */
+            wheel->current = now;
+            break;
+        }
+        wheel->current = next_tick;
+    }
+    return work;
+}
+
+/**
+ ***** Function: timingWheelGetSize *****
+ * Description: Returns the number of timers scheduled in the wheel.
+ *
+ * @param wheel - The wheel which size is requested.
+ *
+ * @return
+ * The number of scheduled timers.
+ */
+int timingWheelGetSize(TimingWheel wheel){
+    assert(wheel);
+    return wheel->size;
+}
+
+/**
+ ***** Function: timerCreate *****
+ * Description: Creates a new detached timer.
+ *
+ * @param owner - The element the timer belongs to. Passed to the expire
+ * function when the timer expires.
+ * @param allocator - Allocator for the timer. May be NULL.
+ *
+ * @return
+ * A new timer in case of success.
+ * NULL in case of memory fail.
+ */
+WheelTimer timerCreate(void* owner, Allocator allocator){
+    WheelTimer timer = allocatorAllocate(allocator, sizeof(*timer));
+    if(!timer){
+        return NULL;
+    }
+    timer->expiry = 0;
+    timer->owner = owner;
+    timer->next = NULL;
+    timer->previous = NULL;
+    timer->level = 0;
+    timer->slot = WHEEL_NO_SLOT;
+    return timer;
+}
+
+/**
+ ***** Function: timerDestroy *****
+ * Description: Frees a detached timer.
+ *
+ * @param timer - The timer to destroy.
+ * @param allocator - Allocator the timer was created with.
+ */
+void timerDestroy(WheelTimer timer, Allocator allocator){
+    assert(!timer || timer->slot == WHEEL_NO_SLOT);
+    allocatorFree(allocator, timer, sizeof(*timer));
+}
+
+/**
+ ***** Function: timerGetExpiry *****
+ * Description: Returns the tick at which the timer expires.
+ *
+ * @param timer - The timer.
+ *
+ * @return
+ * The expiry tick of the timer.
+ */
+WheelTick timerGetExpiry(WheelTimer timer){
+    assert(timer);
+    return timer->expiry;
+}
+
+/**
+ ***** Function: timerSetOwner *****
+ * Description: Changes the element the timer belongs to.
+ *
+ * @param timer - The timer.
+ * @param owner - The new owner.
+ */
+void timerSetOwner(WheelTimer timer, void* owner){
+    assert(timer);
+    timer->owner = owner;
+}
+
+/**
+ ***** Function: timerIsScheduled *****
+ * Description: Checks whether the timer is linked into a wheel.
+ *
+ * @param timer - The timer.
+ *
+ * @return
+ * true if the timer is scheduled, false otherwise.
+ */
+bool timerIsScheduled(WheelTimer timer){
+    assert(timer);
+    return timer->slot != WHEEL_NO_SLOT;
+}
+
+//-----------------------------------------------------------------------//
+//                    TIMING WHEEL: STATIC FUNCTIONS                     //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Static function: wheelLink *****
+ * Description: Puts a timer in the slot matching its distance from the
+ * current tick. Timers further than the whole wheel are parked in the last
+ * slot of the top level and cascaded again once it is reached.
+ *
+ * @param wheel - The wheel.
+ * @param timer - A detached timer.
+ */
+static void wheelLink(TimingWheel wheel, WheelTimer timer){
+    WheelTick target = timer->expiry > wheel->current ? timer->expiry :
+                       wheel->current;
+    WheelTick delta = target - wheel->current;
+    int level = 0;
+    while(level<WHEEL_LEVELS-1 &&
+          delta>=((WheelTick)1 << WHEEL_SHIFT(level+1))){
+        level++;
+    }
+    WheelTick position = target >> WHEEL_SHIFT(level);
+    if(level==WHEEL_LEVELS-1 &&
+       delta>=((WheelTick)1 << WHEEL_SHIFT(WHEEL_LEVELS))){
+        /* Beyond the wheel's horizon. */
+        position = (wheel->current >> WHEEL_SHIFT(level)) + WHEEL_SLOTS - 1;
+    }
+    int slot = (int)(position & WHEEL_SLOT_MASK);
+    timer->level = level;
+    timer->slot = slot;
+    timer->previous = NULL;
+    timer->next = wheel->slots[level][slot];
+    if(timer->next){
+        timer->next->previous = timer;
+    }
+    wheel->slots[level][slot] = timer;
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+/**
+ ***** Static function: wheelUnlink *****
+ * Description: Removes a timer from its slot.
+ *
+ * @param wheel - The wheel.
+ * @param timer - A scheduled timer.
+ */
+static void wheelUnlink(TimingWheel wheel, WheelTimer timer){
+    assert(timer->slot != WHEEL_NO_SLOT);
+    if(timer->previous){
+        timer->previous->next = timer->next;
+    } else {
+        wheel->slots[timer->level][timer->slot] = timer->next;
+        if(!timer->next){
+            /* Slot is now empty. */
+            wheel->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+        }
+    }
+    if(timer->next){
+        timer->next->previous = timer->previous;
+    }
+    timer->next = NULL;
+    timer->previous = NULL;
+    timer->slot = WHEEL_NO_SLOT;
+}
+
+/**
+ ***** Static function: wheelProcessTick *****
+ * Description: Handles the slots due at the current tick: cascades the
+ * upper level slots which start at this tick into lower levels and expires
+ * the timers of the matching bottom level slot. Handling a tick twice is
+ * harmless, so a tick interrupted by the budget is simply handled again.
+ *
+ * @param wheel - The wheel.
+ * @param budget - Maximal amount of timers to handle.
+ * @param expire - Function called with the owner of every expired timer.
+ * @param context - Passed as is to 'expire'.
+ *
+ * @return
+ * The amount of timers handled.
+ */
+static int wheelProcessTick(TimingWheel wheel, int budget,
+                            expireWheelTimer expire, void* context){
+    int work = 0;
+    WheelTick tick = wheel->current;
+    for(int level=WHEEL_LEVELS-1;level>0;level--){
+        WheelTick level_mask = ((WheelTick)1 << WHEEL_SHIFT(level)) - 1;
+        if(tick & level_mask){
+            /* This level's slots don't start at this tick. */
+            continue;
+        }
+        int slot = (int)((tick >> WHEEL_SHIFT(level)) & WHEEL_SLOT_MASK);
+        while(wheel->slots[level][slot]){
+            if(work>=budget){
+                return work;
+            }
+            WheelTimer timer = wheel->slots[level][slot];
+            wheelUnlink(wheel,timer);
+            wheelLink(wheel,timer);
+            work++;
+        }
+    }
+    int slot = (int)(tick & WHEEL_SLOT_MASK);
+    WheelTimer timer = wheel->slots[0][slot];
+    while(timer){
+        if(work>=budget){
+            return work;
+        }
+        WheelTimer next_timer = timer->next;
+        if(timer->expiry<=tick){
+            wheelUnlink(wheel,timer);
+            wheel->size--;
+            expire(timer->owner,context);
+            work++;
+        }
+        timer = next_timer;
+    }
+    return work;
+}
+
+/**
+ ***** Static function: wheelGetNextEventTick *****
+ * Description: Finds the first tick after the current one at which a non
+ * empty slot is due, using the occupancy bitmaps of all levels.
+ *
+ * @param wheel - A wheel with at least one timer.
+ *
+ * @return
+ * The tick of the next event.
+ */
+static WheelTick wheelGetNextEventTick(TimingWheel wheel){
+    WheelTick next_tick = ~(WheelTick)0;
+    for(int level=0;level<WHEEL_LEVELS;level++){
+        uint64_t occupied = wheel->occupied[level];
+        if(!occupied){
+            continue;
+        }
+        WheelTick position = wheel->current >> WHEEL_SHIFT(level);
+        int start = (int)((position + 1) & WHEEL_SLOT_MASK);
+        /* Rotating so bit 0 stands for the slot right after the current. */
+        uint64_t rotated = start ? (occupied >> start) |
+                                   (occupied << (WHEEL_SLOTS - start)) :
+                           occupied;
+        WheelTick distance = (WheelTick)__builtin_ctzll(rotated) + 1;
+        WheelTick tick = (position + distance) << WHEEL_SHIFT(level);
+        if(tick<next_tick){
+            next_tick = tick;
+        }
+    }
+    return next_tick;
+}
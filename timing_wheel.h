@@ -0,0 +1,171 @@
+
+#ifndef MTM_EX3_TIMING_WHEEL_H
+#define MTM_EX3_TIMING_WHEEL_H
+
+#include <stdbool.h>
+#include "allocator.h"
+
+/**
+* Hierarchical Timing Wheel
+*
+* Keeps timers ordered by their expiry tick without sorting them. The wheel
+* has WHEEL_LEVELS levels of WHEEL_SLOTS slots each; a timer is kept in the
+* level whose slot width matches its distance from the current tick and is
+* cascaded into lower levels as time advances. Advancing the wheel jumps
+* directly between non empty slots and never does more than a given budget
+* of work per call, so a large number of timers expiring together is
+* reclaimed over several calls instead of all at once.
+*
+* Timers are allocated by their owner and are only linked into the wheel
+* while scheduled. Ticks are unit-less, the user picks their meaning.
+*/
+
+//-----------------------------------------------------------------------//
+//                        TIMING WHEEL: TYPEDEFS                         //
+//-----------------------------------------------------------------------//
+
+typedef struct timing_wheel_t *TimingWheel;
+
+typedef struct wheel_timer_t *WheelTimer;
+
+/** Type of tick values used by the wheel */
+typedef unsigned long long WheelTick;
+
+/**
+* Type of function called for every expired timer. The timer is already
+* detached from the wheel when it is called.
+*/
+typedef void(*expireWheelTimer)(void* owner, void* context);
+
+//-----------------------------------------------------------------------//
+//                       TIMING WHEEL: FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: timingWheelCreate *****
+ * Description: Creates a new empty timing wheel.
+ *
+ * @param now - The current tick.
+ * @param allocator - Allocator for the wheel. May be NULL.
+ *
+ * @return
+ * A new wheel in case of success.
+ * NULL in case of memory fail.
+ */
+TimingWheel timingWheelCreate(WheelTick now, Allocator allocator);
+
+/**
+ ***** Function: timingWheelDestroy *****
+ * Description: Frees the wheel. Timers still scheduled are only detached,
+ * they still belong to their owners.
+ *
+ * @param wheel - The wheel to destroy. If NULL nothing will be done.
+ */
+void timingWheelDestroy(TimingWheel wheel);
+
+/**
+ ***** Function: timingWheelSchedule *****
+ * Description: Links a detached timer into the wheel so it expires at the
+ * given tick.
+ *
+ * @param wheel - The wheel to schedule the timer in.
+ * @param timer - A detached timer.
+ * @param expiry - The tick at which the timer expires.
+ */
+void timingWheelSchedule(TimingWheel wheel, WheelTimer timer,
+                         WheelTick expiry);
+
+/**
+ ***** Function: timingWheelCancel *****
+ * Description: Detaches a timer from the wheel. Does nothing if the timer
+ * is not scheduled.
+ *
+ * @param wheel - The wheel the timer is scheduled in.
+ * @param timer - The timer to detach.
+ */
+void timingWheelCancel(TimingWheel wheel, WheelTimer timer);
+
+/**
+ ***** Function: timingWheelAdvance *****
+ * Description: Moves the wheel towards 'now', expiring every timer whose
+ * expiry tick was reached. Stops early once 'budget' timers were expired
+ * or cascaded; the next call picks up where this one stopped.
+ *
+ * @param wheel - The wheel to advance.
+ * @param now - The current tick.
+ * @param budget - Maximal amount of timers to handle in this call.
+ * @param expire - Function called with the owner of every expired timer.
+ * @param context - Passed as is to 'expire'.
+ *
+ * @return
+ * The amount of timers handled.
+ */
+int timingWheelAdvance(TimingWheel wheel, WheelTick now, int budget,
+                       expireWheelTimer expire, void* context);
+
+/**
+ ***** Function: timingWheelGetSize *****
+ * Description: Returns the number of timers scheduled in the wheel.
+ *
+ * @param wheel - The wheel which size is requested.
+ *
+ * @return
+ * The number of scheduled timers.
+ */
+int timingWheelGetSize(TimingWheel wheel);
+
+/**
+ ***** Function: timerCreate *****
+ * Description: Creates a new detached timer.
+ *
+ * @param owner - The element the timer belongs to. Passed to the expire
+ * function when the timer expires.
+ * @param allocator - Allocator for the timer. May be NULL.
+ *
+ * @return
+ * A new timer in case of success.
+ * NULL in case of memory fail.
+ */
+WheelTimer timerCreate(void* owner, Allocator allocator);
+
+/**
+ ***** Function: timerDestroy *****
+ * Description: Frees a detached timer.
+ *
+ * @param timer - The timer to destroy.
+ * @param allocator - Allocator the timer was created with.
+ */
+void timerDestroy(WheelTimer timer, Allocator allocator);
+
+/**
+ ***** Function: timerGetExpiry *****
+ * Description: Returns the tick at which the timer expires.
+ *
+ * @param timer - The timer.
+ *
+ * @return
+ * The expiry tick of the timer.
+ */
+WheelTick timerGetExpiry(WheelTimer timer);
+
+/**
+ ***** Function: timerSetOwner *****
+ * Description: Changes the element the timer belongs to.
+ *
+ * @param timer - The timer.
+ * @param owner - The new owner.
+ */
+void timerSetOwner(WheelTimer timer, void* owner);
+
+/**
+ ***** Function: timerIsScheduled *****
+ * Description: Checks whether the timer is linked into a wheel.
+ *
+ * @param timer - The timer.
+ *
+ * @return
+ * true if the timer is scheduled, false otherwise.
+ */
+bool timerIsScheduled(WheelTimer timer);
+
+#endif //MTM_EX3_TIMING_WHEEL_H
@@ -0,0 +1,312 @@
+#include "value_pool.h"
+#include <assert.h>
+
+//-----------------------------------------------------------------------//
+//                          VALUE POOL: DEFINES                          //
+//-----------------------------------------------------------------------//
+
+#define VALUE_POOL_INITIAL_BUCKETS 16
+
+//-----------------------------------------------------------------------//
+//                          VALUE POOL: STRUCTS                          //
+//-----------------------------------------------------------------------//
+
+typedef struct pool_entry_t *PoolEntry;
+
+struct pool_entry_t{
+    void* value;
+    unsigned long hash;
+    int references;
+    PoolEntry next; // Next entry of the same bucket.
+};
+
+/** A chained hash table of the values, doubled whenever it holds as many
+ * values as buckets. */
+struct value_pool_t{
+    PoolEntry* buckets;
+    unsigned long mask; // Number of buckets minus one.
+    int size;
+    int owners;
+    hashPoolValue hash;
+    equalPoolValues equal;
+    copyPoolValue copyValue;
+    freePoolValue freeValue;
+    struct allocator_t allocator;
+};
+
+//-----------------------------------------------------------------------//
+//              VALUE POOL: STATIC FUNCTIONS DECLARATIONS                //
+//-----------------------------------------------------------------------//
+
+static PoolEntry valuePoolFind(ValuePool pool, void* value,
+                               unsigned long hash);
+
+static void* valuePoolInsert(ValuePool pool, void* value, unsigned long hash);
+
+static void valuePoolGrow(ValuePool pool);
+
+//-----------------------------------------------------------------------//
+//                         VALUE POOL: FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: valuePoolCreate *****
+ * Description: Creates a new empty pool with a single owner.
+ *
+ * @param hash - Hashes values.
+ * @param equal - Compares values.
+ * @param copyValue - Copies a value into the pool.
+ * @param freeValue - Frees a value of the pool.
+ * @param allocator - Hooks for the pool's own memory, copied into the pool
+ * (with a byte count of its own) since the pool may outlive their owner.
+ * May be NULL.
+ *
+ * @return
+ * A new pool in case of success.
+ * NULL if a function is NULL or in case of memory fail.
+ */
+ValuePool valuePoolCreate(hashPoolValue hash, equalPoolValues equal,
+                          copyPoolValue copyValue, freePoolValue freeValue,
+                          Allocator allocator){
+    if(!hash || !equal || !copyValue || !freeValue){
+        return NULL;
+    }
+    struct allocator_t hooks;
+    allocatorInit(&hooks, allocator ? allocator->allocate : NULL,
+                  allocator ? allocator->deallocate : NULL,
+                  allocator ? allocator->context : NULL);
+    ValuePool pool = allocatorAllocate(&hooks, sizeof(*pool));
+    if(!pool){
+        return NULL;
+    }
+    pool->buckets = allocatorAllocateZeroed(&hooks,
+            VALUE_POOL_INITIAL_BUCKETS*sizeof(PoolEntry));
+    if(!pool->buckets){
+        allocatorFree(&hooks, pool, sizeof(*pool));
+        return NULL;
+    }
+    pool->mask = VALUE_POOL_INITIAL_BUCKETS-1;
+    pool->size = 0;
+    pool->owners = 1;
+    pool->hash = hash;
+    pool->equal = equal;
+    pool->copyValue = copyValue;
+    pool->freeValue = freeValue;
+    pool->allocator = hooks;
+    return pool;
+}
+
+/**
+ ***** Function: valuePoolShare *****
+ * Description: Adds an owner to the pool.
+ *
+ * @param pool - The pool.
+ *
+ * @return
+ * The pool.
+ */
+ValuePool valuePoolShare(ValuePool pool){
+    assert(pool);
+    pool->owners++;
+    return pool;
+}
+
+/**
+ ***** Function: valuePoolDestroy *****
+ * Description: Removes an owner of the pool, and frees the pool if it was
+ * the last one. All the values must have been released by then.
+ *
+ * @param pool - The pool. If NULL nothing will be done.
+ */
+void valuePoolDestroy(ValuePool pool){
+    if(!pool || --pool->owners > 0){
+        return;
+    }
+    assert(pool->size == 0);
+    struct allocator_t hooks = pool->allocator;
+    allocatorFree(&hooks, pool->buckets, (pool->mask+1)*sizeof(PoolEntry));
+    allocatorFree(&hooks, pool, sizeof(*pool));
+}
+
+/**
+ ***** Function: valuePoolAcquire *****
+ * Description: Returns the interned value equal to a given value, copying
+ * the value into the pool if there is none, and counts a reference to it.
+ *
+ * @param pool - The pool.
+ * @param value - The value to look for. Not kept by the pool.
+ *
+ * @return
+ * The interned value in case of success.
+ * NULL in case of memory fail.
+ */
+void* valuePoolAcquire(ValuePool pool, void* value){
+    assert(pool);
+    unsigned long hash = pool->hash(value);
+    PoolEntry entry = valuePoolFind(pool, value, hash);
+    if(entry){
+        entry->references++;
+        return entry->value;
+    }
+    void* copy = pool->copyValue(value);
+    if(!copy){
+        return NULL;
+    }
+    void* interned = valuePoolInsert(pool, copy, hash);
+    if(!interned){
+        pool->freeValue(copy);
+    }
+    return interned;
+}
+
+/**
+ ***** Function: valuePoolAdopt *****
+ * Description: Like valuePoolAcquire, but takes over a value which the
+ * caller allocated with the pool's copy function instead of copying it.
+ * If an equal value is already interned, the given value is freed.
+ *
+ * @param pool - The pool.
+ * @param value - The value to take over.
+ *
+ * @return
+ * The interned value in case of success.
+ * NULL in case of memory fail. The value is still the caller's.
+ */
+void* valuePoolAdopt(ValuePool pool, void* value){
+    assert(pool);
+    unsigned long hash = pool->hash(value);
+    PoolEntry entry = valuePoolFind(pool, value, hash);
+    if(entry){
+        entry->references++;
+        pool->freeValue(value);
+        return entry->value;
+    }
+    return valuePoolInsert(pool, value, hash);
+}
+
+/**
+ ***** Function: valuePoolRelease *****
+ * Description: Drops a reference to an interned value, and frees the value
+ * if it was the last one.
+ *
+ * @param pool - The pool.
+ * @param value - A value returned by valuePoolAcquire or valuePoolAdopt.
+ */
+void valuePoolRelease(ValuePool pool, void* value){
+    assert(pool);
+    unsigned long hash = pool->hash(value);
+    PoolEntry* link = &pool->buckets[hash & pool->mask];
+    /* Interned values are unique, so the entry is found by its pointer. */
+    while(*link && (*link)->value != value){
+        link = &(*link)->next;
+    }
+    PoolEntry entry = *link;
+    assert(entry);
+    if(!entry || --entry->references > 0){
+        return;
+    }
+    *link = entry->next;
+    pool->size--;
+    pool->freeValue(entry->value);
+    allocatorFree(&pool->allocator, entry, sizeof(*entry));
+}
+
+/**
+ ***** Function: valuePoolGetSize *****
+ * Description: Returns the number of distinct values in the pool.
+ *
+ * @param pool - The pool.
+ *
+ * @return
+ * The number of interned values.
+ */
+int valuePoolGetSize(ValuePool pool){
+    assert(pool);
+    return pool->size;
+}
+
+//-----------------------------------------------------------------------//
+//                     VALUE POOL: STATIC FUNCTIONS                      //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: valuePoolFind *****
+ * Description: Finds the entry of the value equal to a given value.
+ *
+ * @param pool - The pool.
+ * @param value - The value to look for.
+ * @param hash - The value's hash.
+ *
+ * @return
+ * The entry if found, NULL otherwise.
+ */
+static PoolEntry valuePoolFind(ValuePool pool, void* value,
+                               unsigned long hash){
+    PoolEntry entry = pool->buckets[hash & pool->mask];
+    while(entry){
+        if(entry->hash == hash && pool->equal(entry->value, value)){
+            return entry;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+/**
+ ***** Function: valuePoolInsert *****
+ * Description: Adds a value which isn't in the pool yet, with a single
+ * reference.
+ *
+ * @param pool - The pool.
+ * @param value - The value, owned by the pool on success.
+ * @param hash - The value's hash.
+ *
+ * @return
+ * The value in case of success.
+ * NULL in case of memory fail.
+ */
+static void* valuePoolInsert(ValuePool pool, void* value, unsigned long hash){
+    PoolEntry entry = allocatorAllocate(&pool->allocator, sizeof(*entry));
+    if(!entry){
+        return NULL;
+    }
+    entry->value = value;
+    entry->hash = hash;
+    entry->references = 1;
+    entry->next = pool->buckets[hash & pool->mask];
+    pool->buckets[hash & pool->mask] = entry;
+    pool->size++;
+    if((unsigned long)pool->size > pool->mask){
+        valuePoolGrow(pool);
+    }
+    return value;
+}
+
+/**
+ ***** Function: valuePoolGrow *****
+ * Description: Doubles the number of buckets. In case of memory fail the
+ * pool keeps its buckets, only with longer chains.
+ *
+ * @param pool - The pool.
+ */
+static void valuePoolGrow(ValuePool pool){
+    unsigned long buckets_number = (pool->mask+1)*2;
+    PoolEntry* buckets = allocatorAllocateZeroed(&pool->allocator,
+            buckets_number*sizeof(PoolEntry));
+    if(!buckets){
+        return;
+    }
+    for(unsigned long i=0; i<=pool->mask; i++){
+        PoolEntry entry = pool->buckets[i];
+        while(entry){
+            PoolEntry next = entry->next;
+            entry->next = buckets[entry->hash & (buckets_number-1)];
+            buckets[entry->hash & (buckets_number-1)] = entry;
+            entry = next;
+        }
+    }
+    allocatorFree(&pool->allocator, pool->buckets,
+                  (pool->mask+1)*sizeof(PoolEntry));
+    pool->buckets = buckets;
+    pool->mask = buckets_number-1;
+}
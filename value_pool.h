@@ -0,0 +1,133 @@
+
+#ifndef MTM_EX3_VALUE_POOL_H
+#define MTM_EX3_VALUE_POOL_H
+
+#include <stdbool.h>
+#include "allocator.h"
+
+/**
+* Value Pool
+*
+* Interns values: equal values (by a user hash and equality function) are
+* stored once, with a reference count. The first acquisition of a value
+* copies it into the pool and the last release frees the copy; every
+* acquisition in between only counts a reference. Interned values are
+* shared, so they must not be modified.
+*
+* A pool may be shared by several owners (e.g. a map and its copies); it
+* is freed when the last owner lets go of it. It is not thread safe.
+*/
+
+//-----------------------------------------------------------------------//
+//                         VALUE POOL: TYPEDEFS                          //
+//-----------------------------------------------------------------------//
+
+typedef struct value_pool_t *ValuePool;
+
+/** Type of function hashing a value. Equal values must have equal hashes */
+typedef unsigned long(*hashPoolValue)(void* value);
+
+/** Type of function telling whether two values are equal */
+typedef bool(*equalPoolValues)(void* first, void* second);
+
+/** Type of function copying a value. Returns NULL on failure */
+typedef void*(*copyPoolValue)(void* value);
+
+/** Type of function freeing a value */
+typedef void(*freePoolValue)(void* value);
+
+//-----------------------------------------------------------------------//
+//                        VALUE POOL: FUNCTIONS                          //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: valuePoolCreate *****
+ * Description: Creates a new empty pool with a single owner.
+ *
+ * @param hash - Hashes values.
+ * @param equal - Compares values.
+ * @param copyValue - Copies a value into the pool.
+ * @param freeValue - Frees a value of the pool.
+ * @param allocator - Hooks for the pool's own memory, copied into the pool
+ * (with a byte count of its own) since the pool may outlive their owner.
+ * May be NULL.
+ *
+ * @return
+ * A new pool in case of success.
+ * NULL if a function is NULL or in case of memory fail.
+ */
+ValuePool valuePoolCreate(hashPoolValue hash, equalPoolValues equal,
+                          copyPoolValue copyValue, freePoolValue freeValue,
+                          Allocator allocator);
+
+/**
+ ***** Function: valuePoolShare *****
+ * Description: Adds an owner to the pool.
+ *
+ * @param pool - The pool.
+ *
+ * @return
+ * The pool.
+ */
+ValuePool valuePoolShare(ValuePool pool);
+
+/**
+ ***** Function: valuePoolDestroy *****
+ * Description: Removes an owner of the pool, and frees the pool if it was
+ * the last one. All the values must have been released by then.
+ *
+ * @param pool - The pool. If NULL nothing will be done.
+ */
+void valuePoolDestroy(ValuePool pool);
+
+/**
+ ***** Function: valuePoolAcquire *****
+ * Description: Returns the interned value equal to a given value, copying
+ * the value into the pool if there is none, and counts a reference to it.
+ *
+ * @param pool - The pool.
+ * @param value - The value to look for. Not kept by the pool.
+ *
+ * @return
+ * The interned value in case of success.
+ * NULL in case of memory fail.
+ */
+void* valuePoolAcquire(ValuePool pool, void* value);
+
+/**
+ ***** Function: valuePoolAdopt *****
+ * Description: Like valuePoolAcquire, but takes over a value which the
+ * caller allocated with the pool's copy function instead of copying it.
+ * If an equal value is already interned, the given value is freed.
+ *
+ * @param pool - The pool.
+ * @param value - The value to take over.
+ *
+ * @return
+ * The interned value in case of success.
+ * NULL in case of memory fail. The value is still the caller's.
+ */
+void* valuePoolAdopt(ValuePool pool, void* value);
+
+/**
+ ***** Function: valuePoolRelease *****
+ * Description: Drops a reference to an interned value, and frees the value
+ * if it was the last one.
+ *
+ * @param pool - The pool.
+ * @param value - A value returned by valuePoolAcquire or valuePoolAdopt.
+ */
+void valuePoolRelease(ValuePool pool, void* value);
+
+/**
+ ***** Function: valuePoolGetSize *****
+ * Description: Returns the number of distinct values in the pool.
+ *
+ * @param pool - The pool.
+ *
+ * @return
+ * The number of interned values.
+ */
+int valuePoolGetSize(ValuePool pool);
+
+#endif //MTM_EX3_VALUE_POOL_H
@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200112L
+#include "worker_pool.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+//-----------------------------------------------------------------------//
+//                         WORKER POOL: DEFINES                          //
+//-----------------------------------------------------------------------//
+
+/* Upper bound on the threads of a run, whatever the processors number. */
+#define WORKER_POOL_MAX_THREADS 64
+
+//-----------------------------------------------------------------------//
+//                         WORKER POOL: STRUCT                           //
+//-----------------------------------------------------------------------//
+
+typedef struct worker_batch_t{
+    workerPoolTask task;
+    void* context;
+    int tasks;
+    int next_task; // Shared by the workers, accessed atomically.
+} *WorkerBatch;
+
+/** The workers of the process. They are started on demand, wait for
+ * batches between runs and are never stopped. */
+static struct worker_pool_t{
+    pthread_mutex_t run_lock; // Held by the run using the workers.
+    pthread_mutex_t lock; // Protects the fields below.
+    pthread_cond_t batch_ready;
+    pthread_cond_t batch_done;
+    WorkerBatch batch; // The batch being run, NULL between runs.
+    int pending; // Workers the batch still waits to be joined by.
+    int active; // Workers which joined the batch and aren't done yet.
+    int workers_number;
+} worker_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+                 PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                 NULL, 0, 0, 0};
+
+//-----------------------------------------------------------------------//
+//               WORKER POOL: STATIC FUNCTIONS DECLARATIONS              //
+//-----------------------------------------------------------------------//
+
+static void workerPoolStartWorkers(int workers_number);
+static void* workerPoolServe(void* unused);
+static void workerPoolWork(WorkerBatch batch);
+
+//-----------------------------------------------------------------------//
+//                        WORKER POOL: FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: workerPoolRun *****
+ * Description: Runs task(i, context) for every i in [0, tasks) on up to
+ * 'threads' threads and returns once all the tasks are done.
+ *
+ * @param threads - Maximal number of threads, including the calling one.
+ * Values below 1 are treated as 1, and values above the number of online
+ * processors as that number.
+ * @param tasks - Number of tasks.
+ * @param task - The function running a task.
+ * @param context - Passed as is to every task.
+ *
+ * @return
+ * WORKER_POOL_NULL_ARGUMENT - task is NULL.
+ * WORKER_POOL_SUCCESS - All the tasks ran.
+ */
+WorkerPoolResult workerPoolRun(int threads, int tasks, workerPoolTask task,
+                               void* context){
+    if(!task){
+        return WORKER_POOL_NULL_ARGUMENT;
+    }
+    struct worker_batch_t batch = {task, context, tasks, 0};
+    threads = workerPoolLimitThreads(threads);
+    if(threads>tasks){
+        /* No point in threads with nothing to do. */
+        threads = tasks;
+    }
+    if(threads<=1 || pthread_mutex_trylock(&worker_pool.run_lock)!=0){
+        /* The workers are busy with another run (maybe the one calling
+         * this task): the calling thread does it all. */
+        workerPoolWork(&batch);
+        return WORKER_POOL_SUCCESS;
+    }
+    pthread_mutex_lock(&worker_pool.lock);
+    workerPoolStartWorkers(threads-1);
+    int helpers_number = worker_pool.workers_number<threads-1 ?
+                         worker_pool.workers_number : threads-1;
+    worker_pool.batch = &batch;
+    worker_pool.pending = helpers_number;
+    worker_pool.active = helpers_number;
+    pthread_cond_broadcast(&worker_pool.batch_ready);
+    pthread_mutex_unlock(&worker_pool.lock);
+    /* The calling thread works too, alone if no worker could start. */
+    workerPoolWork(&batch);
+    pthread_mutex_lock(&worker_pool.lock);
+    while(worker_pool.active>0 || worker_pool.pending>0){
+        pthread_cond_wait(&worker_pool.batch_done,&worker_pool.lock);
+    }
+    worker_pool.batch = NULL;
+    pthread_mutex_unlock(&worker_pool.lock);
+    pthread_mutex_unlock(&worker_pool.run_lock);
+    return WORKER_POOL_SUCCESS;
+}
+
+/**
+ ***** Function: workerPoolLimitThreads *****
+ * Description: Bounds a number of threads to the ones a run may use: at
+ * least 1, and at most the number of online processors (and never more
+ * than WORKER_POOL_MAX_THREADS).
+ *
+ * @param threads - The number of threads asked for.
+ *
+ * @return
+ * The number of threads a run would use.
+ */
+int workerPoolLimitThreads(int threads){
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    long limit = processors<1 ? 1 : processors<WORKER_POOL_MAX_THREADS ?
+                 processors : WORKER_POOL_MAX_THREADS;
+    return threads<1 ? 1 : threads>limit ? (int)limit : threads;
+}
+
+//-----------------------------------------------------------------------//
+//                     WORKER POOL: STATIC FUNCTIONS                     //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Static function: workerPoolStartWorkers *****
+ * Description: Starts workers until the pool has the given number of them.
+ * Stops at the first worker which can't be started. Called with the pool's
+ * lock held.
+ *
+ * @param workers_number - The number of workers wanted.
+ */
+static void workerPoolStartWorkers(int workers_number){
+    while(worker_pool.workers_number<workers_number){
+        pthread_t worker;
+        if(pthread_create(&worker,NULL,workerPoolServe,NULL)!=0){
+            return;
+        }
+        pthread_detach(worker);
+        worker_pool.workers_number++;
+    }
+}
+
+/**
+ ***** Static function: workerPoolServe *****
+ * Description: Body of a worker: waits for a batch which needs a worker,
+ * runs tasks of it until none is left, and waits again.
+ *
+ * @param unused - Not used.
+ *
+ * @return
+ * Never returns.
+ */
+static void* workerPoolServe(void* unused){
+    pthread_mutex_lock(&worker_pool.lock);
+    while(true){
+        while(worker_pool.pending==0){
+            pthread_cond_wait(&worker_pool.batch_ready,&worker_pool.lock);
+        }
+        worker_pool.pending--;
+        WorkerBatch batch = worker_pool.batch;
+        pthread_mutex_unlock(&worker_pool.lock);
+        workerPoolWork(batch);
+        pthread_mutex_lock(&worker_pool.lock);
+        worker_pool.active--;
+        if(worker_pool.active==0){
+            pthread_cond_signal(&worker_pool.batch_done);
+        }
+    }
+    return NULL;
+}
+
+/**
+ ***** Static function: workerPoolWork *****
+ * Description: Runs tasks of the batch until none is left.
+ *
+ * @param batch - The batch being run.
+ */
+static void workerPoolWork(WorkerBatch batch){
+    while(true){
+        int task_index = __atomic_fetch_add(&batch->next_task,1,
+                                            __ATOMIC_RELAXED);
+        if(task_index>=batch->tasks){
+            break;
+        }
+        batch->task(task_index,batch->context);
+    }
+}
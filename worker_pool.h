@@ -0,0 +1,71 @@
+
+#ifndef MTM_EX3_WORKER_POOL_H
+#define MTM_EX3_WORKER_POOL_H
+
+/**
+* Worker Pool
+*
+* Runs a batch of independent tasks on a group of threads. The calling
+* thread takes part in the work, and every thread keeps pulling the next
+* task index until none is left, so uneven tasks still keep all the threads
+* busy. The other threads are workers shared by the whole process: they are
+* started the first time they are needed and wait for the next batch
+* afterwards, so a run doesn't pay for creating threads. A run never uses
+* more threads than there are online processors. If workers can't be
+* started, or another run is using them, the available threads (at least
+* the calling one) run all the tasks.
+*/
+
+//-----------------------------------------------------------------------//
+//                         WORKER POOL: TYPEDEFS                         //
+//-----------------------------------------------------------------------//
+
+/** Type used for returning error codes from worker pool functions */
+typedef enum WorkerPoolResult_t {
+    WORKER_POOL_SUCCESS,
+    WORKER_POOL_NULL_ARGUMENT
+} WorkerPoolResult;
+
+/**
+* Type of function running a single task. Gets the index of the task and
+* the context given to workerPoolRun.
+*/
+typedef void(*workerPoolTask)(int, void*);
+
+//-----------------------------------------------------------------------//
+//                        WORKER POOL: FUNCTIONS                         //
+//-----------------------------------------------------------------------//
+
+/**
+ ***** Function: workerPoolRun *****
+ * Description: Runs task(i, context) for every i in [0, tasks) on up to
+ * 'threads' threads and returns once all the tasks are done.
+ *
+ * @param threads - Maximal number of threads, including the calling one.
+ * Values below 1 are treated as 1, and values above the number of online
+ * processors as that number.
+ * @param tasks - Number of tasks.
+ * @param task - The function running a task.
+ * @param context - Passed as is to every task.
+ *
+ * @return
+ * WORKER_POOL_NULL_ARGUMENT - task is NULL.
+ * WORKER_POOL_SUCCESS - All the tasks ran.
+ */
+WorkerPoolResult workerPoolRun(int threads, int tasks, workerPoolTask task,
+                               void* context);
+
+/**
+ ***** Function: workerPoolLimitThreads *****
+ * Description: Bounds a number of threads to the ones a run may use: at
+ * least 1, and at most the number of online processors. Lets a caller size
+ * per thread work before a run.
+ *
+ * @param threads - The number of threads asked for.
+ *
+ * @return
+ * The number of threads a run would use.
+ */
+int workerPoolLimitThreads(int threads);
+
+#endif //MTM_EX3_WORKER_POOL_H